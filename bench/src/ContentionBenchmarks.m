@@ -0,0 +1,133 @@
+#import "TOCBenchmark.h"
+#import "TOCContentionBenchmark.h"
+#import "CollapsingFutures.h"
+#include <stdatomic.h>
+
+/// Aborts when a benchmarked operation didn't do what it was supposed to, so broken code can't look fast.
+static void check(bool condition, NSString* description) {
+    if (condition) return;
+    fprintf(stderr, "Benchmark check failed: %s\n", description.UTF8String);
+    abort();
+}
+
+/// The shared state of a round: the objects being contended over, a count of what happened to them, and what that count should come to
+@interface TOCRoundState : NSObject {
+@package NSArray* _objects;
+@package atomic_ulong _count;
+@package unsigned long _expectedCount;
+}
+@end
+
+@implementation TOCRoundState
+@end
+
+static NSArray* contentionBenchmarks(void) {
+    NSMutableArray* benchmarks = [NSMutableArray array];
+    
+    for (NSNumber* threads in @[@1, @2, @4, @8, @16, @32, @64]) {
+        NSUInteger threadCount = threads.unsignedIntegerValue;
+        
+        // many threads pushing handlers onto the same token's handler stack
+        // (the handlers pile up until the round ends, so rounds are capped)
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"whenCancelledDoOnSharedToken"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:(1 << 20) / threadCount
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            return [TOCCancelTokenSource new];
+        } operation:^(TOCCancelTokenSource* source, NSUInteger threadIndex, NSUInteger operationIndex) {
+            [source.token whenCancelledDo:^{}];
+        } tearDown:^(TOCCancelTokenSource* source) {
+            [source cancel];
+        }]];
+        
+        // the same, but each handler is removed right away, so pushes race against removals and dead node cleanup
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"whenCancelledDoUnlessOnSharedToken"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:NSUIntegerMax
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            return [TOCCancelTokenSource new];
+        } operation:^(TOCCancelTokenSource* source, NSUInteger threadIndex, NSUInteger operationIndex) {
+            TOCCancelTokenSource* unless = [TOCCancelTokenSource new];
+            [source.token whenCancelledDo:^{ check(false, @"removed handler never runs"); } unless:unless.token];
+            [unless cancel];
+        } tearDown:^(TOCCancelTokenSource* source) {
+            check(!source.token.isAlreadyCancelled, @"shared token not cancelled");
+        }]];
+        
+        // many threads reading the state of the same future and token
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"pollStateOfSharedFuture"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:NSUIntegerMax
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            return [TOCFutureSource new];
+        } operation:^(TOCFutureSource* source, NSUInteger threadIndex, NSUInteger operationIndex) {
+            check(source.future.state == TOCFutureState_AbleToBeSet, @"shared future still incomplete");
+            check(source.future.cancelledOnCompletionToken.state == TOCCancelTokenState_StillCancellable,
+                  @"shared future's completion token still cancellable");
+        } tearDown:^(TOCFutureSource* source) {
+        }]];
+        
+        // every thread tries to set each of a series of shared sources, so exactly one wins each one
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"racingTrySetResultOnSharedSource"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:1 << 18
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            NSMutableArray* sources = [NSMutableArray arrayWithCapacity:operationsPerThread];
+            for (NSUInteger i = 0; i < operationsPerThread; i++) {
+                TOCFutureSource* source = [TOCFutureSource new];
+                [source.future thenDo:^(id value) {} on:TOCExecutors.inlineExecutor];
+                [sources addObject:source];
+            }
+            TOCRoundState* state = [TOCRoundState new];
+            state->_objects = sources;
+            return state;
+        } operation:^(TOCRoundState* state, NSUInteger threadIndex, NSUInteger operationIndex) {
+            if ([state->_objects[operationIndex] trySetResult:@(threadIndex)]) {
+                atomic_fetch_add_explicit(&state->_count, 1, memory_order_relaxed);
+            }
+        } tearDown:^(TOCRoundState* state) {
+            check(atomic_load(&state->_count) == state->_objects.count, @"each shared source was set exactly once");
+        }]];
+        
+        // threads completing their own futures, sharing nothing but the library (and the runtime)
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"completingIndependentFutures"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:NSUIntegerMax
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            TOCRoundState* state = [TOCRoundState new];
+            state->_expectedCount = n * operationsPerThread;
+            return state;
+        } operation:^(TOCRoundState* state, NSUInteger threadIndex, NSUInteger operationIndex) {
+            TOCFutureSource* source = [TOCFutureSource new];
+            [source.future thenDo:^(id value) {
+                atomic_fetch_add_explicit(&state->_count, 1, memory_order_relaxed);
+            } on:TOCExecutors.inlineExecutor];
+            [source trySetResult:@1];
+        } tearDown:^(TOCRoundState* state) {
+            check(atomic_load(&state->_count) == state->_expectedCount, @"every future's handler ran exactly once");
+        }]];
+        
+        // threads flattening their own futures into each other, which involves cycle detection
+        [benchmarks addObject:[TOCContentionBenchmark benchmarkNamed:@"flatteningIndependentFutures"
+                                                         threadCount:threadCount
+                                              maxOperationsPerThread:NSUIntegerMax
+                                                               setUp:^id(NSUInteger n, NSUInteger operationsPerThread) {
+            return [NSNull null];
+        } operation:^(id unused, NSUInteger threadIndex, NSUInteger operationIndex) {
+            TOCFutureSource* outer = [TOCFutureSource new];
+            TOCFutureSource* inner = [TOCFutureSource new];
+            [outer trySetResult:inner.future];
+            [inner trySetResult:@1];
+            check(outer.future.hasResult, @"flattened future completed");
+        } tearDown:^(id unused) {
+        }]];
+    }
+    
+    return benchmarks;
+}
+
+int main(int argc, const char* argv[]) {
+    @autoreleasepool {
+        return TOCBenchmark_main(argc, argv, @"contention", contentionBenchmarks());
+    }
+}
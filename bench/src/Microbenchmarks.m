@@ -0,0 +1,201 @@
+#import "TOCBenchmark.h"
+#import "CollapsingFutures.h"
+
+/// Aborts when a benchmarked operation didn't do what it was supposed to, so broken code can't look fast.
+static void check(bool condition, NSString* description) {
+    if (condition) return;
+    fprintf(stderr, "Benchmark check failed: %s\n", description.UTF8String);
+    abort();
+}
+
+static NSArray* microbenchmarks(void) {
+    NSMutableArray* benchmarks = [NSMutableArray array];
+    
+    [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"futureWithResult" parameter:0 body:^(NSUInteger iterations) {
+        TOCBenchmark_repeat(iterations, ^{
+            TOCFuture* future = [TOCFuture futureWithResult:@1];
+            check(future.hasResult, @"futureWithResult has a result");
+        });
+    }]];
+    
+    [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"sourceSetResultThenDo" parameter:0 body:^(NSUInteger iterations) {
+        TOCBenchmark_repeat(iterations, ^{
+            __block bool ran = false;
+            TOCFutureSource* source = [TOCFutureSource new];
+            [source.future thenDo:^(id value) { ran = true; }];
+            [source trySetResult:@1];
+            check(ran, @"thenDo handler ran");
+        });
+    }]];
+    
+    // (the longest chains go well past the inline nesting limit, so they also measure the deferred runs that keep the stack flat)
+    for (NSNumber* depth in @[@1, @100, @10000, @1000000]) {
+        NSUInteger n = depth.unsignedIntegerValue;
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"thenChain" parameter:n body:^(NSUInteger iterations) {
+            TOCBenchmark_repeat(iterations, ^{
+                TOCFutureSource* source = [TOCFutureSource new];
+                TOCFuture* future = source.future;
+                for (NSUInteger i = 0; i < n; i++) {
+                    future = [future then:^(id value) { return value; }];
+                }
+                [source trySetResult:@1];
+                check(future.hasResult, @"then: chain completed");
+            });
+        }]];
+    }
+    
+    // a pending continuation's allocations are the library objects plus the handler nodes it creates (objectsPerOp + handlersPerOp)
+    // continuations pile up on one source per batch, so the source's own cost is spread thin
+    NSDictionary* pendingContinuations = @{
+        @"pendingThen": ^(TOCFuture* future) { return [future then:^(id value) { return value; } on:TOCExecutors.inlineExecutor]; },
+        @"pendingCatch": ^(TOCFuture* future) { return [future catch:^(id failure) { return failure; } on:TOCExecutors.inlineExecutor]; },
+        @"pendingFinally": ^(TOCFuture* future) { return [future finally:^(TOCFuture* completed) { return completed; } on:TOCExecutors.inlineExecutor]; }
+    };
+    for (NSString* name in [pendingContinuations.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        TOCFuture* (^continueFuture)(TOCFuture* future) = pendingContinuations[name];
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:name parameter:0 body:^(NSUInteger iterations) {
+            const NSUInteger batchSize = 1024;
+            for (NSUInteger done = 0; done < iterations; done += batchSize) {
+                @autoreleasepool {
+                    TOCFutureSource* source = [TOCFutureSource new];
+                    TOCFuture* last = nil;
+                    for (NSUInteger i = 0; i < MIN(batchSize, iterations - done); i++) {
+                        last = continueFuture(source.future);
+                    }
+                    [source trySetResult:@1];
+                    check(last.hasResult, @"pending continuation completed");
+                }
+            }
+        }]];
+    }
+    
+    [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"whenCancelledDoUnlessRegisterRemove" parameter:0 body:^(NSUInteger iterations) {
+        TOCCancelTokenSource* longLived = [TOCCancelTokenSource new];
+        TOCBenchmark_repeat(iterations, ^{
+            TOCCancelTokenSource* unless = [TOCCancelTokenSource new];
+            [longLived.token whenCancelledDo:^{ check(false, @"removed handler never runs"); } unless:unless.token];
+            [unless cancel];
+        });
+    }]];
+    
+    for (NSNumber* count in @[@1000, @10000, @100000, @1000000]) {
+        NSUInteger n = count.unsignedIntegerValue;
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"finallyAll" parameter:n body:^(NSUInteger iterations) {
+            TOCBenchmark_repeat(iterations, ^{
+                NSMutableArray* sources = [NSMutableArray arrayWithCapacity:n];
+                NSMutableArray* futures = [NSMutableArray arrayWithCapacity:n];
+                for (NSUInteger i = 0; i < n; i++) {
+                    TOCFutureSource* source = [TOCFutureSource new];
+                    [sources addObject:source];
+                    [futures addObject:source.future];
+                }
+                TOCFuture* all = futures.toc_finallyAll;
+                for (TOCFutureSource* source in sources) {
+                    [source trySetResult:@1];
+                }
+                check(all.hasResult, @"toc_finallyAll completed");
+            });
+        }]];
+        
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"finallyAllUnlessCancelled" parameter:n body:^(NSUInteger iterations) {
+            TOCBenchmark_repeat(iterations, ^{
+                // (the sources must stay alive, or the inputs would become immortal instead of staying pending)
+                NSMutableArray* sources = [NSMutableArray arrayWithCapacity:n];
+                NSMutableArray* futures = [NSMutableArray arrayWithCapacity:n];
+                for (NSUInteger i = 0; i < n; i++) {
+                    TOCFutureSource* source = [TOCFutureSource new];
+                    [sources addObject:source];
+                    [futures addObject:source.future];
+                }
+                TOCCancelTokenSource* canceller = [TOCCancelTokenSource new];
+                TOCFuture* all = [futures toc_finallyAllUnless:canceller.token];
+                [canceller cancel];
+                check(all.hasFailedWithCancel, @"toc_finallyAllUnless: cancelled");
+            });
+        }]];
+    }
+    
+    for (NSNumber* depth in @[@1, @100]) {
+        NSUInteger n = depth.unsignedIntegerValue;
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"flatten" parameter:n body:^(NSUInteger iterations) {
+            TOCBenchmark_repeat(iterations, ^{
+                // each source flattens the next one's future, then the last one completes them all
+                TOCFutureSource* first = [TOCFutureSource new];
+                TOCFutureSource* current = first;
+                for (NSUInteger i = 0; i < n; i++) {
+                    TOCFutureSource* next = [TOCFutureSource new];
+                    [current trySetResult:next.future];
+                    current = next;
+                }
+                [current trySetResult:@1];
+                check(first.future.hasResult, @"flattened future completed");
+            });
+        }]];
+    }
+    
+    [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"flattenCycle" parameter:0 body:^(NSUInteger iterations) {
+        TOCBenchmark_repeat(iterations, ^{
+            TOCFutureSource* a = [TOCFutureSource new];
+            TOCFutureSource* b = [TOCFutureSource new];
+            [a trySetResult:b.future];
+            [b trySetResult:a.future];
+            check(a.future.state == TOCFutureState_Immortal, @"flattening cycle detected");
+        });
+    }]];
+    
+    [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"matchFirstToCancelBetween" parameter:0 body:^(NSUInteger iterations) {
+        TOCBenchmark_repeat(iterations, ^{
+            TOCCancelTokenSource* c1 = [TOCCancelTokenSource new];
+            TOCCancelTokenSource* c2 = [TOCCancelTokenSource new];
+            TOCCancelToken* first = [TOCCancelToken matchFirstToCancelBetween:c1.token and:c2.token];
+            [c2 cancel];
+            check(first.isAlreadyCancelled, @"matched token cancelled");
+        });
+    }]];
+    
+    for (NSNumber* racerCount in @[@2, @16]) {
+        NSUInteger n = racerCount.unsignedIntegerValue;
+        
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"raceForWinnerCompleted" parameter:n body:^(NSUInteger iterations) {
+            NSMutableArray* starters = [NSMutableArray array];
+            for (NSUInteger i = 0; i < n; i++) {
+                [starters addObject:[^(TOCCancelToken* untilCancelledToken) {
+                    return [TOCFuture futureWithResult:@(i)];
+                } copy]];
+            }
+            TOCBenchmark_repeat(iterations, ^{
+                TOCCancelTokenSource* lifetime = [TOCCancelTokenSource new];
+                TOCFuture* winner = [starters toc_raceForWinnerLastingUntil:lifetime.token];
+                check(winner.hasResult, @"race has a winner");
+                [lifetime cancel];
+            });
+        }]];
+        
+        [benchmarks addObject:[TOCBenchmark benchmarkNamed:@"raceForWinnerPending" parameter:n body:^(NSUInteger iterations) {
+            TOCBenchmark_repeat(iterations, ^{
+                NSMutableArray* sources = [NSMutableArray arrayWithCapacity:n];
+                NSMutableArray* starters = [NSMutableArray arrayWithCapacity:n];
+                for (NSUInteger i = 0; i < n; i++) {
+                    TOCFutureSource* source = [TOCFutureSource new];
+                    [sources addObject:source];
+                    [starters addObject:[^(TOCCancelToken* untilCancelledToken) {
+                        return source.future;
+                    } copy]];
+                }
+                TOCCancelTokenSource* lifetime = [TOCCancelTokenSource new];
+                TOCFuture* winner = [starters toc_raceForWinnerLastingUntil:lifetime.token];
+                [sources.lastObject trySetResult:@1];
+                check(winner.hasResult, @"race has a winner");
+                [lifetime cancel];
+            });
+        }]];
+    }
+    
+    return benchmarks;
+}
+
+int main(int argc, const char* argv[]) {
+    @autoreleasepool {
+        return TOCBenchmark_main(argc, argv, @"microbenchmarks", microbenchmarks());
+    }
+}
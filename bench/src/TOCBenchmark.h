@@ -0,0 +1,85 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * Runs a benchmarked operation the given number of times.
+ */
+typedef void (^TOCBenchmarkBody)(NSUInteger iterations);
+
+/*!
+ * Something that can be measured by TOCBenchmark_main.
+ */
+@protocol TOCBenchmarkCase <NSObject>
+
+/*!
+ * Identifies the case in the results, and is matched against the --filter option.
+ */
+-(NSString*) name;
+
+/*!
+ * Measures the case, and returns its results as a JSON-compatible dictionary.
+ *
+ * @param sampleCount How many separate measurements to take. Results report the median (and the spread).
+ *
+ * @param minimumSampleDuration How long, in seconds, each measurement should at least take, so that timer resolution doesn't matter.
+ */
+-(NSDictionary*) resultsWithSampleCount:(NSUInteger)sampleCount
+                  minimumSampleDuration:(NSTimeInterval)minimumSampleDuration;
+
+@end
+
+/*!
+ * A single-threaded benchmark of one operation, optionally parameterized by a size (e.g. a chain depth or an array length).
+ *
+ * @discussion Reports the time per operation, and the number of library objects (futures, sources, tokens, token sources)
+ * and handlers created per operation, according to TOCStatistics.
+ *
+ * Parameterized cases also report the time per element, so running a case at several sizes shows how it scales.
+ */
+@interface TOCBenchmark : NSObject <TOCBenchmarkCase>
+
+/*!
+ * Returns a benchmark that measures the given body.
+ *
+ * @param parameter The size the body works at, or 0 for unparameterized cases.
+ *
+ * @param body Runs the operation being measured the given number of times.
+ * Should drain autoreleased objects as it goes (e.g. by using TOCBenchmark_repeat).
+ */
++(TOCBenchmark*) benchmarkNamed:(NSString*)name
+                      parameter:(NSUInteger)parameter
+                           body:(TOCBenchmarkBody)body;
+
+@property (readonly,nonatomic) NSUInteger parameter;
+
+@end
+
+/*!
+ * Runs the given operation the given number of times, draining autoreleased objects every so often.
+ */
+void TOCBenchmark_repeat(NSUInteger iterations, void (^operation)(void));
+
+/*!
+ * Returns the current time, in nanoseconds, on a monotonic clock.
+ */
+uint64_t TOCBenchmark_now(void);
+
+/*!
+ * Returns the median of the given (unsorted) numbers.
+ */
+double TOCBenchmark_median(NSArray* numbers);
+
+/*!
+ * Runs the benchmark cases selected by the command line options, and writes their results as JSON.
+ *
+ * @discussion Options:
+ *
+ * --filter TEXT: only run cases whose name contains TEXT.
+ * --quick: take fewer and shorter samples.
+ * --output PATH: write the JSON to PATH instead of standard output.
+ *
+ * Progress and a human-readable summary are written to standard error.
+ * Set the GIT_COMMIT environment variable to have the results say which commit they are for.
+ *
+ * @result The process exit code.
+ */
+int TOCBenchmark_main(int argc, const char* argv[], NSString* suiteName, NSArray* benchmarkCases);
@@ -0,0 +1,191 @@
+#import "TOCBenchmark.h"
+#import "CollapsingFutures.h"
+#include <time.h>
+
+/// How many iterations run between autorelease pool drains
+static const NSUInteger DrainInterval = 1024;
+
+uint64_t TOCBenchmark_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+void TOCBenchmark_repeat(NSUInteger iterations, void (^operation)(void)) {
+    for (NSUInteger done = 0; done < iterations; done += DrainInterval) {
+        @autoreleasepool {
+            NSUInteger n = MIN(DrainInterval, iterations - done);
+            for (NSUInteger i = 0; i < n; i++) {
+                operation();
+            }
+        }
+    }
+}
+
+double TOCBenchmark_median(NSArray* numbers) {
+    NSArray* sorted = [numbers sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger n = sorted.count;
+    if (n == 0) return 0;
+    if (n % 2 == 1) return [sorted[n / 2] doubleValue];
+    return ([sorted[n / 2 - 1] doubleValue] + [sorted[n / 2] doubleValue]) / 2;
+}
+
+static uint64_t objectsCreated(TOCStatistics* statistics) {
+    return statistics.futuresCreated
+         + statistics.futureSourcesCreated
+         + statistics.cancelTokensCreated
+         + statistics.cancelTokenSourcesCreated;
+}
+
+@implementation TOCBenchmark {
+@private NSString* _name;
+@private TOCBenchmarkBody _body;
+}
+
+@synthesize parameter;
+
++(TOCBenchmark*) benchmarkNamed:(NSString*)name
+                      parameter:(NSUInteger)sizeParameter
+                           body:(TOCBenchmarkBody)body {
+    NSParameterAssert(name != nil);
+    NSParameterAssert(body != nil);
+    
+    TOCBenchmark* benchmark = [TOCBenchmark new];
+    benchmark->_name = [name copy];
+    benchmark->parameter = sizeParameter;
+    benchmark->_body = [body copy];
+    return benchmark;
+}
+
+-(NSString*) name {
+    if (parameter == 0) return _name;
+    return [NSString stringWithFormat:@"%@/%lu", _name, (unsigned long)parameter];
+}
+
+-(uint64_t) _timeIterations:(NSUInteger)iterations {
+    uint64_t start = TOCBenchmark_now();
+    _body(iterations);
+    return TOCBenchmark_now() - start;
+}
+
+-(NSDictionary*) resultsWithSampleCount:(NSUInteger)sampleCount
+                  minimumSampleDuration:(NSTimeInterval)minimumSampleDuration {
+    // warm up, then find how many iterations fill a sample
+    _body(1);
+    uint64_t targetNanoseconds = (uint64_t)(minimumSampleDuration * NSEC_PER_SEC);
+    NSUInteger iterations = 1;
+    while (true) {
+        uint64_t elapsed = [self _timeIterations:iterations];
+        if (elapsed >= targetNanoseconds) break;
+        if (elapsed < targetNanoseconds / 8) {
+            iterations *= 8;
+        } else {
+            iterations = (NSUInteger)ceil(iterations * 1.2 * targetNanoseconds / MAX(elapsed, (uint64_t)1));
+        }
+    }
+    
+    NSMutableArray* nanosecondsPerOperation = [NSMutableArray array];
+    TOCStatistics* before = [TOCStatistics snapshot];
+    for (NSUInteger i = 0; i < sampleCount; i++) {
+        uint64_t elapsed = [self _timeIterations:iterations];
+        [nanosecondsPerOperation addObject:@((double)elapsed / iterations)];
+    }
+    TOCStatistics* counted = [[TOCStatistics snapshot] statisticsSince:before];
+    double operationCount = (double)iterations * sampleCount;
+    
+    double median = TOCBenchmark_median(nanosecondsPerOperation);
+    NSMutableDictionary* results = [NSMutableDictionary dictionary];
+    results[@"name"] = self.name;
+    results[@"case"] = _name;
+    results[@"parameter"] = @(parameter);
+    results[@"iterationsPerSample"] = @(iterations);
+    results[@"samples"] = @(sampleCount);
+    results[@"nsPerOp"] = @(median);
+    results[@"nsPerOpMin"] = [nanosecondsPerOperation valueForKeyPath:@"@min.self"];
+    results[@"nsPerOpMax"] = [nanosecondsPerOperation valueForKeyPath:@"@max.self"];
+    results[@"objectsPerOp"] = @(objectsCreated(counted) / operationCount);
+    results[@"handlersPerOp"] = @(counted.handlersRegistered / operationCount);
+    if (parameter > 0) {
+        results[@"nsPerElement"] = @(median / parameter);
+    }
+    return results;
+}
+
+@end
+
+static NSString* summaryOf(NSDictionary* results) {
+    NSMutableString* summary = [[results[@"name"] stringByPaddingToLength:48 withString:@" " startingAtIndex:0] mutableCopy];
+    for (NSString* key in [[results allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        id value = results[key];
+        if ([key isEqual:@"name"] || [key isEqual:@"case"] || ![value isKindOfClass:[NSNumber class]]) continue;
+        [summary appendFormat:@" %@=%.4g", key, [value doubleValue]];
+    }
+    return summary;
+}
+
+static void writeLine(FILE* file, NSString* text) {
+    fprintf(file, "%s\n", text.UTF8String);
+    fflush(file);
+}
+
+int TOCBenchmark_main(int argc, const char* argv[], NSString* suiteName, NSArray* benchmarkCases) {
+    @autoreleasepool {
+        NSString* filter = nil;
+        NSString* outputPath = nil;
+        bool quick = false;
+        for (int i = 1; i < argc; i++) {
+            NSString* arg = @(argv[i]);
+            if ([arg isEqual:@"--quick"]) {
+                quick = true;
+            } else if ([arg isEqual:@"--filter"] && i + 1 < argc) {
+                filter = @(argv[++i]);
+            } else if ([arg isEqual:@"--output"] && i + 1 < argc) {
+                outputPath = @(argv[++i]);
+            } else {
+                writeLine(stderr, [NSString stringWithFormat:@"usage: %s [--quick] [--filter TEXT] [--output PATH]", argv[0]]);
+                return 2;
+            }
+        }
+        
+        NSUInteger sampleCount = quick ? 3 : 7;
+        NSTimeInterval sampleDuration = quick ? 0.02 : 0.2;
+        
+        NSMutableArray* allResults = [NSMutableArray array];
+        for (id<TOCBenchmarkCase> benchmarkCase in benchmarkCases) {
+            if (filter != nil && [benchmarkCase.name rangeOfString:filter].location == NSNotFound) continue;
+            
+            @autoreleasepool {
+                NSDictionary* results = [benchmarkCase resultsWithSampleCount:sampleCount
+                                                        minimumSampleDuration:sampleDuration];
+                [allResults addObject:results];
+                writeLine(stderr, summaryOf(results));
+            }
+        }
+        
+        NSMutableDictionary* report = [NSMutableDictionary dictionary];
+        report[@"suite"] = suiteName;
+        report[@"timestamp"] = @((uint64_t)[NSDate date].timeIntervalSince1970);
+        report[@"processorCount"] = @(NSProcessInfo.processInfo.activeProcessorCount);
+        report[@"quick"] = @(quick);
+        NSString* commit = NSProcessInfo.processInfo.environment[@"GIT_COMMIT"];
+        if (commit != nil) report[@"commit"] = commit;
+        report[@"results"] = allResults;
+        
+        NSError* error = nil;
+        NSData* json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+        if (json == nil) {
+            writeLine(stderr, [NSString stringWithFormat:@"Failed to encode results: %@", error]);
+            return 1;
+        }
+        if (outputPath != nil) {
+            if (![json writeToFile:outputPath options:NSDataWritingAtomic error:&error]) {
+                writeLine(stderr, [NSString stringWithFormat:@"Failed to write results: %@", error]);
+                return 1;
+            }
+        } else {
+            fwrite(json.bytes, 1, json.length, stdout);
+            fputc('\n', stdout);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,54 @@
+#import <Foundation/Foundation.h>
+#import "TOCBenchmark.h"
+
+/*!
+ * Makes the shared state that the threads of one round of a contention benchmark work on.
+ *
+ * @param threadCount How many threads will run operations on the state.
+ *
+ * @param operationsPerThread How many operations each thread will run.
+ */
+typedef id (^TOCContentionSetUp)(NSUInteger threadCount, NSUInteger operationsPerThread);
+
+/*!
+ * Runs one operation against the shared state of a round.
+ *
+ * @param threadIndex Which of the round's threads is running the operation, from 0.
+ *
+ * @param operationIndex How many operations the thread has already run this round.
+ */
+typedef void (^TOCContentionOperation)(id state, NSUInteger threadIndex, NSUInteger operationIndex);
+
+/*!
+ * Checks and cleans up the shared state of a round, after every thread has finished (outside of the measured time).
+ */
+typedef void (^TOCContentionTearDown)(id state);
+
+/*!
+ * A benchmark of many threads running the same kind of operation against shared state at the same time.
+ *
+ * @discussion Each round starts the given number of threads, releases them all at once, and has each run the same number of operations.
+ * Reports the combined throughput (operations per second, from the first thread starting to the last finishing),
+ * and how much of each thread's time was spent off the CPU.
+ *
+ * Off-CPU time is wall-clock time minus the thread's CPU time.
+ * It measures time spent blocked (e.g. waiting for a contended mutex or @synchronized lock), but not time spent spinning,
+ * and includes time spent preempted, so it is only a clean measure of lock waiting while there are no more threads than cores.
+ */
+@interface TOCContentionBenchmark : NSObject <TOCBenchmarkCase>
+
+/*!
+ * Returns a contention benchmark, run with the given number of threads.
+ *
+ * @param maxOperationsPerThread Caps how many operations each thread runs in a round, for operations whose state grows with every operation.
+ */
++(TOCContentionBenchmark*) benchmarkNamed:(NSString*)name
+                              threadCount:(NSUInteger)threadCount
+                   maxOperationsPerThread:(NSUInteger)maxOperationsPerThread
+                                    setUp:(TOCContentionSetUp)setUp
+                                operation:(TOCContentionOperation)operation
+                                 tearDown:(TOCContentionTearDown)tearDown;
+
+@property (readonly,nonatomic) NSUInteger threadCount;
+
+@end
@@ -0,0 +1,186 @@
+#import "TOCContentionBenchmark.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/// Lines up the start of a round's threads, so they all start running operations at once
+typedef struct {
+    atomic_ulong readyCount;
+    atomic_bool started;
+} TOCContentionStartLine;
+
+@interface TOCContentionWorker : NSObject {
+@package __unsafe_unretained id _state;
+@package TOCContentionOperation _operation;
+@package NSUInteger _threadIndex;
+@package NSUInteger _operationCount;
+@package TOCContentionStartLine* _startLine;
+@package uint64_t _startTime;
+@package uint64_t _endTime;
+@package uint64_t _cpuTime;
+}
+@end
+
+@implementation TOCContentionWorker
+@end
+
+static uint64_t threadCpuNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+static void* runWorker(void* workerReference) {
+    @autoreleasepool {
+        TOCContentionWorker* worker = (__bridge TOCContentionWorker*)workerReference;
+        TOCContentionStartLine* startLine = worker->_startLine;
+        
+        atomic_fetch_add(&startLine->readyCount, 1);
+        while (!atomic_load_explicit(&startLine->started, memory_order_acquire)) {
+            sched_yield();
+        }
+        
+        uint64_t cpuStart = threadCpuNow();
+        worker->_startTime = TOCBenchmark_now();
+        __block NSUInteger operationIndex = 0;
+        TOCContentionOperation operation = worker->_operation;
+        id state = worker->_state;
+        NSUInteger threadIndex = worker->_threadIndex;
+        TOCBenchmark_repeat(worker->_operationCount, ^{
+            operation(state, threadIndex, operationIndex++);
+        });
+        worker->_endTime = TOCBenchmark_now();
+        worker->_cpuTime = threadCpuNow() - cpuStart;
+    }
+    return NULL;
+}
+
+@implementation TOCContentionBenchmark {
+@private NSString* _name;
+@private NSUInteger _maxOperationsPerThread;
+@private TOCContentionSetUp _setUp;
+@private TOCContentionOperation _operation;
+@private TOCContentionTearDown _tearDown;
+}
+
+@synthesize threadCount;
+
++(TOCContentionBenchmark*) benchmarkNamed:(NSString*)name
+                              threadCount:(NSUInteger)count
+                   maxOperationsPerThread:(NSUInteger)maxOperationsPerThread
+                                    setUp:(TOCContentionSetUp)setUp
+                                operation:(TOCContentionOperation)operation
+                                 tearDown:(TOCContentionTearDown)tearDown {
+    NSParameterAssert(name != nil);
+    NSParameterAssert(count > 0);
+    NSParameterAssert(maxOperationsPerThread > 0);
+    NSParameterAssert(setUp != nil);
+    NSParameterAssert(operation != nil);
+    NSParameterAssert(tearDown != nil);
+    
+    TOCContentionBenchmark* benchmark = [TOCContentionBenchmark new];
+    benchmark->_name = [name copy];
+    benchmark->threadCount = count;
+    benchmark->_maxOperationsPerThread = maxOperationsPerThread;
+    benchmark->_setUp = [setUp copy];
+    benchmark->_operation = [operation copy];
+    benchmark->_tearDown = [tearDown copy];
+    return benchmark;
+}
+
+-(NSString*) name {
+    return [NSString stringWithFormat:@"%@/threads:%lu", _name, (unsigned long)threadCount];
+}
+
+/// Runs one round, and returns its wall time and total off-CPU time (in nanoseconds)
+-(void) _runRoundWithOperationsPerThread:(NSUInteger)operationsPerThread
+                                wallTime:(uint64_t*)wallTime
+                              offCpuTime:(uint64_t*)offCpuTime {
+    id state = _setUp(threadCount, operationsPerThread);
+    
+    TOCContentionStartLine startLine;
+    atomic_init(&startLine.readyCount, 0);
+    atomic_init(&startLine.started, false);
+    
+    NSMutableArray* workers = [NSMutableArray array];
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    NSParameterAssert(threads != NULL);
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        TOCContentionWorker* worker = [TOCContentionWorker new];
+        worker->_state = state;
+        worker->_operation = _operation;
+        worker->_threadIndex = i;
+        worker->_operationCount = operationsPerThread;
+        worker->_startLine = &startLine;
+        [workers addObject:worker];
+        
+        int error = pthread_create(&threads[i], NULL, runWorker, (__bridge void*)worker);
+        NSAssert(error == 0, @"Failed to start a benchmark thread: %d", error);
+    }
+    
+    while (atomic_load(&startLine.readyCount) < threadCount) {
+        sched_yield();
+    }
+    atomic_store_explicit(&startLine.started, true, memory_order_release);
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    
+    uint64_t firstStart = UINT64_MAX;
+    uint64_t lastEnd = 0;
+    uint64_t offCpu = 0;
+    for (TOCContentionWorker* worker in workers) {
+        firstStart = MIN(firstStart, worker->_startTime);
+        lastEnd = MAX(lastEnd, worker->_endTime);
+        uint64_t wall = worker->_endTime - worker->_startTime;
+        offCpu += wall > worker->_cpuTime ? wall - worker->_cpuTime : 0;
+    }
+    
+    _tearDown(state);
+    
+    *wallTime = lastEnd - firstStart;
+    *offCpuTime = offCpu;
+}
+
+-(NSDictionary*) resultsWithSampleCount:(NSUInteger)sampleCount
+                  minimumSampleDuration:(NSTimeInterval)minimumSampleDuration {
+    uint64_t wallTime;
+    uint64_t offCpuTime;
+    
+    // warm up, then find how many operations per thread fill a round
+    uint64_t targetNanoseconds = (uint64_t)(minimumSampleDuration * NSEC_PER_SEC);
+    NSUInteger operationsPerThread = MIN((NSUInteger)16, _maxOperationsPerThread);
+    [self _runRoundWithOperationsPerThread:operationsPerThread wallTime:&wallTime offCpuTime:&offCpuTime];
+    while (operationsPerThread < _maxOperationsPerThread) {
+        [self _runRoundWithOperationsPerThread:operationsPerThread wallTime:&wallTime offCpuTime:&offCpuTime];
+        if (wallTime >= targetNanoseconds) break;
+        operationsPerThread = MIN(operationsPerThread * 4, _maxOperationsPerThread);
+    }
+    
+    NSMutableArray* operationsPerSecond = [NSMutableArray array];
+    NSMutableArray* offCpuNanosecondsPerOperation = [NSMutableArray array];
+    double operationCount = (double)operationsPerThread * threadCount;
+    for (NSUInteger i = 0; i < sampleCount; i++) {
+        [self _runRoundWithOperationsPerThread:operationsPerThread wallTime:&wallTime offCpuTime:&offCpuTime];
+        [operationsPerSecond addObject:@(operationCount / MAX(wallTime, (uint64_t)1) * NSEC_PER_SEC)];
+        [offCpuNanosecondsPerOperation addObject:@(offCpuTime / operationCount)];
+    }
+    
+    double medianThroughput = TOCBenchmark_median(operationsPerSecond);
+    return @{
+        @"name": self.name,
+        @"case": _name,
+        @"threads": @(threadCount),
+        @"operationsPerThread": @(operationsPerThread),
+        @"samples": @(sampleCount),
+        @"opsPerSecond": @(medianThroughput),
+        @"opsPerSecondMin": [operationsPerSecond valueForKeyPath:@"@min.self"],
+        @"opsPerSecondMax": [operationsPerSecond valueForKeyPath:@"@max.self"],
+        @"opsPerSecondPerThread": @(medianThroughput / threadCount),
+        @"offCpuNsPerOp": @(TOCBenchmark_median(offCpuNanosecondsPerOperation))
+    };
+}
+
+@end
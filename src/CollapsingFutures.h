@@ -7,5 +7,15 @@
 #import "TOCFuture+MoreContinuations.h"
 #import "TOCFuture+MoreContructors.h"
 
+#import "TOCExecutor.h"
+#import "TOCCompletionStream.h"
+#import "TOCAdaptiveHedgeDelay.h"
+#import "TOCBatcher.h"
+#import "TOCFutureCache.h"
+#import "TOCStatistics.h"
+#import "TOCLatencyTracker.h"
+#import "TOCTracing.h"
+
 #import "TOCTimeout.h"
+#import "TOCRetryPolicy.h"
 #import "TOCTypeDefs.h"
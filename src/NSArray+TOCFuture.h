@@ -1,6 +1,8 @@
 #import <Foundation/Foundation.h>
 #import "TOCFutureAndSource.h"
 #import "TOCTypeDefs.h"
+#import "TOCCompletionStream.h"
+#import "TOCAdaptiveHedgeDelay.h"
 
 @interface NSArray (TOCFuture)
 
@@ -64,6 +66,33 @@
  */
 -(TOCFuture*) toc_thenAll;
 
+/*!
+ * Runs all the TOCUntilOperation blocks in the array, and eventually gets all of their results, unless one of them fails first.
+ * IMPORTANT: An operation's result MUST be cleaned up if the cancel token given to the starter is cancelled EVEN IF the operation has already completed.
+ *
+ * @param untilCancelledToken When this token is cancelled, the operations AND THEIR RESULTS are cancelled, terminated, cleaned up, and generally DEAD.
+ *
+ * @result A future whose result will be an array containing the results of the operations, in the same order as the starters.
+ * A nil result (from an operation that succeeded) is stored as NSNull in the resulting array.
+ * As soon as any operation fails, the future fails with that operation's failure (not an array of failures).
+ * If the untilCancelledToken is cancelled before all the operations have succeeded, the resulting future fails with a cancellation.
+ *
+ * @pre All items in the array must be TOCUntilOperation blocks.
+ *
+ * @discussion Unlike toc_thenAll, which only reports a failure once every future has completed, this fails fast.
+ * When an operation fails, all the other operations are cancelled right away (by cancelling the untilCancelledToken that was given to them),
+ * so that stragglers don't keep doing work (or holding resources) for a result nobody can use.
+ * Operations that haven't been started when the failure happens are not started at all.
+ *
+ * The untilCancelledToken given to the operations is shared between them, and dependent on (but distinct from) the untilCancelledToken given to this method.
+ *
+ * You are allowed to give a nil untilCancelledToken to this method.
+ * However, the operations will still be given a non-nil untilCancelledToken so that they can be cancelled when one of them fails.
+ *
+ * @see TOCUntilOperation
+ */
+-(TOCFuture*) toc_thenAllOrFirstFailureLastingUntil:(TOCCancelToken*)untilCancelledToken;
+
 /*!
  * Immediately returns an array containing futures matching those in the receiving array, but with futures that will complete later placed later in the array, unless cancelled.
  *
@@ -96,6 +125,32 @@
  */
 -(NSArray*) toc_orderedByCompletion;
 
+/*!
+ * Returns a stream that hands out the futures in the receiving array one at a time, in the order they complete, unless cancelled.
+ *
+ * @pre All items in the receiving array must be instances of TOCFuture.
+ *
+ * @result A completion stream whose `next` method returns futures for the inputs in completion order.
+ * If the given cancel token is cancelled, futures not yet matched with an input fail with a cancellation.
+ * @see TOCCompletionStream
+ *
+ * @discussion Like toc_orderedByCompletionUnless:, but results are handed out as they are asked for instead of all up front.
+ * Memory use is proportional to how far the consumer is ahead of or behind the inputs, instead of to the number of inputs.
+ *
+ * A nil cancel token is treated like a cancel token that can never be cancelled.
+ */
+-(TOCCompletionStream*) toc_completionStreamUnless:(TOCCancelToken*)unlessCancelledToken;
+
+/*!
+ * Returns a stream that hands out the futures in the receiving array one at a time, in the order they complete.
+ *
+ * @pre All items in the receiving array must be instances of TOCFuture.
+ *
+ * @result A completion stream whose `next` method returns futures for the inputs in completion order.
+ * @see TOCCompletionStream
+ */
+-(TOCCompletionStream*) toc_completionStream;
+
 /*!
  * Runs all the TOCUntilOperation blocks in the array, racing the asynchronous operations they start against each other, and returns the winner as a future.
  * IMPORTANT: An operation's result MUST be cleaned up if the cancel token given to the starter is cancelled EVEN IF the operation has already completed.
@@ -124,4 +179,114 @@
  */
 -(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken;
 
+/*!
+ * Runs all the TOCUntilOperation blocks in the array, and eventually gets the results of the first ones to succeed, once enough have succeeded to form a quorum.
+ * IMPORTANT: An operation's result MUST be cleaned up if the cancel token given to the starter is cancelled EVEN IF the operation has already completed.
+ *
+ * @param quorumSize How many operations must succeed. Must not be larger than the number of operations.
+ *
+ * @param untilCancelledToken When this token is cancelled, the race AND THE QUORUM'S RESULTS are cancelled, terminated, cleaned up, and generally DEAD.
+ *
+ * @result A future whose result will be an array containing the results of the first quorumSize operations to succeed, in the order they succeeded.
+ * As soon as so many operations have failed that a quorum is impossible, the future fails with an array containing those failures (in the order they failed).
+ * If the untilCancelledToken is cancelled before the race is over, the resulting future fails with a cancellation.
+ *
+ * @pre All items in the array must be TOCUntilOperation blocks.
+ *
+ * @discussion A generalization of toc_raceForWinnerLastingUntil:, which is like a quorum of one, and toc_thenAllOrFirstFailureLastingUntil:, which is like a quorum of everything.
+ * Useful for replicated reads that need agreement from a quorum of replicas, or for scatter-gather queries that only need the first few shards to answer.
+ *
+ * As soon as the race is decided, all the operations that aren't part of the quorum are cancelled by cancelling the untilCancelledToken that was given to them.
+ * That includes operations that are still running, and operations that succeeded too late to be part of the quorum.
+ * Operations that haven't been started when the race is decided are not started at all.
+ *
+ * The untilCancelledTokens given to each operation are dependent, but distinct, from the untilCancelledToken given to this method.
+ *
+ * A quorum of zero immediately succeeds with an empty array, without starting any operations.
+ *
+ * @see TOCUntilOperation
+ */
+-(TOCFuture*) toc_raceForQuorumOf:(NSUInteger)quorumSize
+                     lastingUntil:(TOCCancelToken*)untilCancelledToken;
+
+/*!
+ * Runs the TOCUntilOperation blocks in the array one after another as hedges, racing the operations that have been started, and returns the winner as a future.
+ * IMPORTANT: An operation's result MUST be cleaned up if the cancel token given to the starter is cancelled EVEN IF the operation has already completed.
+ *
+ * @param untilCancelledToken When this token is cancelled, both the race AND THE WINNING RESULT are cancelled, terminated, cleaned up, and generally DEAD.
+ *
+ * @param hedgeDelayInSeconds How long to wait for the started operations before starting the next one.
+ * Must not be negative or NaN.
+ * A delay of zero starts every operation right away. An infinite delay only starts operations to replace ones that failed.
+ *
+ * @result A future that will contain the result of the first started operation to succeed, or else fail with the failures of every operation.
+ * If the untilCancelledToken is cancelled before the race is over, the resulting future fails with a cancellation.
+ *
+ * @pre All items in the array must be TOCUntilOperation blocks.
+ *
+ * @discussion Like toc_raceForWinnerLastingUntil:, except only the first operation is started right away.
+ * Each following operation (e.g. a request to another replica of the same backend) is started only if no operation has succeeded after the hedge delay,
+ * or right away if the previous operation fails.
+ * Operations that haven't been started when the race is won are never started.
+ *
+ * Hedging fixes most of the tail latency that a full race fixes, while usually only doing the work of a single operation.
+ *
+ * When an operation has won, all the other started operations are cancelled by cancelling the untilCancelledToken that was given to them.
+ *
+ * @see toc_raceForWinnerLastingUntil:
+ * @see TOCUntilOperation
+ */
+-(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken
+                             withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds;
+
+/*!
+ * Runs the TOCUntilOperation blocks in the array one after another as hedges, waiting an adaptive delay between them, and returns the winner as a future.
+ * IMPORTANT: An operation's result MUST be cleaned up if the cancel token given to the starter is cancelled EVEN IF the operation has already completed.
+ *
+ * @param untilCancelledToken When this token is cancelled, both the race AND THE WINNING RESULT are cancelled, terminated, cleaned up, and generally DEAD.
+ *
+ * @param hedgeDelay Determines how long to wait before starting each following operation, based on the latencies of previous races.
+ * The time this race took to be won (measured from when the first operation was started, whichever operation won) is recorded into it.
+ * Must not be nil.
+ *
+ * @result A future that will contain the result of the first started operation to succeed, or else fail with the failures of every operation.
+ * If the untilCancelledToken is cancelled before the race is over, the resulting future fails with a cancellation.
+ *
+ * @pre All items in the array must be TOCUntilOperation blocks.
+ *
+ * @discussion Like toc_raceForWinnerLastingUntil:withHedgeDelay:, using the hedge delay's currentDelay at the time of the call.
+ *
+ * @see TOCAdaptiveHedgeDelay
+ */
+-(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken
+                     withAdaptiveHedgeDelay:(TOCAdaptiveHedgeDelay*)hedgeDelay;
+
+/*!
+ * Runs an asynchronous operation for each item in the receiving array, with at most a given number of operations in flight at a time, and returns their results in order.
+ *
+ * @param operation Starts the operation for an item, and returns a future for its result.
+ * It is also given a cancel token, that is cancelled if the map fails or is cancelled while the operation is in flight.
+ *
+ * @param maxConcurrency The most operations to have started but not yet completed at any one time. Must be at least 1.
+ *
+ * @param unlessCancelledToken When this token is cancelled before all the operations have succeeded, no more operations are started and the result fails with a cancellation.
+ *
+ * @result A future whose result will be an array containing the results of the operations, in the same order as their items.
+ * If an operation fails, the future fails with that operation's failure.
+ * If the unlessCancelledToken is cancelled first, the future fails with a cancellation.
+ *
+ * @discussion Only the first maxConcurrency operations are started right away.
+ * Each time an operation succeeds, the operation for the next item is started.
+ * This applies backpressure, so that mapping over a large array doesn't flood whatever the operations talk to.
+ *
+ * When an operation fails, or the map is cancelled, no more operations are started, and the operations in flight are cancelled.
+ *
+ * A nil result (from an operation that succeeded) is stored as NSNull in the resulting array.
+ *
+ * A nil cancel token is treated like a cancel token that can never be cancelled.
+ */
+-(TOCFuture*) toc_mapAsync:(TOCAsyncItemOperation)operation
+            maxConcurrency:(NSUInteger)maxConcurrency
+                    unless:(TOCCancelToken*)unlessCancelledToken;
+
 @end
@@ -1,7 +1,7 @@
 #import "NSArray+TOCFuture.h"
 #import "TOCFuture+MoreContinuations.h"
 #import "TOCInternal.h"
-#include <libkern/OSAtomic.h>
+#include <stdatomic.h>
 
 @implementation NSArray (TOCFuture)
 
@@ -13,26 +13,8 @@
     NSArray* futures = [self copy]; // remove volatility (i.e. ensure not externally mutable)
     TOCInternal_need([futures allItemsAreKindOfClass:[TOCFuture class]]);
     
-    TOCFutureSource* resultSource = [TOCFutureSource new];
-    
-    TOCInternal_need(futures.count < INT_MAX);
-    __block int remaining = (int)futures.count + 1;
-    TOCCancelHandler doneHandler = ^() {
-        if (OSAtomicDecrement32(&remaining) > 0) return;
-        [resultSource trySetResult:futures];
-    };
-    
-    for (TOCFuture* item in futures) {
-        [item.cancelledOnCompletionToken whenCancelledDo:doneHandler
-                                                  unless:unlessCancelledToken];
-    }
-    
-    doneHandler();
-    
-    [unlessCancelledToken whenCancelledDo:^{ [resultSource trySetFailedWithCancel]; }
-                                   unless:resultSource.future.cancelledOnCompletionToken];
-    
-    return resultSource.future;
+    return [TOCInternal_FinallyAllAggregator futureForCompletionOfAll:futures
+                                                               unless:unlessCancelledToken];
 }
 
 -(TOCFuture*) toc_thenAll {
@@ -50,6 +32,50 @@
     }];
 }
 
+-(TOCFuture*) toc_thenAllOrFirstFailureLastingUntil:(TOCCancelToken*)untilCancelledToken {
+    NSArray* starters = [self copy]; // remove volatility (i.e. ensure not externally mutable)
+    TOCInternal_need([starters allItemsAreKindOfClass:NSClassFromString(@"NSBlock")]);
+    
+    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:untilCancelledToken];
+    TOCCancelTokenSource* operationsCanceller = [TOCCancelTokenSource cancelTokenSourceUntil:untilCancelledToken];
+    
+    // only read by the last successful operation's handler, after the countdown shows every operation was started
+    NSMutableArray* operations = [NSMutableArray arrayWithCapacity:starters.count];
+    __block atomic_long remaining = (long)starters.count + 1;
+    TOCInternal_Handler countDown = ^{
+        if (atomic_fetch_sub(&remaining, 1) != 1) return;
+        NSMutableArray* results = [NSMutableArray arrayWithCapacity:operations.count];
+        for (TOCFuture* operation in operations) {
+            // operations are allowed to succeed with nil, e.g. when they have nothing to return
+            id result = operation.forceGetResult;
+            [results addObject:result != nil ? result : [NSNull null]];
+        }
+        [resultSource trySetResult:results];
+    };
+    
+    for (TOCUntilOperation starter in starters) {
+        // no point starting more operations once the result is decided (by a failure or a cancellation)
+        if (!resultSource.future.isIncomplete) break;
+        
+        TOCFuture* operation = starter(operationsCanceller.token);
+        TOCInternal_need(operation != nil);
+        [operations addObject:operation];
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the operation completes.
+        [operation _whenCompletedDo:^{
+            if (operation.hasResult) {
+                countDown();
+            } else if ([resultSource trySetFailure:operation.forceGetFailure]) {
+                // stop the stragglers (and clean up the results that did arrive), since the overall result is a failure
+                [operationsCanceller cancel];
+            }
+        } on:TOCExecutors.inlineExecutor unless:nil];
+    }
+    
+    countDown();
+    return resultSource.future;
+}
+
 -(NSArray*) toc_orderedByCompletion {
     return [self toc_orderedByCompletionUnless:nil];
 }
@@ -60,10 +86,9 @@
     
     NSMutableArray* resultSources = [NSMutableArray array];
     
-    TOCInternal_need(futures.count <= INT_MAX);
-    __block int nextIndexMinusOne = -1;
+    __block atomic_long nextIndex = 0;
     TOCFutureFinallyHandler doneHandler = ^(TOCFuture *completed) {
-        NSUInteger i = (NSUInteger)OSAtomicIncrement32Barrier(&nextIndexMinusOne);
+        NSUInteger i = (NSUInteger)atomic_fetch_add(&nextIndex, 1);
         [resultSources[i] forceSetResult:completed];
     };
     
@@ -75,6 +100,14 @@
     return [resultSources map:^(TOCFutureSource* source) { return source.future; }];
 }
 
+-(TOCCompletionStream*) toc_completionStream {
+    return [self toc_completionStreamUnless:nil];
+}
+
+-(TOCCompletionStream*) toc_completionStreamUnless:(TOCCancelToken*)unlessCancelledToken {
+    return [TOCCompletionStream completionStreamOf:self unless:unlessCancelledToken];
+}
+
 -(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken {
     NSArray* starters = [self copy]; // remove volatility (i.e. ensure not externally mutable)
     TOCInternal_need(starters.count > 0);
@@ -83,4 +116,53 @@
     return [TOCInternal_Racer asyncRace:starters until:untilCancelledToken];
 }
 
+-(TOCFuture*) toc_raceForQuorumOf:(NSUInteger)quorumSize
+                     lastingUntil:(TOCCancelToken*)untilCancelledToken {
+    NSArray* starters = [self copy]; // remove volatility (i.e. ensure not externally mutable)
+    TOCInternal_need(quorumSize <= starters.count);
+    TOCInternal_need([starters allItemsAreKindOfClass:NSClassFromString(@"NSBlock")]);
+    
+    return [TOCInternal_Racer asyncQuorumRace:starters
+                                   quorumSize:quorumSize
+                                        until:untilCancelledToken];
+}
+
+-(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken
+                             withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds {
+    NSArray* starters = [self copy]; // remove volatility (i.e. ensure not externally mutable)
+    TOCInternal_need(starters.count > 0);
+    TOCInternal_need([starters allItemsAreKindOfClass:NSClassFromString(@"NSBlock")]);
+    
+    return [TOCInternal_Racer asyncHedgedRace:starters
+                               withHedgeDelay:hedgeDelayInSeconds
+                              latencyRecorder:nil
+                                        until:untilCancelledToken];
+}
+
+-(TOCFuture*) toc_raceForWinnerLastingUntil:(TOCCancelToken*)untilCancelledToken
+                     withAdaptiveHedgeDelay:(TOCAdaptiveHedgeDelay*)hedgeDelay {
+    TOCInternal_need(hedgeDelay != nil);
+    NSArray* starters = [self copy]; // remove volatility (i.e. ensure not externally mutable)
+    TOCInternal_need(starters.count > 0);
+    TOCInternal_need([starters allItemsAreKindOfClass:NSClassFromString(@"NSBlock")]);
+    
+    return [TOCInternal_Racer asyncHedgedRace:starters
+                               withHedgeDelay:hedgeDelay.currentDelay
+                              latencyRecorder:hedgeDelay
+                                        until:untilCancelledToken];
+}
+
+-(TOCFuture*) toc_mapAsync:(TOCAsyncItemOperation)operation
+            maxConcurrency:(NSUInteger)maxConcurrency
+                    unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(operation != nil);
+    TOCInternal_need(maxConcurrency > 0);
+    NSArray* items = [self copy]; // remove volatility (i.e. ensure not externally mutable)
+    
+    return [TOCInternal_AsyncMapper mapAsync:items
+                                   operation:operation
+                              maxConcurrency:maxConcurrency
+                                      unless:unlessCancelledToken];
+}
+
 @end
@@ -0,0 +1,51 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * Tracks how long recent operations took, and suggests how long to wait for an operation before hedging it by starting a replica.
+ *
+ * @discussion The suggested delay is the given percentile of the recently observed latencies.
+ * For example, at the 95th percentile, a replica is only started for the slowest ~5% of operations.
+ * That fixes most of the tail latency while adding only ~5% more load, instead of the 100% (or more) added by starting every replica up front.
+ *
+ * Give the same instance to every hedged race against the same kind of backend, using toc_raceForWinnerLastingUntil:withAdaptiveHedgeDelay:.
+ * Those races record how long they took to be won, measured from when their first operation was started, into it.
+ * (Measuring only the winner would under-count: a replica only wins when it beats the original operation, after starting a delay later.)
+ *
+ * Only a bounded window of the most recent latencies is remembered, so the delay follows the backend as it speeds up or slows down.
+ *
+ * TOCAdaptiveHedgeDelay is thread safe.
+ */
+@interface TOCAdaptiveHedgeDelay : NSObject
+
+/*!
+ * Returns a new adaptive hedge delay, that suggests the given percentile of recently observed latencies.
+ *
+ * @param latencyPercentile Which percentile of the observed latencies to suggest, from 0 (the fastest) to 100 (the slowest).
+ *
+ * @param initialDelayInSeconds The delay to suggest until a latency has been recorded.
+ * Must not be negative or NaN. May be infinite.
+ */
++(TOCAdaptiveHedgeDelay*) adaptiveHedgeDelayAtPercentile:(double)latencyPercentile
+                                            initialDelay:(NSTimeInterval)initialDelayInSeconds;
+
+/*!
+ * Which percentile of the observed latencies is suggested as the delay.
+ */
+@property (readonly,nonatomic) double percentile;
+
+/*!
+ * Returns the delay, in seconds, that hedged races should currently wait before starting each replica.
+ */
+-(NSTimeInterval) currentDelay;
+
+/*!
+ * Records how long an operation took to succeed.
+ *
+ * @param latencyInSeconds The time, in seconds, from when the operation was started until it succeeded.
+ * Must not be negative or NaN.
+ *
+ * @discussion Hedged races using this instance call this automatically, with the time from starting their first operation until they were won.
+ */
+-(void) recordLatency:(NSTimeInterval)latencyInSeconds;
+
+@end
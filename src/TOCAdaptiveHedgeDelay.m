@@ -0,0 +1,65 @@
+#import "TOCAdaptiveHedgeDelay.h"
+#import "TOCInternal.h"
+
+/// How many of the most recent latencies are used to pick the delay
+#define TOCInternal_HedgeDelayWindowSize 128
+
+static int compareLatencies(const void* a, const void* b) {
+    NSTimeInterval x = *(const NSTimeInterval*)a;
+    NSTimeInterval y = *(const NSTimeInterval*)b;
+    return (x > y) - (x < y);
+}
+
+@implementation TOCAdaptiveHedgeDelay {
+@private NSTimeInterval _initialDelay;
+/// A ring buffer of the most recently recorded latencies
+@private NSTimeInterval _window[TOCInternal_HedgeDelayWindowSize];
+/// How many latencies have been recorded, in total (the next one goes into _window[_recordedCount % size])
+@private NSUInteger _recordedCount;
+}
+
+@synthesize percentile;
+
++(TOCAdaptiveHedgeDelay*) adaptiveHedgeDelayAtPercentile:(double)latencyPercentile
+                                            initialDelay:(NSTimeInterval)initialDelayInSeconds {
+    TOCInternal_need(latencyPercentile >= 0 && latencyPercentile <= 100);
+    TOCInternal_need(initialDelayInSeconds >= 0);
+    TOCInternal_need(!isnan(initialDelayInSeconds));
+
+    TOCAdaptiveHedgeDelay* hedgeDelay = [TOCAdaptiveHedgeDelay new];
+    hedgeDelay->percentile = latencyPercentile;
+    hedgeDelay->_initialDelay = initialDelayInSeconds;
+    return hedgeDelay;
+}
+
+-(NSTimeInterval) currentDelay {
+    NSTimeInterval sorted[TOCInternal_HedgeDelayWindowSize];
+    NSUInteger n;
+    @synchronized(self) {
+        if (_recordedCount == 0) return _initialDelay;
+        n = MIN(_recordedCount, (NSUInteger)TOCInternal_HedgeDelayWindowSize);
+        memcpy(sorted, _window, n * sizeof(NSTimeInterval));
+    }
+
+    qsort(sorted, n, sizeof(NSTimeInterval), compareLatencies);
+
+    // nearest-rank percentile
+    NSUInteger rank = (NSUInteger)ceil(percentile / 100 * n);
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+-(void) recordLatency:(NSTimeInterval)latencyInSeconds {
+    TOCInternal_need(latencyInSeconds >= 0);
+    TOCInternal_need(!isnan(latencyInSeconds));
+
+    @synchronized(self) {
+        _window[_recordedCount % TOCInternal_HedgeDelayWindowSize] = latencyInSeconds;
+        _recordedCount += 1;
+    }
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Adaptive hedge delay at p%g: %gs", percentile, self.currentDelay];
+}
+
+@end
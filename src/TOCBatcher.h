@@ -0,0 +1,91 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+
+/*!
+ * A block that starts an asynchronous operation for a whole batch of keys at once.
+ *
+ * @param keys The distinct keys in the batch, in the order they were first asked for.
+ *
+ * @result A future for a dictionary mapping each key to its value.
+ * Keys that are missing from the dictionary get a nil value.
+ */
+typedef TOCFuture* (^TOCBatchOperation)(NSArray* keys);
+
+/*!
+ * Coalesces requests for individual keys, from many independent callers, into batched requests.
+ *
+ * @discussion Each caller is handed a future for its key right away.
+ * Keys are collected into a pending batch, which is sent (by running the batch operation) once it has maxBatchSize distinct keys,
+ * or once batchWindow seconds have passed since its first key was asked for, whichever comes first.
+ *
+ * When the batch operation's dictionary arrives, each caller's future is completed with the value for its key.
+ * When the batch operation fails, every caller in the batch fails with the same failure.
+ *
+ * Asking for a key that is already in the pending batch shares the key, instead of sending it twice.
+ *
+ * Callers that cancel before their batch is sent are dropped from it, and their key is only sent if another caller still wants it.
+ * A batch left with no callers is not sent at all.
+ *
+ * Batches sent because of the window are sent from a background thread.
+ * Batches sent because they filled up are sent from the thread that asked for the last key.
+ *
+ * TOCBatcher is thread safe.
+ */
+@interface TOCBatcher : NSObject
+
+/*!
+ * Returns a batcher that collects keys into batches, and sends each batch by running the given operation.
+ *
+ * @param maxBatchSize The most distinct keys to put in a batch. Must be at least 1.
+ *
+ * @param batchWindowInSeconds How long to collect keys for, starting from the first key of a batch, before sending it.
+ * Must not be negative or NaN. May be infinite, so batches are only sent when full or flushed.
+ *
+ * @param batchOperation Runs the asynchronous operation for a batch of keys. Must not return nil.
+ */
++(TOCBatcher*) batcherWithMaxBatchSize:(NSUInteger)maxBatchSize
+                           batchWindow:(NSTimeInterval)batchWindowInSeconds
+                             operation:(TOCBatchOperation)batchOperation;
+
+/*!
+ * The most distinct keys that are put into a batch.
+ */
+@property (readonly,nonatomic) NSUInteger maxBatchSize;
+
+/*!
+ * How long, in seconds, keys are collected for before a batch is sent.
+ */
+@property (readonly,nonatomic) NSTimeInterval batchWindow;
+
+/*!
+ * Adds the given key to the pending batch, and returns a future for its value, unless cancelled.
+ *
+ * @param key The key to get the value of. Must not be nil. Used as a dictionary key.
+ *
+ * @param unlessCancelledToken When this token is cancelled before the value arrives, the result fails with a cancellation.
+ * If the batch hasn't been sent yet, the caller is also dropped from it.
+ * A nil cancel token corresponds to an immortal cancel token.
+ *
+ * @result A future that will contain the key's value from the batch operation's dictionary, or the batch operation's failure.
+ */
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                    unless:(TOCCancelToken*)unlessCancelledToken;
+
+/*!
+ * Adds the given key to the pending batch, and returns a future for its value.
+ *
+ * @param key The key to get the value of. Must not be nil. Used as a dictionary key.
+ *
+ * @result A future that will contain the key's value from the batch operation's dictionary, or the batch operation's failure.
+ */
+-(TOCFuture*) futureForKey:(id<NSCopying>)key;
+
+/*!
+ * Sends the pending batch right away, instead of waiting for it to fill up or for its window to end.
+ *
+ * @discussion Does nothing when no keys are pending.
+ */
+-(void) flush;
+
+@end
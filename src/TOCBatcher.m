@@ -0,0 +1,168 @@
+#import "TOCBatcher.h"
+#import "TOCInternal.h"
+
+/// Keys collected for a batch that hasn't been sent yet, along with the callers waiting on them
+@interface TOCInternal_PendingBatch : NSObject {
+/// The distinct keys, in the order they were first asked for
+@package NSMutableArray* _keys;
+/// An array of TOCFutureSource (one per caller) for each key
+@package NSMutableDictionary* _waitersByKey;
+/// Sends the batch when its window ends, or nil when the window is infinite
+@package TOCInternal_TimerWheelEntry* _windowTimer;
+}
+@end
+
+@implementation TOCInternal_PendingBatch
+@end
+
+@implementation TOCBatcher {
+@private TOCBatchOperation _batchOperation;
+/// The batch collecting keys, or nil when no keys are waiting to be sent. Guarded by self.
+@private TOCInternal_PendingBatch* _pendingBatch;
+}
+
+@synthesize maxBatchSize, batchWindow;
+
++(TOCBatcher*) batcherWithMaxBatchSize:(NSUInteger)maxBatchSize
+                           batchWindow:(NSTimeInterval)batchWindowInSeconds
+                             operation:(TOCBatchOperation)batchOperation {
+    TOCInternal_need(maxBatchSize > 0);
+    TOCInternal_need(batchWindowInSeconds >= 0);
+    TOCInternal_need(!isnan(batchWindowInSeconds));
+    TOCInternal_need(batchOperation != nil);
+    
+    TOCBatcher* batcher = [TOCBatcher new];
+    batcher->maxBatchSize = maxBatchSize;
+    batcher->batchWindow = batchWindowInSeconds;
+    batcher->_batchOperation = batchOperation;
+    return batcher;
+}
+
+-(TOCFuture*) futureForKey:(id<NSCopying>)key {
+    return [self futureForKey:key unless:nil];
+}
+
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                    unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(key != nil);
+    
+    TOCFutureSource* waiter = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
+    if (!waiter.future.isIncomplete) {
+        // already cancelled, so no point adding the key to a batch
+        return waiter.future;
+    }
+    
+    TOCInternal_PendingBatch* batch;
+    TOCInternal_PendingBatch* fullBatch = nil;
+    @synchronized(self) {
+        if (_pendingBatch == nil) {
+            [self _startPendingBatch];
+        }
+        batch = _pendingBatch;
+        
+        NSMutableArray* waiters = batch->_waitersByKey[key];
+        if (waiters == nil) {
+            waiters = [NSMutableArray array];
+            batch->_waitersByKey[key] = waiters;
+            [batch->_keys addObject:key];
+        }
+        [waiters addObject:waiter];
+        
+        if (batch->_keys.count >= maxBatchSize) {
+            fullBatch = [self _takePendingBatch];
+        }
+    }
+    
+    // drop the caller from the batch if they cancel before it is sent (after it is sent, there's nothing to drop)
+    [unlessCancelledToken _whenCancelledDo:^{ [self _dropWaiter:waiter forKey:key fromBatch:batch]; }
+                                        on:TOCExecutors.inlineExecutor
+                             unlessSettled:waiter.future];
+    
+    if (fullBatch != nil) {
+        [self _sendBatch:fullBatch];
+    }
+    return waiter.future;
+}
+
+-(void) flush {
+    TOCInternal_PendingBatch* batch;
+    @synchronized(self) {
+        batch = [self _takePendingBatch];
+    }
+    if (batch != nil) {
+        [self _sendBatch:batch];
+    }
+}
+
+/// Must be called while holding the lock.
+-(void) _startPendingBatch {
+    TOCInternal_PendingBatch* batch = [TOCInternal_PendingBatch new];
+    batch->_keys = [NSMutableArray array];
+    batch->_waitersByKey = [NSMutableDictionary dictionary];
+    if (batchWindow < INFINITY) {
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the batch is sent or dropped.
+        batch->_windowTimer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [self _sendIfStillPending:batch]; }
+                                                                          afterDelay:batchWindow];
+    }
+    _pendingBatch = batch;
+}
+
+/// Must be called while holding the lock.
+-(TOCInternal_PendingBatch*) _takePendingBatch {
+    TOCInternal_PendingBatch* batch = _pendingBatch;
+    _pendingBatch = nil;
+    [batch->_windowTimer cancel];
+    batch->_windowTimer = nil;
+    return batch;
+}
+
+-(void) _sendIfStillPending:(TOCInternal_PendingBatch*)batch {
+    @synchronized(self) {
+        if (_pendingBatch != batch) return;
+        [self _takePendingBatch];
+    }
+    [self _sendBatch:batch];
+}
+
+-(void) _dropWaiter:(TOCFutureSource*)waiter
+             forKey:(id<NSCopying>)key
+          fromBatch:(TOCInternal_PendingBatch*)batch {
+    @synchronized(self) {
+        if (_pendingBatch != batch) return;
+        
+        NSMutableArray* waiters = batch->_waitersByKey[key];
+        [waiters removeObjectIdenticalTo:waiter];
+        if (waiters.count > 0) return;
+        
+        [batch->_waitersByKey removeObjectForKey:key];
+        [batch->_keys removeObject:key];
+        if (batch->_keys.count == 0) {
+            // nobody is waiting on the batch anymore, so don't send it
+            [self _takePendingBatch];
+        }
+    }
+}
+
+-(void) _sendBatch:(TOCInternal_PendingBatch*)batch {
+    // the batch was taken out of the batcher, so nothing else modifies it anymore
+    NSArray* keys = [batch->_keys copy];
+    NSDictionary* waitersByKey = [batch->_waitersByKey copy];
+    
+    TOCFuture* futureValues = _batchOperation(keys);
+    TOCInternal_need(futureValues != nil);
+    
+    [futureValues finallyDo:^(TOCFuture* completed) {
+        NSDictionary* values = completed.hasResult ? completed.forceGetResult : nil;
+        for (id key in keys) {
+            for (TOCFutureSource* waiter in waitersByKey[key]) {
+                if (completed.hasResult) {
+                    [waiter trySetResult:values[key]];
+                } else {
+                    [waiter trySetFailure:completed.forceGetFailure];
+                }
+            }
+        }
+    } on:TOCExecutors.inlineExecutor unless:nil];
+}
+
+@end
@@ -2,6 +2,36 @@
 
 @interface TOCCancelToken (MoreConstructors)
 
+/*!
+ * Returns a cancel token that will be cancelled after the given delay.
+ *
+ * @param delayInSeconds The amount of time to wait, in seconds, before the returned token is cancelled.
+ * Must not be negative or NaN (raises exception).
+ * A delay of 0 results in a token that's already cancelled.
+ * A delay of INFINITY results in an immortal token.
+ *
+ * @result A cancel token whose deadline is the given delay from now.
+ *
+ * @discussion The returned token's deadline is available from its deadline and remainingTime methods, and is passed on to tokens derived from it.
+ * Prefer handing one deadline token down through a request's nested operations over giving each layer its own timeout.
+ *
+ * The token may be cancelled up to delayCoalescingLeeway late, so that it can be cancelled together with other timers ending around the same time.
+ * @see delayCoalescingLeeway
+ */
++(TOCCancelToken*) cancelledAfter:(NSTimeInterval)delayInSeconds;
+
+/*!
+ * Returns a cancel token that will be cancelled at the given deadline.
+ *
+ * @param deadline When the returned token should be cancelled. Must not be nil.
+ * A deadline in the past results in a token that's already cancelled.
+ *
+ * @result A cancel token with the given deadline.
+ *
+ * @discussion The deadline is converted into a delay right away, so later changes to the system clock don't affect when the token is cancelled.
+ */
++(TOCCancelToken*) cancelledAtDeadline:(NSDate*)deadline;
+
 /*!
  * Returns a cancel token that will be cancelled when either of the given cancel tokens is cancelled.
  *
@@ -15,6 +45,8 @@
  *
  * @discussion The returned cancel token is guaranteed to become immortal if both the given tokens become immortal.
  *
+ * The returned cancel token has the earlier of the given tokens' deadlines.
+ *
  * The result may be one of the given tokens, instead of a new token. Specifically:
  *
  * - If one of the given tokens has already been cancelled, it will be used as the result.
@@ -39,6 +71,8 @@
  *
  * @discussion The returned cancel token is guaranteed to become immortal if either of the given tokens becomes immortal.
  *
+ * The returned cancel token only has a deadline if both the given tokens have one, in which case it has the later of the two.
+ *
  * The result may be one of the given tokens, instead of a new token. Specifically:
  *
  * - If one of the given tokens has already been cancelled, the other will be used as the result.
@@ -3,6 +3,33 @@
 
 @implementation TOCCancelToken (MoreConstructors)
 
++(TOCCancelToken*) cancelledAfter:(NSTimeInterval)delayInSeconds {
+    TOCInternal_need(delayInSeconds >= 0);
+    TOCInternal_need(!isnan(delayInSeconds));
+    
+    if (delayInSeconds == 0) return TOCCancelToken.cancelledToken;
+    if (delayInSeconds == INFINITY) return TOCCancelToken.immortalToken;
+    
+    double delayInNanoseconds = delayInSeconds * NSEC_PER_SEC;
+    TOCInternal_need(delayInNanoseconds < INT64_MAX/2);
+    
+    TOCCancelTokenSource* source = [TOCCancelTokenSource new];
+    TOCInternal_TimerWheelEntry* timer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [source cancel]; }
+                                                                                     afterDelay:delayInSeconds];
+    
+    // the wheel may push the timer back a bit, to coalesce it with others, so report when it will actually fire
+    [source.token _initDeadlineTime:timer.fireTime];
+    return source.token;
+}
+
++(TOCCancelToken*) cancelledAtDeadline:(NSDate*)deadline {
+    TOCInternal_need(deadline != nil);
+    
+    NSTimeInterval delayInSeconds = deadline.timeIntervalSinceNow;
+    TOCInternal_need(!isnan(delayInSeconds));
+    return [self cancelledAfter:MAX(0, delayInSeconds)];
+}
+
 +(TOCCancelToken*) matchFirstToCancelBetween:(TOCCancelToken*)token1 and:(TOCCancelToken*)token2 {
     // check for special cases where we can just give back one of the tokens
     if (token1 == token2) return token1;
@@ -14,6 +41,7 @@
     if (state2 == TOCCancelTokenState_Cancelled) return token2;
     
     TOCCancelTokenSource* minSource = [TOCCancelTokenSource new];
+    [minSource.token _initDeadlineTime:MIN(token1._deadlineTime, token2._deadlineTime)];
     void (^doCancel)(void) = [^{ [minSource cancel]; } copy];
     [token1 whenCancelledDo:doCancel unless:minSource.token];
     [token2 whenCancelledDo:doCancel unless:minSource.token];
@@ -42,6 +70,7 @@
     
     // work to cancel the result can continue once one of the input tokens has settled
     TOCCancelTokenSource* maxSource = [TOCCancelTokenSource new];
+    [maxSource.token _initDeadlineTime:MAX(token1._deadlineTime, token2._deadlineTime)];
     [cancelledWhenEitherSettle.token whenCancelledDo:^{
         enum TOCCancelTokenState settledState1 = token1.state;
         enum TOCCancelTokenState settledState2 = token2.state;
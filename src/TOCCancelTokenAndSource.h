@@ -1,4 +1,5 @@
 #import <Foundation/Foundation.h>
+#import "TOCExecutor.h"
 
 @class TOCCancelTokenSource;
 
@@ -111,6 +112,40 @@ typedef void (^TOCCancelHandler)(void);
  */
 -(bool)canStillBeCancelled;
 
+/*!
+ * Returns the time by which the receiving token will have been cancelled, or nil if it has no deadline.
+ *
+ * @discussion Tokens get deadlines from constructors like cancelledAfter: and cancelledAtDeadline:.
+ * Tokens derived from a token with a deadline (e.g. by cancelTokenSourceUntil: or matchFirstToCancelBetween:and:) keep the earliest deadline that applies to them.
+ * That way nested operations can see the whole remaining budget, without each layer needing its own timer.
+ *
+ * A token may be cancelled before its deadline, but not (much) after it.
+ * The deadline of a token from cancelledAfter: can be a bit later than requested, because its timer is coalesced with nearby timers (see TOCFuture's delayCoalescingLeeway).
+ *
+ * Immortal tokens, including the nil token, have no deadline.
+ */
+-(NSDate*) deadline;
+
+/*!
+ * Returns how much time, in seconds, is left before the receiving token's deadline.
+ *
+ * @result INFINITY if the token has no deadline, or zero if the token is already cancelled or its deadline has passed.
+ *
+ * @discussion Useful for skipping work that can't finish before the token is cancelled, or for passing the remaining budget along to other systems.
+ *
+ * CAUTION: Sending this message to a nil token returns 0, not INFINITY. Use willBeCancelledWithin: when the token may be nil.
+ */
+-(NSTimeInterval) remainingTime;
+
+/*!
+ * Determines if the receiving token is already cancelled, or will be cancelled by its deadline within the given amount of time.
+ *
+ * @param durationInSeconds How long the caller needs, e.g. the expected duration of some work.
+ *
+ * @discussion Returns false for tokens without a deadline (including the nil token), unless they are already cancelled.
+ */
+-(bool) willBeCancelledWithin:(NSTimeInterval)durationInSeconds;
+
 // ---
 // note to self:
 // do NOT include an isImmortal method. A nil cancel token is supposed to act like an immortal token, but [nil isImmortal] would return false
@@ -131,6 +166,19 @@ typedef void (^TOCCancelHandler)(void);
  */
 -(void)whenCancelledDo:(TOCCancelHandler)cancelHandler;
 
+/*!
+ * Registers a cancel handler block to be run, using the given executor, once the receiving token is cancelled.
+ *
+ * @param cancelHandler The block to run once the token is cancelled.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion Otherwise behaves like whenCancelledDo:.
+ * When the token is already cancelled, the handler is only run inline if the executor runs blocks inline on the calling thread.
+ */
+-(void)whenCancelledDo:(TOCCancelHandler)cancelHandler
+                    on:(id<TOCExecutor>)executor;
+
 /*!
  * Registers a cancel handler block to be called once the receiving token is cancelled, unless another token is cancelled before the handler runs.
  *
@@ -159,6 +207,17 @@ typedef void (^TOCCancelHandler)(void);
 -(void) whenCancelledDo:(TOCCancelHandler)cancelHandler
                  unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like whenCancelledDo:unless:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion If the unlessCancelledToken is cancelled while the handler is waiting for the executor to run it, the handler is discarded without being run.
+ */
+-(void) whenCancelledDo:(TOCCancelHandler)cancelHandler
+                     on:(id<TOCExecutor>)executor
+                 unless:(TOCCancelToken*)unlessCancelledToken;
+
 @end
 
 /*!
@@ -202,6 +261,8 @@ typedef void (^TOCCancelHandler)(void);
  * @result A cancel token source that depends on the given cancel token.
  *
  * @discussion The returned cancel token source can still be cancelled normally.
+ *
+ * The returned source's token has the same deadline as the given token, if it has one.
  */
 +(TOCCancelTokenSource*) cancelTokenSourceUntil:(TOCCancelToken*)untilCancelledToken;
 
@@ -1,15 +1,34 @@
 #import "TOCCancelTokenAndSource.h"
 #import "TOCFutureAndSource.h"
 #import "TOCInternal.h"
-#include <libkern/OSAtomic.h>
-
-typedef void (^Remover)(void);
-typedef void (^SettledHandler)(void);
+#include <stdatomic.h>
 
 @implementation TOCCancelToken {
-@private NSMutableArray* _cancelHandlers;
-@private NSMutableSet* _removableSettledHandlers; // run when the token is cancelled or immortal
-@private enum TOCCancelTokenState _state;
+/// Holds an enum TOCCancelTokenState. Only ever transitions away from StillCancellable, at most once.
+@private atomic_int _state;
+/// Cancel handlers, and removable settled handlers (run when the token is cancelled or immortal)
+/// Closed right after the state transitions away from StillCancellable
+@private TOCInternal_HandlerStack _handlers;
+/// The monotonic time by which the token will be cancelled, or INFINITY. Only set while the token is being made.
+@private NSTimeInterval _deadlineTime;
+/// The number identifying this token in traces, or 0 until it is needed
+@private _Atomic(uint64_t) _traceId;
+}
+
+-(instancetype) init {
+    if (self = [super init]) {
+        TOCInternal_count(TOCInternal_Counter_CancelTokensCreated);
+        _deadlineTime = INFINITY;
+    }
+    return self;
+}
+
+-(void) dealloc {
+    TOCInternal_count(TOCInternal_Counter_CancelTokensDeallocated);
+}
+
+-(uint64_t) _traceId {
+    return TOCInternal_traceIdIn(&_traceId);
 }
 
 +(TOCCancelToken *)cancelledToken {
@@ -17,7 +36,8 @@ typedef void (^SettledHandler)(void);
     static TOCCancelToken* token = nil;
     dispatch_once(&once, ^{
         token = [TOCCancelToken new];
-        token->_state = TOCCancelTokenState_Cancelled;
+        atomic_store_explicit(&token->_state, TOCCancelTokenState_Cancelled, memory_order_release);
+        TOCInternal_HandlerStack_closeAndRun(&token->_handlers, true);
     });
     return token;
 }
@@ -28,66 +48,46 @@ typedef void (^SettledHandler)(void);
     dispatch_once(&once, ^{
         token = [TOCCancelToken new];
         // default state should be immortal
-        assert(token->_state == TOCCancelTokenState_Immortal);
+        assert(token.state == TOCCancelTokenState_Immortal);
+        TOCInternal_HandlerStack_closeAndRun(&token->_handlers, false);
     });
     return token;
 }
 
 +(TOCCancelToken*) _ForSource_cancellableToken {
     TOCCancelToken* token = [TOCCancelToken new];
-    token->_cancelHandlers = [NSMutableArray array];
-    token->_removableSettledHandlers = [NSMutableSet set];
-    token->_state = TOCCancelTokenState_StillCancellable;
+    atomic_store_explicit(&token->_state, TOCCancelTokenState_StillCancellable, memory_order_release);
     return token;
 }
--(bool) _ForSource_tryImmortalize {
-    NSSet* settledHandlersSnapshot;
-    @synchronized(self) {
-        if (_state != TOCCancelTokenState_StillCancellable) return false;
-        _state = TOCCancelTokenState_Immortal;
-        
-        // need to copy+clear settled handlers, instead of just nil-ing the ref, because indirect references to it escape and may be kept alive indefinitely
-        settledHandlersSnapshot = [_removableSettledHandlers copy];
-        [_removableSettledHandlers removeAllObjects];
-        _removableSettledHandlers = nil;
-        
-        _cancelHandlers = nil;
+-(bool) _trySettleInto:(enum TOCCancelTokenState)finalState {
+    int expected = TOCCancelTokenState_StillCancellable;
+    if (!atomic_compare_exchange_strong_explicit(&_state,
+                                                 &expected,
+                                                 finalState,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire)) {
+        return false;
     }
-    
-    for (SettledHandler handler in settledHandlersSnapshot) {
-        handler();
+    TOCInternal_count(finalState == TOCCancelTokenState_Cancelled
+                      ? TOCInternal_Counter_CancelTokensCancelled
+                      : TOCInternal_Counter_CancelTokensImmortalized);
+    if (finalState == TOCCancelTokenState_Cancelled && TOCInternal_isTracing()) {
+        TOCInternal_trace(TOCInternal_TraceEvent_TokenCancelled, self._traceId, 0, 0);
     }
+    
+    // registrations that lose the race against this close will see the final state set above
+    TOCInternal_HandlerStack_closeAndRun(&_handlers, finalState == TOCCancelTokenState_Cancelled);
     return true;
 }
+-(bool) _ForSource_tryImmortalize {
+    return [self _trySettleInto:TOCCancelTokenState_Immortal];
+}
 -(bool) _ForSource_tryCancel {
-    NSArray* cancelHandlersSnapshot;
-    NSSet* settledHandlersSnapshot;
-    @synchronized(self) {
-        if (_state != TOCCancelTokenState_StillCancellable) return false;
-        _state = TOCCancelTokenState_Cancelled;
-        
-        cancelHandlersSnapshot = _cancelHandlers;
-        _cancelHandlers = nil;
-        
-        // need to copy+clear settled handlers, instead of just nil-ing the ref, because indirect references to it escape and may be kept alive indefinitely
-        settledHandlersSnapshot = [_removableSettledHandlers copy];
-        [_removableSettledHandlers removeAllObjects];
-        _removableSettledHandlers = nil;
-    }
-    
-    for (TOCCancelHandler handler in cancelHandlersSnapshot) {
-        handler();
-    }
-    for (SettledHandler handler in settledHandlersSnapshot) {
-        handler();
-    }
-    return true;
+    return [self _trySettleInto:TOCCancelTokenState_Cancelled];
 }
 
 -(enum TOCCancelTokenState)state {
-    @synchronized(self) {
-        return _state;
-    }
+    return (enum TOCCancelTokenState)atomic_load_explicit(&_state, memory_order_acquire);
 }
 -(bool)isAlreadyCancelled {
     return self.state == TOCCancelTokenState_Cancelled;
@@ -95,61 +95,66 @@ typedef void (^SettledHandler)(void);
 -(bool)canStillBeCancelled {
     return self.state == TOCCancelTokenState_StillCancellable;
 }
-
--(TOCCancelHandler) _preserveMainThreadness:(TOCCancelHandler)cancelHandler {
-    if (!NSThread.isMainThread) return cancelHandler;
-    
-    return ^{ [TOCInternal_BlockObject performBlock:cancelHandler
-                                           onThread:NSThread.mainThread]; };
+-(bool)_hasBeenTriggered {
+    return self.isAlreadyCancelled;
 }
 
--(TOCCancelHandler) _preserveMainThreadness:(TOCCancelHandler)cancelHandler
-                                   andCheck:(TOCCancelToken*)unlessCancelledToken {
-    if (!NSThread.isMainThread) return cancelHandler;
-    
-    return [self _preserveMainThreadness:^{
-        // do a final check, to help the caller out
-        // consider: if the unless token was cancelled after this token, but before the callback reached the main thread
-        // in that situation, the caller may have already done UI things based on observing that the token was cancelled
-        // they may be *extremely* surprised by the callback running their cleanup stuff again
-        // we don't want to surprise them, so we do this polite check before calling
-        if (unlessCancelledToken.isAlreadyCancelled) return;
-        
-        cancelHandler();
-    }];
+-(NSTimeInterval) _deadlineTime {
+    return _deadlineTime;
+}
+-(void) _initDeadlineTime:(NSTimeInterval)deadlineTime {
+    _deadlineTime = MIN(_deadlineTime, deadlineTime);
+}
+-(NSDate*) deadline {
+    if (_deadlineTime == INFINITY) return nil;
+    if (self.state == TOCCancelTokenState_Immortal) return nil;
+    return [NSDate dateWithTimeIntervalSinceNow:_deadlineTime - TOCInternal_monotonicNow()];
+}
+-(NSTimeInterval) remainingTime {
+    if (self.isAlreadyCancelled) return 0;
+    if (_deadlineTime == INFINITY) return INFINITY;
+    if (self.state == TOCCancelTokenState_Immortal) return INFINITY;
+    return MAX(0, _deadlineTime - TOCInternal_monotonicNow());
+}
+-(bool) willBeCancelledWithin:(NSTimeInterval)durationInSeconds {
+    TOCInternal_need(!isnan(durationInSeconds));
+    return self.remainingTime <= durationInSeconds;
 }
 
 -(void)whenCancelledDo:(TOCCancelHandler)cancelHandler {
+    [self whenCancelledDo:cancelHandler on:nil];
+}
+
+-(void)whenCancelledDo:(TOCCancelHandler)cancelHandler
+                    on:(id<TOCExecutor>)executor {
     TOCInternal_need(cancelHandler != nil);
+    executor = TOCInternal_resolveExecutor(executor);
     
-    @synchronized(self) {
-        if (_state == TOCCancelTokenState_Immortal) return;
-        if (_state == TOCCancelTokenState_StillCancellable) {
-            TOCCancelHandler safeHandler = [self _preserveMainThreadness:cancelHandler];
-            [_cancelHandlers addObject:safeHandler];
-            return;
-        }
+    enum TOCCancelTokenState state = self.state;
+    if (state == TOCCancelTokenState_StillCancellable) {
+        TOCCancelHandler safeHandler = TOCInternal_executedBy(executor, cancelHandler, nil);
+        if (TOCInternal_HandlerStack_tryPush(&_handlers, safeHandler, TOCInternal_HandlerKind_OnTrigger) != nil) return;
+        
+        // the token settled concurrently, so its state is now final
+        state = self.state;
     }
     
-    cancelHandler();
+    if (state == TOCCancelTokenState_Cancelled) {
+        if (TOCInternal_executesInlineHere(executor)) {
+            cancelHandler();
+        } else {
+            [executor execute:cancelHandler];
+        }
+    }
 }
 
--(Remover)_removable_whenSettledDo:(SettledHandler)settledHandler {
+-(TOCInternal_Remover)_removable_whenSettledDo:(TOCInternal_SettledHandler)settledHandler {
     TOCInternal_need(settledHandler != nil);
-    @synchronized(self) {
-        if (_state == TOCCancelTokenState_StillCancellable) {
-            // to ensure we don't end up with two distinct copies of the block, move it to a local
-            // (otherwise one copy will be made when adding to the array, and another when storing to the remove closure)
-            // (so without this line, the added handler wouldn't be guaranteed removable, because the remover will try to remove the wrong instance)
-            SettledHandler singleCopyOfHandler = [settledHandler copy];
-            
-            [_removableSettledHandlers addObject:singleCopyOfHandler];
-            
-            return ^{
-                @synchronized(self) {
-                    [self->_removableSettledHandlers removeObject:singleCopyOfHandler];
-                }
-            };
+    
+    if (self.state == TOCCancelTokenState_StillCancellable) {
+        TOCInternal_HandlerNode* node = TOCInternal_HandlerStack_tryPush(&_handlers, settledHandler, TOCInternal_HandlerKind_OnSettle);
+        if (node != nil) {
+            return ^{ TOCInternal_HandlerStack_remove(&self->_handlers, node); };
         }
     }
     
@@ -159,49 +164,37 @@ typedef void (^SettledHandler)(void);
 
 -(void) whenCancelledDo:(TOCCancelHandler)cancelHandler
                  unless:(TOCCancelToken*)unlessCancelledToken {
+    [self whenCancelledDo:cancelHandler on:nil unless:unlessCancelledToken];
+}
+
+-(void) whenCancelledDo:(TOCCancelHandler)cancelHandler
+                     on:(id<TOCExecutor>)executor
+                 unless:(TOCCancelToken*)unlessCancelledToken {
     TOCInternal_need(cancelHandler != nil);
     
-    // fair warning: the following code is very difficult to get right.
-    
     // optimistically do less work
     enum TOCCancelTokenState peekOtherState = unlessCancelledToken.state;
     if (peekOtherState == TOCCancelTokenState_Immortal) {
-        [self whenCancelledDo:cancelHandler];
+        [self whenCancelledDo:cancelHandler on:executor];
         return;
     }
     if (unlessCancelledToken == self || peekOtherState == TOCCancelTokenState_Cancelled) {
         return;
     }
     
-    // make a block that must be called twice to break the cancelling-each-other cycle
-    // that way we can be sure we don't touch an un-initialized part of the cycle, by making one call only once setup is complete
-    __block int callCount = 0;
-    __block Remover removeHandlerFromOtherToSelf = nil;
-    Remover onSecondCallRemoveHandlerFromOtherToSelf = ^{
-        if (OSAtomicIncrement32Barrier(&callCount) == 1) return;
-        if (removeHandlerFromOtherToSelf == nil) return; // only occurs when the handler was already run and discarded anyways
-        removeHandlerFromOtherToSelf();
-        removeHandlerFromOtherToSelf = nil;
-    };
-    
-    // make the cancel-each-other cycle, running the cancel handler if self is cancelled first
-    TOCCancelHandler safeHandler = [self _preserveMainThreadness:cancelHandler
-                                                        andCheck:unlessCancelledToken];
-    __block Remover removeHandlerFromSelfToOther = [self _removable_whenSettledDo:^(){
+    [self _whenCancelledDo:cancelHandler on:executor unlessSettled:unlessCancelledToken];
+}
+
+-(void) _whenCancelledDo:(TOCCancelHandler)cancelHandler
+                      on:(id<TOCExecutor>)executor
+           unlessSettled:(id<TOCInternal_Settleable>)other {
+    TOCCancelHandler safeHandler = TOCInternal_executedBy(TOCInternal_resolveExecutor(executor), cancelHandler, other);
+    TOCInternal_whenSettledDoUnlessSettled(self, ^{
         // note: this self-reference is fine because it doesn't involve self's source, and gets cleared if the source is deallocated
-        if (self->_state == TOCCancelTokenState_Cancelled) {
+        if (self.state == TOCCancelTokenState_Cancelled) {
             safeHandler();
         }
-        onSecondCallRemoveHandlerFromOtherToSelf();
-    }];
-    removeHandlerFromOtherToSelf = [unlessCancelledToken _removable_whenSettledDo:^() {
-        if (removeHandlerFromSelfToOther == nil) return; // only occurs when the handler was already run and discarded anyways
-        removeHandlerFromSelfToOther();
-        removeHandlerFromSelfToOther = nil;
-    }];
-    
-    // allow the cycle to be broken
-    onSecondCallRemoveHandlerFromOtherToSelf();
+    }, other);
 }
 
 -(NSString*) description {
@@ -226,6 +219,7 @@ typedef void (^SettledHandler)(void);
 -(TOCCancelTokenSource*) init {
     self = [super init];
     if (self) {
+        TOCInternal_count(TOCInternal_Counter_CancelTokenSourcesCreated);
         self->token = [TOCCancelToken _ForSource_cancellableToken];
     }
     return self;
@@ -233,12 +227,16 @@ typedef void (^SettledHandler)(void);
 
 +(TOCCancelTokenSource*) cancelTokenSourceUntil:(TOCCancelToken*)untilCancelledToken {
     TOCCancelTokenSource* source = [TOCCancelTokenSource new];
+    if (untilCancelledToken != nil) {
+        [source.token _initDeadlineTime:untilCancelledToken._deadlineTime];
+    }
     [untilCancelledToken whenCancelledDo:^{ [source cancel]; }
                                   unless:source.token];
     return source;
 }
 
 -(void) dealloc {
+    TOCInternal_count(TOCInternal_Counter_CancelTokenSourcesDeallocated);
     [token _ForSource_tryImmortalize];
 }
 -(void) cancel {
@@ -0,0 +1,55 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+
+/*!
+ * Hands out a fixed set of futures one at a time, in the order that they complete.
+ *
+ * @discussion Get a completion stream by using toc_completionStreamUnless: on an array of futures, or completionStreamOf:unless:.
+ *
+ * Use `next` to get a future for the next input to complete.
+ * Futures returned by `next` complete in order: the first one matches whichever input completes first, the second whichever completes second, and so on.
+ * You don't have to wait for one to complete before asking for the next, so work on each item can be started (or pipelined) as it lands.
+ *
+ * A completion stream only remembers inputs that completed but haven't been asked for yet, and futures that were asked for but haven't completed yet.
+ * Memory use is proportional to how far the consumer is ahead of or behind the inputs, not to the number of inputs.
+ *
+ * TOCCompletionStream is thread safe.
+ */
+@interface TOCCompletionStream : NSObject
+
+/*!
+ * Returns a completion stream that hands out the given futures in the order they complete, unless cancelled.
+ *
+ * @param futures The futures to hand out. Must all be instances of TOCFuture.
+ *
+ * @param unlessCancelledToken When this token is cancelled, futures waiting to be matched with an input fail with a cancellation.
+ * So do futures asked for afterwards. Completed inputs that haven't been handed out yet are dropped.
+ * A nil cancel token corresponds to an immortal cancel token.
+ *
+ * @discussion The stream does not keep the array, or any input after it has been handed out, alive.
+ */
++(TOCCompletionStream*) completionStreamOf:(NSArray*)futures
+                                    unless:(TOCCancelToken*)unlessCancelledToken;
+
+/*!
+ * Returns a future that will match the next input to complete, in the order they complete.
+ *
+ * @pre There must be items remaining (i.e. remainingCount must be greater than zero).
+ *
+ * @result A future matching the result or failure of the next input to complete.
+ * If the input has already completed, it is returned as-is.
+ * If the stream's cancel token is cancelled before an input can be handed out, the future fails with a cancellation.
+ * @see hasFailedWithCancel
+ *
+ * @discussion Inputs that will never complete (i.e. that are immortal) are skipped.
+ * Once all of the other inputs have been handed out, the futures returned for them are immortal.
+ */
+-(TOCFuture*) next;
+
+/*!
+ * Returns the number of times `next` can still be called, i.e. the number of inputs that haven't been handed out yet.
+ */
+-(NSUInteger) remainingCount;
+
+@end
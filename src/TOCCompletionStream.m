@@ -0,0 +1,171 @@
+#import "TOCCompletionStream.h"
+#import "TOCInternal.h"
+
+@implementation TOCCompletionStream {
+/// The number of times next can still be called
+@private NSUInteger _remainingCount;
+/// The number of inputs that haven't completed or become immortal yet
+@private NSUInteger _unsettledCount;
+@private bool _isCancelled;
+/// Cancelled once every input has settled, at which point there's nothing left for the unless token to cancel
+@private TOCCancelTokenSource* _allInputsSettledSource;
+
+/// A ring buffer holding either completed inputs that haven't been handed out (oldest first),
+/// or sources for handed out futures that are waiting for an input (oldest first). Never both at once.
+/// Slots hold retained references.
+@private void** _ring;
+@private NSUInteger _ringCapacity;
+@private NSUInteger _ringStart;
+@private NSUInteger _ringCount;
+/// Whether the ring holds waiting sources, as opposed to completed inputs. Only meaningful when the ring isn't empty.
+@private bool _ringHoldsWaiters;
+}
+
++(TOCCompletionStream*) completionStreamOf:(NSArray*)futures
+                                    unless:(TOCCancelToken*)unlessCancelledToken {
+    futures = [futures copy]; // remove volatility (i.e. ensure not externally mutable)
+    TOCInternal_need([futures allItemsAreKindOfClass:[TOCFuture class]]);
+    
+    TOCCompletionStream* stream = [TOCCompletionStream new];
+    stream->_remainingCount = futures.count;
+    stream->_unsettledCount = futures.count + 1; // one extra, for setting up
+    stream->_allInputsSettledSource = [TOCCancelTokenSource new];
+    
+    [unlessCancelledToken _whenCancelledDo:^{ [stream _cancel]; }
+                                        on:TOCExecutors.inlineExecutor
+                             unlessSettled:stream->_allInputsSettledSource.token];
+    
+    for (TOCFuture* item in futures) {
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the item settles.
+        [item _whenSettledDo:^{ [stream _inputSettled:item]; }];
+    }
+    
+    [stream _inputSettled:nil];
+    return stream;
+}
+
+-(void) dealloc {
+    while (_ringCount > 0) {
+        (void)[self _ringPop];
+    }
+    free(_ring);
+}
+
+/// Must be called while synchronized on self.
+-(void) _ringPush:(id)item {
+    if (_ringCount == _ringCapacity) {
+        // grow, unrolling the ring so that it starts at the beginning of the new storage
+        NSUInteger newCapacity = _ringCapacity == 0 ? 8 : _ringCapacity * 2;
+        void** newRing = malloc(newCapacity * sizeof(void*));
+        TOCInternal_force(newRing != NULL);
+        for (NSUInteger i = 0; i < _ringCount; i++) {
+            newRing[i] = _ring[(_ringStart + i) % _ringCapacity];
+        }
+        free(_ring);
+        _ring = newRing;
+        _ringCapacity = newCapacity;
+        _ringStart = 0;
+    }
+    
+    _ring[(_ringStart + _ringCount) % _ringCapacity] = (__bridge_retained void*)item;
+    _ringCount += 1;
+}
+/// Must be called while synchronized on self, with the ring not empty.
+-(id) _ringPop {
+    id item = (__bridge_transfer id)_ring[_ringStart];
+    _ring[_ringStart] = NULL;
+    _ringStart = (_ringStart + 1) % _ringCapacity;
+    _ringCount -= 1;
+    return item;
+}
+/// Must be called while synchronized on self.
+-(NSArray*) _ringPopAll {
+    NSMutableArray* items = [NSMutableArray arrayWithCapacity:_ringCount];
+    while (_ringCount > 0) {
+        [items addObject:[self _ringPop]];
+    }
+    return items;
+}
+
+/// Called once for each input, when it completes or becomes immortal, and once (with nil) when setup is done.
+-(void) _inputSettled:(TOCFuture*)input {
+    TOCFutureSource* waiter = nil;
+    NSArray* abandonedWaiters = nil;
+    bool allInputsSettled;
+    @synchronized(self) {
+        _unsettledCount -= 1;
+        allInputsSettled = _unsettledCount == 0;
+        
+        if (!_isCancelled && input != nil && !input.isIncomplete) {
+            if (_ringCount > 0 && _ringHoldsWaiters) {
+                waiter = [self _ringPop];
+            } else {
+                _ringHoldsWaiters = false;
+                [self _ringPush:input];
+            }
+        }
+        
+        // waiters beyond the inputs that completed were waiting on immortal inputs, and will never get anything
+        if (allInputsSettled && _ringCount > 0 && _ringHoldsWaiters) {
+            abandonedWaiters = [self _ringPopAll];
+        }
+    }
+    
+    // (sources are set outside the lock, since setting them runs arbitrary handlers)
+    [waiter trySetResult:input];
+    if (allInputsSettled) [_allInputsSettledSource cancel];
+    
+    // dropping the abandoned waiters' sources makes their futures immortal
+    abandonedWaiters = nil;
+}
+
+-(void) _cancel {
+    NSArray* waiters = nil;
+    @synchronized(self) {
+        if (_isCancelled) return;
+        _isCancelled = true;
+        
+        // completed inputs that haven't been handed out are dropped, waiters are cancelled
+        NSArray* items = [self _ringPopAll];
+        if (_ringHoldsWaiters) waiters = items;
+    }
+    
+    for (TOCFutureSource* waiter in waiters) {
+        [waiter trySetFailedWithCancel];
+    }
+}
+
+-(TOCFuture*) next {
+    @synchronized(self) {
+        TOCInternal_need(_remainingCount > 0);
+        _remainingCount -= 1;
+        
+        if (_isCancelled) {
+            return [TOCFuture futureWithFailure:TOCCancelToken.cancelledToken];
+        }
+        if (_ringCount > 0 && !_ringHoldsWaiters) {
+            return [self _ringPop];
+        }
+        if (_unsettledCount == 0) {
+            // everything that was going to complete has been handed out, and the rest is immortal
+            return [TOCFutureSource new].future;
+        }
+        
+        TOCFutureSource* waiter = [TOCFutureSource new];
+        _ringHoldsWaiters = true;
+        [self _ringPush:waiter];
+        return waiter.future;
+    }
+}
+
+-(NSUInteger) remainingCount {
+    @synchronized(self) {
+        return _remainingCount;
+    }
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Completion Stream with %lu remaining", (unsigned long)self.remainingCount];
+}
+
+@end
@@ -0,0 +1,98 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * Something that runs blocks, such as the handlers and continuations registered on futures and cancel tokens.
+ *
+ * @discussion An executor decides where (and when) a block runs: inline, on a dispatch queue, on the main thread, and so forth.
+ *
+ * Executors must run every block given to them exactly once, eventually.
+ * They must not run a block before execute returns, unless they run it inline (i.e. during the call to execute).
+ *
+ * Use TOCExecutors to get the stock executors.
+ */
+@protocol TOCExecutor <NSObject>
+
+/*!
+ * Eventually runs the given block.
+ *
+ * @param block The block to run. Must not be nil.
+ *
+ * @discussion May run the block inline, before returning to the caller.
+ */
+-(void) execute:(void(^)(void))block;
+
+@end
+
+/*!
+ * Creates the stock executors.
+ */
+@interface TOCExecutors : NSObject
+
+/*!
+ * Returns an executor that runs blocks inline, on whichever thread gives them to it.
+ *
+ * @discussion Handlers run by the inline executor run on the thread that completed the future or cancelled the token.
+ * They should be short, because they delay everything else that thread was going to do.
+ */
++(id<TOCExecutor>) inlineExecutor;
+
+/*!
+ * Returns an executor that asynchronously dispatches blocks onto the given dispatch queue.
+ *
+ * @param queue The queue to dispatch onto. Must not be nil.
+ *
+ * @discussion Use a global concurrent queue to keep heavy continuations off of the thread that completed a future.
+ */
++(id<TOCExecutor>) executorOnQueue:(dispatch_queue_t)queue;
+
+/*!
+ * Returns an executor that asynchronously dispatches blocks onto the main dispatch queue.
+ *
+ * @discussion Blocks are always dispatched, even when given to the executor from the main thread.
+ */
++(id<TOCExecutor>) mainQueueExecutor;
+
+/*!
+ * Returns a new executor that runs the blocks given to it one at a time, in the order they were given, using the given executor.
+ *
+ * @param underlyingExecutor The executor used to actually run blocks. Must not be nil.
+ *
+ * @discussion A serial executor never has more than one block running (or waiting to run) on the underlying executor.
+ * Blocks given to it while it is busy are queued up, and run by the same underlying execution once the current block finishes.
+ *
+ * Useful for bounding how much of a concurrent queue some kind of continuation can use, or for protecting state that isn't thread safe.
+ */
++(id<TOCExecutor>) serialExecutorOn:(id<TOCExecutor>)underlyingExecutor;
+
+/*!
+ * Returns the executor used when no executor is specified, based on the current thread.
+ *
+ * @discussion On the main thread, this is an executor that runs blocks on the main thread (inline, if they are given to it on the main thread).
+ * On any other thread, this is the inline executor.
+ *
+ * This is why handlers registered from the main thread, without specifying an executor, are guaranteed to also run on the main thread.
+ */
++(id<TOCExecutor>) defaultExecutor;
+
+/*!
+ * Returns how deeply handlers run inline by completing futures and cancelling tokens may nest, before they get queued instead.
+ *
+ * @discussion When a handler completes a future (e.g. a 'then' continuation setting its result) that future's handlers run inside it.
+ * A long chain of dependent futures would recurse once per link, and eventually overflow the stack.
+ * Instead, once this many runs are nested, further runs are queued and done iteratively by the outermost run on the same thread.
+ * Everything still runs before the outermost call (e.g. the trySetResult that started it) returns.
+ *
+ * Defaults to 16.
+ */
++(NSUInteger) inlineNestingLimit;
+
+/*!
+ * Sets how deeply handlers run inline by completing futures and cancelling tokens may nest, before they get queued instead.
+ *
+ * @param limit The new limit. Zero means handlers never nest: runs started by handlers are always queued.
+ *
+ * @discussion Affects all threads. Smaller limits use less stack, larger limits keep handlers closer to the order they would run in without queueing.
+ */
++(void) setInlineNestingLimit:(NSUInteger)limit;
+
+@end
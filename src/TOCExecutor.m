@@ -0,0 +1,142 @@
+#import "TOCExecutor.h"
+#import "TOCInternal.h"
+
+@interface TOCInternal_InlineExecutor : NSObject <TOCExecutor>
+@end
+
+@implementation TOCInternal_InlineExecutor
+
+-(void) execute:(void(^)(void))block {
+    TOCInternal_need(block != nil);
+    block();
+}
+
+-(NSString*) description {
+    return @"Inline Executor";
+}
+
+@end
+
+@interface TOCInternal_QueueExecutor : NSObject <TOCExecutor>
+@end
+
+@implementation TOCInternal_QueueExecutor {
+@private dispatch_queue_t _queue;
+}
+
++(TOCInternal_QueueExecutor*) queueExecutorOn:(dispatch_queue_t)queue {
+    TOCInternal_need(queue != nil);
+
+    TOCInternal_QueueExecutor* executor = [TOCInternal_QueueExecutor new];
+    executor->_queue = queue;
+    return executor;
+}
+
+-(void) execute:(void(^)(void))block {
+    TOCInternal_need(block != nil);
+    if (_queue == dispatch_get_main_queue()) TOCInternal_count(TOCInternal_Counter_MainThreadHops);
+    dispatch_async(_queue, block);
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Queue Executor: %s", dispatch_queue_get_label(_queue)];
+}
+
+@end
+
+@interface TOCInternal_SerialExecutor : NSObject <TOCExecutor>
+@end
+
+@implementation TOCInternal_SerialExecutor {
+@private id<TOCExecutor> _underlyingExecutor;
+/// Blocks given to the executor that haven't started running yet, in the order they were given
+@private NSMutableArray* _pendingBlocks;
+/// Whether or not a drain has been given to the underlying executor, and hasn't found the pending blocks empty yet
+@private bool _isDraining;
+}
+
++(TOCInternal_SerialExecutor*) serialExecutorOn:(id<TOCExecutor>)underlyingExecutor {
+    TOCInternal_need(underlyingExecutor != nil);
+
+    TOCInternal_SerialExecutor* executor = [TOCInternal_SerialExecutor new];
+    executor->_underlyingExecutor = underlyingExecutor;
+    executor->_pendingBlocks = [NSMutableArray array];
+    return executor;
+}
+
+-(void) execute:(void(^)(void))block {
+    TOCInternal_need(block != nil);
+
+    @synchronized(self) {
+        [_pendingBlocks addObject:[block copy]];
+        if (_isDraining) return;
+        _isDraining = true;
+    }
+
+    [_underlyingExecutor execute:^{ [self _drain]; }];
+}
+
+-(void) _drain {
+    while (true) {
+        void (^block)(void);
+        @synchronized(self) {
+            if (_pendingBlocks.count == 0) {
+                _isDraining = false;
+                return;
+            }
+            block = _pendingBlocks[0];
+            [_pendingBlocks removeObjectAtIndex:0];
+        }
+
+        block();
+    }
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Serial Executor on %@", _underlyingExecutor];
+}
+
+@end
+
+@implementation TOCExecutors
+
++(id<TOCExecutor>) inlineExecutor {
+    static dispatch_once_t once;
+    static TOCInternal_InlineExecutor* executor = nil;
+    dispatch_once(&once, ^{
+        executor = [TOCInternal_InlineExecutor new];
+    });
+    return executor;
+}
+
++(id<TOCExecutor>) executorOnQueue:(dispatch_queue_t)queue {
+    return [TOCInternal_QueueExecutor queueExecutorOn:queue];
+}
+
++(id<TOCExecutor>) mainQueueExecutor {
+    static dispatch_once_t once;
+    static TOCInternal_QueueExecutor* executor = nil;
+    dispatch_once(&once, ^{
+        executor = [TOCInternal_QueueExecutor queueExecutorOn:dispatch_get_main_queue()];
+    });
+    return executor;
+}
+
++(id<TOCExecutor>) serialExecutorOn:(id<TOCExecutor>)underlyingExecutor {
+    return [TOCInternal_SerialExecutor serialExecutorOn:underlyingExecutor];
+}
+
++(id<TOCExecutor>) defaultExecutor {
+    if (NSThread.isMainThread) return TOCInternal_mainThreadExecutor();
+    return self.inlineExecutor;
+}
+
++(NSUInteger) inlineNestingLimit {
+    return TOCInternal_HandlerList_nestingLimit_get();
+}
+
++(void) setInlineNestingLimit:(NSUInteger)limit {
+    TOCInternal_HandlerList_nestingLimit_set(limit);
+}
+
+@end
@@ -78,6 +78,54 @@
  */
 -(void) finallyDo:(TOCFutureFinallyHandler)completionHandler;
 
+/*!
+ * Like then:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
+                on:(id<TOCExecutor>)executor;
+
+/*!
+ * Like catch:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
+                 on:(id<TOCExecutor>)executor;
+
+/*!
+ * Like finally:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
+                   on:(id<TOCExecutor>)executor;
+
+/*!
+ * Like thenDo:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(void) thenDo:(TOCFutureThenHandler)resultHandler
+            on:(id<TOCExecutor>)executor;
+
+/*!
+ * Like catchDo:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(void) catchDo:(TOCFutureCatchHandler)failureHandler
+             on:(id<TOCExecutor>)executor;
+
+/*!
+ * Like finallyDo:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ */
+-(void) finallyDo:(TOCFutureFinallyHandler)completionHandler
+               on:(id<TOCExecutor>)executor;
+
 /*!
  * Returns a future that will match the receiving future, except it immediately cancels if the given cancellation tokens is cancelled first.
  *
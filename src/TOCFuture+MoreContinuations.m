@@ -27,12 +27,47 @@
     return [self catch:failureContinuation unless:nil];
 }
 
+-(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
+                on:(id<TOCExecutor>)executor {
+    return [self then:resultContinuation on:executor unless:nil];
+}
+
+-(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
+                 on:(id<TOCExecutor>)executor {
+    return [self catch:failureContinuation on:executor unless:nil];
+}
+
+-(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
+                   on:(id<TOCExecutor>)executor {
+    return [self finally:completionContinuation on:executor unless:nil];
+}
+
+-(void) thenDo:(TOCFutureThenHandler)resultHandler
+            on:(id<TOCExecutor>)executor {
+    [self thenDo:resultHandler on:executor unless:nil];
+}
+
+-(void) catchDo:(TOCFutureCatchHandler)failureHandler
+             on:(id<TOCExecutor>)executor {
+    [self catchDo:failureHandler on:executor unless:nil];
+}
+
+-(void) finallyDo:(TOCFutureFinallyHandler)completionHandler
+               on:(id<TOCExecutor>)executor {
+    [self finallyDo:completionHandler on:executor unless:nil];
+}
+
 -(TOCFuture*) unless:(TOCCancelToken*)unlessCancelledToken {
     // optimistically do nothing, when given immortal cancel tokens
     if (unlessCancelledToken.state == TOCCancelTokenState_Immortal) {
         return self;
     }
     
+    // completed futures are immutable, and can't be affected by cancelling later
+    if (!self.isIncomplete && !unlessCancelledToken.isAlreadyCancelled) {
+        return self;
+    }
+    
     return [self finally:^(TOCFuture *completed) { return completed; }
                   unless:unlessCancelledToken];
 }
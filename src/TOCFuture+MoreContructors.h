@@ -2,6 +2,7 @@
 #import "TOCFutureAndSource.h"
 #import "TOCTypeDefs.h"
 #import "TOCTimeout.h"
+#import "TOCRetryPolicy.h"
 
 @interface TOCFuture (MoreConstructors)
 
@@ -54,9 +55,12 @@
  * A delay of INFINITY result in an immortal future that never completes.
  *
  * @param unlessCancelledToken If this token is cancelled before the delay expires, the future immediately fails with the cancel token as its failure.
- * Any resources being used for the delay, such as NSTimers, will also be immediately cleaned up upon cancellation.
+ * Any resources being used for the delay, such as the timer and the result value, will also be immediately cleaned up upon cancellation.
  *
  * @result A delayed future result, unless the delay is cancelled.
+ *
+ * @discussion All delays (and the timeouts built on them) share a single timer wheel, so pending delays cost a small fixed amount of memory each.
+ * The delay may end up to delayCoalescingLeeway late, so that it can complete together with other delays ending around the same time.
  */
 +(TOCFuture*) futureWithResult:(id)resultValue
                     afterDelay:(NSTimeInterval)delayInSeconds
@@ -77,6 +81,26 @@
 +(TOCFuture*) futureWithResult:(id)resultValue
                     afterDelay:(NSTimeInterval)delayInSeconds;
 
+/*!
+ * Returns how late, in seconds, delays and timeouts are allowed to end so that ones ending around the same time can be handled together.
+ *
+ * @discussion Deadlines are rounded up to a multiple of the leeway.
+ * A larger leeway means fewer timer wake ups when there are many pending delays, at the cost of less precise timing.
+ * Deadline tokens (e.g. from cancelledAfter:) report the rounded deadline, so their remainingTime doesn't reach zero before they are due to be cancelled.
+ *
+ * Defaults to one millisecond.
+ */
++(NSTimeInterval) delayCoalescingLeeway;
+
+/*!
+ * Sets how late, in seconds, delays and timeouts are allowed to end so that ones ending around the same time can be handled together.
+ *
+ * @param leewayInSeconds The new leeway. Must not be negative, NaN, or infinite.
+ *
+ * @discussion Affects delays started after the change. Delays that are already pending keep their deadlines.
+ */
++(void) setDelayCoalescingLeeway:(NSTimeInterval)leewayInSeconds;
+
 /*!
  * Returns a future that eventually contains the result, which lasts until the given token is cancelled, of an asynchronous operation as long as it completes before the given timeout.
  *
@@ -148,4 +172,33 @@
 +(TOCFuture*) futureFromUnlessOperation:(TOCUnlessOperation)asyncCancellableOperation
                             withTimeout:(NSTimeInterval)timeoutPeriodInSeconds;
 
+/*!
+ * Returns a future for the eventual result of an asynchronous operation, retrying it with randomized exponential backoff when it fails, unless cancelled.
+ *
+ * @param asyncCancellableOperation The cancellable asynchronous operation to evaluate, once per attempt.
+ *
+ * @param retryPolicy Determines how many attempts are made, how long to wait between them, which failures are retried, and the overall deadline.
+ * Must not be nil.
+ *
+ * @param unlessCancelledToken Cancelling this token cancels the current attempt, or the wait before the next attempt, and stops retrying.
+ * A nil cancel token corresponds to an immortal cancel token.
+ *
+ * @result The eventual result of the first attempt to succeed, or else the failure of the last attempt.
+ * Fails with a timeout (an instance of TOCTimeout) when the policy's total timeout cuts an attempt short,
+ * or with a cancellation when the given token is cancelled.
+ *
+ * @discussion Each attempt gets a token that is cancelled when the given token is cancelled, or when the policy's total timeout runs out.
+ * That token carries the total timeout's deadline, so operations can see how much time they have left.
+ * The result fails with a timeout as soon as the total timeout runs out, even if the attempt in flight ignores its token and never completes.
+ *
+ * Waiting between attempts doesn't hold up cancellation: the wait ends, and the result fails, as soon as the token is cancelled.
+ *
+ * Failures that the policy doesn't consider retryable, cancellations included, are propagated right away.
+ *
+ * @see TOCRetryPolicy
+ */
++(TOCFuture*) futureFromUnlessOperation:(TOCUnlessOperation)asyncCancellableOperation
+                        withRetryPolicy:(TOCRetryPolicy*)retryPolicy
+                                 unless:(TOCCancelToken*)unlessCancelledToken;
+
 @end
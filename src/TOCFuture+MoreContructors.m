@@ -2,6 +2,7 @@
 #import "TOCFuture+MoreContinuations.h"
 #import "TOCInternal.h"
 #import "NSArray+TOCFuture.h"
+#import "TOCCancelToken+MoreConstructors.h"
 
 @implementation TOCFuture (MoreConstructors)
 
@@ -49,7 +50,6 @@
     TOCInternal_need(!isnan(delayInSeconds));
     
     if (delayInSeconds == 0) return [TOCFuture futureWithResult:resultValue];
-    __block id resultValueBlock = resultValue;
     
     TOCFutureSource* resultSource = [TOCFutureSource new];
     if (delayInSeconds == INFINITY) return [resultSource.future unless:unlessCancelledToken];
@@ -57,20 +57,30 @@
     double delayInNanoseconds = delayInSeconds * NSEC_PER_SEC;
     TOCInternal_need(delayInNanoseconds < INT64_MAX/2);
     
-    dispatch_time_t then = dispatch_time(DISPATCH_TIME_NOW, (int64_t)delayInNanoseconds);
-    dispatch_after(then, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        [resultSource trySetResult:resultValueBlock];
-    });
-    [unlessCancelledToken whenCancelledDo:^{
+    TOCInternal_TimerWheelEntry* timer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [resultSource trySetResult:resultValue]; }
+                                                                                     afterDelay:delayInSeconds];
+    
+    // cancelling frees the timer's slot (and the result value) right away, instead of leaving it armed until it would have fired
+    [unlessCancelledToken _whenCancelledDo:^{
         if ([resultSource trySetFailedWithCancel]) {
-            resultValueBlock = nil;
+            [timer cancel];
         }
-    }];
-    
+    } on:TOCExecutors.inlineExecutor unlessSettled:resultSource.future];
     
     return resultSource.future;
 }
 
++(NSTimeInterval) delayCoalescingLeeway {
+    return TOCInternal_TimerWheel.sharedTimerWheel.coalescingLeeway;
+}
+
++(void) setDelayCoalescingLeeway:(NSTimeInterval)leewayInSeconds {
+    TOCInternal_need(leewayInSeconds >= 0);
+    TOCInternal_need(leewayInSeconds < INFINITY);
+    
+    TOCInternal_TimerWheel.sharedTimerWheel.coalescingLeeway = leewayInSeconds;
+}
+
 +(TOCFuture*) futureFromUntilOperation:(TOCUntilOperation)asyncOperationWithResultLastingUntilCancelled
                   withOperationTimeout:(NSTimeInterval)timeoutPeriodInSeconds
                                  until:(TOCCancelToken*)untilCancelledToken {
@@ -117,20 +127,32 @@
         return asyncCancellableOperation(unlessCancelledToken);
     }
     
-    // start the timeout countdown, making sure it cancels if the caller cancels
-    TOCFuture* futureTimeout = [TOCFuture futureWithResult:nil
-                                                afterDelay:timeoutPeriodInSeconds
-                                                    unless:unlessCancelledToken];
+    // when the caller's own deadline comes first, the timeout can't happen and doesn't need a timer
+    NSTimeInterval timeoutTime = TOCInternal_monotonicNow() + timeoutPeriodInSeconds;
+    if (unlessCancelledToken != nil && unlessCancelledToken._deadlineTime <= timeoutTime) {
+        return asyncCancellableOperation(unlessCancelledToken);
+    }
+    
+    // start the timeout countdown, as a deadline token that also cancels if the caller cancels
+    TOCCancelTokenSource* timeoutSource = [TOCCancelTokenSource new];
+    TOCInternal_TimerWheelEntry* timer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [timeoutSource cancel]; }
+                                                                                     afterDelay:timeoutPeriodInSeconds];
+    [timeoutSource.token _initDeadlineTime:timer.fireTime];
+    TOCCancelToken* operationToken = [TOCCancelToken matchFirstToCancelBetween:timeoutSource.token
+                                                                           and:unlessCancelledToken];
     
     // start the operation, ensuring it cancels if the timeout finishes or is cancelled
-    TOCFuture* futureOperationResult = asyncCancellableOperation(futureTimeout.cancelledOnCompletionToken);
+    TOCFuture* futureOperationResult = asyncCancellableOperation(operationToken);
     
     // wait for the operation to finish or be cancelled or timeout
     return [futureOperationResult finally:^(TOCFuture* completedOperationResult) {
+        // the timer isn't needed anymore (dropping it also lets the timeout token become immortal, releasing handlers on it)
+        [timer cancel];
+        
         // detect when cancellation was due to timeout, and report appropriately
         bool wasCancelled = completedOperationResult.hasFailedWithCancel;
         bool wasNotCancelledExternally = !unlessCancelledToken.isAlreadyCancelled;
-        bool wasTimeout = wasCancelled && wasNotCancelledExternally;
+        bool wasTimeout = wasCancelled && wasNotCancelledExternally && timeoutSource.token.isAlreadyCancelled;
         if (wasTimeout) {
             return [TOCFuture futureWithTimeoutFailure];
         }
@@ -150,4 +172,97 @@
                                     unless:nil];
 }
 
++(TOCFuture*) futureFromUnlessOperation:(TOCUnlessOperation)asyncCancellableOperation
+                        withRetryPolicy:(TOCRetryPolicy*)retryPolicy
+                                 unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(asyncCancellableOperation != nil);
+    TOCInternal_need(retryPolicy != nil);
+    
+    if (unlessCancelledToken.isAlreadyCancelled) {
+        return [TOCFuture futureWithCancelFailure];
+    }
+    
+    NSTimeInterval totalTimeout = retryPolicy.totalTimeout;
+    if (totalTimeout == INFINITY) {
+        return [self _attempt:0
+           ofRetriedOperation:asyncCancellableOperation
+              withRetryPolicy:retryPolicy
+                     deadline:INFINITY
+                       unless:unlessCancelledToken];
+    }
+    
+    // start the overall countdown, as a deadline token that also cancels if the caller cancels
+    NSTimeInterval deadlineTime = TOCInternal_monotonicNow() + totalTimeout;
+    TOCCancelTokenSource* timeoutSource = [TOCCancelTokenSource new];
+    TOCInternal_TimerWheelEntry* timer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [timeoutSource cancel]; }
+                                                                                     afterDelay:totalTimeout];
+    [timeoutSource.token _initDeadlineTime:timer.fireTime];
+    TOCCancelToken* attemptsToken = [TOCCancelToken matchFirstToCancelBetween:timeoutSource.token
+                                                                          and:unlessCancelledToken];
+    
+    TOCFuture* futureRetriedResult = [self _attempt:0
+                                 ofRetriedOperation:asyncCancellableOperation
+                                    withRetryPolicy:retryPolicy
+                                           deadline:deadlineTime
+                                             unless:attemptsToken];
+    
+    // the deadline settles the result by itself, instead of waiting for the attempt in flight to notice its cancellation
+    TOCFutureSource* resultSource = [TOCFutureSource new];
+    [timeoutSource.token whenCancelledDo:^{
+        if (unlessCancelledToken.isAlreadyCancelled) return;
+        [resultSource trySetFailedWithTimeout];
+    } on:TOCExecutors.inlineExecutor];
+    
+    [futureRetriedResult finallyDo:^(TOCFuture* completedRetriedResult) {
+        // the timer isn't needed anymore (dropping it also lets the timeout token become immortal, releasing handlers on it)
+        [timer cancel];
+        
+        // detect when cancellation was due to the overall deadline, and report appropriately
+        bool wasCancelled = completedRetriedResult.hasFailedWithCancel;
+        bool wasNotCancelledExternally = !unlessCancelledToken.isAlreadyCancelled;
+        bool wasTimeout = wasCancelled && wasNotCancelledExternally && timeoutSource.token.isAlreadyCancelled;
+        if (wasTimeout) {
+            [resultSource trySetFailedWithTimeout];
+            return;
+        }
+        
+        [resultSource trySetResult:completedRetriedResult];
+    } on:TOCExecutors.inlineExecutor unless:nil];
+    
+    return resultSource.future;
+}
+
+/// Runs the given attempt of a retried operation, and the attempts after it as needed.
++(TOCFuture*) _attempt:(NSUInteger)attemptIndex
+    ofRetriedOperation:(TOCUnlessOperation)asyncCancellableOperation
+       withRetryPolicy:(TOCRetryPolicy*)retryPolicy
+              deadline:(NSTimeInterval)deadlineTime
+                unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCFuture* futureAttemptResult = asyncCancellableOperation(unlessCancelledToken);
+    TOCInternal_need(futureAttemptResult != nil);
+    
+    return [futureAttemptResult catch:^id(id failure) {
+        bool isLastAttempt = attemptIndex + 1 >= retryPolicy.maxAttempts;
+        if (isLastAttempt || unlessCancelledToken.isAlreadyCancelled || ![retryPolicy shouldRetryFailure:failure]) {
+            return [TOCFuture futureWithFailure:failure];
+        }
+        
+        // no point waiting for a retry that the deadline won't allow
+        NSTimeInterval delay = [retryPolicy jitteredDelayBeforeRetry:attemptIndex];
+        if (TOCInternal_monotonicNow() + delay >= deadlineTime) {
+            return [TOCFuture futureWithFailure:failure];
+        }
+        
+        // a cancellation ends the wait right away, and skips the retry
+        TOCFuture* futureRetryTime = [TOCFuture futureWithResult:nil afterDelay:delay unless:unlessCancelledToken];
+        return [futureRetryTime then:^(id _) {
+            return [self _attempt:attemptIndex + 1
+               ofRetriedOperation:asyncCancellableOperation
+                  withRetryPolicy:retryPolicy
+                         deadline:deadlineTime
+                           unless:unlessCancelledToken];
+        } on:TOCExecutors.inlineExecutor unless:nil];
+    } on:TOCExecutors.inlineExecutor unless:nil];
+}
+
 @end
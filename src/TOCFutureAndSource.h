@@ -1,5 +1,6 @@
 #import <Foundation/Foundation.h>
 #import "TOCCancelTokenAndSource.h"
+#import "TOCExecutor.h"
 
 /*!
  * The states that a future can be in.
@@ -132,6 +133,7 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
  *
  * You can use isIncomplete/hasResult/hasFailed to determine if the future has already completed or not.
  * Use forceGetResult/forceGetFailure to get the future's result or failure, or an exception if the future is in the wrong state.
+ * When synchronous code has no choice but to block on a future, use waitUntilCompletedWithTimeout:/forceGetResultWaitingUpTo:.
  *
  * Use the TOCFutureSource class to control your own TOCFuture instances.
  *
@@ -238,6 +240,43 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
  */
 -(id)forceGetFailure;
 
+/*!
+ * Blocks the calling thread until the receiving future completes, or until the given timeout has elapsed.
+ *
+ * @param timeoutInSeconds The most time, in seconds, to wait for.
+ * Must not be negative or NaN. May be infinite, to wait as long as it takes.
+ *
+ * @result True if the future has completed (with a result or a failure), false if it was still incomplete when the wait ended.
+ *
+ * @discussion Only meant for bridging futures into synchronous code, like tests and command line tools.
+ * Prefer continuations wherever possible: blocking a thread on a future is a great way to introduce deadlocks and UI hangs.
+ *
+ * Returns right away, without registering anything, when the future has already completed.
+ * Also returns right away, with false, when the future is immortal and so will never complete.
+ *
+ * Raises an exception, instead of deadlocking, when called on the main thread for a future that is waiting on a continuation that can only run on the main thread.
+ * For example, on the main thread, [[source.future then:block] waitUntilCompletedWithTimeout:INFINITY] raises an exception because the continuation runs on the default executor (the main thread).
+ * Futures waiting on such a future are caught as well, when they were continued from it or set to flatten it after it was made.
+ * (A future continued from a future that only later gets set to flatten such a future is not caught.)
+ *
+ * When called from a handler, blocks that handler has released for the main thread, or queued up past the inline nesting limit, are sent on their way before blocking.
+ */
+-(bool)waitUntilCompletedWithTimeout:(NSTimeInterval)timeoutInSeconds;
+
+/*!
+ * Blocks the calling thread until the receiving future completes, or until the given timeout has elapsed, and returns the future's result.
+ *
+ * @param timeoutInSeconds The most time, in seconds, to wait for.
+ * Must not be negative or NaN. May be infinite, to wait as long as it takes.
+ *
+ * @result The future's result.
+ *
+ * @discussion Raises an exception if the future failed, or if it was still incomplete when the wait ended.
+ *
+ * See waitUntilCompletedWithTimeout: for the caveats of blocking on a future.
+ */
+-(id)forceGetResultWaitingUpTo:(NSTimeInterval)timeoutInSeconds;
+
 /*!
  * Eventually runs a 'finally' handler on the receiving future, once it has completed with a result or failed, unless cancelled.
  *
@@ -258,6 +297,17 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(void) finallyDo:(TOCFutureFinallyHandler)completionHandler
            unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like finallyDo:unless:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the handler is only run inline if the executor runs blocks inline on the calling thread.
+ */
+-(void) finallyDo:(TOCFutureFinallyHandler)completionHandler
+               on:(id<TOCExecutor>)executor
+           unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Eventually runs a 'then' handler on the receiving future's result, unless cancelled.
  *
@@ -277,6 +327,17 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(void) thenDo:(TOCFutureThenHandler)resultHandler
         unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like thenDo:unless:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the handler is only run inline if the executor runs blocks inline on the calling thread.
+ */
+-(void) thenDo:(TOCFutureThenHandler)resultHandler
+            on:(id<TOCExecutor>)executor
+        unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Eventually runs a 'catch' handler on the receiving future's failure, unless cancelled.
  *
@@ -299,6 +360,17 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(void) catchDo:(TOCFutureCatchHandler)failureHandler
          unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like catchDo:unless:, except the handler is run using the given executor.
+ *
+ * @param executor The executor that runs the handler. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the handler is only run inline if the executor runs blocks inline on the calling thread.
+ */
+-(void) catchDo:(TOCFutureCatchHandler)failureHandler
+             on:(id<TOCExecutor>)executor
+         unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Eventually evaluates a 'finally' continuation on the receiving future, once it has completed with a result or failed.
  *
@@ -327,6 +399,19 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
                unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like finally:unless:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the continuation is only run inline if the executor runs blocks inline on the calling thread.
+ *
+ * Use an executor on a background queue to keep a heavy continuation from delaying the thread that completes the receiving future.
+ */
+-(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
+                   on:(id<TOCExecutor>)executor
+               unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Eventually evaluates a 'then' continuation on the receiving future's result, or else propagates the receiving future's failure.
  *
@@ -357,6 +442,19 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
             unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like then:unless:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the continuation is only run inline if the executor runs blocks inline on the calling thread.
+ *
+ * Use an executor on a background queue to keep a heavy continuation from delaying the thread that completes the receiving future.
+ */
+-(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
+                on:(id<TOCExecutor>)executor
+            unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Eventually matches the receiving future's result, or else evaluates a 'catch' continuation on the receiving future's failure, unless cancelled.
  *
@@ -385,6 +483,19 @@ typedef id (^TOCFutureCatchContinuation)(id failure);
 -(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
              unless:(TOCCancelToken*)unlessCancelledToken;
 
+/*!
+ * Like catch:unless:, except the continuation is run using the given executor.
+ *
+ * @param executor The executor that runs the continuation. A nil executor corresponds to the default executor of the calling thread.
+ *
+ * @discussion When the receiving future has already completed, the continuation is only run inline if the executor runs blocks inline on the calling thread.
+ *
+ * Use an executor on a background queue to keep a heavy continuation from delaying the thread that completes the receiving future.
+ */
+-(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
+                 on:(id<TOCExecutor>)executor
+             unless:(TOCCancelToken*)unlessCancelledToken;
+
 /*!
  * Determines if two futures are in the same state and guaranteed to end up in the same final state.
  *
@@ -1,160 +1,380 @@
 #import "TOCFutureAndSource.h"
 #import "TOCInternal.h"
 #import "TOCTimeout.h"
-#import "UnionFind.h"
-
-static NSObject* getSharedCycleDetectionLock() {
-    static dispatch_once_t once;
-    static NSObject* lock = nil;
-    dispatch_once(&once, ^{
-        lock = [NSObject new];
-    });
-    return lock;
-}
-
-enum StartUnwrapResult {
-    StartUnwrapResult_CycleDetected,
-    StartUnwrapResult_Started,
-    StartUnwrapResult_StartedAndFinished,
-    StartUnwrapResult_AlreadySet
+#include <stdatomic.h>
+
+/// The _link of a future that holds its own final state (or is about to), and so can no longer be linked to another future
+static const uintptr_t TOCFuture_Link_Settled = 0x1;
+
+/// Which of then:, catch: or finally: a continuation was made by
+enum TOCFuture_ContinuationKind {
+    TOCFuture_ContinuationKind_Then,
+    TOCFuture_ContinuationKind_Catch,
+    TOCFuture_ContinuationKind_Finally
 };
 
+@interface TOCFuture ()
+-(void) _continueInto:(TOCFuture*)resultFuture
+                   by:(enum TOCFuture_ContinuationKind)kind
+                 with:(id)continuation;
+-(bool) _ForSource_tryImmortalize;
+@end
+
+/// The settled handler of a pending continuation that runs inline and can't be cancelled, run with its result future as the target
+/// Does the continuation's work itself, instead of wrapping it in blocks, so the continuation costs just this node and its result future
+@interface TOCFuture_ContinuationNode : TOCInternal_HandlerNode {
+@package TOCFuture* _receiver;
+@package id _continuation;
+@package enum TOCFuture_ContinuationKind _continuationKind;
+}
+@end
+
+@implementation TOCFuture_ContinuationNode
+
+-(void) runWithTarget:(id)target {
+    TOCFuture* resultFuture = target;
+    if (_receiver.isIncomplete) {
+        [resultFuture _ForSource_tryImmortalize];
+        return;
+    }
+    [_receiver _continueInto:resultFuture by:_continuationKind with:_continuation];
+}
+
+@end
+
 @implementation TOCFuture {
-/// The future's final result, final failure, or flattening target
+/// Either 0 (this future holds the state of its flattening group), TOCFuture_Link_Settled (same, but the group's state is final or about to be),
+/// or a retained pointer to a future this future was linked to (that future, or a future it links to, holds the group's state)
+/// Only ever changes from 0, at most once, so a future keeps every future it links to alive
+/// Futures set to flatten an incomplete future link that future's group to their own group, so chains of flattened futures all point at the outermost one
+@private _Atomic(uintptr_t) _link;
+
+/// Holds an enum TOCFutureState, but only ever AbleToBeSet, CompletedWithResult, Failed or Immortal (flattening is tracked by _hasBeenSet)
+/// Only meaningful when _link is not a pointer. Only ever transitions away from AbleToBeSet, at most once.
+/// Zero (immortal) by default, so a future that was never given a source acts like an eternal one
+@private atomic_int _state;
+/// Whether or not the future has already been told to flatten or complete or fail (or become immortal)
+/// The one member of a flattening group that hasn't been set is the only one allowed to settle the group
+@private atomic_bool _hasBeenSet;
+/// The group's final result or final failure, when _link is not a pointer
+/// Written before _state is released, and not touched afterwards
 @private id _value;
-/// Whether or not the future has already been told to flatten or complete or fail
-@private bool _hasBeenSet;
-/// Whether or not the future has succeeded vs failed
-@private bool _ifDoneHasSucceeded;
 
-/// Callback functionality is delegated to this token
-/// It is only cancelled *after* the above state fields have been set
-@private TOCCancelToken* _completionToken;
+/// Completion handlers, and settled handlers (run when the group completes or becomes immortal)
+/// Closed right after _state transitions away from AbleToBeSet, or right after _link is pointed at another future (the handlers move to that future)
+@private TOCInternal_HandlerStack _handlers;
 
-/// Used for detection of immortal flattening cycles
-/// Must hold getSharedCycleDetectionLock() when touching this node
-@private UFDisjointSetNode* _cycleNode;
+/// A retained TOCCancelToken, or NULL until someone asks for cancelledOnCompletionToken
+@private _Atomic(void*) _completionToken;
+
+/// A retained TOCInternal_UnionFindNode used for detection of immortal flattening cycles, or NULL until needed
+/// Only created when flattening involves an incomplete future, and kept until dealloc (concurrent flattenings may be using it)
+@private _Atomic(void*) _cycleNode;
+
+/// Whether or not the future is the result of a continuation that has yet to start running, and can only run on the main thread
+/// Used to refuse waits that would deadlock, by blocking the main thread on work queued up for the main thread
+@private atomic_bool _awaitsMainThread;
+/// A future this future is waiting on (as a continuation, or by flattening), if that future was waiting on the main thread at the time
+/// Lets waits see through chains of futures to a main thread continuation at the bottom. Weak, so it never keeps a completed chain alive.
+@private __weak TOCFuture* _awaitsMainThreadVia;
+
+/// The number identifying this future in traces, or 0 until it is needed
+@private _Atomic(uint64_t) _traceId;
 }
 
+/// Finds the future holding the state of the given future's flattening group.
+/// Not retained, but safe to use while the given future is alive (futures keep the futures they link to alive).
+static __unsafe_unretained TOCFuture* rootOf(__unsafe_unretained TOCFuture* future) {
+    while (true) {
+        uintptr_t link = atomic_load_explicit(&future->_link, memory_order_acquire);
+        if (link <= TOCFuture_Link_Settled) return future;
+        future = (__bridge TOCFuture*)(void*)link;
+    }
+}
+
+-(instancetype) init {
+    if (self = [super init]) {
+        TOCInternal_count(TOCInternal_Counter_FuturesCreated);
+        if (TOCInternal_isTracing()) TOCInternal_trace(TOCInternal_TraceEvent_FutureCreated, self._traceId, 0, 0);
+    }
+    return self;
+}
+-(uint64_t) _traceId {
+    return TOCInternal_traceIdIn(&_traceId);
+}
+
++(TOCFuture*) _completedFutureWithValue:(id)value
+                              succeeded:(bool)succeeded {
+    TOCFuture *future = [TOCFuture new];
+    future->_value = value;
+    atomic_store_explicit(&future->_hasBeenSet, true, memory_order_relaxed);
+    atomic_store_explicit(&future->_link, TOCFuture_Link_Settled, memory_order_relaxed);
+    atomic_store_explicit(&future->_state,
+                          succeeded ? TOCFutureState_CompletedWithResult : TOCFutureState_Failed,
+                          memory_order_release);
+    TOCInternal_count(TOCInternal_Counter_FuturesCompleted);
+    if (TOCInternal_isTracing()) {
+        TOCInternal_trace(TOCInternal_TraceEvent_FutureSettled, future._traceId, 0,
+                          succeeded ? TOCFutureState_CompletedWithResult : TOCFutureState_Failed);
+    }
+    TOCInternal_HandlerStack_closeAndRun(&future->_handlers, true);
+    return future;
+}
 +(TOCFuture *)futureWithResult:(id)resultValue {
     if ([resultValue isKindOfClass:[TOCFuture class]]) {
         return resultValue;
     }
     
-    TOCFuture *future = [TOCFuture new];
-    future->_completionToken = TOCCancelToken.cancelledToken;
-    future->_ifDoneHasSucceeded = true;
-    future->_value = resultValue;
-    return future;
+    return [TOCFuture _completedFutureWithValue:resultValue succeeded:true];
 }
 +(TOCFuture *)futureWithFailure:(id)failureValue {
-    TOCFuture *future = [TOCFuture new];
-    future->_completionToken = TOCCancelToken.cancelledToken;
-    future->_ifDoneHasSucceeded = false;
-    future->_value = failureValue;
-    return future;
+    return [TOCFuture _completedFutureWithValue:failureValue succeeded:false];
 }
 
-+(TOCFuture*) _ForSource_completableFutureWithCompletionToken:(TOCCancelToken*)completionToken {
++(TOCFuture*) _ForSource_completableFuture {
     TOCFuture* future = [TOCFuture new];
-    future->_completionToken = completionToken;
+    atomic_store_explicit(&future->_state, TOCFutureState_AbleToBeSet, memory_order_release);
     return future;
 }
 
--(UFDisjointSetNode*) _getInitCycleNode {
-    if (_cycleNode == nil) _cycleNode = [UFDisjointSetNode new];
-    return _cycleNode;
+-(void) dealloc {
+    TOCInternal_count(TOCInternal_Counter_FuturesDeallocated);
+    uintptr_t link = atomic_load_explicit(&_link, memory_order_acquire);
+    if (link > TOCFuture_Link_Settled) (void)(__bridge_transfer TOCFuture*)(void*)link;
+    void* completionToken = atomic_load_explicit(&_completionToken, memory_order_acquire);
+    if (completionToken != NULL) (void)(__bridge_transfer TOCCancelToken*)completionToken;
+    void* cycleNode = atomic_load_explicit(&_cycleNode, memory_order_acquire);
+    if (cycleNode != NULL) (void)(__bridge_transfer TOCInternal_UnionFindNode*)cycleNode;
 }
 
--(enum StartUnwrapResult) _ForSource_tryStartUnwrapping:(TOCFuture*)targetFuture {
-    TOCInternal_need(targetFuture != nil);
+-(TOCInternal_UnionFindNode*) _getInitCycleNode {
+    void* existing = atomic_load_explicit(&_cycleNode, memory_order_acquire);
+    if (existing != NULL) return (__bridge TOCInternal_UnionFindNode*)existing;
     
-    // try set (without completing)
-    @synchronized(self) {
-        if (_hasBeenSet) return StartUnwrapResult_AlreadySet;
-        _hasBeenSet = true;
+    void* desired = (__bridge_retained void*)[TOCInternal_UnionFindNode new];
+    if (!atomic_compare_exchange_strong_explicit(&_cycleNode,
+                                                 &existing,
+                                                 desired,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire)) {
+        // someone else initialized it first
+        (void)(__bridge_transfer TOCInternal_UnionFindNode*)desired;
+        return (__bridge TOCInternal_UnionFindNode*)existing;
     }
+    return (__bridge TOCInternal_UnionFindNode*)desired;
+}
+
+-(bool) _tryClaim {
+    bool expected = false;
+    return atomic_compare_exchange_strong_explicit(&_hasBeenSet,
+                                                   &expected,
+                                                   true,
+                                                   memory_order_acq_rel,
+                                                   memory_order_relaxed);
+}
+-(void) _settleClaimedGroupInto:(enum TOCFutureState)finalState
+                          value:(id)finalValue {
+    TOCInternal_need(![finalValue isKindOfClass:[TOCFuture class]]);
     
-    // optimistically finish without doing cycle stuff
-    if (!targetFuture.isIncomplete) {
-        [self _ForSource_forceUnwrapToComplete:targetFuture];
-        return StartUnwrapResult_StartedAndFinished;
+    while (true) {
+        __unsafe_unretained TOCFuture* root = rootOf(self);
+        
+        // stop the root from being linked elsewhere while we settle it
+        uintptr_t expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&root->_link,
+                                                    &expected,
+                                                    TOCFuture_Link_Settled,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+            root->_value = finalValue;
+            atomic_store_explicit(&root->_state, finalState, memory_order_release);
+            TOCInternal_count(finalState == TOCFutureState_Immortal
+                              ? TOCInternal_Counter_FuturesImmortalized
+                              : TOCInternal_Counter_FuturesCompleted);
+            if (TOCInternal_isTracing()) TOCInternal_trace(TOCInternal_TraceEvent_FutureSettled, self._traceId, 0, finalState);
+            
+            // registrations that lose the race against this close will see the final state set above
+            TOCInternal_HandlerStack_closeAndRun(&root->_handlers, finalState != TOCFutureState_Immortal);
+            return;
+        }
+        
+        // the claimer is the only one allowed to settle the group, so the root must have been linked elsewhere concurrently
+        TOCInternal_force(expected != TOCFuture_Link_Settled);
     }
+}
+-(void) _settleClaimedGroupToMatch:(TOCFuture*)settledFuture {
+    __unsafe_unretained TOCFuture* settledRoot = rootOf(settledFuture);
+    enum TOCFutureState finalState = (enum TOCFutureState)atomic_load_explicit(&settledRoot->_state, memory_order_acquire);
+    TOCInternal_force(finalState != TOCFutureState_AbleToBeSet);
     
-    // look for flattening cycles
-    @synchronized(getSharedCycleDetectionLock()) {
-        bool didMerge = [self._getInitCycleNode unionWith:targetFuture._getInitCycleNode];
-        if (!didMerge) {
-            // it's not necessary to clear the cycle nodes, but it frees up some memory
-            // other futures in the cycle won't get their cycle nodes cleared
-            // but node chains should be in EXTREMELY shallow trees
-            // and the nodes can't keep futures alive, so there's no reference cycle
-            _cycleNode = nil;
-            targetFuture->_cycleNode = nil;
-            return StartUnwrapResult_CycleDetected;
+    [self _settleClaimedGroupInto:finalState
+                            value:finalState == TOCFutureState_Immortal ? nil : settledRoot->_value];
+}
+-(void) _linkClaimedGroupTo:(TOCFuture*)targetFuture {
+    while (true) {
+        __unsafe_unretained TOCFuture* targetRoot = rootOf(targetFuture);
+        if (atomic_load_explicit(&targetRoot->_state, memory_order_acquire) != TOCFutureState_AbleToBeSet) {
+            // the target settled concurrently (or was never going to settle)
+            [self _settleClaimedGroupToMatch:targetFuture];
+            return;
+        }
+        
+        // point the target's group at our group, so chains of flattening futures collapse into the outermost one
+        // (linking to a stale root is fine: it links onwards to the current root)
+        uintptr_t expected = 0;
+        uintptr_t desired = (uintptr_t)(__bridge_retained void*)rootOf(self);
+        if (atomic_compare_exchange_strong_explicit(&targetRoot->_link,
+                                                    &expected,
+                                                    desired,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+            // registrations racing this move will fail to push onto the closed stack, and retry on our group
+            TOCInternal_HandlerList movedHandlers = TOCInternal_HandlerStack_closeAndTake(&targetRoot->_handlers);
+            [self _moveHandlersIntoGroup:movedHandlers];
+            return;
         }
+        (void)(__bridge_transfer TOCFuture*)(void*)desired;
+        
+        if (expected == TOCFuture_Link_Settled) {
+            // the target is settling right now, and will have its final state by the time it runs its handlers
+            [targetFuture _whenSettledDo:^{ [self _settleClaimedGroupToMatch:targetFuture]; }];
+            return;
+        }
+        
+        // the target's root was linked elsewhere concurrently, retry with its new root
     }
-    
-    return StartUnwrapResult_Started;
 }
--(void) _ForSource_forceUnwrapToComplete:(TOCFuture*)future {
-    TOCInternal_force(future != nil);
-    TOCInternal_force(!future.isIncomplete);
+-(void) _moveHandlersIntoGroup:(TOCInternal_HandlerList)handlers {
+    if (handlers == NULL) return;
     
-    bool flatteningFutureSucceeded = [self _trySetOrComplete:future->_value
-                                                   succeeded:future->_ifDoneHasSucceeded
-                                                  isUnwiring:true];
-    TOCInternal_force(flatteningFutureSucceeded);
+    while (true) {
+        __unsafe_unretained TOCFuture* root = rootOf(self);
+        if (TOCInternal_HandlerStack_tryPushAll(&root->_handlers, handlers)) return;
+        
+        if (atomic_load_explicit(&root->_link, memory_order_acquire) == TOCFuture_Link_Settled) {
+            // the stack only closes after the state has been set
+            enum TOCFutureState finalState = (enum TOCFutureState)atomic_load_explicit(&root->_state, memory_order_acquire);
+            TOCInternal_HandlerList_run(handlers, finalState != TOCFutureState_Immortal);
+            return;
+        }
+        
+        // the root was linked elsewhere concurrently, retry with its new root
+    }
 }
+
 -(bool) _ForSource_tryComplete:(id)finalValue
                      succeeded:(bool)succeeded {
-    return [self _trySetOrComplete:finalValue
-                         succeeded:succeeded
-                        isUnwiring:false];
+    TOCInternal_need(![finalValue isKindOfClass:[TOCFuture class]]);
+    if (![self _tryClaim]) return false;
+    
+    [self _settleClaimedGroupInto:succeeded ? TOCFutureState_CompletedWithResult : TOCFutureState_Failed
+                            value:finalValue];
+    return true;
 }
--(bool) _trySetOrComplete:(id)finalValue
-                succeeded:(bool)succeeded
-               isUnwiring:(bool)unwiring {
+-(bool) _ForSource_tryImmortalize {
+    if (![self _tryClaim]) return false;
     
-    TOCInternal_need(![finalValue isKindOfClass:[TOCFuture class]]);
+    [self _settleClaimedGroupInto:TOCFutureState_Immortal value:nil];
+    return true;
+}
+-(bool) _ForSource_trySetAndFlatten:(TOCFuture*)targetFuture {
+    TOCInternal_need(targetFuture != nil);
     
-    @synchronized(self) {
-        if (_hasBeenSet && !unwiring) return false;
-        _hasBeenSet = true;
-        _value = finalValue;
-        _ifDoneHasSucceeded = succeeded;
+    // try set (without completing)
+    if (![self _tryClaim]) return false;
+    if (TOCInternal_isTracing()) {
+        TOCInternal_trace(TOCInternal_TraceEvent_FutureFlattened, self._traceId, targetFuture._traceId, 0);
     }
-    @synchronized(getSharedCycleDetectionLock()) {
-        _cycleNode = nil;
+    
+    // optimistically finish without doing cycle stuff
+    if (!targetFuture.isIncomplete) {
+        [self _settleClaimedGroupToMatch:targetFuture];
+        return true;
+    }
+    
+    // look for flattening cycles
+    // (we're the only unset future in our set, so the target being in our set means it is transitively flattening into us)
+    if (![self._getInitCycleNode unionWith:targetFuture._getInitCycleNode]) {
+        // this future will never complete
+        TOCInternal_count(TOCInternal_Counter_FlatteningCyclesDetected);
+        if (TOCInternal_isTracing()) {
+            TOCInternal_trace(TOCInternal_TraceEvent_FlatteningCycle, self._traceId, targetFuture._traceId, 0);
+        }
+        [self _settleClaimedGroupInto:TOCFutureState_Immortal value:nil];
+        return true;
     }
+    
+    // from now on, whatever settles the target's group settles ours
+    [targetFuture _noteWaitedOnBy:self];
+    [self _linkClaimedGroupTo:targetFuture];
+    
+    // this future is set (i.e. it can't be set anymore), even if it is not completed yet or ever
     return true;
 }
-
+-(bool) _ForSource_trySetResult:(id)result {
+    // automatic flattening
+    if ([result isKindOfClass:[TOCFuture class]]) {
+        return [self _ForSource_trySetAndFlatten:result];
+    }
+    
+    return [self _ForSource_tryComplete:result succeeded:true];
+}
 
 -(TOCCancelToken*) cancelledOnCompletionToken {
-    return _completionToken;
+    void* existing = atomic_load_explicit(&_completionToken, memory_order_acquire);
+    if (existing != NULL) return (__bridge TOCCancelToken*)existing;
+    
+    // settled futures can just use the shared tokens
+    switch ([self _groupState]) {
+        case TOCFutureState_CompletedWithResult:
+        case TOCFutureState_Failed:
+            return TOCCancelToken.cancelledToken;
+        case TOCFutureState_Immortal:
+            return TOCCancelToken.immortalToken;
+        default:
+            break;
+    }
+    
+    // lazily make the token, and publish it (unless someone else beat us to it)
+    TOCCancelTokenSource* source = [TOCCancelTokenSource new];
+    TOCCancelToken* token = source.token;
+    void* expected = NULL;
+    void* desired = (__bridge_retained void*)token;
+    if (!atomic_compare_exchange_strong_explicit(&_completionToken,
+                                                 &expected,
+                                                 desired,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire)) {
+        (void)(__bridge_transfer TOCCancelToken*)desired;
+        return (__bridge TOCCancelToken*)expected;
+    }
+    
+    // keep the source alive in the handler until it can be cancelled
+    // if we become immortal, the source is discarded instead (making its token immortal as well)
+    [self _whenSettledDo:^{
+        if (!self.isIncomplete) [source cancel];
+    }];
+    return token;
 }
 
+-(enum TOCFutureState) _groupState {
+    return (enum TOCFutureState)atomic_load_explicit(&rootOf(self)->_state, memory_order_acquire);
+}
+-(id) _settledValue {
+    return rootOf(self)->_value;
+}
 -(enum TOCFutureState) state {
-    enum TOCCancelTokenState completionCancelTokenState = _completionToken.state;
-    switch (completionCancelTokenState) {
-        case TOCCancelTokenState_Cancelled:
-            return _ifDoneHasSucceeded ? TOCFutureState_CompletedWithResult : TOCFutureState_Failed;
-            
-        case TOCCancelTokenState_Immortal:
-            return TOCFutureState_Immortal;
-            
-        case TOCCancelTokenState_StillCancellable:
-            @synchronized(self) {
-                return _hasBeenSet ? TOCFutureState_Flattening : TOCFutureState_AbleToBeSet;
-            }
-            
-        default:
-            TOCInternal_unexpectedEnum(completionCancelTokenState);
-    }
+    enum TOCFutureState state = [self _groupState];
+    if (state != TOCFutureState_AbleToBeSet) return state;
+    if (!atomic_load_explicit(&_hasBeenSet, memory_order_acquire)) return state;
+    
+    // set, but maybe not settled yet
+    state = [self _groupState];
+    return state == TOCFutureState_AbleToBeSet ? TOCFutureState_Flattening : state;
 }
 -(bool)isIncomplete {
-    return !_completionToken.isAlreadyCancelled;
+    enum TOCFutureState state = [self _groupState];
+    return state != TOCFutureState_CompletedWithResult && state != TOCFutureState_Failed;
 }
 -(bool)hasResult {
     return self.state == TOCFutureState_CompletedWithResult;
@@ -170,99 +390,396 @@ enum StartUnwrapResult {
 }
 -(id)forceGetResult {
     TOCInternal_force(self.hasResult);
-    return _value;
+    return self._settledValue;
 }
 -(id)forceGetFailure {
     TOCInternal_force(self.hasFailed);
-    return _value;
+    return self._settledValue;
+}
+-(bool)waitUntilCompletedWithTimeout:(NSTimeInterval)timeoutInSeconds {
+    TOCInternal_need(timeoutInSeconds >= 0);
+    TOCInternal_need(!isnan(timeoutInSeconds));
+    
+    enum TOCFutureState state = self.state;
+    if (state == TOCFutureState_CompletedWithResult || state == TOCFutureState_Failed) return true;
+    if (state == TOCFutureState_Immortal) return false;
+    
+    if (timeoutInSeconds == 0) return !self.isIncomplete;
+    
+    // blocking the main thread on a continuation that is queued up for the main thread can only ever time out
+    bool waitWouldDeadlock = NSThread.isMainThread && [self _isWaitingOnMainThread];
+    TOCInternal_force(!waitWouldDeadlock);
+    
+    dispatch_semaphore_t settledSignal = dispatch_semaphore_create(0);
+    TOCInternal_Remover remover = [self _removable_whenSettledDo:^{ dispatch_semaphore_signal(settledSignal); }];
+    if (remover != nil) {
+        // when waiting inside a handler, work this thread is holding back until the handlers are done has to go out now
+        // (the future may be waiting on it, and the handlers can't be done while we wait)
+        TOCInternal_HandlerList_runQueued();
+        TOCInternal_MainThreadBatch_flush();
+        
+        double timeoutInNanoseconds = timeoutInSeconds * NSEC_PER_SEC;
+        dispatch_time_t waitDeadline = timeoutInNanoseconds >= INT64_MAX
+                                     ? DISPATCH_TIME_FOREVER
+                                     : dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutInNanoseconds);
+        if (dispatch_semaphore_wait(settledSignal, waitDeadline) != 0) {
+            // don't leave the handler behind, in case the future stays incomplete for a long time
+            remover();
+        }
+    }
+    
+    return !self.isIncomplete;
+}
+/// Determines if the receiver can't complete until a continuation that can only run on the main thread gets to start.
+-(bool) _isWaitingOnMainThread {
+    TOCFuture* future = self;
+    while (future != nil && future.isIncomplete) {
+        if (atomic_load_explicit(&future->_awaitsMainThread, memory_order_acquire)) return true;
+        future = future->_awaitsMainThreadVia;
+    }
+    return false;
+}
+/// Notes that the given future is waiting on the receiver, so that waits on it can tell when that means waiting on the main thread.
+-(void) _noteWaitedOnBy:(TOCFuture*)dependentFuture {
+    if (![self _isWaitingOnMainThread]) return;
+    dependentFuture->_awaitsMainThreadVia = self;
+}
+-(id)forceGetResultWaitingUpTo:(NSTimeInterval)timeoutInSeconds {
+    [self waitUntilCompletedWithTimeout:timeoutInSeconds];
+    return self.forceGetResult;
+}
+-(bool)_hasBeenTriggered {
+    return !self.isIncomplete;
+}
+
+/// Pushes a node onto the handler stack of the receiver's flattening group, following the group if it is moved concurrently.
+/// Returns false, discarding the target, if the group has already settled.
+-(bool) _tryPushNode:(TOCInternal_HandlerNode*)node
+              target:(id)target
+                kind:(enum TOCInternal_HandlerKind)kind {
+    while (true) {
+        __unsafe_unretained TOCFuture* root = rootOf(self);
+        if (atomic_load_explicit(&root->_state, memory_order_acquire) != TOCFutureState_AbleToBeSet) return false;
+        
+        if (TOCInternal_HandlerStack_tryPushNode(&root->_handlers, node, target, kind)) return true;
+        if (atomic_load_explicit(&root->_link, memory_order_acquire) == TOCFuture_Link_Settled) return false;
+        
+        // the group was linked into another group concurrently, retry there
+    }
+}
+/// Pushes a handler onto the handler stack of the receiver's flattening group, following the group if it is moved concurrently.
+/// Returns nil, discarding the handler, if the group has already settled.
+-(TOCInternal_HandlerNode*) _tryPushHandler:(TOCInternal_Handler)handler
+                                       kind:(enum TOCInternal_HandlerKind)kind {
+    if ([self _groupState] != TOCFutureState_AbleToBeSet) return nil;
+    
+    TOCInternal_HandlerNode* node = [TOCInternal_HandlerNode new];
+    if (![self _tryPushNode:node target:[handler copy] kind:kind]) return nil;
+    return node;
+}
+-(void) _whenSettledDo:(TOCInternal_SettledHandler)settledHandler {
+    if ([self _tryPushHandler:settledHandler kind:TOCInternal_HandlerKind_OnSettle] != nil) return;
+    
+    settledHandler();
+}
+-(TOCInternal_Remover) _removable_whenSettledDo:(TOCInternal_SettledHandler)settledHandler {
+    TOCInternal_need(settledHandler != nil);
+    
+    TOCInternal_HandlerNode* node = [self _tryPushHandler:settledHandler kind:TOCInternal_HandlerKind_OnSettle];
+    if (node != nil) {
+        // the node may have moved into another group's stack since, so count the removal against the current one
+        return ^{ TOCInternal_HandlerStack_remove(&rootOf(self)->_handlers, node); };
+    }
+    
+    settledHandler();
+    return nil;
+}
+
+-(void) _whenCompletedDo:(TOCInternal_Handler)completionHandler
+                      on:(id<TOCExecutor>)executor {
+    completionHandler = TOCInternal_tracedHandler(completionHandler, self);
+    if ([self _groupState] == TOCFutureState_AbleToBeSet) {
+        TOCInternal_Handler safeHandler = TOCInternal_executedBy(executor, completionHandler, nil);
+        if ([self _tryPushHandler:safeHandler kind:TOCInternal_HandlerKind_OnTrigger] != nil) return;
+        
+        // the future settled concurrently, so its state is now final
+    }
+    
+    if (!self.isIncomplete) {
+        if (TOCInternal_executesInlineHere(executor)) {
+            completionHandler();
+        } else {
+            [executor execute:completionHandler];
+        }
+    }
+}
+-(void) _whenCompletedDo:(TOCInternal_Handler)completionHandler
+                      on:(id<TOCExecutor>)executor
+                  unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(completionHandler != nil);
+    executor = TOCInternal_resolveExecutor(executor);
+    
+    // optimistically do less work
+    enum TOCCancelTokenState peekOtherState = unlessCancelledToken.state;
+    if (peekOtherState == TOCCancelTokenState_Immortal) {
+        [self _whenCompletedDo:completionHandler on:executor];
+        return;
+    }
+    if (peekOtherState == TOCCancelTokenState_Cancelled) {
+        return;
+    }
+    
+    completionHandler = TOCInternal_tracedHandler(completionHandler, self);
+    TOCInternal_Handler safeHandler = TOCInternal_executedBy(executor, completionHandler, unlessCancelledToken);
+    TOCInternal_whenSettledDoUnlessSettled(self, ^{
+        if (!self.isIncomplete) {
+            safeHandler();
+        }
+    }, unlessCancelledToken);
+}
+
+/// Whether or not a continuation can be run right now, instead of being registered, without anyone being able to tell the difference
+-(bool) _isCompletedAndUncancellable:(TOCCancelToken*)unlessCancelledToken
+                    executedInlineBy:(id<TOCExecutor>)executor {
+    // (a nil token also reports the immortal state)
+    return !self.isIncomplete
+        && unlessCancelledToken.state == TOCCancelTokenState_Immortal
+        && TOCInternal_executesInlineHere(executor);
+}
+-(TOCFuture*) _futureOn:(id<TOCExecutor>)executor
+                 unless:(TOCCancelToken*)unlessCancelledToken
+  continuedOnCompletion:(void(^)(TOCFuture* resultFuture))continuation {
+    enum TOCCancelTokenState unlessState = unlessCancelledToken.state;
+    if (unlessState == TOCCancelTokenState_Cancelled) {
+        // the continuation will never run
+        return [TOCFuture futureWithFailure:TOCCancelToken.cancelledToken];
+    }
+    bool awaitsMainThread = TOCInternal_executesOnlyOnMainThread(executor);
+    if (awaitsMainThread) {
+        void(^mainThreadContinuation)(TOCFuture* resultFuture) = continuation;
+        continuation = ^(TOCFuture* resultFuture) {
+            atomic_store(&resultFuture->_awaitsMainThread, false);
+            mainThreadContinuation(resultFuture);
+        };
+    }
+    if (unlessState == TOCCancelTokenState_Immortal) {
+        // no source needed: the handler immortalizes the result itself when we become immortal
+        TOCFuture* result = [TOCFuture _ForSource_completableFuture];
+        if (awaitsMainThread) atomic_store(&result->_awaitsMainThread, true);
+        [self _noteWaitedOnBy:result];
+        if (TOCInternal_isTracing()) TOCInternal_trace(TOCInternal_TraceEvent_FutureLinked, result._traceId, self._traceId, 0);
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed once we settle.
+        [self _whenSettledDo:^{
+            if (self.isIncomplete) {
+                [result _ForSource_tryImmortalize];
+                return;
+            }
+            if (executor == TOCExecutors.inlineExecutor && !TOCInternal_isTracing()) {
+                continuation(result);
+                return;
+            }
+            TOCInternal_Handler continueResult = TOCInternal_tracedHandler(^{ continuation(result); }, self);
+            if (executor == TOCExecutors.inlineExecutor) {
+                continueResult();
+            } else {
+                [executor execute:continueResult];
+            }
+        }];
+        return result;
+    }
+    
+    // the source makes the result immortal when dropped, i.e. when the handler is discarded without running
+    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
+    if (awaitsMainThread) atomic_store(&resultSource.future->_awaitsMainThread, true);
+    [self _noteWaitedOnBy:resultSource.future];
+    if (TOCInternal_isTracing()) {
+        TOCInternal_trace(TOCInternal_TraceEvent_FutureLinked, resultSource.future._traceId, self._traceId, 0);
+    }
+    
+    // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
+    [self _whenCompletedDo:^{ continuation(resultSource.future); }
+                        on:executor
+                    unless:unlessCancelledToken];
+    
+    return resultSource.future;
 }
 
+/// Sets the result future of a continuation made by then:, catch: or finally:, once the receiver has completed
+-(void) _continueInto:(TOCFuture*)resultFuture
+                   by:(enum TOCFuture_ContinuationKind)kind
+                 with:(id)continuation {
+    switch (kind) {
+        case TOCFuture_ContinuationKind_Then:
+            if (self.hasResult) {
+                [resultFuture _ForSource_trySetResult:((TOCFutureThenContinuation)continuation)(self._settledValue)];
+            } else {
+                [resultFuture _ForSource_tryComplete:self._settledValue succeeded:false];
+            }
+            return;
+        case TOCFuture_ContinuationKind_Catch:
+        {
+            id v = self._settledValue;
+            if (self.hasFailed) v = ((TOCFutureCatchContinuation)continuation)(v);
+            [resultFuture _ForSource_trySetResult:v];
+            return;
+        }
+        case TOCFuture_ContinuationKind_Finally:
+            [resultFuture _ForSource_trySetResult:((TOCFutureFinallyContinuation)continuation)(self)];
+            return;
+    }
+}
+-(TOCFuture*) _futureOn:(id<TOCExecutor>)executor
+                 unless:(TOCCancelToken*)unlessCancelledToken
+            continuedBy:(enum TOCFuture_ContinuationKind)kind
+                   with:(id)continuation {
+    if (executor == TOCExecutors.inlineExecutor
+            && unlessCancelledToken.state == TOCCancelTokenState_Immortal
+            && !TOCInternal_isTracing()) {
+        // the common case gets by without any blocks: one node, and the result future
+        TOCFuture* result = [TOCFuture _ForSource_completableFuture];
+        [self _noteWaitedOnBy:result];
+        TOCFuture_ContinuationNode* node = [TOCFuture_ContinuationNode new];
+        node->_receiver = self;
+        node->_continuation = continuation;
+        node->_continuationKind = kind;
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed once we settle.
+        if (![self _tryPushNode:node target:result kind:TOCInternal_HandlerKind_OnSettle]) {
+            // settled concurrently
+            [node runWithTarget:result];
+        }
+        return result;
+    }
+    
+    return [self _futureOn:executor unless:unlessCancelledToken continuedOnCompletion:^(TOCFuture* resultFuture) {
+        [self _continueInto:resultFuture by:kind with:continuation];
+    }];
+}
+
+-(void)finallyDo:(TOCFutureFinallyHandler)completionHandler
+          unless:(TOCCancelToken *)unlessCancelledToken {
+    [self finallyDo:completionHandler on:nil unless:unlessCancelledToken];
+}
 -(void)finallyDo:(TOCFutureFinallyHandler)completionHandler
+              on:(id<TOCExecutor>)executor
           unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(completionHandler != nil);
     
     // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{ completionHandler(self); }
-                               unless:unlessCancelledToken];
+    [self _whenCompletedDo:^{ completionHandler(self); }
+                        on:executor
+                    unless:unlessCancelledToken];
 }
 
 -(void)thenDo:(TOCFutureThenHandler)resultHandler
        unless:(TOCCancelToken *)unlessCancelledToken {
+    [self thenDo:resultHandler on:nil unless:unlessCancelledToken];
+}
+-(void)thenDo:(TOCFutureThenHandler)resultHandler
+           on:(id<TOCExecutor>)executor
+       unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(resultHandler != nil);
     
     // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{
-        if (self->_ifDoneHasSucceeded) {
-            resultHandler(self->_value);
+    [self _whenCompletedDo:^{
+        if (self.hasResult) {
+            resultHandler(self._settledValue);
         }
-    } unless:unlessCancelledToken];
+    } on:executor unless:unlessCancelledToken];
 }
 
 -(void)catchDo:(TOCFutureCatchHandler)failureHandler
         unless:(TOCCancelToken *)unlessCancelledToken {
+    [self catchDo:failureHandler on:nil unless:unlessCancelledToken];
+}
+-(void)catchDo:(TOCFutureCatchHandler)failureHandler
+            on:(id<TOCExecutor>)executor
+        unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(failureHandler != nil);
     
     // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{
-        if (!self->_ifDoneHasSucceeded) {
-            failureHandler(self->_value);
+    [self _whenCompletedDo:^{
+        if (self.hasFailed) {
+            failureHandler(self._settledValue);
         }
-    } unless:unlessCancelledToken];
+    } on:executor unless:unlessCancelledToken];
 }
 
 -(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
                unless:(TOCCancelToken *)unlessCancelledToken {
+    return [self finally:completionContinuation on:nil unless:unlessCancelledToken];
+}
+-(TOCFuture *)finally:(TOCFutureFinallyContinuation)completionContinuation
+                   on:(id<TOCExecutor>)executor
+               unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(completionContinuation != nil);
+    executor = TOCInternal_resolveExecutor(executor);
     
-    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
-    
-    // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{ [resultSource trySetResult:completionContinuation(self)]; }
-             unless:unlessCancelledToken];
+    if ([self _isCompletedAndUncancellable:unlessCancelledToken executedInlineBy:executor]) {
+        return [TOCFuture futureWithResult:completionContinuation(self)];
+    }
     
-    return resultSource.future;
+    return [self _futureOn:executor
+                    unless:unlessCancelledToken
+               continuedBy:TOCFuture_ContinuationKind_Finally
+                      with:[completionContinuation copy]];
 }
 
 -(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
             unless:(TOCCancelToken *)unlessCancelledToken {
+    return [self then:resultContinuation on:nil unless:unlessCancelledToken];
+}
+-(TOCFuture *)then:(TOCFutureThenContinuation)resultContinuation
+                on:(id<TOCExecutor>)executor
+            unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(resultContinuation != nil);
+    executor = TOCInternal_resolveExecutor(executor);
     
-    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
-    
-    // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{
-        if (self->_ifDoneHasSucceeded) {
-            [resultSource trySetResult:resultContinuation(self->_value)];
-        } else {
-            [resultSource trySetFailure:self->_value];
-        }
-    } unless:unlessCancelledToken];
+    if (!self.isIncomplete && !self.hasResult && unlessCancelledToken.state == TOCCancelTokenState_Immortal) {
+        // a failure passes through unchanged, and completed futures are immutable, so the receiver can stand in for the result
+        return self;
+    }
+    if ([self _isCompletedAndUncancellable:unlessCancelledToken executedInlineBy:executor]) {
+        return [TOCFuture futureWithResult:resultContinuation(self._settledValue)];
+    }
     
-    return resultSource.future;
+    return [self _futureOn:executor
+                    unless:unlessCancelledToken
+               continuedBy:TOCFuture_ContinuationKind_Then
+                      with:[resultContinuation copy]];
 }
 
 -(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
              unless:(TOCCancelToken *)unlessCancelledToken {
+    return [self catch:failureContinuation on:nil unless:unlessCancelledToken];
+}
+-(TOCFuture *)catch:(TOCFutureCatchContinuation)failureContinuation
+                 on:(id<TOCExecutor>)executor
+             unless:(TOCCancelToken *)unlessCancelledToken {
     TOCInternal_need(failureContinuation != nil);
+    executor = TOCInternal_resolveExecutor(executor);
     
-    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
-    
-    // Reference cycle is fine. It is not self-sustaining. It gets removed if our source is deallocated.
-    [_completionToken whenCancelledDo:^{
-        id v = self->_value;
-        if (!self->_ifDoneHasSucceeded) v = failureContinuation(v);
-        [resultSource trySetResult:v];
-    } unless:unlessCancelledToken];
+    if (!self.isIncomplete && !self.hasFailed && unlessCancelledToken.state == TOCCancelTokenState_Immortal) {
+        // a result passes through unchanged, and completed futures are immutable, so the receiver can stand in for the result
+        return self;
+    }
+    if ([self _isCompletedAndUncancellable:unlessCancelledToken executedInlineBy:executor]) {
+        return [TOCFuture futureWithResult:failureContinuation(self._settledValue)];
+    }
     
-    return resultSource.future;
+    return [self _futureOn:executor
+                    unless:unlessCancelledToken
+               continuedBy:TOCFuture_ContinuationKind_Catch
+                      with:[failureContinuation copy]];
 }
 
 -(NSString*) description {
     switch (self.state) {
         case TOCFutureState_CompletedWithResult:
-            return [NSString stringWithFormat:@"Future with Result: %@", _value];
+            return [NSString stringWithFormat:@"Future with Result: %@", self._settledValue];
         case TOCFutureState_Failed:
-            return [NSString stringWithFormat:@"Future with Failure: %@", _value];
+            return [NSString stringWithFormat:@"Future with Failure: %@", self._settledValue];
         case TOCFutureState_Flattening:
             return @"Incomplete Future [Set, Flattening Result]";
         case TOCFutureState_Immortal:
@@ -292,7 +809,11 @@ enum StartUnwrapResult {
             
         case TOCFutureState_CompletedWithResult:
         case TOCFutureState_Failed:
-            return _value == other->_value || [_value isEqual:other->_value];
+        {
+            id value1 = self._settledValue;
+            id value2 = other._settledValue;
+            return value1 == value2 || [value1 isEqual:value2];
+        }
 
         case TOCFutureState_Flattening:
         case TOCFutureState_AbleToBeSet:
@@ -307,10 +828,10 @@ enum StartUnwrapResult {
             return NSUIntegerMax;
             
         case TOCFutureState_CompletedWithResult:
-            return [_value hash];
+            return [self._settledValue hash];
 
         case TOCFutureState_Failed:
-            return ~[_value hash];
+            return ~[self._settledValue hash];
             
         case TOCFutureState_Flattening:
         case TOCFutureState_AbleToBeSet:
@@ -321,89 +842,44 @@ enum StartUnwrapResult {
 
 @end
 
-@implementation TOCFutureSource {
-@private TOCCancelTokenSource* _cancelledOnCompletedSource_ClearedOnSet;
-}
+@implementation TOCFutureSource
 
 @synthesize future;
 
 -(TOCFutureSource*) init {
     self = [super init];
     if (self) {
-        self->_cancelledOnCompletedSource_ClearedOnSet = [TOCCancelTokenSource new];
-        self->future = [TOCFuture _ForSource_completableFutureWithCompletionToken:self->_cancelledOnCompletedSource_ClearedOnSet.token];
+        TOCInternal_count(TOCInternal_Counter_FutureSourcesCreated);
+        self->future = [TOCFuture _ForSource_completableFuture];
     }
     return self;
 }
 
 +(TOCFutureSource*) futureSourceUntil:(TOCCancelToken*)untilCancelledToken {
     TOCFutureSource* source = [TOCFutureSource new];
-    [untilCancelledToken whenCancelledDo:^{ [source trySetFailedWithCancel]; }
-                                  unless:source.future.cancelledOnCompletionToken];
-    return source;
-}
-
--(bool) _trySetAndFlattenResult:(TOCFuture*)result {
-    enum StartUnwrapResult startUnwrapResult = [future _ForSource_tryStartUnwrapping:result];
-    
-    bool didNotSet = startUnwrapResult == StartUnwrapResult_AlreadySet;
-    if (didNotSet) return false;
-    
-    // transfer the only reference to the completion source into a local now, so we don't have to clear it in multiple cases
-    TOCCancelTokenSource* cancelledOnCompletedSource = _cancelledOnCompletedSource_ClearedOnSet;
-    _cancelledOnCompletedSource_ClearedOnSet = nil;
     
-    switch (startUnwrapResult) {
-        case StartUnwrapResult_StartedAndFinished:
-            // nice: the result was already completed
-            // cancel completion source to propagate that completion
-            [cancelledOnCompletedSource cancel];
-            break;
-            
-        case StartUnwrapResult_CycleDetected:
-            // this future will never complete
-            // just allow our completion source to be discarded without being cancelled
-            // that way its token will become immortal and our future will also become immortal
-            break;
-            
-        case StartUnwrapResult_Started: {
-            // future will complete later
-            // keep completion source alive in closure until it can be cancelled
-            // if result becomes immortal, the closure will be discarded and take the source with it (making our future immortal as well)
-            [result.cancelledOnCompletionToken whenCancelledDo:^{
-                // future must be ready to be accessed before we propagate completion
-                [self->future _ForSource_forceUnwrapToComplete:result];
-                [cancelledOnCompletedSource cancel];
-            }];
-            break;
-            
-        } default:
-            // already checked StartUnwrapResult_AlreadySet above
-            TOCInternal_unexpectedEnum(startUnwrapResult);
+    enum TOCCancelTokenState untilState = untilCancelledToken.state;
+    if (untilState == TOCCancelTokenState_Cancelled) {
+        [source trySetFailedWithCancel];
+    } else if (untilState == TOCCancelTokenState_StillCancellable) {
+        [untilCancelledToken _whenCancelledDo:^{ [source trySetFailedWithCancel]; }
+                                           on:nil
+                                unlessSettled:source.future];
     }
     
-    // this source is set (i.e. it can't be set anymore), even if its future is not completed yet or ever
-    return true;
+    return source;
 }
--(bool) _tryComplete:(id)value succeeded:(bool)succeeded {
-    bool didSet = [future _ForSource_tryComplete:value succeeded:succeeded];
-    if (!didSet) return false;
-    
-    [_cancelledOnCompletedSource_ClearedOnSet cancel];
-    _cancelledOnCompletedSource_ClearedOnSet = nil;
-    return true;
+
+-(void) dealloc {
+    TOCInternal_count(TOCInternal_Counter_FutureSourcesDeallocated);
+    [future _ForSource_tryImmortalize];
 }
 
 -(bool) trySetResult:(id)result {
-    // automatic flattening
-    if ([result isKindOfClass:[TOCFuture class]]) {
-        return [self _trySetAndFlattenResult:result];
-    }
-    
-    return [self _tryComplete:result succeeded:true];
+    return [future _ForSource_trySetResult:result];
 }
 -(bool) trySetFailure:(id)failure {
-    return [self _tryComplete:failure succeeded:false];
+    return [future _ForSource_tryComplete:failure succeeded:false];
 }
 -(bool) trySetFailedWithCancel {
     return [self trySetFailure:TOCCancelToken.cancelledToken];
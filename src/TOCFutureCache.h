@@ -0,0 +1,112 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+#import "TOCTypeDefs.h"
+
+/*!
+ * Caches the futures of asynchronous operations by key, so that concurrent and repeated requests for the same key share a single operation.
+ *
+ * @discussion Asking for a key that isn't cached starts the given operation, and caches its future right away (before it completes).
+ * Asking for the same key again, while the operation is in flight or after it has succeeded, returns the cached future instead of starting another operation.
+ *
+ * Futures that fail are evicted as soon as they fail, so the next request for their key starts a new operation.
+ * Futures that succeed are evicted once their time to live has passed since they succeeded.
+ *
+ * The cache is bounded by a count limit and a cost limit.
+ * When a new entry puts the cache over either limit, the least recently used entries are evicted until it is back under both.
+ * An entry is used whenever its key is asked for.
+ *
+ * Each request can be cancelled with its own unless token, which only cancels the future returned to that request.
+ * When every request waiting on an in-flight operation has been cancelled, the operation is cancelled as well (by cancelling the token given to it),
+ * and evicted, so abandoned work stops as soon as nobody wants it.
+ * Requests with a nil (or immortal) token never give up on the operation, so they keep it running.
+ *
+ * Evicting an entry doesn't affect requests that already got its future, and doesn't cancel its operation.
+ *
+ * TOCFutureCache is thread safe.
+ */
+@interface TOCFutureCache : NSObject
+
+/*!
+ * Returns a new, empty, future cache with the given limits.
+ *
+ * @param countLimit The most entries to keep. Must be at least 1. Use NSUIntegerMax for no limit.
+ *
+ * @param costLimit The most total cost of the entries to keep. Use NSUIntegerMax for no limit.
+ *
+ * @param timeToLiveInSeconds How long, after succeeding, a future stays cached.
+ * Must be positive and not NaN. May be infinite, so succeeded futures are only evicted to stay within the limits.
+ */
++(TOCFutureCache*) futureCacheWithCountLimit:(NSUInteger)countLimit
+                                   costLimit:(NSUInteger)costLimit
+                                  timeToLive:(NSTimeInterval)timeToLiveInSeconds;
+
+/*!
+ * The most entries the cache keeps.
+ */
+@property (readonly,nonatomic) NSUInteger countLimit;
+
+/*!
+ * The most total cost of the entries the cache keeps.
+ */
+@property (readonly,nonatomic) NSUInteger costLimit;
+
+/*!
+ * How long, in seconds, a future stays cached after succeeding.
+ */
+@property (readonly,nonatomic) NSTimeInterval timeToLive;
+
+/*!
+ * Returns the cached future for the given key, or else starts the given operation and caches its future, unless cancelled.
+ *
+ * @param key The key to look up. Must not be nil. Used as a dictionary key.
+ *
+ * @param operation Starts the asynchronous operation, when the key isn't cached. Must not be nil, and must not return nil.
+ * The token given to it is cancelled if every request waiting on it is cancelled before it completes.
+ * If it throws, the exception propagates to the caller and nothing stays cached. Requests that were already sharing it fail with the exception.
+ *
+ * @param cost The cost of the entry, counted against the cost limit, when the operation is started.
+ *
+ * @param unlessCancelledToken When this token is cancelled, the returned future fails with a cancellation.
+ * The request also stops counting as waiting on the operation.
+ * A nil cancel token corresponds to an immortal cancel token.
+ *
+ * @result A future that will contain the result or failure of the (possibly shared) operation, or else a cancellation.
+ *
+ * @discussion Only successes stay cached. Failed operations, and operations whose future becomes immortal, are evicted so the next request starts over.
+ */
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                   orStart:(TOCUntilOperation)operation
+                  withCost:(NSUInteger)cost
+                    unless:(TOCCancelToken*)unlessCancelledToken;
+
+/*!
+ * Returns the cached future for the given key, or else starts the given operation and caches its future (with a cost of 1), unless cancelled.
+ *
+ * @see futureForKey:orStart:withCost:unless:
+ */
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                   orStart:(TOCUntilOperation)operation
+                    unless:(TOCCancelToken*)unlessCancelledToken;
+
+/*!
+ * Evicts the entry for the given key, if there is one, so that the next request for it starts a new operation.
+ */
+-(void) removeFutureForKey:(id<NSCopying>)key;
+
+/*!
+ * Evicts every entry.
+ */
+-(void) removeAllFutures;
+
+/*!
+ * Returns the number of entries currently cached, including in-flight operations.
+ */
+-(NSUInteger) count;
+
+/*!
+ * Returns the total cost of the entries currently cached.
+ */
+-(NSUInteger) totalCost;
+
+@end
@@ -0,0 +1,255 @@
+#import "TOCFutureCache.h"
+#import "TOCFuture+MoreContinuations.h"
+#import "TOCInternal.h"
+
+/// A cached future, along with what's needed to cancel its operation and evict it
+@interface TOCInternal_FutureCacheEntry : NSObject {
+@package id _key;
+@package TOCFuture* _future;
+/// Given to the operation. Cancelled when every request waiting on the operation has been cancelled.
+@package TOCCancelTokenSource* _operationCanceller;
+@package NSUInteger _cost;
+/// The number of requests waiting on the incomplete future that haven't been cancelled. Guarded by the cache.
+@package NSUInteger _waiterCount;
+/// The system uptime after which the entry is stale, or INFINITY until the future succeeds. Guarded by the cache.
+@package NSTimeInterval _expiryTime;
+/// Evicts the entry once it is stale. Guarded by the cache.
+@package TOCInternal_TimerWheelEntry* _expiryTimer;
+/// Whether or not the entry is still in the cache. Guarded by the cache.
+@package bool _isCached;
+/// The neighbouring entries in order of use. Only linked while the entry is in the cache (which keeps it alive).
+@package __unsafe_unretained TOCInternal_FutureCacheEntry* _lessRecentlyUsed;
+@package __unsafe_unretained TOCInternal_FutureCacheEntry* _moreRecentlyUsed;
+}
+@end
+
+@implementation TOCInternal_FutureCacheEntry
+@end
+
+@implementation TOCFutureCache {
+/// The cached entries, by key. Guarded by self.
+@private NSMutableDictionary* _entries;
+@private NSUInteger _totalCost;
+/// The ends of the list of cached entries, in order of use. Guarded by self.
+@private __unsafe_unretained TOCInternal_FutureCacheEntry* _leastRecentlyUsed;
+@private __unsafe_unretained TOCInternal_FutureCacheEntry* _mostRecentlyUsed;
+}
+
+@synthesize countLimit, costLimit, timeToLive;
+
++(TOCFutureCache*) futureCacheWithCountLimit:(NSUInteger)maxCount
+                                   costLimit:(NSUInteger)maxTotalCost
+                                  timeToLive:(NSTimeInterval)timeToLiveInSeconds {
+    TOCInternal_need(maxCount > 0);
+    TOCInternal_need(timeToLiveInSeconds > 0);
+    
+    TOCFutureCache* cache = [TOCFutureCache new];
+    cache->countLimit = maxCount;
+    cache->costLimit = maxTotalCost;
+    cache->timeToLive = timeToLiveInSeconds;
+    cache->_entries = [NSMutableDictionary dictionary];
+    return cache;
+}
+
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                   orStart:(TOCUntilOperation)operation
+                    unless:(TOCCancelToken*)unlessCancelledToken {
+    return [self futureForKey:key orStart:operation withCost:1 unless:unlessCancelledToken];
+}
+
+-(TOCFuture*) futureForKey:(id<NSCopying>)key
+                   orStart:(TOCUntilOperation)operation
+                  withCost:(NSUInteger)cost
+                    unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(key != nil);
+    TOCInternal_need(operation != nil);
+    if (unlessCancelledToken.isAlreadyCancelled) {
+        return [TOCFuture futureWithFailure:TOCCancelToken.cancelledToken];
+    }
+    
+    TOCInternal_FutureCacheEntry* entry;
+    TOCFutureSource* missSource = nil;
+    bool isWaiting;
+    @synchronized(self) {
+        entry = _entries[key];
+        if (entry != nil && entry->_expiryTime <= TOCInternal_monotonicNow()) {
+            // stale, but its expiry timer hasn't gotten around to evicting it yet
+            [self _evict:entry];
+            entry = nil;
+        }
+        
+        if (entry == nil) {
+            // cache a placeholder right away, so that concurrent misses share the operation started below
+            missSource = [TOCFutureSource new];
+            entry = [TOCInternal_FutureCacheEntry new];
+            entry->_key = [key copyWithZone:nil];
+            entry->_future = missSource.future;
+            entry->_operationCanceller = [TOCCancelTokenSource new];
+            entry->_cost = cost;
+            entry->_expiryTime = INFINITY;
+            [self _insert:entry];
+            [self _evictToFitLimitsSparing:entry];
+        } else {
+            [self _unlink:entry];
+            [self _linkAsMostRecentlyUsed:entry];
+        }
+        
+        isWaiting = entry->_future.isIncomplete;
+        if (isWaiting) entry->_waiterCount += 1;
+    }
+    
+    if (missSource != nil) {
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the future settles.
+        // (Settling includes becoming immortal, which has to evict the entry too, or the key would never be started again.)
+        [entry->_future _whenSettledDo:^{ [self _entrySettled:entry]; }];
+        
+        TOCFuture* operationResult;
+        @try {
+            operationResult = operation(entry->_operationCanceller.token);
+            TOCInternal_need(operationResult != nil);
+        } @catch (id exception) {
+            // nothing is going to complete the placeholder, so don't leave it behind for later requests
+            @synchronized(self) {
+                if (entry->_isCached) [self _evict:entry];
+            }
+            // requests that already joined the placeholder fail, instead of waiting on it forever
+            [missSource trySetFailure:exception];
+            @throw;
+        }
+        [missSource trySetResult:operationResult];
+    }
+    
+    if (isWaiting) {
+        [unlessCancelledToken _whenCancelledDo:^{ [self _waiterCancelled:entry]; }
+                                            on:TOCExecutors.inlineExecutor
+                                 unlessSettled:entry->_future];
+    }
+    
+    return [entry->_future unless:unlessCancelledToken];
+}
+
+-(void) removeFutureForKey:(id<NSCopying>)key {
+    TOCInternal_need(key != nil);
+    @synchronized(self) {
+        TOCInternal_FutureCacheEntry* entry = _entries[key];
+        if (entry != nil) [self _evict:entry];
+    }
+}
+
+-(void) removeAllFutures {
+    @synchronized(self) {
+        while (_leastRecentlyUsed != nil) {
+            TOCInternal_FutureCacheEntry* entry = _leastRecentlyUsed;
+            [self _evict:entry];
+        }
+    }
+}
+
+-(NSUInteger) count {
+    @synchronized(self) {
+        return _entries.count;
+    }
+}
+
+-(NSUInteger) totalCost {
+    @synchronized(self) {
+        return _totalCost;
+    }
+}
+
+-(void) _entrySettled:(TOCInternal_FutureCacheEntry*)entry {
+    @synchronized(self) {
+        if (!entry->_isCached) return;
+        
+        if (!entry->_future.hasResult) {
+            // don't hand out failures or futures that will never complete to later requests, let them try again
+            [self _evict:entry];
+            return;
+        }
+        
+        if (timeToLive < INFINITY) {
+            entry->_expiryTime = TOCInternal_monotonicNow() + timeToLive;
+            __weak TOCFutureCache* weakSelf = self;
+            entry->_expiryTimer = [TOCInternal_TimerWheel.sharedTimerWheel scheduleBlock:^{ [weakSelf _entryExpired:entry]; }
+                                                                              afterDelay:timeToLive];
+        }
+    }
+}
+
+-(void) _entryExpired:(TOCInternal_FutureCacheEntry*)entry {
+    @synchronized(self) {
+        if (entry->_isCached) [self _evict:entry];
+    }
+}
+
+-(void) _waiterCancelled:(TOCInternal_FutureCacheEntry*)entry {
+    bool isAbandoned;
+    @synchronized(self) {
+        entry->_waiterCount -= 1;
+        isAbandoned = entry->_waiterCount == 0 && entry->_future.isIncomplete;
+        
+        // evict before cancelling, so that later requests start over instead of getting the cancellation
+        if (isAbandoned && entry->_isCached) [self _evict:entry];
+    }
+    
+    if (isAbandoned) {
+        [entry->_operationCanceller cancel];
+    }
+}
+
+/// Must be called while holding the lock.
+-(void) _insert:(TOCInternal_FutureCacheEntry*)entry {
+    _entries[entry->_key] = entry;
+    _totalCost += entry->_cost;
+    entry->_isCached = true;
+    [self _linkAsMostRecentlyUsed:entry];
+}
+
+/// Must be called while holding the lock.
+-(void) _evict:(TOCInternal_FutureCacheEntry*)entry {
+    [self _unlink:entry];
+    _totalCost -= entry->_cost;
+    entry->_isCached = false;
+    [entry->_expiryTimer cancel];
+    entry->_expiryTimer = nil;
+    [_entries removeObjectForKey:entry->_key]; // last, because it may release the entry
+}
+
+/// Must be called while holding the lock.
+-(void) _evictToFitLimitsSparing:(TOCInternal_FutureCacheEntry*)newEntry {
+    while (_entries.count > countLimit || _totalCost > costLimit) {
+        TOCInternal_FutureCacheEntry* victim = _leastRecentlyUsed;
+        if (victim == newEntry) break; // everything else is gone, and a single entry is allowed to be over the cost limit
+        [self _evict:victim];
+    }
+}
+
+/// Must be called while holding the lock.
+-(void) _linkAsMostRecentlyUsed:(TOCInternal_FutureCacheEntry*)entry {
+    entry->_lessRecentlyUsed = _mostRecentlyUsed;
+    entry->_moreRecentlyUsed = nil;
+    if (_mostRecentlyUsed != nil) {
+        _mostRecentlyUsed->_moreRecentlyUsed = entry;
+    } else {
+        _leastRecentlyUsed = entry;
+    }
+    _mostRecentlyUsed = entry;
+}
+
+/// Must be called while holding the lock.
+-(void) _unlink:(TOCInternal_FutureCacheEntry*)entry {
+    if (entry->_lessRecentlyUsed != nil) {
+        entry->_lessRecentlyUsed->_moreRecentlyUsed = entry->_moreRecentlyUsed;
+    } else {
+        _leastRecentlyUsed = entry->_moreRecentlyUsed;
+    }
+    if (entry->_moreRecentlyUsed != nil) {
+        entry->_moreRecentlyUsed->_lessRecentlyUsed = entry->_lessRecentlyUsed;
+    } else {
+        _mostRecentlyUsed = entry->_lessRecentlyUsed;
+    }
+    entry->_lessRecentlyUsed = nil;
+    entry->_moreRecentlyUsed = nil;
+}
+
+@end
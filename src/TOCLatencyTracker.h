@@ -0,0 +1,144 @@
+#import <Foundation/Foundation.h>
+#import "TOCFutureAndSource.h"
+
+/*!
+ * The ways that a tracked operation can end.
+ */
+enum TOCOperationOutcome {
+    /*!
+     * The operation's future completed with a result.
+     */
+    TOCOperationOutcome_Result = 0,
+    
+    /*!
+     * The operation's future failed, with a failure that isn't a cancellation or timeout.
+     */
+    TOCOperationOutcome_Failure = 1,
+    
+    /*!
+     * The operation's future failed with a cancel token, i.e. the operation was cancelled.
+     */
+    TOCOperationOutcome_Cancel = 2,
+    
+    /*!
+     * The operation's future failed with a TOCTimeout.
+     */
+    TOCOperationOutcome_Timeout = 3
+};
+
+/*!
+ * A summary of the latencies recorded by a TOCLatencyTracker, at some point in time.
+ *
+ * @discussion Latencies are kept in log-linear buckets, like an HdrHistogram,
+ * so percentiles are approximate: they overestimate the true latency by at most ~3%, and never underestimate it.
+ * The minimum, maximum and mean are exact.
+ *
+ * Snapshots are immutable.
+ */
+@interface TOCLatencySnapshot : NSObject
+
+/*! The number of latencies recorded. */
+@property (readonly,nonatomic) uint64_t count;
+
+/*! The smallest latency recorded, in seconds, or 0 if nothing was recorded. */
+@property (readonly,nonatomic) NSTimeInterval minimum;
+
+/*! The largest latency recorded, in seconds, or 0 if nothing was recorded. */
+@property (readonly,nonatomic) NSTimeInterval maximum;
+
+/*! The average latency recorded, in seconds, or 0 if nothing was recorded. */
+@property (readonly,nonatomic) NSTimeInterval mean;
+
+/*!
+ * Returns the given percentile of the recorded latencies, in seconds, or 0 if nothing was recorded.
+ *
+ * @param percentile Which percentile to return, from 0 (the minimum) to 100 (the maximum).
+ *
+ * @discussion Uses the nearest-rank method: the result is (an upper bound on) the smallest latency
+ * that at least the given percentage of the recorded latencies are less than or equal to.
+ *
+ * For example, the 99th percentile of an operation is a reasonable timeout for it,
+ * and the 95th percentile is a reasonable delay before hedging it.
+ */
+-(NSTimeInterval) latencyAtPercentile:(double)percentile;
+
+/*!
+ * Returns a snapshot of the latencies recorded in either the receiver or the given snapshot.
+ *
+ * @param other The snapshot to combine with. Must not be nil.
+ */
+-(TOCLatencySnapshot*) snapshotCombinedWith:(TOCLatencySnapshot*)other;
+
+@end
+
+/*!
+ * Records how long operations with the same label take to complete, split by how they completed.
+ *
+ * @discussion Tracking is opt-in. Get the tracker for a label with latencyTrackerForLabel:,
+ * and pass the futures of the operations to time through trackLatencyOf:.
+ * For example, [[TOCLatencyTracker latencyTrackerForLabel:@"fetch"] trackLatencyOf:[TOCFuture futureFromUnlessOperation:fetch withTimeout:5]].
+ *
+ * Latencies are recorded separately for each outcome (result, failure, cancel, timeout),
+ * so that e.g. timeouts piling up at the timeout period don't hide how long the operations that succeeded took.
+ *
+ * Recording is lock-free, so many threads can record into the same tracker without contending on a lock.
+ *
+ * TOCLatencyTracker is thread safe.
+ */
+@interface TOCLatencyTracker : NSObject
+
+/*!
+ * Returns the tracker for the given label, creating it if it doesn't exist yet.
+ *
+ * @param label Identifies the kind of operation being tracked. Must not be nil.
+ *
+ * @discussion Trackers are kept for the life of the process, so labels should come from a small fixed set (not e.g. include request ids).
+ */
++(TOCLatencyTracker*) latencyTrackerForLabel:(NSString*)label;
+
+/*!
+ * Returns every tracker that has been created so far, keyed by label.
+ */
++(NSDictionary*) latencyTrackersByLabel;
+
+/*!
+ * The label identifying the kind of operation being tracked.
+ */
+@property (readonly,nonatomic) NSString* label;
+
+/*!
+ * Starts timing the given future, and records its latency and outcome once it completes.
+ *
+ * @param future The future of the operation to time. Must not be nil.
+ *
+ * @result The given future, for convenience.
+ *
+ * @discussion The latency is measured from when this method is called until the future completes.
+ * Start the operation just before calling this method, or record the latency with recordLatency:withOutcome: yourself when
+ * the operation takes a noticeable amount of time to start.
+ *
+ * Nothing is recorded if the future never completes (i.e. becomes immortal).
+ */
+-(TOCFuture*) trackLatencyOf:(TOCFuture*)future;
+
+/*!
+ * Records the latency of one operation.
+ *
+ * @param latencyInSeconds How long the operation took. Must be finite, not NaN, and not negative.
+ *
+ * @param outcome How the operation ended.
+ */
+-(void) recordLatency:(NSTimeInterval)latencyInSeconds
+          withOutcome:(enum TOCOperationOutcome)outcome;
+
+/*!
+ * Returns a snapshot of the latencies recorded, so far, for operations that ended with the given outcome.
+ */
+-(TOCLatencySnapshot*) snapshotOfOutcome:(enum TOCOperationOutcome)outcome;
+
+/*!
+ * Returns a snapshot of the latencies recorded, so far, for every outcome.
+ */
+-(TOCLatencySnapshot*) snapshot;
+
+@end
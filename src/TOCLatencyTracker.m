@@ -0,0 +1,181 @@
+#import "TOCLatencyTracker.h"
+#import "TOCInternal.h"
+
+/// One histogram per outcome, indexed by the outcome (which runs from zero up to the last one, without gaps)
+#define TOCInternal_OperationOutcomeCount (TOCOperationOutcome_Timeout + 1)
+
+static NSTimeInterval secondsFromNanoseconds(uint64_t nanoseconds) {
+    return nanoseconds / (NSTimeInterval)NSEC_PER_SEC;
+}
+
+@implementation TOCLatencySnapshot {
+@private TOCInternal_LatencyHistogramCounts _counts;
+}
+
++(TOCLatencySnapshot*) _snapshotOfHistograms:(TOCInternal_LatencyHistogram*)histograms count:(int)histogramCount {
+    TOCLatencySnapshot* snapshot = [TOCLatencySnapshot new];
+    TOCInternal_LatencyHistogramCounts_init(&snapshot->_counts);
+    for (int i = 0; i < histogramCount; i++) {
+        TOCInternal_LatencyHistogram_addCountsInto(&histograms[i], &snapshot->_counts);
+    }
+    return snapshot;
+}
+
+-(uint64_t) count {
+    return _counts.count;
+}
+
+-(NSTimeInterval) minimum {
+    if (_counts.count == 0) return 0;
+    return secondsFromNanoseconds(_counts.minNanoseconds);
+}
+
+-(NSTimeInterval) maximum {
+    if (_counts.count == 0) return 0;
+    return secondsFromNanoseconds(_counts.maxNanoseconds);
+}
+
+-(NSTimeInterval) mean {
+    if (_counts.count == 0) return 0;
+    return secondsFromNanoseconds(_counts.totalNanoseconds) / _counts.count;
+}
+
+-(NSTimeInterval) latencyAtPercentile:(double)percentile {
+    TOCInternal_need(percentile >= 0 && percentile <= 100);
+    if (_counts.count == 0) return 0;
+    
+    // nearest-rank percentile
+    uint64_t rank = (uint64_t)ceil(percentile / 100 * _counts.count);
+    if (rank == 0) return self.minimum;
+    
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < TOCInternal_LatencyHistogram_BucketCount; bucket++) {
+        seen += _counts.buckets[bucket];
+        if (seen >= rank) {
+            // the exact extremes are tighter bounds than the bucket's edge, when they are in the same bucket
+            uint64_t nanoseconds = TOCInternal_LatencyHistogram_highestValueInBucket(bucket);
+            nanoseconds = MIN(nanoseconds, _counts.maxNanoseconds);
+            nanoseconds = MAX(nanoseconds, _counts.minNanoseconds);
+            return secondsFromNanoseconds(nanoseconds);
+        }
+    }
+    
+    // a concurrent recording was only partially included in the counts
+    return self.maximum;
+}
+
+-(TOCLatencySnapshot*) snapshotCombinedWith:(TOCLatencySnapshot*)other {
+    TOCInternal_need(other != nil);
+    
+    TOCLatencySnapshot* combined = [TOCLatencySnapshot new];
+    combined->_counts = _counts;
+    for (int i = 0; i < TOCInternal_LatencyHistogram_BucketCount; i++) {
+        combined->_counts.buckets[i] += other->_counts.buckets[i];
+    }
+    combined->_counts.count += other->_counts.count;
+    combined->_counts.totalNanoseconds += other->_counts.totalNanoseconds;
+    combined->_counts.minNanoseconds = MIN(_counts.minNanoseconds, other->_counts.minNanoseconds);
+    combined->_counts.maxNanoseconds = MAX(_counts.maxNanoseconds, other->_counts.maxNanoseconds);
+    return combined;
+}
+
+-(NSString*) description {
+    if (_counts.count == 0) return @"No latencies";
+    return [NSString stringWithFormat:@"%llu latencies: min %gs, p50 %gs, p90 %gs, p99 %gs, max %gs, mean %gs",
+            (unsigned long long)_counts.count,
+            self.minimum,
+            [self latencyAtPercentile:50],
+            [self latencyAtPercentile:90],
+            [self latencyAtPercentile:99],
+            self.maximum,
+            self.mean];
+}
+
+@end
+
+@implementation TOCLatencyTracker {
+/// One histogram per outcome, indexed by enum TOCOperationOutcome
+@private TOCInternal_LatencyHistogram _histograms[TOCInternal_OperationOutcomeCount];
+}
+
+@synthesize label;
+
++(NSMutableDictionary*) _trackersByLabel {
+    static dispatch_once_t once;
+    static NSMutableDictionary* trackers = nil;
+    dispatch_once(&once, ^{
+        trackers = [NSMutableDictionary dictionary];
+    });
+    return trackers;
+}
+
++(TOCLatencyTracker*) latencyTrackerForLabel:(NSString*)trackerLabel {
+    TOCInternal_need(trackerLabel != nil);
+    
+    NSMutableDictionary* trackers = [self _trackersByLabel];
+    @synchronized(trackers) {
+        TOCLatencyTracker* tracker = trackers[trackerLabel];
+        if (tracker == nil) {
+            tracker = [TOCLatencyTracker new];
+            tracker->label = [trackerLabel copy];
+            for (int i = 0; i < TOCInternal_OperationOutcomeCount; i++) {
+                TOCInternal_LatencyHistogram_init(&tracker->_histograms[i]);
+            }
+            trackers[tracker->label] = tracker;
+        }
+        return tracker;
+    }
+}
+
++(NSDictionary*) latencyTrackersByLabel {
+    NSMutableDictionary* trackers = [self _trackersByLabel];
+    @synchronized(trackers) {
+        return [trackers copy];
+    }
+}
+
+-(TOCFuture*) trackLatencyOf:(TOCFuture*)future {
+    TOCInternal_need(future != nil);
+    
+    NSTimeInterval startTime = TOCInternal_monotonicNow();
+    [future finallyDo:^(TOCFuture* completed) {
+        enum TOCOperationOutcome outcome;
+        if (completed.hasResult) {
+            outcome = TOCOperationOutcome_Result;
+        } else if (completed.hasFailedWithCancel) {
+            outcome = TOCOperationOutcome_Cancel;
+        } else if (completed.hasFailedWithTimeout) {
+            outcome = TOCOperationOutcome_Timeout;
+        } else {
+            outcome = TOCOperationOutcome_Failure;
+        }
+        [self recordLatency:MAX(0, TOCInternal_monotonicNow() - startTime) withOutcome:outcome];
+    } on:TOCExecutors.inlineExecutor unless:nil];
+    return future;
+}
+
+-(void) recordLatency:(NSTimeInterval)latencyInSeconds
+          withOutcome:(enum TOCOperationOutcome)outcome {
+    TOCInternal_need(latencyInSeconds >= 0);
+    TOCInternal_need(latencyInSeconds < INFINITY);
+    TOCInternal_need((unsigned)outcome < TOCInternal_OperationOutcomeCount);
+    
+    // latencies past ~292 years are clamped, so the conversion can't overflow
+    double nanoseconds = MIN(latencyInSeconds * NSEC_PER_SEC, (double)(UINT64_MAX >> 1));
+    TOCInternal_LatencyHistogram_record(&_histograms[outcome], (uint64_t)nanoseconds);
+}
+
+-(TOCLatencySnapshot*) snapshotOfOutcome:(enum TOCOperationOutcome)outcome {
+    TOCInternal_need((unsigned)outcome < TOCInternal_OperationOutcomeCount);
+    return [TOCLatencySnapshot _snapshotOfHistograms:&_histograms[outcome] count:1];
+}
+
+-(TOCLatencySnapshot*) snapshot {
+    return [TOCLatencySnapshot _snapshotOfHistograms:_histograms count:TOCInternal_OperationOutcomeCount];
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Latencies of %@: %@", label, self.snapshot];
+}
+
+@end
@@ -0,0 +1,97 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * A block that determines if an operation that failed with the given failure should be retried.
+ */
+typedef bool (^TOCRetryableFailurePredicate)(id failure);
+
+/*!
+ * Describes how, and for how long, to keep retrying a failing asynchronous operation.
+ *
+ * @discussion Use with futureFromUnlessOperation:withRetryPolicy:unless:.
+ *
+ * The delay before each retry is chosen with "full jitter": uniformly at random between zero and an exponentially growing cap.
+ * The cap before the n'th retry (counting from 0) is baseDelay * 2^n, but never more than maxDelay.
+ * Randomizing the whole delay keeps many clients that failed at the same time (e.g. during a backend blip) from all retrying at the same time.
+ *
+ * Retry policies are immutable. Use the policyWith... methods to get modified copies.
+ */
+@interface TOCRetryPolicy : NSObject
+
+/*!
+ * Returns a retry policy that retries any failure (except a cancellation), up to the given number of attempts in total.
+ *
+ * @param maxAttempts The most times to run the operation, including the first attempt. Must be at least 1.
+ *
+ * @param baseDelayInSeconds The cap on the delay before the first retry, which doubles for each following retry.
+ * Must not be negative, infinite or NaN.
+ *
+ * @param maxDelayInSeconds The most to ever wait before a retry. Must not be less than the base delay, or NaN. May be infinite.
+ */
++(TOCRetryPolicy*) retryPolicyWithMaxAttempts:(NSUInteger)maxAttempts
+                                    baseDelay:(NSTimeInterval)baseDelayInSeconds
+                                     maxDelay:(NSTimeInterval)maxDelayInSeconds;
+
+/*!
+ * Returns a copy of the receiving policy that only retries failures matching the given predicate.
+ *
+ * @param isRetryableFailure Determines if a failure is worth retrying. Must not be nil.
+ *
+ * @discussion Cancellations are never retried, regardless of the predicate.
+ */
+-(TOCRetryPolicy*) policyWithRetryableFailurePredicate:(TOCRetryableFailurePredicate)isRetryableFailure;
+
+/*!
+ * Returns a copy of the receiving policy that gives up once the given amount of time has passed since the first attempt started.
+ *
+ * @param totalTimeoutInSeconds How long all of the attempts, and the delays between them, may take together.
+ * Must be positive and not NaN. May be infinite, for no overall deadline.
+ *
+ * @discussion An attempt still running at the deadline is cancelled, and the retried operation fails with a timeout.
+ * A retry whose delay would end after the deadline isn't waited for: the retried operation fails with the last failure right away.
+ */
+-(TOCRetryPolicy*) policyWithTotalTimeout:(NSTimeInterval)totalTimeoutInSeconds;
+
+/*!
+ * The most times the operation is run, including the first attempt.
+ */
+@property (readonly,nonatomic) NSUInteger maxAttempts;
+
+/*!
+ * The cap, in seconds, on the delay before the first retry.
+ */
+@property (readonly,nonatomic) NSTimeInterval baseDelay;
+
+/*!
+ * The most time, in seconds, waited before any retry.
+ */
+@property (readonly,nonatomic) NSTimeInterval maxDelay;
+
+/*!
+ * Determines which failures are retried, or nil when every failure (except a cancellation) is retried.
+ */
+@property (readonly,nonatomic) TOCRetryableFailurePredicate isRetryableFailure;
+
+/*!
+ * How long, in seconds, all of the attempts may take together. INFINITY when there is no overall deadline.
+ */
+@property (readonly,nonatomic) NSTimeInterval totalTimeout;
+
+/*!
+ * Determines if the receiving policy allows retrying after the given failure.
+ *
+ * @discussion False for cancellations, and for failures that don't match the isRetryableFailure predicate.
+ */
+-(bool) shouldRetryFailure:(id)failure;
+
+/*!
+ * Returns a randomly chosen delay, in seconds, to wait before the given retry.
+ *
+ * @param retryIndex The number of retries that have already happened (i.e. 0 for the delay after the first attempt failed).
+ *
+ * @result A delay chosen uniformly at random between 0 and min(maxDelay, baseDelay * 2^retryIndex).
+ * INFINITY when that cap is infinite (only possible when maxDelay is infinite).
+ */
+-(NSTimeInterval) jitteredDelayBeforeRetry:(NSUInteger)retryIndex;
+
+@end
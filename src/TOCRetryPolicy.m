@@ -0,0 +1,73 @@
+#import "TOCRetryPolicy.h"
+#import "TOCCancelTokenAndSource.h"
+#import "TOCInternal.h"
+
+@implementation TOCRetryPolicy
+
+@synthesize maxAttempts, baseDelay, maxDelay, isRetryableFailure, totalTimeout;
+
++(TOCRetryPolicy*) retryPolicyWithMaxAttempts:(NSUInteger)maxAttemptCount
+                                    baseDelay:(NSTimeInterval)baseDelayInSeconds
+                                     maxDelay:(NSTimeInterval)maxDelayInSeconds {
+    TOCInternal_need(maxAttemptCount > 0);
+    TOCInternal_need(baseDelayInSeconds >= 0);
+    TOCInternal_need(baseDelayInSeconds < INFINITY);
+    TOCInternal_need(maxDelayInSeconds >= baseDelayInSeconds);
+    
+    TOCRetryPolicy* policy = [TOCRetryPolicy new];
+    policy->maxAttempts = maxAttemptCount;
+    policy->baseDelay = baseDelayInSeconds;
+    policy->maxDelay = maxDelayInSeconds;
+    policy->totalTimeout = INFINITY;
+    return policy;
+}
+
+-(TOCRetryPolicy*) _copy {
+    TOCRetryPolicy* policy = [TOCRetryPolicy new];
+    policy->maxAttempts = maxAttempts;
+    policy->baseDelay = baseDelay;
+    policy->maxDelay = maxDelay;
+    policy->isRetryableFailure = isRetryableFailure;
+    policy->totalTimeout = totalTimeout;
+    return policy;
+}
+
+-(TOCRetryPolicy*) policyWithRetryableFailurePredicate:(TOCRetryableFailurePredicate)retryableFailurePredicate {
+    TOCInternal_need(retryableFailurePredicate != nil);
+    
+    TOCRetryPolicy* policy = [self _copy];
+    policy->isRetryableFailure = retryableFailurePredicate;
+    return policy;
+}
+
+-(TOCRetryPolicy*) policyWithTotalTimeout:(NSTimeInterval)totalTimeoutInSeconds {
+    TOCInternal_need(totalTimeoutInSeconds > 0);
+    
+    TOCRetryPolicy* policy = [self _copy];
+    policy->totalTimeout = totalTimeoutInSeconds;
+    return policy;
+}
+
+-(bool) shouldRetryFailure:(id)failure {
+    if ([failure isKindOfClass:[TOCCancelToken class]]) return false;
+    return isRetryableFailure == nil || isRetryableFailure(failure);
+}
+
+-(NSTimeInterval) jitteredDelayBeforeRetry:(NSUInteger)retryIndex {
+    // ldexp saturates to infinity instead of overflowing, and a finite max delay brings it back down
+    NSTimeInterval cap = MIN(maxDelay, ldexp(baseDelay, (int)MIN(retryIndex, (NSUInteger)1024)));
+    if (cap == INFINITY) return INFINITY;
+    
+    double unitRandom = arc4random() / (double)UINT32_MAX;
+    return cap * unitRandom;
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Retry policy: up to %lu attempts, delays up to %gs doubling from %gs, total timeout %gs",
+            (unsigned long)maxAttempts,
+            maxDelay,
+            baseDelay,
+            totalTimeout];
+}
+
+@end
@@ -0,0 +1,85 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * A snapshot of how many futures, cancel tokens and handlers the library has created, settled and released.
+ *
+ * @discussion Get the current totals with [TOCStatistics snapshot].
+ * To get rates (e.g. futures created per second), take two snapshots and use statisticsSince: to get the difference.
+ *
+ * The counting is always on, and cheap: each thread increments its own counters, without any locking or contention,
+ * and the counters of every thread are only added up when a snapshot is taken.
+ * Counts are read one at a time, while other threads may be counting, so a snapshot is not an exact instant.
+ * For example, a live count can be briefly off by the events that are in flight.
+ *
+ * Live counts are the number of objects created but not yet deallocated. A steadily rising live count indicates a leak.
+ * Pending handlers are handlers that have been registered, but haven't been run, discarded or removed yet.
+ * A steadily rising pending handler count indicates handlers being registered on futures or tokens that never settle.
+ *
+ * Snapshots are immutable.
+ */
+@interface TOCStatistics : NSObject
+
+/*!
+ * Returns the totals counted since the process started.
+ */
++(TOCStatistics*) snapshot;
+
+/*!
+ * Returns how much each count has increased since the given (earlier) snapshot.
+ *
+ * @param earlierSnapshot A snapshot taken before the receiver. Must not be nil.
+ *
+ * @discussion Live and pending counts aren't differences: they are the receiver's counts, as of when it was taken.
+ */
+-(TOCStatistics*) statisticsSince:(TOCStatistics*)earlierSnapshot;
+
+/*! The number of futures created (including flattened and already-completed futures). */
+@property (readonly,nonatomic) uint64_t futuresCreated;
+/*! The number of times a future (or a group of futures flattened into each other) completed with a result or failure. */
+@property (readonly,nonatomic) uint64_t futuresCompleted;
+/*! The number of times a future (or a group of futures flattened into each other) became immortal, i.e. was guaranteed to never complete. */
+@property (readonly,nonatomic) uint64_t futuresImmortalized;
+/*! The number of futures that have been created but not deallocated. */
+@property (readonly,nonatomic) int64_t liveFutures;
+
+/*! The number of future sources created. */
+@property (readonly,nonatomic) uint64_t futureSourcesCreated;
+/*! The number of future sources that have been created but not deallocated. */
+@property (readonly,nonatomic) int64_t liveFutureSources;
+
+/*! The number of cancel tokens created. */
+@property (readonly,nonatomic) uint64_t cancelTokensCreated;
+/*! The number of cancel tokens that were cancelled. */
+@property (readonly,nonatomic) uint64_t cancelTokensCancelled;
+/*! The number of cancel tokens that became immortal, i.e. were guaranteed to never be cancelled. */
+@property (readonly,nonatomic) uint64_t cancelTokensImmortalized;
+/*! The number of cancel tokens that have been created but not deallocated. */
+@property (readonly,nonatomic) int64_t liveCancelTokens;
+
+/*! The number of cancel token sources created. */
+@property (readonly,nonatomic) uint64_t cancelTokenSourcesCreated;
+/*! The number of cancel token sources that have been created but not deallocated. */
+@property (readonly,nonatomic) int64_t liveCancelTokenSources;
+
+/*! The number of handlers registered on futures and cancel tokens (including the library's own internal handlers). */
+@property (readonly,nonatomic) uint64_t handlersRegistered;
+/*! The number of registered handlers that were removed before their future or token settled (e.g. by an unless token being cancelled). */
+@property (readonly,nonatomic) uint64_t handlersRemoved;
+/*! The number of registered handlers that were run. */
+@property (readonly,nonatomic) uint64_t handlersRun;
+/*! The number of registered handlers that were discarded without running, because their future or token became immortal. */
+@property (readonly,nonatomic) uint64_t handlersDiscarded;
+/*! The number of registered handlers that are still waiting to be run, discarded or removed. */
+@property (readonly,nonatomic) int64_t pendingHandlers;
+
+/*! The number of times blocks were dispatched onto the main queue (a batch of blocks hopping together counts once). */
+@property (readonly,nonatomic) uint64_t mainThreadHops;
+/*! The number of times a future was set to flatten a future that was (transitively) flattening into it, making both immortal. */
+@property (readonly,nonatomic) uint64_t flatteningCyclesDetected;
+
+/*!
+ * Returns the counts in a dictionary, keyed by the names of the corresponding properties, for logging or exporting to a metrics system.
+ */
+-(NSDictionary*) dictionaryRepresentation;
+
+@end
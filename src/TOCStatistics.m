@@ -0,0 +1,103 @@
+#import "TOCStatistics.h"
+#import "TOCInternal.h"
+
+@implementation TOCStatistics {
+/// Event counts (or differences in event counts), indexed by enum TOCInternal_Counter
+@private uint64_t _counts[TOCInternal_CounterCount];
+/// Event totals as of when the snapshot was taken, for the live and pending counts
+@private uint64_t _totals[TOCInternal_CounterCount];
+}
+
++(TOCStatistics*) snapshot {
+    TOCStatistics* statistics = [TOCStatistics new];
+    TOCInternal_Counters_readTotals(statistics->_totals);
+    memcpy(statistics->_counts, statistics->_totals, sizeof(statistics->_counts));
+    return statistics;
+}
+
+-(TOCStatistics*) statisticsSince:(TOCStatistics*)earlierSnapshot {
+    TOCInternal_need(earlierSnapshot != nil);
+    
+    TOCStatistics* statistics = [TOCStatistics new];
+    for (int i = 0; i < TOCInternal_CounterCount; i++) {
+        statistics->_counts[i] = _counts[i] - earlierSnapshot->_counts[i];
+    }
+    memcpy(statistics->_totals, _totals, sizeof(statistics->_totals));
+    return statistics;
+}
+
+-(int64_t) _total:(enum TOCInternal_Counter)counter {
+    return (int64_t)_totals[counter];
+}
+
+-(uint64_t) futuresCreated { return _counts[TOCInternal_Counter_FuturesCreated]; }
+-(uint64_t) futuresCompleted { return _counts[TOCInternal_Counter_FuturesCompleted]; }
+-(uint64_t) futuresImmortalized { return _counts[TOCInternal_Counter_FuturesImmortalized]; }
+-(int64_t) liveFutures {
+    return [self _total:TOCInternal_Counter_FuturesCreated]
+         - [self _total:TOCInternal_Counter_FuturesDeallocated];
+}
+
+-(uint64_t) futureSourcesCreated { return _counts[TOCInternal_Counter_FutureSourcesCreated]; }
+-(int64_t) liveFutureSources {
+    return [self _total:TOCInternal_Counter_FutureSourcesCreated]
+         - [self _total:TOCInternal_Counter_FutureSourcesDeallocated];
+}
+
+-(uint64_t) cancelTokensCreated { return _counts[TOCInternal_Counter_CancelTokensCreated]; }
+-(uint64_t) cancelTokensCancelled { return _counts[TOCInternal_Counter_CancelTokensCancelled]; }
+-(uint64_t) cancelTokensImmortalized { return _counts[TOCInternal_Counter_CancelTokensImmortalized]; }
+-(int64_t) liveCancelTokens {
+    return [self _total:TOCInternal_Counter_CancelTokensCreated]
+         - [self _total:TOCInternal_Counter_CancelTokensDeallocated];
+}
+
+-(uint64_t) cancelTokenSourcesCreated { return _counts[TOCInternal_Counter_CancelTokenSourcesCreated]; }
+-(int64_t) liveCancelTokenSources {
+    return [self _total:TOCInternal_Counter_CancelTokenSourcesCreated]
+         - [self _total:TOCInternal_Counter_CancelTokenSourcesDeallocated];
+}
+
+-(uint64_t) handlersRegistered { return _counts[TOCInternal_Counter_HandlersRegistered]; }
+-(uint64_t) handlersRemoved { return _counts[TOCInternal_Counter_HandlersRemoved]; }
+-(uint64_t) handlersRun { return _counts[TOCInternal_Counter_HandlersRun]; }
+-(uint64_t) handlersDiscarded { return _counts[TOCInternal_Counter_HandlersDiscarded]; }
+-(int64_t) pendingHandlers {
+    return [self _total:TOCInternal_Counter_HandlersRegistered]
+         - [self _total:TOCInternal_Counter_HandlersRemoved]
+         - [self _total:TOCInternal_Counter_HandlersRun]
+         - [self _total:TOCInternal_Counter_HandlersDiscarded];
+}
+
+-(uint64_t) mainThreadHops { return _counts[TOCInternal_Counter_MainThreadHops]; }
+-(uint64_t) flatteningCyclesDetected { return _counts[TOCInternal_Counter_FlatteningCyclesDetected]; }
+
+-(NSDictionary*) dictionaryRepresentation {
+    return @{
+        @"futuresCreated": @(self.futuresCreated),
+        @"futuresCompleted": @(self.futuresCompleted),
+        @"futuresImmortalized": @(self.futuresImmortalized),
+        @"liveFutures": @(self.liveFutures),
+        @"futureSourcesCreated": @(self.futureSourcesCreated),
+        @"liveFutureSources": @(self.liveFutureSources),
+        @"cancelTokensCreated": @(self.cancelTokensCreated),
+        @"cancelTokensCancelled": @(self.cancelTokensCancelled),
+        @"cancelTokensImmortalized": @(self.cancelTokensImmortalized),
+        @"liveCancelTokens": @(self.liveCancelTokens),
+        @"cancelTokenSourcesCreated": @(self.cancelTokenSourcesCreated),
+        @"liveCancelTokenSources": @(self.liveCancelTokenSources),
+        @"handlersRegistered": @(self.handlersRegistered),
+        @"handlersRemoved": @(self.handlersRemoved),
+        @"handlersRun": @(self.handlersRun),
+        @"handlersDiscarded": @(self.handlersDiscarded),
+        @"pendingHandlers": @(self.pendingHandlers),
+        @"mainThreadHops": @(self.mainThreadHops),
+        @"flatteningCyclesDetected": @(self.flatteningCyclesDetected)
+    };
+}
+
+-(NSString*) description {
+    return [NSString stringWithFormat:@"Statistics: %@", self.dictionaryRepresentation];
+}
+
+@end
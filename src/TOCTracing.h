@@ -0,0 +1,50 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * Records what futures and cancel tokens do, for viewing the dependencies between futures on a timeline.
+ *
+ * @discussion Tracing is off by default. While it is on, the library records:
+ *
+ * - futures being made, and which future a continuation's future (from then:, finally:, etc) is continuing,
+ * - futures being set to flatten other futures (including flattening cycles),
+ * - futures settling (completing, failing, or becoming immortal),
+ * - cancel tokens being cancelled,
+ * - completion handlers running, and for how long.
+ *
+ * Each event is tagged with the thread it happened on.
+ * Events are recorded into a per-thread ring buffer, without locking, so tracing doesn't serialize the traced threads.
+ * Each thread keeps its most recent 16384 events, so older events are lost when tracing busy programs for a long time.
+ *
+ * Export the recorded events with chromeTraceJSON, and open them in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ * Futures are shown as async spans, from being made until settling, labelled with the future they continue from (their parent).
+ * Handlers are shown as slices on the thread that ran them, labelled with how long they waited after their future settled.
+ * Following parents back from a slow future gives its critical path.
+ *
+ * Only handlers registered while tracing is on are timed. When tracing is off, each traced spot costs one relaxed atomic load.
+ */
+@interface TOCTracing : NSObject
+
+/*!
+ * Discards any previously recorded events, and starts recording.
+ */
++(void) startTracing;
+
+/*!
+ * Stops recording. The recorded events are kept, for exporting.
+ */
++(void) stopTracing;
+
+/*!
+ * Determines if events are currently being recorded.
+ */
++(bool) isTracing;
+
+/*!
+ * Returns the events recorded since tracing was last started, in the Chrome trace event format (JSON).
+ *
+ * @discussion Can be called while tracing, but events recorded during the export may or may not be included.
+ * Timestamps are relative to when tracing was started.
+ */
++(NSData*) chromeTraceJSON;
+
+@end
@@ -0,0 +1,22 @@
+#import "TOCTracing.h"
+#import "TOCInternal.h"
+
+@implementation TOCTracing
+
++(void) startTracing {
+    TOCInternal_Tracing_start();
+}
+
++(void) stopTracing {
+    TOCInternal_Tracing_stop();
+}
+
++(bool) isTracing {
+    return TOCInternal_isTracing();
+}
+
++(NSData*) chromeTraceJSON {
+    return TOCInternal_Tracing_exportChromeTrace();
+}
+
+@end
@@ -31,3 +31,16 @@ typedef TOCFuture* (^TOCUntilOperation)(TOCCancelToken* untilCancelledToken);
  * The future returned by the operation should immediately transition to the cancelled state when the operation is cancelled.
  */
 typedef TOCFuture* (^TOCUnlessOperation)(TOCCancelToken* unlessCancelledToken);
+
+/*!
+ * A block that starts an asynchronous operation for one item of a collection, and returns a future that will contain its result unless the operation is cancelled.
+ *
+ * @param item The item to start the operation for.
+ *
+ * @param unlessCancelledToken Cancelling this token before the operation has completed should immediately cancel the operation.
+ *
+ * @result A future representing the eventual result of the asynchronous operation, or a cancellation failure if the operation was cancelled.
+ *
+ * @discussion Like TOCUnlessOperation, but given the item to work on.
+ */
+typedef TOCFuture* (^TOCAsyncItemOperation)(id item, TOCCancelToken* unlessCancelledToken);
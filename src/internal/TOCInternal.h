@@ -3,6 +3,17 @@
 #import "TOCInternal_BlockObject.h"
 #import "TOCInternal_Racer.h"
 #import "TOCInternal_OnDeallocObject.h"
+#import "TOCInternal_HandlerStack.h"
+#import "TOCInternal_Settleable.h"
+#import "TOCInternal_UnionFindNode.h"
+#import "TOCInternal_Executor.h"
+#import "TOCInternal_FinallyAllAggregator.h"
+#import "TOCInternal_TimerWheel.h"
+#import "TOCInternal_Deadline.h"
+#import "TOCInternal_AsyncMapper.h"
+#import "TOCInternal_Statistics.h"
+#import "TOCInternal_LatencyHistogram.h"
+#import "TOCInternal_Tracing.h"
 
 #define TOCInternal_need(expr) \
     if (!(expr)) \
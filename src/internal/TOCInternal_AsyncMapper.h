@@ -0,0 +1,26 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+#import "TOCTypeDefs.h"
+
+/*!
+ * Runs an asynchronous operation over every item of an array, with a bounded number of operations in flight, for toc_mapAsync:maxConcurrency:unless:.
+ *
+ * @discussion Operations are started by whichever thread frees up a slot, but only one thread starts operations at a time.
+ * A thread that frees up a slot while another thread is starting operations leaves the slot for that thread to fill.
+ * That keeps operations that complete inline from recursing into starting the next operation, no matter how many items there are.
+ */
+@interface TOCInternal_AsyncMapper : NSObject
+
+/*!
+ * Returns a future for the results of running the operation over every item, in the same order as the items.
+ *
+ * @discussion Fails with the first failure, or with a cancellation when the given token is cancelled first.
+ * Either way, no more operations are started, and the operations in flight are cancelled.
+ */
++(TOCFuture*) mapAsync:(NSArray*)items
+             operation:(TOCAsyncItemOperation)operation
+        maxConcurrency:(NSUInteger)maxConcurrency
+                unless:(TOCCancelToken*)unlessCancelledToken;
+
+@end
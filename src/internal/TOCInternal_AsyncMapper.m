@@ -0,0 +1,108 @@
+#import "TOCInternal_AsyncMapper.h"
+#import "TOCInternal.h"
+
+@implementation TOCInternal_AsyncMapper {
+@private NSArray* _items;
+@private TOCAsyncItemOperation _operation;
+@private TOCFutureSource* _resultSource;
+/// Cancelled when the result fails (or is cancelled), to stop the operations in flight
+@private TOCCancelTokenSource* _operationsCanceller;
+/// The results so far, at the index of their item (NSNull for operations that haven't succeeded yet). Guarded by self.
+@private NSMutableArray* _results;
+/// The index of the next item to start an operation for. Guarded by self.
+@private NSUInteger _nextIndex;
+/// How many more operations may be started right now. Guarded by self.
+@private NSUInteger _freeSlotCount;
+/// How many operations have succeeded. Guarded by self.
+@private NSUInteger _succeededCount;
+/// Whether or not some thread is currently starting operations. Guarded by self.
+@private bool _isStarting;
+}
+
++(TOCFuture*) mapAsync:(NSArray*)items
+             operation:(TOCAsyncItemOperation)operation
+        maxConcurrency:(NSUInteger)maxConcurrency
+                unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(items != nil);
+    TOCInternal_need(operation != nil);
+    TOCInternal_need(maxConcurrency > 0);
+    
+    TOCFutureSource* resultSource = [TOCFutureSource futureSourceUntil:unlessCancelledToken];
+    if (items.count == 0) {
+        [resultSource trySetResult:@[]];
+        return resultSource.future;
+    }
+    
+    TOCInternal_AsyncMapper* mapper = [TOCInternal_AsyncMapper new];
+    mapper->_items = items;
+    mapper->_operation = operation;
+    mapper->_resultSource = resultSource;
+    mapper->_operationsCanceller = [TOCCancelTokenSource cancelTokenSourceUntil:unlessCancelledToken];
+    mapper->_results = [NSMutableArray arrayWithCapacity:items.count];
+    for (NSUInteger i = 0; i < items.count; i++) {
+        [mapper->_results addObject:[NSNull null]];
+    }
+    mapper->_freeSlotCount = MIN(maxConcurrency, items.count);
+    
+    [mapper _startOperations];
+    return resultSource.future;
+}
+
+-(void) _startOperations {
+    @synchronized(self) {
+        // whoever is already starting operations will fill the freed slot
+        if (_isStarting) return;
+        _isStarting = true;
+    }
+    
+    while (true) {
+        NSUInteger index;
+        @synchronized(self) {
+            bool isDone = _freeSlotCount == 0
+                       || _nextIndex == _items.count
+                       || !_resultSource.future.isIncomplete;
+            if (isDone) {
+                _isStarting = false;
+                return;
+            }
+            _freeSlotCount -= 1;
+            index = _nextIndex;
+            _nextIndex += 1;
+        }
+        
+        TOCFuture* operationResult = _operation(_items[index], _operationsCanceller.token);
+        TOCInternal_need(operationResult != nil);
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the operation completes or the map fails.
+        [operationResult _whenCompletedDo:^{ [self _operation:operationResult completedAtIndex:index]; }
+                                       on:TOCExecutors.inlineExecutor
+                                   unless:_operationsCanceller.token];
+    }
+}
+
+-(void) _operation:(TOCFuture*)operationResult completedAtIndex:(NSUInteger)index {
+    if (operationResult.hasFailed) {
+        // fail fast, stopping the other operations (when the map was cancelled, the result has already failed)
+        if ([_resultSource trySetFailure:operationResult.forceGetFailure]) {
+            [_operationsCanceller cancel];
+        }
+        return;
+    }
+    
+    NSArray* finishedResults = nil;
+    @synchronized(self) {
+        id result = operationResult.forceGetResult;
+        if (result != nil) _results[index] = result;
+        _succeededCount += 1;
+        _freeSlotCount += 1;
+        if (_succeededCount == _items.count) finishedResults = [_results copy];
+    }
+    
+    if (finishedResults != nil) {
+        [_resultSource trySetResult:finishedResults];
+        return;
+    }
+    [self _startOperations];
+}
+
+@end
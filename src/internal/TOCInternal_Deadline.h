@@ -0,0 +1,26 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+
+/*!
+ * Returns the current time, in seconds, on the monotonic clock that deadlines and delays are measured against.
+ *
+ * @discussion Unaffected by changes to the wall clock.
+ */
+NSTimeInterval TOCInternal_monotonicNow(void);
+
+@interface TOCCancelToken (TOCInternal_Deadline)
+
+/*!
+ * Returns the time, on the monotonic clock, by which the receiving token will have been cancelled, or INFINITY if it has no deadline.
+ */
+-(NSTimeInterval) _deadlineTime;
+
+/*!
+ * Gives the receiving token a deadline, or moves its deadline earlier.
+ *
+ * @discussion Only call this on a token that hasn't been given out yet, from the code that is making it.
+ * The caller is responsible for actually cancelling the token by the deadline.
+ */
+-(void) _initDeadlineTime:(NSTimeInterval)deadlineTime;
+
+@end
@@ -0,0 +1,5 @@
+#import "TOCInternal_Deadline.h"
+
+NSTimeInterval TOCInternal_monotonicNow(void) {
+    return NSProcessInfo.processInfo.systemUptime;
+}
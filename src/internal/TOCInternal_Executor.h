@@ -0,0 +1,68 @@
+#import <Foundation/Foundation.h>
+#import "TOCExecutor.h"
+#import "TOCInternal_HandlerStack.h"
+#import "TOCInternal_Settleable.h"
+
+/*!
+ * Returns an executor that runs blocks on the main thread, inline when they are given to it on the main thread.
+ *
+ * @discussion This is what the default executor is, on the main thread.
+ * Blocks from other threads are dispatched onto the main queue (no run loop required), batched when possible.
+ */
+id<TOCExecutor> TOCInternal_mainThreadExecutor(void);
+
+/*!
+ * Starts collecting the blocks given to the main thread executor from the current thread, instead of dispatching each one separately.
+ *
+ * @result True if collecting started, in which case the caller must call TOCInternal_MainThreadBatch_end.
+ * False on the main thread (where those blocks run inline anyways), or when the current thread is already collecting.
+ *
+ * @discussion Used while running the handlers released by settling a token or future, so that they get to the main thread in one hop.
+ */
+bool TOCInternal_MainThreadBatch_begin(void);
+
+/*!
+ * Stops collecting blocks for the main thread, and dispatches everything collected onto the main queue as a single block.
+ *
+ * @discussion The collected blocks run in the order they were given to the main thread executor.
+ */
+void TOCInternal_MainThreadBatch_end(void);
+
+/*!
+ * Dispatches the blocks collected for the main thread so far, if any, without ending the collecting.
+ *
+ * @discussion Used before blocking the current thread, since the blocks might be what it ends up waiting for.
+ */
+void TOCInternal_MainThreadBatch_flush(void);
+
+/*!
+ * Returns the given executor, or the default executor for the current thread when given nil.
+ *
+ * @discussion Resolve at registration time, not when the handler runs, so that the registering thread decides.
+ */
+id<TOCExecutor> TOCInternal_resolveExecutor(id<TOCExecutor> executor);
+
+/*!
+ * Determines if the given (resolved) executor would run a block inline, if given one on the current thread right now.
+ *
+ * @discussion Used to skip wrapping handlers that are about to run anyways.
+ */
+bool TOCInternal_executesInlineHere(id<TOCExecutor> executor);
+
+/*!
+ * Determines if the given (resolved) executor only ever runs blocks on the main thread.
+ *
+ * @discussion Used to detect waits, on the main thread, for work that can't start until the main thread is free.
+ */
+bool TOCInternal_executesOnlyOnMainThread(id<TOCExecutor> executor);
+
+/*!
+ * Wraps a handler so that running the wrapper gives the handler to the given (resolved) executor.
+ *
+ * @param unlessTriggered When not nil, the wrapped handler does a final check (once the executor runs it) and skips running if this has been triggered.
+ *
+ * @result The handler itself, when the executor is the inline executor.
+ */
+TOCInternal_Handler TOCInternal_executedBy(id<TOCExecutor> executor,
+                                           TOCInternal_Handler handler,
+                                           id<TOCInternal_Settleable> unlessTriggered);
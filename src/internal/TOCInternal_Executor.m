@@ -0,0 +1,112 @@
+#import "TOCInternal_Executor.h"
+#import "TOCInternal.h"
+
+/// Whether or not blocks given to the main thread executor from this thread are being collected
+static _Thread_local bool mainThreadBatchIsOpen;
+/// A retained NSMutableArray of the collected blocks (in order), or NULL if nothing has been collected yet
+static _Thread_local void* mainThreadBatchBlocks;
+
+bool TOCInternal_MainThreadBatch_begin(void) {
+    if (mainThreadBatchIsOpen) return false;
+    if (NSThread.isMainThread) return false;
+    mainThreadBatchIsOpen = true;
+    return true;
+}
+
+void TOCInternal_MainThreadBatch_end(void) {
+    TOCInternal_force(mainThreadBatchIsOpen);
+    TOCInternal_MainThreadBatch_flush();
+    mainThreadBatchIsOpen = false;
+}
+
+void TOCInternal_MainThreadBatch_flush(void) {
+    void* blocksReference = mainThreadBatchBlocks;
+    if (blocksReference == NULL) return;
+    mainThreadBatchBlocks = NULL;
+
+    NSArray* blocks = (__bridge_transfer NSMutableArray*)blocksReference;
+    TOCInternal_count(TOCInternal_Counter_MainThreadHops);
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (void (^block)(void) in blocks) {
+            block();
+        }
+    });
+}
+
+@interface TOCInternal_MainThreadExecutor : NSObject <TOCExecutor>
+@end
+
+@implementation TOCInternal_MainThreadExecutor
+
+-(void) execute:(void(^)(void))block {
+    TOCInternal_need(block != nil);
+
+    if (NSThread.isMainThread) {
+        block();
+        return;
+    }
+
+    if (mainThreadBatchIsOpen) {
+        if (mainThreadBatchBlocks == NULL) {
+            mainThreadBatchBlocks = (__bridge_retained void*)[NSMutableArray array];
+        }
+        [(__bridge NSMutableArray*)mainThreadBatchBlocks addObject:[block copy]];
+        return;
+    }
+
+    TOCInternal_count(TOCInternal_Counter_MainThreadHops);
+    dispatch_async(dispatch_get_main_queue(), block);
+}
+
+-(NSString*) description {
+    return @"Main Thread Executor";
+}
+
+@end
+
+id<TOCExecutor> TOCInternal_mainThreadExecutor(void) {
+    static dispatch_once_t once;
+    static TOCInternal_MainThreadExecutor* executor = nil;
+    dispatch_once(&once, ^{
+        executor = [TOCInternal_MainThreadExecutor new];
+    });
+    return executor;
+}
+
+id<TOCExecutor> TOCInternal_resolveExecutor(id<TOCExecutor> executor) {
+    if (executor != nil) return executor;
+    return TOCExecutors.defaultExecutor;
+}
+
+bool TOCInternal_executesInlineHere(id<TOCExecutor> executor) {
+    if (executor == TOCExecutors.inlineExecutor) return true;
+    return executor == TOCInternal_mainThreadExecutor() && NSThread.isMainThread;
+}
+
+bool TOCInternal_executesOnlyOnMainThread(id<TOCExecutor> executor) {
+    return executor == TOCInternal_mainThreadExecutor() || executor == TOCExecutors.mainQueueExecutor;
+}
+
+TOCInternal_Handler TOCInternal_executedBy(id<TOCExecutor> executor,
+                                           TOCInternal_Handler handler,
+                                           id<TOCInternal_Settleable> unlessTriggered) {
+    TOCInternal_need(executor != nil);
+    TOCInternal_need(handler != nil);
+    if (executor == TOCExecutors.inlineExecutor) return handler;
+
+    TOCInternal_Handler checkedHandler = handler;
+    if (unlessTriggered != nil) {
+        checkedHandler = ^{
+            // do a final check, to help the caller out
+            // consider: if the unless token was cancelled after the receiver settled, but before the executor got around to the callback
+            // in that situation, the caller may have already done UI things based on observing that the token was cancelled
+            // they may be *extremely* surprised by the callback running their cleanup stuff again
+            // we don't want to surprise them, so we do this polite check before calling
+            if (unlessTriggered._hasBeenTriggered) return;
+
+            handler();
+        };
+    }
+
+    return ^{ [executor execute:checkedHandler]; };
+}
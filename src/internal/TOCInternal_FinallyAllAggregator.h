@@ -0,0 +1,25 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+
+/*!
+ * Waits for every future in an array to complete, for toc_finallyAll and friends.
+ *
+ * @discussion Each input gets one plain handler, that counts down a single shared counter.
+ * The unless token gets one registration, no matter how many inputs there are.
+ *
+ * Cancelling (or an input becoming immortal) detaches the aggregator from all of its inputs in one step.
+ * The inputs' handlers stay registered, but only keep the (by then empty) aggregator alive instead of the result or the other inputs.
+ */
+@interface TOCInternal_FinallyAllAggregator : NSObject
+
+/*!
+ * Returns a future that completes with the given array of futures once they have all completed, unless cancelled first.
+ *
+ * @discussion The result fails with a cancel token when the given token is cancelled first,
+ * and becomes immortal as soon as any of the given futures becomes immortal.
+ */
++(TOCFuture*) futureForCompletionOfAll:(NSArray*)futures
+                                unless:(TOCCancelToken*)unlessCancelledToken;
+
+@end
@@ -0,0 +1,80 @@
+#import "TOCInternal_FinallyAllAggregator.h"
+#import "TOCInternal.h"
+#include <stdatomic.h>
+
+@implementation TOCInternal_FinallyAllAggregator {
+/// Inputs that haven't completed yet, plus one for the aggregator's own setup
+@private atomic_long _remaining;
+/// A retained TOCFutureSource for the result, or NULL once something has taken it to complete, cancel or drop the result
+@private _Atomic(void*) _resultSource;
+/// The inputs, which become the result. Only touched by whoever takes the result source.
+@private NSArray* _futures;
+}
+
++(TOCFuture*) futureForCompletionOfAll:(NSArray*)futures
+                                unless:(TOCCancelToken*)unlessCancelledToken {
+    TOCInternal_need(futures != nil);
+    if (unlessCancelledToken.isAlreadyCancelled) {
+        return [TOCFuture futureWithFailure:TOCCancelToken.cancelledToken];
+    }
+    
+    TOCFutureSource* resultSource = [TOCFutureSource new];
+    TOCFuture* result = resultSource.future;
+    
+    TOCInternal_FinallyAllAggregator* aggregator = [TOCInternal_FinallyAllAggregator new];
+    aggregator->_futures = futures;
+    atomic_init(&aggregator->_remaining, (long)futures.count + 1);
+    atomic_init(&aggregator->_resultSource, (__bridge_retained void*)resultSource);
+    resultSource = nil;
+    
+    // one registration on the token, cleaned up when the result settles first
+    [unlessCancelledToken _whenCancelledDo:^{ [[aggregator _takeResultSource] trySetFailedWithCancel]; }
+                                        on:TOCExecutors.inlineExecutor
+                             unlessSettled:result];
+    
+    for (TOCFuture* item in futures) {
+        // no point registering on the rest once the result has been cancelled or dropped
+        if (atomic_load_explicit(&aggregator->_resultSource, memory_order_relaxed) == NULL) break;
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the item settles.
+        [item _whenSettledDo:^{
+            if (item.isIncomplete) {
+                // the item is immortal, and so the result will never complete: drop the source to make it immortal too
+                [aggregator _takeResultSource];
+            } else {
+                [aggregator _countDown];
+            }
+        }];
+    }
+    
+    [aggregator _countDown];
+    return result;
+}
+
+/// Claims the result source, also releasing the inputs. Returns nil if it was already claimed.
+-(TOCFutureSource*) _takeResultSource {
+    return [self _takeResultSourceAndFutures:nil];
+}
+-(TOCFutureSource*) _takeResultSourceAndFutures:(NSArray* __autoreleasing *)futuresOut {
+    void* resultSource = atomic_exchange_explicit(&_resultSource, NULL, memory_order_acq_rel);
+    if (resultSource == NULL) return nil;
+    
+    if (futuresOut != NULL) *futuresOut = _futures;
+    _futures = nil;
+    return (__bridge_transfer TOCFutureSource*)resultSource;
+}
+
+-(void) _countDown {
+    if (atomic_fetch_sub_explicit(&_remaining, 1, memory_order_acq_rel) != 1) return;
+    
+    NSArray* futures = nil;
+    TOCFutureSource* resultSource = [self _takeResultSourceAndFutures:&futures];
+    [resultSource trySetResult:futures];
+}
+
+-(void) dealloc {
+    void* resultSource = atomic_load_explicit(&_resultSource, memory_order_acquire);
+    if (resultSource != NULL) (void)(__bridge_transfer TOCFutureSource*)resultSource;
+}
+
+@end
@@ -0,0 +1,147 @@
+#import <Foundation/Foundation.h>
+#include <stdatomic.h>
+
+/*!
+ * A lock-free (Treiber) stack of handler blocks, waiting for its owner to settle.
+ *
+ * @discussion Embed it directly in the owning object. A zeroed stack is open and empty.
+ *
+ * Pushing is a single CAS onto the head.
+ * Closing swaps the head for a closed marker, giving the closer sole ownership of every handler pushed before it.
+ * A push that loses the race against closing fails, and the caller then acts on the owner's (by then final) state.
+ *
+ * Removing a handler releases it immediately but leaves a tiny dead node behind.
+ * Dead nodes are unlinked in batches, once they make up a large part of the stack.
+ * Closing has to wait for a batch being unlinked, which is the one place where a thread can be held up by another.
+ * It only spins briefly, then yields the processor until the unlinking thread is done.
+ */
+typedef struct {
+    _Atomic(uintptr_t) head;
+    atomic_long count;
+    atomic_long deadCount;
+} TOCInternal_HandlerStack;
+
+/*!
+ * Determines whether a handler runs only when its stack is closed by the owner being triggered (e.g. a token being cancelled),
+ * or when its stack is closed either way (e.g. a token being cancelled or becoming immortal).
+ */
+enum TOCInternal_HandlerKind {
+    TOCInternal_HandlerKind_OnTrigger = 0,
+    TOCInternal_HandlerKind_OnSettle = 1
+};
+
+typedef void (^TOCInternal_Handler)(void);
+
+/*!
+ * A handle to a pushed handler, used to remove it.
+ *
+ * @discussion Subclasses can do their work in runWithTarget:, and be pushed with TOCInternal_HandlerStack_tryPushNode,
+ * to avoid allocating a handler block on top of the node.
+ */
+@interface TOCInternal_HandlerNode : NSObject
+
+/*!
+ * Runs the handler.
+ *
+ * @param target The object pushed with the node. Calls it as a TOCInternal_Handler, unless overridden.
+ */
+-(void) runWithTarget:(id)target;
+
+@end
+
+/*!
+ * Pushes a handler onto the stack.
+ *
+ * @result A handle for removing the handler, or nil if the stack was already closed (in which case the handler is discarded).
+ */
+TOCInternal_HandlerNode* TOCInternal_HandlerStack_tryPush(TOCInternal_HandlerStack* stack,
+                                                          TOCInternal_Handler handler,
+                                                          enum TOCInternal_HandlerKind kind);
+
+/*!
+ * Pushes a node onto the stack, to be run with the given target.
+ *
+ * @result False if the stack was already closed, in which case the target is released and the node can be pushed elsewhere.
+ *
+ * @discussion The node must not already be in a stack. Removing the node releases the target, as if it was a handler.
+ */
+bool TOCInternal_HandlerStack_tryPushNode(TOCInternal_HandlerStack* stack,
+                                          TOCInternal_HandlerNode* node,
+                                          id target,
+                                          enum TOCInternal_HandlerKind kind);
+
+/*!
+ * Discards a pushed handler, unless it has already been run or discarded.
+ *
+ * @discussion Safe to call concurrently with pushing, closing and other removals.
+ */
+void TOCInternal_HandlerStack_remove(TOCInternal_HandlerStack* stack,
+                                     TOCInternal_HandlerNode* node);
+
+/*!
+ * Closes the stack, then runs its handlers in registration order.
+ *
+ * @param triggered Whether OnTrigger handlers should be run (they are discarded otherwise).
+ * OnSettle handlers are always run.
+ *
+ * @discussion Has no effect if the stack was already closed.
+ */
+void TOCInternal_HandlerStack_closeAndRun(TOCInternal_HandlerStack* stack,
+                                          bool triggered);
+
+/*!
+ * Determines if the stack has been closed.
+ */
+bool TOCInternal_HandlerStack_isClosed(TOCInternal_HandlerStack* stack);
+
+/*!
+ * A chain of handler nodes taken out of a closed stack (newest first), or NULL when empty.
+ * Whoever holds a list owns its nodes, and must eventually push them onto another stack or run them.
+ */
+typedef void* TOCInternal_HandlerList;
+
+/*!
+ * Closes the stack without running anything, taking ownership of everything pushed onto it.
+ *
+ * @result The taken handlers, or NULL if there were none (or the stack was already closed).
+ *
+ * @discussion Used to move handlers to another stack, when their owner is merged into another object.
+ * Nodes keep their identity, so handles returned by tryPush can still be used to remove the moved handlers.
+ */
+TOCInternal_HandlerList TOCInternal_HandlerStack_closeAndTake(TOCInternal_HandlerStack* stack);
+
+/*!
+ * Pushes all the handlers in the given list onto the stack, with a single CAS.
+ *
+ * @result False if the stack was already closed, in which case the list is left untouched (and still owned by the caller).
+ */
+bool TOCInternal_HandlerStack_tryPushAll(TOCInternal_HandlerStack* stack,
+                                         TOCInternal_HandlerList list);
+
+/*!
+ * Runs the handlers in the given list in registration order, consuming the list.
+ *
+ * @param triggered Whether OnTrigger handlers should be run (they are discarded otherwise).
+ *
+ * @discussion Runs nested inside a handler (e.g. a handler completing a future) happen inline, up to the nesting limit.
+ * Past the limit, the run is queued instead and done by the outermost run on the same thread, once its own handlers are done.
+ * Either way, everything has run by the time the outermost run returns.
+ *
+ * If a handler throws, the handlers after it in the same list are discarded, and the exception propagates.
+ * Runs queued for the outermost run still happen first.
+ */
+void TOCInternal_HandlerList_run(TOCInternal_HandlerList list,
+                                 bool triggered);
+
+/*!
+ * Does the runs queued up for the outermost run on the current thread right away, instead of when the outermost run gets to them.
+ *
+ * @discussion Used before blocking the current thread, since the outermost run can't get to them until the thread is unblocked.
+ */
+void TOCInternal_HandlerList_runQueued(void);
+
+/*!
+ * How many handler runs may nest inside the outermost run on a thread, before further nested runs are queued for it.
+ */
+NSUInteger TOCInternal_HandlerList_nestingLimit_get(void);
+void TOCInternal_HandlerList_nestingLimit_set(NSUInteger limit);
@@ -0,0 +1,334 @@
+#import "TOCInternal_HandlerStack.h"
+#import "TOCInternal.h"
+#include <stdlib.h>
+#include <sched.h>
+
+/// The head of a stack that has been closed. Nodes are objects, so their pointers never have the low bits set.
+static const uintptr_t TOCInternal_HandlerStack_Closed = 0x2;
+/// Set on the head while dead nodes are being unlinked. Pushes preserve it, closing waits for it to clear.
+static const uintptr_t TOCInternal_HandlerStack_Purging = 0x1;
+/// Removals tolerated before bothering to unlink dead nodes.
+static const long TOCInternal_HandlerStack_PurgeThreshold = 16;
+/// How many times closing re-checks a purging head before it starts yielding the processor instead.
+static const int TOCInternal_HandlerStack_PurgeSpinLimit = 64;
+
+@implementation TOCInternal_HandlerNode {
+/// The node below this one. Not owning: the stack owns one reference to each of its nodes.
+@public void* _next;
+/// The target (usually the handler block), retained, or NULL once it has been run or removed
+@public _Atomic(void*) _handler;
+@public enum TOCInternal_HandlerKind _kind;
+}
+
+-(void) runWithTarget:(id)target {
+    ((TOCInternal_Handler)target)();
+}
+
+-(void) dealloc {
+    void* handler = atomic_exchange_explicit(&_handler, NULL, memory_order_acquire);
+    if (handler != NULL) (void)(__bridge_transfer id)handler;
+}
+
+@end
+
+TOCInternal_HandlerNode* TOCInternal_HandlerStack_tryPush(TOCInternal_HandlerStack* stack,
+                                                          TOCInternal_Handler handler,
+                                                          enum TOCInternal_HandlerKind kind) {
+    TOCInternal_need(handler != nil);
+
+    TOCInternal_HandlerNode* node = [TOCInternal_HandlerNode new];
+    if (!TOCInternal_HandlerStack_tryPushNode(stack, node, [handler copy], kind)) return nil;
+    return node;
+}
+
+bool TOCInternal_HandlerStack_tryPushNode(TOCInternal_HandlerStack* stack,
+                                          TOCInternal_HandlerNode* node,
+                                          id target,
+                                          enum TOCInternal_HandlerKind kind) {
+    TOCInternal_need(node != nil);
+    TOCInternal_need(target != nil);
+
+    atomic_store_explicit(&node->_handler, (__bridge_retained void*)target, memory_order_relaxed);
+    node->_kind = kind;
+
+    void* stackReference = (__bridge_retained void*)node;
+    uintptr_t head = atomic_load_explicit(&stack->head, memory_order_acquire);
+    while (true) {
+        if (head == TOCInternal_HandlerStack_Closed) {
+            // lost the race against the owner settling: discard the target, and give back the stack's reference
+            void* targetReference = atomic_exchange_explicit(&node->_handler, NULL, memory_order_relaxed);
+            (void)(__bridge_transfer id)targetReference;
+            (void)(__bridge_transfer TOCInternal_HandlerNode*)stackReference;
+            return false;
+        }
+
+        node->_next = (void*)(head & ~TOCInternal_HandlerStack_Purging);
+        uintptr_t newHead = (uintptr_t)stackReference | (head & TOCInternal_HandlerStack_Purging);
+        if (atomic_compare_exchange_weak_explicit(&stack->head,
+                                                  &head,
+                                                  newHead,
+                                                  memory_order_release,
+                                                  memory_order_acquire)) {
+            break;
+        }
+    }
+
+    atomic_fetch_add_explicit(&stack->count, 1, memory_order_relaxed);
+    TOCInternal_count(TOCInternal_Counter_HandlersRegistered);
+    return true;
+}
+
+static void TOCInternal_HandlerStack_tryPurge(TOCInternal_HandlerStack* stack) {
+    uintptr_t head = atomic_load_explicit(&stack->head, memory_order_relaxed);
+    do {
+        if (head == 0) return;
+        if (head == TOCInternal_HandlerStack_Closed) return;
+        if ((head & TOCInternal_HandlerStack_Purging) != 0) return; // someone else is already on it
+    } while (!atomic_compare_exchange_weak_explicit(&stack->head,
+                                                    &head,
+                                                    head | TOCInternal_HandlerStack_Purging,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed));
+
+    // pushers only ever write the head, and closing waits for us, so everything below the head node is ours to relink
+    // (the head node itself stays, even if dead, since unlinking it would race against pushes)
+    __unsafe_unretained TOCInternal_HandlerNode* previous = (__bridge TOCInternal_HandlerNode*)(void*)head;
+    void* current = previous->_next;
+    long purgedCount = 0;
+    while (current != NULL) {
+        __unsafe_unretained TOCInternal_HandlerNode* node = (__bridge TOCInternal_HandlerNode*)current;
+        void* next = node->_next;
+        if (atomic_load_explicit(&node->_handler, memory_order_acquire) == NULL) {
+            previous->_next = next;
+            (void)(__bridge_transfer TOCInternal_HandlerNode*)current;
+            purgedCount += 1;
+        } else {
+            previous = node;
+        }
+        current = next;
+    }
+
+    atomic_fetch_sub_explicit(&stack->deadCount, purgedCount, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&stack->count, purgedCount, memory_order_relaxed);
+    atomic_fetch_and_explicit(&stack->head, ~TOCInternal_HandlerStack_Purging, memory_order_release);
+}
+
+void TOCInternal_HandlerStack_remove(TOCInternal_HandlerStack* stack,
+                                     TOCInternal_HandlerNode* node) {
+    TOCInternal_need(node != nil);
+
+    void* handler = atomic_exchange_explicit(&node->_handler, NULL, memory_order_acq_rel);
+    if (handler == NULL) return; // already run or removed
+    TOCInternal_count(TOCInternal_Counter_HandlersRemoved);
+
+    // release whatever the handler was keeping alive right away, instead of when the node is eventually unlinked
+    (void)(__bridge_transfer id)handler;
+
+    long deadCount = atomic_fetch_add_explicit(&stack->deadCount, 1, memory_order_relaxed) + 1;
+    long count = atomic_load_explicit(&stack->count, memory_order_relaxed);
+    if (deadCount >= TOCInternal_HandlerStack_PurgeThreshold && deadCount * 2 >= count) {
+        TOCInternal_HandlerStack_tryPurge(stack);
+    }
+}
+
+TOCInternal_HandlerList TOCInternal_HandlerStack_closeAndTake(TOCInternal_HandlerStack* stack) {
+    uintptr_t head = atomic_load_explicit(&stack->head, memory_order_relaxed);
+    int spinCount = 0;
+    while (true) {
+        if (head == TOCInternal_HandlerStack_Closed) return NULL;
+        if ((head & TOCInternal_HandlerStack_Purging) != 0) {
+            // unlinking dead nodes takes bounded time and never runs user code, so wait it out
+            // but the purging thread may have been preempted (or have a lower priority), so stop spinning and let it run
+            if (spinCount < TOCInternal_HandlerStack_PurgeSpinLimit) {
+                spinCount += 1;
+            } else {
+                sched_yield();
+            }
+            head = atomic_load_explicit(&stack->head, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&stack->head,
+                                                  &head,
+                                                  TOCInternal_HandlerStack_Closed,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed)) {
+            return (TOCInternal_HandlerList)head;
+        }
+    }
+}
+
+bool TOCInternal_HandlerStack_tryPushAll(TOCInternal_HandlerStack* stack,
+                                         TOCInternal_HandlerList list) {
+    if (list == NULL) return !TOCInternal_HandlerStack_isClosed(stack);
+
+    // the list is ours, so walking it is safe
+    __unsafe_unretained TOCInternal_HandlerNode* oldest = (__bridge TOCInternal_HandlerNode*)list;
+    long count = 1;
+    long deadCount = atomic_load_explicit(&oldest->_handler, memory_order_relaxed) == NULL ? 1 : 0;
+    while (oldest->_next != NULL) {
+        oldest = (__bridge TOCInternal_HandlerNode*)oldest->_next;
+        count += 1;
+        if (atomic_load_explicit(&oldest->_handler, memory_order_relaxed) == NULL) deadCount += 1;
+    }
+
+    uintptr_t head = atomic_load_explicit(&stack->head, memory_order_acquire);
+    while (true) {
+        if (head == TOCInternal_HandlerStack_Closed) {
+            oldest->_next = NULL;
+            return false;
+        }
+
+        oldest->_next = (void*)(head & ~TOCInternal_HandlerStack_Purging);
+        uintptr_t newHead = (uintptr_t)list | (head & TOCInternal_HandlerStack_Purging);
+        if (atomic_compare_exchange_weak_explicit(&stack->head,
+                                                  &head,
+                                                  newHead,
+                                                  memory_order_release,
+                                                  memory_order_acquire)) {
+            break;
+        }
+    }
+
+    atomic_fetch_add_explicit(&stack->count, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stack->deadCount, deadCount, memory_order_relaxed);
+    return true;
+}
+
+/// A handler list whose run was put off because it would have nested too deeply, waiting for the outermost run on its thread
+typedef struct TOCInternal_DeferredRun {
+    TOCInternal_HandlerList list;
+    bool triggered;
+    struct TOCInternal_DeferredRun* next;
+} TOCInternal_DeferredRun;
+
+/// How many runs may nest inside the outermost run on a thread, before further runs are deferred to it
+static _Atomic(NSUInteger) TOCInternal_HandlerList_nestingLimit = 16;
+/// The number of handler lists currently being run by this thread, nested inside each other
+static _Thread_local NSUInteger runDepth;
+/// Deferred runs for the outermost run on this thread to drain, oldest first
+static _Thread_local TOCInternal_DeferredRun* oldestDeferredRun;
+static _Thread_local TOCInternal_DeferredRun* newestDeferredRun;
+
+NSUInteger TOCInternal_HandlerList_nestingLimit_get(void) {
+    return atomic_load_explicit(&TOCInternal_HandlerList_nestingLimit, memory_order_relaxed);
+}
+void TOCInternal_HandlerList_nestingLimit_set(NSUInteger limit) {
+    atomic_store_explicit(&TOCInternal_HandlerList_nestingLimit, limit, memory_order_relaxed);
+}
+
+static void TOCInternal_HandlerList_runNow(TOCInternal_HandlerList list,
+                                           bool triggered) {
+    // the list is newest-first, but handlers should run in the order they were registered
+    void* reversed = NULL;
+    void* current = list;
+    while (current != NULL) {
+        __unsafe_unretained TOCInternal_HandlerNode* node = (__bridge TOCInternal_HandlerNode*)current;
+        void* next = node->_next;
+        node->_next = reversed;
+        reversed = current;
+        current = next;
+    }
+
+    current = reversed;
+    @try {
+        while (current != NULL) {
+            TOCInternal_HandlerNode* node = (__bridge_transfer TOCInternal_HandlerNode*)current;
+            current = node->_next;
+
+            void* handlerReference = atomic_exchange_explicit(&node->_handler, NULL, memory_order_acq_rel);
+            if (handlerReference == NULL) continue; // removed
+
+            id target = (__bridge_transfer id)handlerReference;
+            if (triggered || node->_kind == TOCInternal_HandlerKind_OnSettle) {
+                TOCInternal_count(TOCInternal_Counter_HandlersRun);
+                [node runWithTarget:target];
+            } else {
+                TOCInternal_count(TOCInternal_Counter_HandlersDiscarded);
+            }
+        }
+    } @finally {
+        // a handler threw: discard the handlers after it, instead of leaking them along with their nodes
+        while (current != NULL) {
+            TOCInternal_HandlerNode* node = (__bridge_transfer TOCInternal_HandlerNode*)current;
+            current = node->_next;
+
+            void* handlerReference = atomic_exchange_explicit(&node->_handler, NULL, memory_order_acq_rel);
+            if (handlerReference == NULL) continue;
+            (void)(__bridge_transfer id)handlerReference;
+            TOCInternal_count(TOCInternal_Counter_HandlersDiscarded);
+        }
+    }
+}
+
+/// Does the runs queued up for the outermost run on this thread, including any queued up while doing them.
+static void TOCInternal_HandlerList_runDeferred(void) {
+    while (oldestDeferredRun != NULL) {
+        TOCInternal_DeferredRun* deferred = oldestDeferredRun;
+        oldestDeferredRun = deferred->next;
+        if (oldestDeferredRun == NULL) newestDeferredRun = NULL;
+        TOCInternal_HandlerList deferredList = deferred->list;
+        bool deferredTriggered = deferred->triggered;
+        free(deferred);
+
+        @try {
+            TOCInternal_HandlerList_runNow(deferredList, deferredTriggered);
+        } @catch (id exception) {
+            // the other queued runs belong to other completions, so one of them throwing mustn't strand the rest
+            TOCInternal_HandlerList_runDeferred();
+            @throw;
+        }
+    }
+}
+
+void TOCInternal_HandlerList_run(TOCInternal_HandlerList list,
+                                 bool triggered) {
+    if (list == NULL) return;
+
+    // a handler settling something, whose handler settles something, and so on, would otherwise recurse once per link
+    // past the limit, leave it to the outermost run to get to iteratively
+    if (runDepth > TOCInternal_HandlerList_nestingLimit_get()) {
+        TOCInternal_DeferredRun* deferred = malloc(sizeof(TOCInternal_DeferredRun));
+        TOCInternal_force(deferred != NULL);
+        deferred->list = list;
+        deferred->triggered = triggered;
+        deferred->next = NULL;
+        if (newestDeferredRun == NULL) {
+            oldestDeferredRun = deferred;
+        } else {
+            newestDeferredRun->next = deferred;
+        }
+        newestDeferredRun = deferred;
+        return;
+    }
+
+    // handlers registered on the main thread (and anything they cause to settle) get there in a single hop
+    bool isBatchingMainThreadHops = TOCInternal_MainThreadBatch_begin();
+    bool isOutermost = runDepth == 0;
+    runDepth += 1;
+    @try {
+        @try {
+            TOCInternal_HandlerList_runNow(list, triggered);
+        } @finally {
+            // even when a handler throws, the queued runs belong to completions that already happened
+            // left in the queue, they would run later, inside some unrelated run on this thread
+            if (isOutermost) TOCInternal_HandlerList_runDeferred();
+        }
+    } @finally {
+        runDepth -= 1;
+        if (isBatchingMainThreadHops) TOCInternal_MainThreadBatch_end();
+    }
+}
+
+void TOCInternal_HandlerList_runQueued(void) {
+    if (runDepth == 0) return;
+    TOCInternal_HandlerList_runDeferred();
+}
+
+void TOCInternal_HandlerStack_closeAndRun(TOCInternal_HandlerStack* stack,
+                                          bool triggered) {
+    TOCInternal_HandlerList_run(TOCInternal_HandlerStack_closeAndTake(stack), triggered);
+}
+
+bool TOCInternal_HandlerStack_isClosed(TOCInternal_HandlerStack* stack) {
+    return atomic_load_explicit(&stack->head, memory_order_acquire) == TOCInternal_HandlerStack_Closed;
+}
@@ -0,0 +1,75 @@
+#import <Foundation/Foundation.h>
+#include <stdatomic.h>
+
+/// Values below 2^SubBucketBits nanoseconds get a bucket each. Above that, each power of two is split into 2^(SubBucketBits-1) buckets.
+#define TOCInternal_LatencyHistogram_SubBucketBits 6
+/// The highest power of two (in nanoseconds) with its own buckets. Larger latencies (over ~78 hours) go into the overflow bucket.
+#define TOCInternal_LatencyHistogram_MaxExponent 47
+/// The bucket after the ones for the powers of two, holding every latency too large for them.
+#define TOCInternal_LatencyHistogram_OverflowBucket \
+    ((1 << TOCInternal_LatencyHistogram_SubBucketBits) \
+     + (TOCInternal_LatencyHistogram_MaxExponent - TOCInternal_LatencyHistogram_SubBucketBits + 1) \
+       * (1 << (TOCInternal_LatencyHistogram_SubBucketBits - 1)))
+#define TOCInternal_LatencyHistogram_BucketCount (TOCInternal_LatencyHistogram_OverflowBucket + 1)
+
+/*!
+ * A histogram of latencies, in nanoseconds, with log-linear buckets (like an HdrHistogram).
+ *
+ * @discussion Each bucket covers at most 1/32nd of its values' magnitude, so percentiles read from the buckets are within ~3% of the true value.
+ *
+ * Recording is lock-free and wait-free, except for the compare-and-swap loops that maintain the minimum and maximum (which only retry while those are improving).
+ * Any number of threads may record at the same time.
+ *
+ * Zero-initialized memory is not a valid histogram. Use TOCInternal_LatencyHistogram_init.
+ */
+typedef struct TOCInternal_LatencyHistogram {
+    _Atomic(uint64_t) buckets[TOCInternal_LatencyHistogram_BucketCount];
+    _Atomic(uint64_t) totalNanoseconds;
+    _Atomic(uint64_t) minNanoseconds;
+    _Atomic(uint64_t) maxNanoseconds;
+} TOCInternal_LatencyHistogram;
+
+/*!
+ * A copy of a histogram's counts, for reading.
+ */
+typedef struct TOCInternal_LatencyHistogramCounts {
+    uint64_t buckets[TOCInternal_LatencyHistogram_BucketCount];
+    uint64_t count;
+    uint64_t totalNanoseconds;
+    /// UINT64_MAX when nothing has been recorded
+    uint64_t minNanoseconds;
+    uint64_t maxNanoseconds;
+} TOCInternal_LatencyHistogramCounts;
+
+/*!
+ * Prepares the given histogram to be recorded into, with nothing recorded.
+ */
+void TOCInternal_LatencyHistogram_init(TOCInternal_LatencyHistogram* histogram);
+
+/*!
+ * Records one latency into the given histogram.
+ */
+void TOCInternal_LatencyHistogram_record(TOCInternal_LatencyHistogram* histogram, uint64_t nanoseconds);
+
+/*!
+ * Adds the given histogram's current counts into the given counts.
+ *
+ * @discussion Each count is read atomically, but concurrent recordings may be partially included.
+ */
+void TOCInternal_LatencyHistogram_addCountsInto(TOCInternal_LatencyHistogram* histogram,
+                                                TOCInternal_LatencyHistogramCounts* counts);
+
+/*!
+ * Prepares the given counts to be added into, with nothing counted.
+ */
+void TOCInternal_LatencyHistogramCounts_init(TOCInternal_LatencyHistogramCounts* counts);
+
+/*!
+ * Returns the index of the bucket that the given latency is counted in.
+ */
+int TOCInternal_LatencyHistogram_bucketOf(uint64_t nanoseconds);
+
+/*!
+ * Returns the largest latency that is counted in the given bucket.
+ */
+uint64_t TOCInternal_LatencyHistogram_highestValueInBucket(int bucket);
@@ -0,0 +1,73 @@
+#import "TOCInternal_LatencyHistogram.h"
+#import "TOCInternal.h"
+
+#define SubBucketBits TOCInternal_LatencyHistogram_SubBucketBits
+#define HalfSubBucketCount (1 << (SubBucketBits - 1))
+
+void TOCInternal_LatencyHistogram_init(TOCInternal_LatencyHistogram* histogram) {
+    for (int i = 0; i < TOCInternal_LatencyHistogram_BucketCount; i++) {
+        atomic_init(&histogram->buckets[i], 0);
+    }
+    atomic_init(&histogram->totalNanoseconds, 0);
+    atomic_init(&histogram->minNanoseconds, UINT64_MAX);
+    atomic_init(&histogram->maxNanoseconds, 0);
+}
+
+int TOCInternal_LatencyHistogram_bucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < (1 << SubBucketBits)) return (int)nanoseconds;
+    
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    if (exponent > TOCInternal_LatencyHistogram_MaxExponent) return TOCInternal_LatencyHistogram_OverflowBucket;
+    
+    // the top SubBucketBits bits of the value, with the leading one dropped, pick the bucket within the power of two
+    int shift = exponent - (SubBucketBits - 1);
+    int subBucket = (int)(nanoseconds >> shift) - HalfSubBucketCount;
+    return (1 << SubBucketBits) + (exponent - SubBucketBits) * HalfSubBucketCount + subBucket;
+}
+
+uint64_t TOCInternal_LatencyHistogram_highestValueInBucket(int bucket) {
+    TOCInternal_need(bucket >= 0 && bucket < TOCInternal_LatencyHistogram_BucketCount);
+    if (bucket < (1 << SubBucketBits)) return (uint64_t)bucket;
+    if (bucket == TOCInternal_LatencyHistogram_OverflowBucket) return UINT64_MAX;
+    
+    int exponent = (bucket - (1 << SubBucketBits)) / HalfSubBucketCount + SubBucketBits;
+    int subBucket = (bucket - (1 << SubBucketBits)) % HalfSubBucketCount;
+    int shift = exponent - (SubBucketBits - 1);
+    uint64_t lowest = (uint64_t)(HalfSubBucketCount + subBucket) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void TOCInternal_LatencyHistogram_record(TOCInternal_LatencyHistogram* histogram, uint64_t nanoseconds) {
+    int bucket = TOCInternal_LatencyHistogram_bucketOf(nanoseconds);
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->totalNanoseconds, nanoseconds, memory_order_relaxed);
+    
+    uint64_t min = atomic_load_explicit(&histogram->minNanoseconds, memory_order_relaxed);
+    while (nanoseconds < min
+           && !atomic_compare_exchange_weak_explicit(&histogram->minNanoseconds, &min, nanoseconds,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+    
+    uint64_t max = atomic_load_explicit(&histogram->maxNanoseconds, memory_order_relaxed);
+    while (nanoseconds > max
+           && !atomic_compare_exchange_weak_explicit(&histogram->maxNanoseconds, &max, nanoseconds,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void TOCInternal_LatencyHistogramCounts_init(TOCInternal_LatencyHistogramCounts* counts) {
+    memset(counts, 0, sizeof(TOCInternal_LatencyHistogramCounts));
+    counts->minNanoseconds = UINT64_MAX;
+}
+
+void TOCInternal_LatencyHistogram_addCountsInto(TOCInternal_LatencyHistogram* histogram,
+                                                TOCInternal_LatencyHistogramCounts* counts) {
+    for (int i = 0; i < TOCInternal_LatencyHistogram_BucketCount; i++) {
+        uint64_t n = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        counts->buckets[i] += n;
+        counts->count += n;
+    }
+    counts->totalNanoseconds += atomic_load_explicit(&histogram->totalNanoseconds, memory_order_relaxed);
+    counts->minNanoseconds = MIN(counts->minNanoseconds, atomic_load_explicit(&histogram->minNanoseconds, memory_order_relaxed));
+    counts->maxNanoseconds = MAX(counts->maxNanoseconds, atomic_load_explicit(&histogram->maxNanoseconds, memory_order_relaxed));
+}
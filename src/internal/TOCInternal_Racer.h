@@ -2,6 +2,7 @@
 #import "TOCCancelTokenAndSource.h"
 #import "TOCFutureAndSource.h"
 #import "TOCTypeDefs.h"
+#import "TOCAdaptiveHedgeDelay.h"
 
 @interface TOCInternal_Racer : NSObject
 
@@ -11,4 +12,13 @@
 +(TOCFuture*) asyncRace:(NSArray*)starters
                   until:(TOCCancelToken*)untilCancelledToken;
 
++(TOCFuture*) asyncHedgedRace:(NSArray*)starters
+               withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds
+              latencyRecorder:(TOCAdaptiveHedgeDelay*)latencyRecorder
+                        until:(TOCCancelToken*)untilCancelledToken;
+
++(TOCFuture*) asyncQuorumRace:(NSArray*)starters
+                   quorumSize:(NSUInteger)quorumSize
+                        until:(TOCCancelToken*)untilCancelledToken;
+
 @end
@@ -1,6 +1,19 @@
 #import "TOCInternal.h"
 #import "TOCFuture+MoreContinuations.h"
-#include <libkern/OSAtomic.h>
+#include <stdatomic.h>
+
+@interface TOCInternal_HedgedRace : NSObject
++(TOCFuture*) hedgedRace:(NSArray*)starters
+          withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds
+         latencyRecorder:(TOCAdaptiveHedgeDelay*)latencyRecorder
+                   until:(TOCCancelToken*)untilCancelledToken;
+@end
+
+@interface TOCInternal_QuorumRace : NSObject
++(TOCFuture*) quorumRace:(NSArray*)starters
+              quorumSize:(NSUInteger)quorumSize
+                   until:(TOCCancelToken*)untilCancelledToken;
+@end
 
 @implementation TOCInternal_Racer
 
@@ -29,14 +42,13 @@
     TOCFutureSource* futureWinningRacerSource = [TOCFutureSource futureSourceUntil:untilCancelledToken];
     
     // tell each racer how to get on the podium (or how to be a failure)
-    __block int failedRacerCount = 0;
-    TOCInternal_need(racers.count <= INT_MAX);
+    __block atomic_long failedRacerCount = 0;
     for (TOCInternal_Racer* racer in racers) {
         [racer.futureResult finallyDo:^(TOCFuture *completed) {
             if (completed.hasResult) {
                 // winner?
                 [futureWinningRacerSource trySetResult:racer];
-            } else if (OSAtomicIncrement32(&failedRacerCount) == (int)racers.count) {
+            } else if (atomic_fetch_add(&failedRacerCount, 1) + 1 == (long)racers.count) {
                 // prefer to fail with a cancellation over failing with a list of cancellations
                 if (untilCancelledToken.isAlreadyCancelled) return;
                 
@@ -62,4 +74,251 @@
     return futureWinnerResult;
 }
 
++(TOCFuture*) asyncHedgedRace:(NSArray*)starters
+               withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds
+              latencyRecorder:(TOCAdaptiveHedgeDelay*)latencyRecorder
+                        until:(TOCCancelToken*)untilCancelledToken {
+    return [TOCInternal_HedgedRace hedgedRace:starters
+                               withHedgeDelay:hedgeDelayInSeconds
+                              latencyRecorder:latencyRecorder
+                                        until:untilCancelledToken];
+}
+
++(TOCFuture*) asyncQuorumRace:(NSArray*)starters
+                   quorumSize:(NSUInteger)quorumSize
+                        until:(TOCCancelToken*)untilCancelledToken {
+    return [TOCInternal_QuorumRace quorumRace:starters
+                                   quorumSize:quorumSize
+                                        until:untilCancelledToken];
+}
+
+@end
+
+@implementation TOCInternal_HedgedRace {
+@private NSArray* _starters;
+@private NSTimeInterval _hedgeDelay;
+@private TOCAdaptiveHedgeDelay* _latencyRecorder;
+@private TOCCancelToken* _untilCancelledToken;
+/// When the first racer was started, which is when the race's latency is measured from
+@private NSTimeInterval _startTime;
+/// The podium for the winning racer, or for the failures of every racer
+@private TOCFutureSource* _futureWinningRacerSource;
+/// The started racers, at the index of their starter (NSNull for starters that haven't finished starting). Guarded by self.
+@private NSMutableArray* _racers;
+/// How many starters have been claimed for starting. Guarded by self.
+@private NSUInteger _startedRacerCount;
+/// How many racers have failed. Guarded by self.
+@private NSUInteger _failedRacerCount;
+}
+
++(TOCFuture*) hedgedRace:(NSArray*)starters
+          withHedgeDelay:(NSTimeInterval)hedgeDelayInSeconds
+         latencyRecorder:(TOCAdaptiveHedgeDelay*)latencyRecorder
+                   until:(TOCCancelToken*)untilCancelledToken {
+    TOCInternal_need(starters.count > 0);
+    TOCInternal_need(hedgeDelayInSeconds >= 0);
+    TOCInternal_need(!isnan(hedgeDelayInSeconds));
+    
+    TOCInternal_HedgedRace* race = [TOCInternal_HedgedRace new];
+    race->_starters = starters;
+    race->_hedgeDelay = hedgeDelayInSeconds;
+    race->_latencyRecorder = latencyRecorder;
+    race->_untilCancelledToken = untilCancelledToken;
+    race->_futureWinningRacerSource = [TOCFutureSource futureSourceUntil:untilCancelledToken];
+    race->_racers = [NSMutableArray arrayWithCapacity:starters.count];
+    for (NSUInteger i = 0; i < starters.count; i++) {
+        [race->_racers addObject:NSNull.null];
+    }
+    
+    // only the first racer starts right away, the others are started as hedges
+    race->_startTime = TOCInternal_monotonicNow();
+    [race _startNextRacer];
+    
+    // get the winning racer's result
+    return [race->_futureWinningRacerSource.future then:^id(TOCInternal_Racer* winningRacer) { return winningRacer.futureResult; }];
+}
+
+-(void) _startNextRacer {
+    NSUInteger index;
+    @synchronized(self) {
+        if (_startedRacerCount == _starters.count) return;
+        // no point in starting more racers once the race is over
+        if (!_futureWinningRacerSource.future.isIncomplete) return;
+        index = _startedRacerCount++;
+    }
+    
+    TOCInternal_Racer* racer = [TOCInternal_Racer racerStartedFrom:_starters[index]
+                                                             until:_untilCancelledToken];
+    @synchronized(self) {
+        _racers[index] = racer;
+    }
+    
+    // the race may have been won while this racer was starting, in which case nobody else will cancel it
+    TOCFuture* futureWinningRacer = _futureWinningRacerSource.future;
+    if (futureWinningRacer.hasResult && futureWinningRacer.forceGetResult != racer) {
+        [racer.canceller cancel];
+    }
+    
+    // the next racer starts when this one fails, or when it's taking too long (whichever happens first)
+    TOCFutureSource* hedgeTriggerSource = [TOCFutureSource new];
+    id<TOCExecutor> inlineExecutor = TOCExecutors.inlineExecutor;
+    [hedgeTriggerSource.future thenDo:^(id _) { [self _startNextRacer]; }
+                                   on:inlineExecutor];
+    
+    [racer.futureResult finallyDo:^(TOCFuture *completed) {
+        if (completed.hasResult) {
+            [self _racerSucceeded:racer];
+        } else {
+            [hedgeTriggerSource trySetResult:nil];
+            [self _racerFailed];
+        }
+    } on:inlineExecutor unless:_untilCancelledToken];
+    
+    if (index + 1 < _starters.count && _hedgeDelay < INFINITY) {
+        TOCFuture* futureHedgeDelayElapsed = [TOCFuture futureWithResult:nil
+                                                              afterDelay:_hedgeDelay
+                                                                  unless:futureWinningRacer.cancelledOnCompletionToken];
+        [futureHedgeDelayElapsed thenDo:^(id _) { [hedgeTriggerSource trySetResult:nil]; }
+                                     on:inlineExecutor];
+    }
+}
+
+-(void) _racerSucceeded:(TOCInternal_Racer*)racer {
+    if (![_futureWinningRacerSource trySetResult:racer]) return;
+    
+    // The whole race's latency, not the winner's: a hedge only wins when it beats the first racer, and started a delay late.
+    // Recording only its own time would feed the delay samples below the first racer's latencies, shrinking it race after race.
+    [_latencyRecorder recordLatency:MAX(0, TOCInternal_monotonicNow() - _startTime)];
+    
+    // once there's a winner, cancel the other racers
+    NSArray* racers;
+    @synchronized(self) {
+        racers = [_racers copy];
+    }
+    for (id other in racers) {
+        if (other != racer && other != NSNull.null) {
+            [[(TOCInternal_Racer*)other canceller] cancel];
+        }
+    }
+}
+
+-(void) _racerFailed {
+    NSArray* racers;
+    @synchronized(self) {
+        _failedRacerCount += 1;
+        if (_failedRacerCount < _starters.count) return;
+        racers = [_racers copy];
+    }
+    
+    // prefer to fail with a cancellation over failing with a list of cancellations
+    if (_untilCancelledToken.isAlreadyCancelled) return;
+    
+    // everyone is a failure, thus so are we
+    NSArray* allFailures = [racers map:^(TOCInternal_Racer* r) { return r.futureResult.forceGetFailure; }];
+    [_futureWinningRacerSource trySetFailure:allFailures];
+}
+
+@end
+
+@implementation TOCInternal_QuorumRace {
+@private NSUInteger _racerCount;
+@private NSUInteger _quorumSize;
+@private TOCFutureSource* _resultSource;
+/// The started racers, in the order they were started. Guarded by self.
+@private NSMutableArray* _racers;
+/// The racers that have succeeded, in the order they succeeded, until the quorum is reached. Guarded by self.
+@private NSMutableArray* _winningRacers;
+/// The failures of the racers that have failed, in the order they failed. Guarded by self.
+@private NSMutableArray* _failures;
+/// Whether or not the race is over (either the quorum was reached, or it can no longer be reached). Guarded by self.
+@private bool _isDecided;
+}
+
++(TOCFuture*) quorumRace:(NSArray*)starters
+              quorumSize:(NSUInteger)quorumSize
+                   until:(TOCCancelToken*)untilCancelledToken {
+    TOCInternal_need(quorumSize <= starters.count);
+    if (quorumSize == 0) return [TOCFuture futureWithResult:@[]];
+    
+    TOCInternal_QuorumRace* race = [TOCInternal_QuorumRace new];
+    race->_racerCount = starters.count;
+    race->_quorumSize = quorumSize;
+    race->_resultSource = [TOCFutureSource futureSourceUntil:untilCancelledToken];
+    race->_racers = [NSMutableArray arrayWithCapacity:starters.count];
+    race->_winningRacers = [NSMutableArray arrayWithCapacity:quorumSize];
+    race->_failures = [NSMutableArray array];
+    
+    for (TOCUntilOperation starter in starters) {
+        // operations that haven't been started when the race is decided are never started
+        @synchronized(race) {
+            if (race->_isDecided) break;
+        }
+        if (untilCancelledToken.isAlreadyCancelled) break;
+        
+        TOCInternal_Racer* racer = [TOCInternal_Racer racerStartedFrom:starter
+                                                                 until:untilCancelledToken];
+        bool isLateLoser;
+        @synchronized(race) {
+            [race->_racers addObject:racer];
+            isLateLoser = race->_isDecided;
+        }
+        if (isLateLoser) {
+            // decided while this racer was starting, after the losers were cancelled
+            [racer.canceller cancel];
+            break;
+        }
+        
+        // Reference cycle is fine. It is not self-sustaining. It gets removed when the racer completes.
+        [racer.futureResult _whenCompletedDo:^{ [race _racerCompleted:racer]; }
+                                          on:TOCExecutors.inlineExecutor
+                                      unless:untilCancelledToken];
+    }
+    
+    return race->_resultSource.future;
+}
+
+-(void) _racerCompleted:(TOCInternal_Racer*)racer {
+    TOCFuture* completed = racer.futureResult;
+    
+    bool wasAlreadyDecided;
+    NSArray* racers = nil;
+    NSArray* winningRacers = nil;
+    NSArray* failures = nil;
+    @synchronized(self) {
+        wasAlreadyDecided = _isDecided;
+        if (!wasAlreadyDecided) {
+            if (completed.hasResult) {
+                [_winningRacers addObject:racer];
+                if (_winningRacers.count < _quorumSize) return;
+                winningRacers = [_winningRacers copy];
+            } else {
+                [_failures addObject:completed.forceGetFailure];
+                if (_racerCount - _failures.count >= _quorumSize) return;
+                failures = [_failures copy];
+            }
+            racers = [_racers copy];
+            _isDecided = true;
+        }
+    }
+    
+    if (wasAlreadyDecided) {
+        // the race was already decided, so this racer lost (e.g. it succeeded just after the quorum was reached)
+        [racer.canceller cancel];
+        return;
+    }
+    
+    if (winningRacers != nil) {
+        [_resultSource trySetResult:[winningRacers map:^(TOCInternal_Racer* r) { return r.futureResult.forceGetResult; }]];
+    } else {
+        [_resultSource trySetFailure:failures];
+    }
+    
+    // cancel everyone who didn't make the quorum, so stragglers stop working and extra results are cleaned up
+    for (TOCInternal_Racer* other in racers) {
+        if (![winningRacers containsObject:other]) {
+            [other.canceller cancel];
+        }
+    }
+}
+
 @end
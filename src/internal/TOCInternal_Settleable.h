@@ -0,0 +1,75 @@
+#import <Foundation/Foundation.h>
+#import "TOCCancelTokenAndSource.h"
+#import "TOCFutureAndSource.h"
+#import "TOCExecutor.h"
+#import "TOCInternal_HandlerStack.h"
+
+typedef void (^TOCInternal_Remover)(void);
+typedef void (^TOCInternal_SettledHandler)(void);
+
+/*!
+ * Something that eventually settles, either by being triggered (a token being cancelled, a future completing) or by becoming immortal.
+ */
+@protocol TOCInternal_Settleable <NSObject>
+
+/*!
+ * Registers a handler to be run once the receiver has settled (either way), unless it is removed first.
+ *
+ * @result A block that removes the handler, or nil if the receiver had already settled and the handler was run inline.
+ *
+ * @discussion The handler runs on whichever thread settles the receiver. Main-threadness is not preserved.
+ */
+-(TOCInternal_Remover) _removable_whenSettledDo:(TOCInternal_SettledHandler)settledHandler;
+
+/*!
+ * Determines if the receiver has settled by being triggered, as opposed to still being pending or having become immortal.
+ */
+-(bool) _hasBeenTriggered;
+
+@end
+
+@interface TOCCancelToken (TOCInternal_Settleable) <TOCInternal_Settleable>
+
+/*!
+ * Like whenCancelledDo:on:unless:, but the handler is also discarded when the given settleable is triggered first.
+ *
+ * @param executor The executor to run the handler with. Nil means the default executor for the calling thread.
+ */
+-(void) _whenCancelledDo:(TOCCancelHandler)cancelHandler
+                      on:(id<TOCExecutor>)executor
+           unlessSettled:(id<TOCInternal_Settleable>)other;
+
+@end
+
+@interface TOCFuture (TOCInternal_Settleable) <TOCInternal_Settleable>
+
+/*!
+ * Runs the given handler once the receiving future has settled (either way), inline if it already has.
+ *
+ * @discussion Cheaper than _removable_whenSettledDo:, for handlers that never need to be removed.
+ * The handler runs on whichever thread settles the future.
+ */
+-(void) _whenSettledDo:(TOCInternal_SettledHandler)settledHandler;
+
+/*!
+ * Runs the given handler once the receiving future has completed with a result or failed, unless cancelled first.
+ *
+ * @param executor The executor to run the handler with. Nil means the default executor for the calling thread.
+ *
+ * @discussion Behaves like registering on the future's cancelledOnCompletionToken, without having to create that token.
+ */
+-(void) _whenCompletedDo:(TOCInternal_Handler)completionHandler
+                      on:(id<TOCExecutor>)executor
+                  unless:(TOCCancelToken*)unlessCancelledToken;
+
+@end
+
+/*!
+ * Runs the given handler once the receiver settles (either way), unless the other settleable settles first.
+ *
+ * @discussion Whichever one settles first removes the registration made on the other, so nothing is left behind.
+ */
+void TOCInternal_whenSettledDoUnlessSettled(id<TOCInternal_Settleable> receiver,
+                                            TOCInternal_SettledHandler settledHandler,
+                                            id<TOCInternal_Settleable> unlessSettled);
+
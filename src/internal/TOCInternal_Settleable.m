@@ -0,0 +1,38 @@
+#import "TOCInternal_Settleable.h"
+#import "TOCInternal.h"
+#include <stdatomic.h>
+
+void TOCInternal_whenSettledDoUnlessSettled(id<TOCInternal_Settleable> receiver,
+                                            TOCInternal_SettledHandler settledHandler,
+                                            id<TOCInternal_Settleable> unlessSettled) {
+    TOCInternal_need(receiver != nil);
+    TOCInternal_need(settledHandler != nil);
+    TOCInternal_need(unlessSettled != nil);
+
+    // fair warning: the following code is very difficult to get right.
+
+    // make a block that must be called twice to break the removing-each-other cycle
+    // that way we can be sure we don't touch an un-initialized part of the cycle, by making one call only once setup is complete
+    __block atomic_int callCount = 0;
+    __block TOCInternal_Remover removeHandlerFromOtherToSelf = nil;
+    TOCInternal_Remover onSecondCallRemoveHandlerFromOtherToSelf = ^{
+        if (atomic_fetch_add(&callCount, 1) == 0) return;
+        if (removeHandlerFromOtherToSelf == nil) return; // only occurs when the handler was already run and discarded anyways
+        removeHandlerFromOtherToSelf();
+        removeHandlerFromOtherToSelf = nil;
+    };
+
+    // make the remove-each-other cycle, running the handler if the receiver settles first
+    __block TOCInternal_Remover removeHandlerFromSelfToOther = [receiver _removable_whenSettledDo:^(){
+        settledHandler();
+        onSecondCallRemoveHandlerFromOtherToSelf();
+    }];
+    removeHandlerFromOtherToSelf = [unlessSettled _removable_whenSettledDo:^() {
+        if (removeHandlerFromSelfToOther == nil) return; // only occurs when the handler was already run and discarded anyways
+        removeHandlerFromSelfToOther();
+        removeHandlerFromSelfToOther = nil;
+    }];
+
+    // allow the cycle to be broken
+    onSecondCallRemoveHandlerFromOtherToSelf();
+}
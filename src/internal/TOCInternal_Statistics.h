@@ -0,0 +1,67 @@
+#import <Foundation/Foundation.h>
+#include <stdatomic.h>
+
+/*!
+ * The events counted for TOCStatistics.
+ */
+enum TOCInternal_Counter {
+    TOCInternal_Counter_FuturesCreated,
+    TOCInternal_Counter_FuturesDeallocated,
+    TOCInternal_Counter_FuturesCompleted,
+    TOCInternal_Counter_FuturesImmortalized,
+    TOCInternal_Counter_FutureSourcesCreated,
+    TOCInternal_Counter_FutureSourcesDeallocated,
+    TOCInternal_Counter_CancelTokensCreated,
+    TOCInternal_Counter_CancelTokensDeallocated,
+    TOCInternal_Counter_CancelTokensCancelled,
+    TOCInternal_Counter_CancelTokensImmortalized,
+    TOCInternal_Counter_CancelTokenSourcesCreated,
+    TOCInternal_Counter_CancelTokenSourcesDeallocated,
+    TOCInternal_Counter_HandlersRegistered,
+    TOCInternal_Counter_HandlersRemoved,
+    TOCInternal_Counter_HandlersRun,
+    TOCInternal_Counter_HandlersDiscarded,
+    TOCInternal_Counter_MainThreadHops,
+    TOCInternal_Counter_FlatteningCyclesDetected,
+    
+    TOCInternal_CounterCount
+};
+
+/*!
+ * One thread's event counts.
+ *
+ * @discussion Only the owning thread writes the counts, so incrementing them doesn't need a locked read-modify-write.
+ * Other threads only read them, when merging the counts of every thread.
+ */
+typedef struct TOCInternal_ThreadCounters {
+    _Atomic(uint64_t) counts[TOCInternal_CounterCount];
+    struct TOCInternal_ThreadCounters* next;
+} TOCInternal_ThreadCounters;
+
+/// The current thread's counters, or NULL until the thread counts its first event
+extern _Thread_local TOCInternal_ThreadCounters* TOCInternal_currentThreadCounters;
+
+/*!
+ * Makes counters for the current thread, and adds them to the counters that are merged on read.
+ *
+ * @discussion When the thread exits, its counts are folded into a shared total and its counters are freed.
+ */
+TOCInternal_ThreadCounters* TOCInternal_ThreadCounters_register(void);
+
+/*!
+ * Counts one occurrence of the given event on the current thread.
+ */
+static inline void TOCInternal_count(enum TOCInternal_Counter counter) {
+    TOCInternal_ThreadCounters* counters = TOCInternal_currentThreadCounters;
+    if (counters == NULL) counters = TOCInternal_ThreadCounters_register();
+    
+    uint64_t count = atomic_load_explicit(&counters->counts[counter], memory_order_relaxed);
+    atomic_store_explicit(&counters->counts[counter], count + 1, memory_order_relaxed);
+}
+
+/*!
+ * Fills the given array with the total counts of every event, across every thread (including exited threads).
+ *
+ * @discussion Each count is read atomically, but the counts aren't read all at the same instant.
+ */
+void TOCInternal_Counters_readTotals(uint64_t totals[TOCInternal_CounterCount]);
@@ -0,0 +1,64 @@
+#import "TOCInternal_Statistics.h"
+#import "TOCInternal.h"
+#include <pthread.h>
+
+_Thread_local TOCInternal_ThreadCounters* TOCInternal_currentThreadCounters;
+
+/// Guards the list of live threads' counters, and the totals of exited threads
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static TOCInternal_ThreadCounters* liveThreadCounters;
+static uint64_t exitedThreadTotals[TOCInternal_CounterCount];
+
+/// Lets us know when a registered thread exits
+static pthread_key_t threadExitKey;
+static pthread_once_t threadExitKeyOnce = PTHREAD_ONCE_INIT;
+
+static void retireThreadCounters(void* countersReference) {
+    TOCInternal_ThreadCounters* counters = countersReference;
+    
+    pthread_mutex_lock(&registryLock);
+    for (int i = 0; i < TOCInternal_CounterCount; i++) {
+        exitedThreadTotals[i] += atomic_load_explicit(&counters->counts[i], memory_order_relaxed);
+    }
+    TOCInternal_ThreadCounters** link = &liveThreadCounters;
+    while (*link != counters) link = &(*link)->next;
+    *link = counters->next;
+    pthread_mutex_unlock(&registryLock);
+    
+    // events counted by later thread-exit cleanup (e.g. deallocations) register fresh counters
+    if (TOCInternal_currentThreadCounters == counters) TOCInternal_currentThreadCounters = NULL;
+    free(counters);
+}
+
+static void createThreadExitKey(void) {
+    TOCInternal_force(pthread_key_create(&threadExitKey, retireThreadCounters) == 0);
+}
+
+TOCInternal_ThreadCounters* TOCInternal_ThreadCounters_register(void) {
+    pthread_once(&threadExitKeyOnce, createThreadExitKey);
+    
+    TOCInternal_ThreadCounters* counters = calloc(1, sizeof(TOCInternal_ThreadCounters));
+    TOCInternal_force(counters != NULL);
+    
+    pthread_mutex_lock(&registryLock);
+    counters->next = liveThreadCounters;
+    liveThreadCounters = counters;
+    pthread_mutex_unlock(&registryLock);
+    
+    pthread_setspecific(threadExitKey, counters);
+    TOCInternal_currentThreadCounters = counters;
+    return counters;
+}
+
+void TOCInternal_Counters_readTotals(uint64_t totals[TOCInternal_CounterCount]) {
+    pthread_mutex_lock(&registryLock);
+    for (int i = 0; i < TOCInternal_CounterCount; i++) {
+        totals[i] = exitedThreadTotals[i];
+    }
+    for (TOCInternal_ThreadCounters* counters = liveThreadCounters; counters != NULL; counters = counters->next) {
+        for (int i = 0; i < TOCInternal_CounterCount; i++) {
+            totals[i] += atomic_load_explicit(&counters->counts[i], memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&registryLock);
+}
@@ -0,0 +1,58 @@
+#import <Foundation/Foundation.h>
+#import "TOCInternal_HandlerStack.h"
+
+/*!
+ * A block scheduled on a timer wheel, that can be cancelled before it runs.
+ */
+@interface TOCInternal_TimerWheelEntry : NSObject
+
+/*!
+ * Removes the entry from its timer wheel, so its block never runs, and releases the block.
+ *
+ * @result True if the entry was cancelled, false if its block has already been handed off to run (or it was already cancelled).
+ */
+-(bool) cancel;
+
+/*!
+ * The time, on the monotonic clock (see TOCInternal_monotonicNow), that the entry's block is due to run at.
+ *
+ * @discussion This is the requested deadline, rounded up to a tick and to the wheel's coalescing leeway.
+ * Code that reports a deadline for something the entry does (e.g. a deadline token) should report this time, not the requested one.
+ */
+@property (readonly,nonatomic) NSTimeInterval fireTime;
+
+@end
+
+/*!
+ * A hierarchical timing wheel, serving all of the library's delays and timeouts from a single timer on a single serial queue.
+ *
+ * @discussion Deadlines are kept in four levels of 64 slots each, with one tick per millisecond at the bottom level.
+ * Scheduling and cancelling are constant time. Cancelling an entry removes it from its slot right away, releasing its block.
+ * Deadlines too far out for the top level are parked in its furthest slot, and re-filed when that slot comes around.
+ *
+ * The wheel only wakes up when a slot needs to be fired or cascaded down a level, not on every tick.
+ *
+ * Deadlines are rounded up to a multiple of the coalescing leeway, so that nearby deadlines land in the same slot and fire together.
+ * Fired blocks are run asynchronously on a global concurrent queue, so slow blocks don't hold up the wheel.
+ */
+@interface TOCInternal_TimerWheel : NSObject
+
+/*!
+ * Returns the timer wheel used by the library.
+ */
++(TOCInternal_TimerWheel*) sharedTimerWheel;
+
+/*!
+ * Schedules the given block to run after (at least) the given delay, unless the returned entry is cancelled first.
+ *
+ * @param delayInSeconds How long to wait. Must be finite, not NaN, and not negative.
+ */
+-(TOCInternal_TimerWheelEntry*) scheduleBlock:(TOCInternal_Handler)block
+                                   afterDelay:(NSTimeInterval)delayInSeconds;
+
+/*!
+ * How far, in seconds, deadlines may be pushed back so that they fire together with nearby deadlines.
+ */
+@property (atomic) NSTimeInterval coalescingLeeway;
+
+@end
@@ -0,0 +1,304 @@
+#import "TOCInternal_TimerWheel.h"
+#import "TOCInternal.h"
+
+/// How many bits of the deadline (in ticks) each level of the wheel covers
+#define TOCInternal_TimerWheel_LevelBits 6
+#define TOCInternal_TimerWheel_SlotCount 64
+#define TOCInternal_TimerWheel_LevelCount 4
+
+/// The duration of one tick at the bottom level of the wheel, in seconds
+static const NSTimeInterval TickDuration = 0.001;
+
+@interface TOCInternal_TimerWheel ()
+-(bool) _cancelEntry:(TOCInternal_TimerWheelEntry*)entry;
+@end
+
+@interface TOCInternal_TimerWheelEntry () {
+@package TOCInternal_TimerWheel* _wheel;
+/// The block to run, or nil once the entry has been fired or cancelled
+@package TOCInternal_Handler _block;
+/// The tick the entry should fire on
+@package uint64_t _deadlineTick;
+/// When that tick comes around, on the monotonic clock
+@package NSTimeInterval _fireTime;
+/// Whether or not the entry is in one of its wheel's slots
+@package bool _isLinked;
+@package int _level;
+@package int _slot;
+/// The next entry in the same slot. Slots own their entries through this chain.
+@package TOCInternal_TimerWheelEntry* _next;
+@package __unsafe_unretained TOCInternal_TimerWheelEntry* _prev;
+}
+@end
+
+@implementation TOCInternal_TimerWheelEntry
+
+-(bool) cancel {
+    return [_wheel _cancelEntry:self];
+}
+
+-(NSTimeInterval) fireTime {
+    return _fireTime;
+}
+
+@end
+
+@implementation TOCInternal_TimerWheel {
+@private dispatch_queue_t _queue;
+@private dispatch_source_t _timer;
+/// The system uptime that tick 0 corresponds to
+@private NSTimeInterval _startTime;
+@private NSTimeInterval _coalescingLeeway;
+/// The last tick that was processed. Slot positions are relative to it.
+@private uint64_t _currentTick;
+/// The tick the timer is set to wake up on, or UINT64_MAX when it is not set
+@private uint64_t _armedTick;
+/// One bit per slot, set when the slot has entries in it
+@private uint64_t _occupied[TOCInternal_TimerWheel_LevelCount];
+@private TOCInternal_TimerWheelEntry* _slots[TOCInternal_TimerWheel_LevelCount][TOCInternal_TimerWheel_SlotCount];
+}
+
++(TOCInternal_TimerWheel*) sharedTimerWheel {
+    static dispatch_once_t once;
+    static TOCInternal_TimerWheel* wheel = nil;
+    dispatch_once(&once, ^{
+        wheel = [TOCInternal_TimerWheel new];
+    });
+    return wheel;
+}
+
+-(instancetype) init {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("CollapsingFutures.TimerWheel", DISPATCH_QUEUE_SERIAL);
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+        _startTime = TOCInternal_monotonicNow();
+        _coalescingLeeway = TickDuration;
+        _armedTick = UINT64_MAX;
+
+        __weak TOCInternal_TimerWheel* weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{ [weakSelf _wake]; });
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_timer);
+    }
+    return self;
+}
+
+-(NSTimeInterval) coalescingLeeway {
+    @synchronized(self) {
+        return _coalescingLeeway;
+    }
+}
+
+-(void) setCoalescingLeeway:(NSTimeInterval)coalescingLeeway {
+    TOCInternal_need(coalescingLeeway >= 0);
+    TOCInternal_need(coalescingLeeway < INFINITY);
+
+    @synchronized(self) {
+        _coalescingLeeway = coalescingLeeway;
+    }
+}
+
+-(uint64_t) _nowTick {
+    NSTimeInterval elapsed = TOCInternal_monotonicNow() - _startTime;
+    return elapsed <= 0 ? 0 : (uint64_t)(elapsed / TickDuration);
+}
+
+-(TOCInternal_TimerWheelEntry*) scheduleBlock:(TOCInternal_Handler)block
+                                   afterDelay:(NSTimeInterval)delayInSeconds {
+    TOCInternal_need(block != nil);
+    TOCInternal_need(delayInSeconds >= 0);
+    TOCInternal_need(delayInSeconds < INFINITY);
+
+    TOCInternal_TimerWheelEntry* entry = [TOCInternal_TimerWheelEntry new];
+    entry->_wheel = self;
+    entry->_block = block;
+
+    @synchronized(self) {
+        // an empty wheel can skip straight to the present, instead of filing relative to a stale position
+        bool isEmpty = true;
+        for (int level = 0; level < TOCInternal_TimerWheel_LevelCount; level++) {
+            if (_occupied[level] != 0) isEmpty = false;
+        }
+        NSTimeInterval elapsed = TOCInternal_monotonicNow() - _startTime;
+        uint64_t nowTick = elapsed <= 0 ? 0 : (uint64_t)(elapsed / TickDuration);
+        if (isEmpty && nowTick > _currentTick) _currentTick = nowTick;
+
+        // round the deadline up to a tick (so it can't fire early), then to a multiple of the leeway, so nearby deadlines share a slot
+        uint64_t leewayTicks = MAX(1, (uint64_t)ceil(_coalescingLeeway / TickDuration));
+        uint64_t deadlineTick = (uint64_t)ceil(MAX(elapsed, 0) / TickDuration + delayInSeconds / TickDuration);
+        deadlineTick = (deadlineTick + leewayTicks - 1) / leewayTicks * leewayTicks;
+
+        entry->_deadlineTick = MAX(deadlineTick, _currentTick + 1);
+        entry->_fireTime = _startTime + entry->_deadlineTick * TickDuration;
+        [self _file:entry];
+        [self _armFor:[self _nextEventTick]];
+    }
+
+    return entry;
+}
+
+-(bool) _cancelEntry:(TOCInternal_TimerWheelEntry*)entry {
+    // the timer is left armed, even if it was armed for this entry, because waking up for nothing is harmless
+    @synchronized(self) {
+        if (!entry->_isLinked) return false;
+        [self _unlink:entry];
+        entry->_block = nil;
+        return true;
+    }
+}
+
+/// Puts the entry into the slot that should be processed next for its deadline, relative to the current tick.
+-(void) _file:(TOCInternal_TimerWheelEntry*)entry {
+    uint64_t deadlineTick = MAX(entry->_deadlineTick, _currentTick);
+
+    int level = 0;
+    while (level < TOCInternal_TimerWheel_LevelCount) {
+        int shift = level * TOCInternal_TimerWheel_LevelBits;
+        if ((deadlineTick >> shift) - (_currentTick >> shift) < TOCInternal_TimerWheel_SlotCount) break;
+        level++;
+    }
+
+    uint64_t bucket;
+    if (level == TOCInternal_TimerWheel_LevelCount) {
+        // too far out: park in the top level's furthest slot, and re-file when it comes around
+        level = TOCInternal_TimerWheel_LevelCount - 1;
+        bucket = (_currentTick >> (level * TOCInternal_TimerWheel_LevelBits)) + TOCInternal_TimerWheel_SlotCount - 1;
+    } else {
+        bucket = deadlineTick >> (level * TOCInternal_TimerWheel_LevelBits);
+    }
+    int slot = (int)(bucket & (TOCInternal_TimerWheel_SlotCount - 1));
+
+    entry->_level = level;
+    entry->_slot = slot;
+    entry->_prev = nil;
+    entry->_next = _slots[level][slot];
+    if (entry->_next != nil) entry->_next->_prev = entry;
+    _slots[level][slot] = entry;
+    _occupied[level] |= (uint64_t)1 << slot;
+    entry->_isLinked = true;
+}
+
+-(void) _unlink:(TOCInternal_TimerWheelEntry*)entry {
+    int level = entry->_level;
+    int slot = entry->_slot;
+    TOCInternal_TimerWheelEntry* next = entry->_next;
+
+    if (next != nil) next->_prev = entry->_prev;
+    if (entry->_prev != nil) {
+        entry->_prev->_next = next;
+    } else {
+        _slots[level][slot] = next;
+    }
+    if (_slots[level][slot] == nil) {
+        _occupied[level] &= ~((uint64_t)1 << slot);
+    }
+
+    entry->_next = nil;
+    entry->_prev = nil;
+    entry->_isLinked = false;
+}
+
+/// Removes and returns the chain of entries in the given slot.
+-(TOCInternal_TimerWheelEntry*) _takeSlot:(int)slot atLevel:(int)level {
+    TOCInternal_TimerWheelEntry* head = _slots[level][slot];
+    _slots[level][slot] = nil;
+    _occupied[level] &= ~((uint64_t)1 << slot);
+    return head;
+}
+
+/// Returns the first tick after the current tick on which some slot needs to be fired or cascaded, or UINT64_MAX if there are no entries.
+-(uint64_t) _nextEventTick {
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < TOCInternal_TimerWheel_LevelCount; level++) {
+        uint64_t bits = _occupied[level];
+        if (bits == 0) continue;
+
+        int shift = level * TOCInternal_TimerWheel_LevelBits;
+        uint64_t bucket = _currentTick >> shift;
+
+        // rotate so that the slot after the current position is bit 0
+        unsigned start = (unsigned)((bucket + 1) & (TOCInternal_TimerWheel_SlotCount - 1));
+        uint64_t rotated = start == 0 ? bits : (bits >> start) | (bits << (64 - start));
+        uint64_t distance = (uint64_t)__builtin_ctzll(rotated) + 1;
+
+        best = MIN(best, (bucket + distance) << shift);
+    }
+    return best;
+}
+
+-(void) _armFor:(uint64_t)tick {
+    if (tick >= _armedTick) return;
+    _armedTick = tick;
+
+    NSTimeInterval delay = _startTime + tick * TickDuration - TOCInternal_monotonicNow();
+    int64_t delayInNanoseconds = delay <= 0 ? 0 : (int64_t)(delay * NSEC_PER_SEC);
+    dispatch_source_set_timer(_timer,
+                              dispatch_time(DISPATCH_TIME_NOW, delayInNanoseconds),
+                              DISPATCH_TIME_FOREVER,
+                              (uint64_t)(TickDuration * NSEC_PER_SEC));
+}
+
+-(void) _wake {
+    NSMutableArray* firedBlocks = [NSMutableArray array];
+
+    @synchronized(self) {
+        _armedTick = UINT64_MAX;
+        uint64_t nowTick = [self _nowTick];
+
+        // jump from event to event, instead of stepping through every tick
+        while (true) {
+            uint64_t nextTick = [self _nextEventTick];
+            if (nextTick > nowTick) break;
+            _currentTick = nextTick;
+            [self _processCurrentTickInto:firedBlocks];
+        }
+        if (nowTick > _currentTick) _currentTick = nowTick;
+
+        uint64_t nextTick = [self _nextEventTick];
+        if (nextTick == UINT64_MAX) {
+            dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        } else {
+            [self _armFor:nextTick];
+        }
+    }
+
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (TOCInternal_Handler block in firedBlocks) {
+        dispatch_async(queue, block);
+    }
+}
+
+-(void) _processCurrentTickInto:(NSMutableArray*)firedBlocks {
+    uint64_t tick = _currentTick;
+
+    // cascade higher levels whose slot just came around, from the top down, re-filing their entries closer to the bottom
+    for (int level = TOCInternal_TimerWheel_LevelCount - 1; level >= 1; level--) {
+        int shift = level * TOCInternal_TimerWheel_LevelBits;
+        if ((tick & (((uint64_t)1 << shift) - 1)) != 0) continue;
+
+        int slot = (int)((tick >> shift) & (TOCInternal_TimerWheel_SlotCount - 1));
+        TOCInternal_TimerWheelEntry* entry = [self _takeSlot:slot atLevel:level];
+        while (entry != nil) {
+            TOCInternal_TimerWheelEntry* next = entry->_next;
+            entry->_next = nil;
+            entry->_prev = nil;
+            [self _file:entry];
+            entry = next;
+        }
+    }
+
+    // fire the bottom level's slot
+    int slot = (int)(tick & (TOCInternal_TimerWheel_SlotCount - 1));
+    TOCInternal_TimerWheelEntry* entry = [self _takeSlot:slot atLevel:0];
+    while (entry != nil) {
+        TOCInternal_TimerWheelEntry* next = entry->_next;
+        [firedBlocks addObject:entry->_block];
+        entry->_block = nil;
+        entry->_next = nil;
+        entry->_prev = nil;
+        entry->_isLinked = false;
+        entry = next;
+    }
+}
+
+@end
@@ -0,0 +1,123 @@
+#import <Foundation/Foundation.h>
+#include <stdatomic.h>
+#import "TOCFutureAndSource.h"
+#import "TOCCancelTokenAndSource.h"
+#import "TOCInternal_HandlerStack.h"
+
+/// How many events each thread's ring buffer holds. Older events are overwritten by newer ones.
+#define TOCInternal_TraceBufferCapacity 16384
+
+/*!
+ * The events recorded while tracing.
+ */
+enum TOCInternal_TraceEventKind {
+    /// A future was made. (object: the future)
+    TOCInternal_TraceEvent_FutureCreated,
+    /// A future was made to hold the result of a continuation. (object: the continuation's future, related: the future being continued)
+    TOCInternal_TraceEvent_FutureLinked,
+    /// A future was set to flatten another future. (object: the future, related: the future it is flattening)
+    TOCInternal_TraceEvent_FutureFlattened,
+    /// Flattening a future made a cycle, so the future became immortal. (object: the future, related: the future it tried to flatten)
+    TOCInternal_TraceEvent_FlatteningCycle,
+    /// A future (and any futures flattening it) settled. (object: the future, detail: its enum TOCFutureState)
+    TOCInternal_TraceEvent_FutureSettled,
+    /// A cancel token was cancelled. (object: the token)
+    TOCInternal_TraceEvent_TokenCancelled,
+    /// A completion handler ran. (object: the completed future, detail: how long the handler ran for, in nanoseconds)
+    TOCInternal_TraceEvent_HandlerRan
+};
+
+/*!
+ * One recorded event.
+ *
+ * @discussion The fields are atomic so that exporting, which may read a slot while its thread is overwriting it, is well defined.
+ * Torn events are detected and dropped by the exporter.
+ */
+typedef struct TOCInternal_TraceEvent {
+    /// When the event happened (for handlers, when they started running), in nanoseconds on the monotonic clock
+    _Atomic(uint64_t) timestamp;
+    _Atomic(uint64_t) kind;
+    _Atomic(uint64_t) object;
+    _Atomic(uint64_t) related;
+    _Atomic(uint64_t) detail;
+} TOCInternal_TraceEvent;
+
+/// Whether or not events are being recorded. Checked (cheaply) before doing any tracing work.
+extern atomic_bool TOCInternal_tracingEnabled;
+
+static inline bool TOCInternal_isTracing(void) {
+    return atomic_load_explicit(&TOCInternal_tracingEnabled, memory_order_relaxed);
+}
+
+/*!
+ * Returns the current time, in nanoseconds, on the clock that trace events are timestamped with.
+ */
+uint64_t TOCInternal_traceNow(void);
+
+/*!
+ * Records an event, that happened at the given time, into the current thread's ring buffer.
+ *
+ * @discussion Does nothing when tracing is off.
+ */
+void TOCInternal_traceAt(uint64_t timestamp,
+                         enum TOCInternal_TraceEventKind kind,
+                         uint64_t object,
+                         uint64_t related,
+                         uint64_t detail);
+
+/*!
+ * Records an event, that happened just now, into the current thread's ring buffer.
+ *
+ * @discussion Does nothing when tracing is off.
+ */
+void TOCInternal_trace(enum TOCInternal_TraceEventKind kind,
+                       uint64_t object,
+                       uint64_t related,
+                       uint64_t detail);
+
+/*!
+ * Wraps a completion handler, so that how long it runs for is recorded (when tracing).
+ *
+ * @param completedFuture The future whose completion the handler is waiting on.
+ *
+ * @result The handler itself, when not tracing.
+ */
+TOCInternal_Handler TOCInternal_tracedHandler(TOCInternal_Handler handler, TOCFuture* completedFuture);
+
+/*!
+ * Discards every recorded event, and starts recording new events.
+ */
+void TOCInternal_Tracing_start(void);
+
+/*!
+ * Stops recording events. The recorded events are kept.
+ */
+void TOCInternal_Tracing_stop(void);
+
+/*!
+ * Returns the events recorded since tracing was last started, as a Chrome trace (JSON).
+ */
+NSData* TOCInternal_Tracing_exportChromeTrace(void);
+
+@interface TOCFuture (TOCInternal_Tracing)
+
+/*!
+ * Returns a number identifying the receiving future in traces, assigning one if it doesn't have one yet.
+ */
+-(uint64_t) _traceId;
+
+@end
+
+@interface TOCCancelToken (TOCInternal_Tracing)
+
+/*!
+ * Returns a number identifying the receiving token in traces, assigning one if it doesn't have one yet.
+ */
+-(uint64_t) _traceId;
+
+@end
+
+/*!
+ * Returns the id stored in the given slot, storing a newly assigned id into it first if it is still 0.
+ */
+uint64_t TOCInternal_traceIdIn(_Atomic(uint64_t)* slot);
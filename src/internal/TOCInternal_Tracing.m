@@ -0,0 +1,354 @@
+#import "TOCInternal_Tracing.h"
+#import "TOCInternal.h"
+#include <pthread.h>
+#include <time.h>
+
+atomic_bool TOCInternal_tracingEnabled;
+
+/// Incremented each time tracing starts, so that threads know to discard the events of the previous session
+static _Atomic(uint64_t) currentGeneration;
+static _Atomic(uint64_t) nextTraceId = 1;
+
+/*!
+ * One thread's ring buffer of events.
+ *
+ * @discussion Only the owning thread writes events. The exporter reads them, seqlock style:
+ * the writer bumps startedCount before overwriting a slot and bumps publishedCount after,
+ * so the exporter can tell which of the slots it copied may have been overwritten mid-copy.
+ */
+typedef struct TOCInternal_TraceBuffer {
+    TOCInternal_TraceEvent events[TOCInternal_TraceBufferCapacity];
+    _Atomic(uint64_t) startedCount;
+    _Atomic(uint64_t) publishedCount;
+    /// The tracing session the counts belong to
+    _Atomic(uint64_t) generation;
+    uint64_t threadIndex;
+    char threadName[64];
+    /// Set when the owning thread exits. Guarded by the registry lock.
+    bool hasExited;
+    struct TOCInternal_TraceBuffer* next;
+} TOCInternal_TraceBuffer;
+
+static _Thread_local TOCInternal_TraceBuffer* currentThreadBuffer;
+
+/// Guards the list of buffers, and the session start time. Held while exporting, so buffers aren't freed mid-copy.
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static TOCInternal_TraceBuffer* allBuffers;
+static uint64_t registeredThreadCount;
+static uint64_t sessionStartTime;
+
+static pthread_key_t threadExitKey;
+static pthread_once_t threadExitKeyOnce = PTHREAD_ONCE_INIT;
+
+static void retireTraceBuffer(void* bufferReference) {
+    TOCInternal_TraceBuffer* buffer = bufferReference;
+    
+    // the events are kept for exporting, and the buffer is freed when the next session starts
+    pthread_mutex_lock(&registryLock);
+    buffer->hasExited = true;
+    pthread_mutex_unlock(&registryLock);
+    
+    if (currentThreadBuffer == buffer) currentThreadBuffer = NULL;
+}
+
+static void createThreadExitKey(void) {
+    TOCInternal_force(pthread_key_create(&threadExitKey, retireTraceBuffer) == 0);
+}
+
+static TOCInternal_TraceBuffer* registerTraceBuffer(void) {
+    pthread_once(&threadExitKeyOnce, createThreadExitKey);
+    
+    TOCInternal_TraceBuffer* buffer = calloc(1, sizeof(TOCInternal_TraceBuffer));
+    TOCInternal_force(buffer != NULL);
+    pthread_getname_np(pthread_self(), buffer->threadName, sizeof(buffer->threadName));
+    
+    pthread_mutex_lock(&registryLock);
+    buffer->threadIndex = ++registeredThreadCount;
+    buffer->next = allBuffers;
+    allBuffers = buffer;
+    pthread_mutex_unlock(&registryLock);
+    
+    if (buffer->threadName[0] == '\0') {
+        snprintf(buffer->threadName, sizeof(buffer->threadName),
+                 NSThread.isMainThread ? "Main Thread" : "Thread %llu",
+                 (unsigned long long)buffer->threadIndex);
+    }
+    
+    pthread_setspecific(threadExitKey, buffer);
+    currentThreadBuffer = buffer;
+    return buffer;
+}
+
+uint64_t TOCInternal_traceNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+uint64_t TOCInternal_traceIdIn(_Atomic(uint64_t)* slot) {
+    uint64_t existing = atomic_load_explicit(slot, memory_order_relaxed);
+    if (existing != 0) return existing;
+    
+    uint64_t desired = atomic_fetch_add_explicit(&nextTraceId, 1, memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(slot, &existing, desired, memory_order_relaxed, memory_order_relaxed)) {
+        // someone else assigned one first
+        return existing;
+    }
+    return desired;
+}
+
+void TOCInternal_traceAt(uint64_t timestamp,
+                         enum TOCInternal_TraceEventKind kind,
+                         uint64_t object,
+                         uint64_t related,
+                         uint64_t detail) {
+    if (!TOCInternal_isTracing()) return;
+    
+    TOCInternal_TraceBuffer* buffer = currentThreadBuffer;
+    if (buffer == NULL) buffer = registerTraceBuffer();
+    
+    uint64_t generation = atomic_load_explicit(&currentGeneration, memory_order_acquire);
+    if (atomic_load_explicit(&buffer->generation, memory_order_relaxed) != generation) {
+        // first event of a new session: discard the previous session's events
+        atomic_store_explicit(&buffer->startedCount, 0, memory_order_relaxed);
+        atomic_store_explicit(&buffer->publishedCount, 0, memory_order_relaxed);
+        atomic_store_explicit(&buffer->generation, generation, memory_order_release);
+    }
+    
+    uint64_t index = atomic_load_explicit(&buffer->startedCount, memory_order_relaxed);
+    atomic_store_explicit(&buffer->startedCount, index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    TOCInternal_TraceEvent* event = &buffer->events[index % TOCInternal_TraceBufferCapacity];
+    atomic_store_explicit(&event->timestamp, timestamp, memory_order_relaxed);
+    atomic_store_explicit(&event->kind, kind, memory_order_relaxed);
+    atomic_store_explicit(&event->object, object, memory_order_relaxed);
+    atomic_store_explicit(&event->related, related, memory_order_relaxed);
+    atomic_store_explicit(&event->detail, detail, memory_order_relaxed);
+    
+    atomic_store_explicit(&buffer->publishedCount, index + 1, memory_order_release);
+}
+
+void TOCInternal_trace(enum TOCInternal_TraceEventKind kind,
+                       uint64_t object,
+                       uint64_t related,
+                       uint64_t detail) {
+    if (!TOCInternal_isTracing()) return;
+    TOCInternal_traceAt(TOCInternal_traceNow(), kind, object, related, detail);
+}
+
+TOCInternal_Handler TOCInternal_tracedHandler(TOCInternal_Handler handler, TOCFuture* completedFuture) {
+    if (!TOCInternal_isTracing()) return handler;
+    
+    uint64_t futureId = completedFuture._traceId;
+    return ^{
+        uint64_t startTime = TOCInternal_traceNow();
+        handler();
+        TOCInternal_traceAt(startTime, TOCInternal_TraceEvent_HandlerRan, futureId, 0, TOCInternal_traceNow() - startTime);
+    };
+}
+
+void TOCInternal_Tracing_start(void) {
+    pthread_mutex_lock(&registryLock);
+    
+    // buffers of exited threads can't be written to anymore, and their events are about to be discarded
+    TOCInternal_TraceBuffer** link = &allBuffers;
+    while (*link != NULL) {
+        TOCInternal_TraceBuffer* buffer = *link;
+        if (buffer->hasExited) {
+            *link = buffer->next;
+            free(buffer);
+        } else {
+            link = &buffer->next;
+        }
+    }
+    
+    sessionStartTime = TOCInternal_traceNow();
+    atomic_fetch_add_explicit(&currentGeneration, 1, memory_order_acq_rel);
+    pthread_mutex_unlock(&registryLock);
+    
+    atomic_store_explicit(&TOCInternal_tracingEnabled, true, memory_order_relaxed);
+}
+
+void TOCInternal_Tracing_stop(void) {
+    atomic_store_explicit(&TOCInternal_tracingEnabled, false, memory_order_relaxed);
+}
+
+/// An event copied out of a ring buffer
+typedef struct {
+    uint64_t timestamp;
+    uint64_t kind;
+    uint64_t object;
+    uint64_t related;
+    uint64_t detail;
+    uint64_t threadIndex;
+} TOCInternal_CopiedTraceEvent;
+
+static int compareCopiedTraceEvents(const void* a, const void* b) {
+    uint64_t x = ((const TOCInternal_CopiedTraceEvent*)a)->timestamp;
+    uint64_t y = ((const TOCInternal_CopiedTraceEvent*)b)->timestamp;
+    return (x > y) - (x < y);
+}
+
+/// Copies the events of the given buffer that weren't overwritten while being copied. Returns how many were copied.
+static NSUInteger copyTraceEvents(TOCInternal_TraceBuffer* buffer, uint64_t generation, TOCInternal_CopiedTraceEvent* out) {
+    if (atomic_load_explicit(&buffer->generation, memory_order_acquire) != generation) return 0;
+    
+    uint64_t published = atomic_load_explicit(&buffer->publishedCount, memory_order_acquire);
+    uint64_t first = published > TOCInternal_TraceBufferCapacity ? published - TOCInternal_TraceBufferCapacity : 0;
+    for (uint64_t i = first; i < published; i++) {
+        TOCInternal_TraceEvent* event = &buffer->events[i % TOCInternal_TraceBufferCapacity];
+        TOCInternal_CopiedTraceEvent* copy = &out[i - first];
+        copy->timestamp = atomic_load_explicit(&event->timestamp, memory_order_relaxed);
+        copy->kind = atomic_load_explicit(&event->kind, memory_order_relaxed);
+        copy->object = atomic_load_explicit(&event->object, memory_order_relaxed);
+        copy->related = atomic_load_explicit(&event->related, memory_order_relaxed);
+        copy->detail = atomic_load_explicit(&event->detail, memory_order_relaxed);
+        copy->threadIndex = buffer->threadIndex;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    
+    // slots the writer started overwriting (or reset) during the copy may be torn
+    if (atomic_load_explicit(&buffer->generation, memory_order_relaxed) != generation) return 0;
+    uint64_t started = atomic_load_explicit(&buffer->startedCount, memory_order_relaxed);
+    uint64_t firstIntact = started > TOCInternal_TraceBufferCapacity ? started - TOCInternal_TraceBufferCapacity : 0;
+    if (firstIntact >= published) return 0;
+    if (firstIntact > first) {
+        memmove(out, &out[firstIntact - first], (size_t)(published - firstIntact) * sizeof(TOCInternal_CopiedTraceEvent));
+        first = firstIntact;
+    }
+    return (NSUInteger)(published - first);
+}
+
+static NSString* traceIdString(uint64_t traceId) {
+    return [NSString stringWithFormat:@"0x%llx", (unsigned long long)traceId];
+}
+
+static NSString* futureStateName(uint64_t state) {
+    switch ((enum TOCFutureState)state) {
+        case TOCFutureState_CompletedWithResult: return @"result";
+        case TOCFutureState_Failed: return @"failed";
+        case TOCFutureState_Immortal: return @"immortal";
+        default: return @"unknown";
+    }
+}
+
+NSData* TOCInternal_Tracing_exportChromeTrace(void) {
+    NSMutableArray* traceEvents = [NSMutableArray array];
+    [traceEvents addObject:@{@"ph": @"M", @"name": @"process_name", @"pid": @1, @"args": @{@"name": @"CollapsingFutures"}}];
+    
+    // copy everything out while holding the lock (so buffers of exited threads can't be freed), then work on the copies
+    pthread_mutex_lock(&registryLock);
+    uint64_t generation = atomic_load_explicit(&currentGeneration, memory_order_acquire);
+    uint64_t startTime = sessionStartTime;
+    NSUInteger bufferCount = 0;
+    for (TOCInternal_TraceBuffer* buffer = allBuffers; buffer != NULL; buffer = buffer->next) bufferCount++;
+    TOCInternal_CopiedTraceEvent* events = malloc(MAX(1, bufferCount) * TOCInternal_TraceBufferCapacity * sizeof(TOCInternal_CopiedTraceEvent));
+    if (events == NULL) {
+        pthread_mutex_unlock(&registryLock);
+        TOCInternal_force(events != NULL);
+    }
+    NSUInteger eventCount = 0;
+    for (TOCInternal_TraceBuffer* buffer = allBuffers; buffer != NULL; buffer = buffer->next) {
+        NSUInteger copied = copyTraceEvents(buffer, generation, &events[eventCount]);
+        if (copied == 0) continue;
+        eventCount += copied;
+        [traceEvents addObject:@{@"ph": @"M",
+                                 @"name": @"thread_name",
+                                 @"pid": @1,
+                                 @"tid": @(buffer->threadIndex),
+                                 @"args": @{@"name": [NSString stringWithUTF8String:buffer->threadName] ?: @"Thread"}}];
+    }
+    pthread_mutex_unlock(&registryLock);
+    
+    qsort(events, eventCount, sizeof(TOCInternal_CopiedTraceEvent), compareCopiedTraceEvents);
+    
+    // futures settle when the future they're flattening settles, but only the claimed one records it
+    NSMutableDictionary* parentOf = [NSMutableDictionary dictionary];
+    NSMutableDictionary* flattenersOf = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < eventCount; i++) {
+        TOCInternal_CopiedTraceEvent* e = &events[i];
+        if (e->kind == TOCInternal_TraceEvent_FutureLinked) {
+            parentOf[@(e->object)] = @(e->related);
+        } else if (e->kind == TOCInternal_TraceEvent_FutureFlattened) {
+            NSMutableArray* flatteners = flattenersOf[@(e->related)];
+            if (flatteners == nil) flattenersOf[@(e->related)] = flatteners = [NSMutableArray array];
+            [flatteners addObject:@(e->object)];
+        }
+    }
+    
+    NSMutableSet* openFutures = [NSMutableSet set];
+    NSMutableDictionary* settledTimeOf = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < eventCount; i++) {
+        TOCInternal_CopiedTraceEvent* e = &events[i];
+        NSNumber* ts = @(((double)e->timestamp - (double)startTime) / 1000.0);
+        NSNumber* tid = @(e->threadIndex);
+        NSString* objectId = traceIdString(e->object);
+        
+        switch ((enum TOCInternal_TraceEventKind)e->kind) {
+            case TOCInternal_TraceEvent_FutureCreated: {
+                NSNumber* parent = parentOf[@(e->object)];
+                NSDictionary* args = parent == nil
+                                   ? @{@"future": objectId}
+                                   : @{@"future": objectId, @"parent": traceIdString(parent.unsignedLongLongValue)};
+                [traceEvents addObject:@{@"ph": @"b", @"cat": @"future", @"name": @"future", @"id": objectId,
+                                         @"pid": @1, @"tid": tid, @"ts": ts, @"args": args}];
+                [openFutures addObject:@(e->object)];
+                break;
+            }
+            case TOCInternal_TraceEvent_FutureLinked:
+                [traceEvents addObject:@{@"ph": @"i", @"s": @"t", @"cat": @"future", @"name": @"continue",
+                                         @"pid": @1, @"tid": tid, @"ts": ts,
+                                         @"args": @{@"future": objectId, @"parent": traceIdString(e->related)}}];
+                break;
+            case TOCInternal_TraceEvent_FutureFlattened:
+            case TOCInternal_TraceEvent_FlatteningCycle:
+                [traceEvents addObject:@{@"ph": @"i", @"s": @"t", @"cat": @"future",
+                                         @"name": e->kind == TOCInternal_TraceEvent_FutureFlattened ? @"flatten" : @"flattening cycle",
+                                         @"pid": @1, @"tid": tid, @"ts": ts,
+                                         @"args": @{@"future": objectId, @"target": traceIdString(e->related)}}];
+                break;
+            case TOCInternal_TraceEvent_FutureSettled: {
+                // settle the future, and every future (transitively) flattening it
+                NSMutableArray* pending = [NSMutableArray arrayWithObject:@(e->object)];
+                while (pending.count > 0) {
+                    NSNumber* future = pending.lastObject;
+                    [pending removeLastObject];
+                    if (settledTimeOf[future] != nil) continue;
+                    settledTimeOf[future] = @(e->timestamp);
+                    [pending addObjectsFromArray:flattenersOf[future] ?: @[]];
+                    
+                    if (![openFutures containsObject:future]) continue;
+                    [openFutures removeObject:future];
+                    [traceEvents addObject:@{@"ph": @"e", @"cat": @"future", @"name": @"future",
+                                             @"id": traceIdString(future.unsignedLongLongValue),
+                                             @"pid": @1, @"tid": tid, @"ts": ts,
+                                             @"args": @{@"state": futureStateName(e->detail)}}];
+                }
+                break;
+            }
+            case TOCInternal_TraceEvent_TokenCancelled:
+                [traceEvents addObject:@{@"ph": @"i", @"s": @"t", @"cat": @"token", @"name": @"cancel",
+                                         @"pid": @1, @"tid": tid, @"ts": ts,
+                                         @"args": @{@"token": objectId}}];
+                break;
+            case TOCInternal_TraceEvent_HandlerRan: {
+                NSMutableDictionary* args = [NSMutableDictionary dictionaryWithObject:objectId forKey:@"future"];
+                NSNumber* settledTime = settledTimeOf[@(e->object)];
+                if (settledTime != nil && settledTime.unsignedLongLongValue <= e->timestamp) {
+                    args[@"queueDelayUs"] = @((e->timestamp - settledTime.unsignedLongLongValue) / 1000.0);
+                }
+                [traceEvents addObject:@{@"ph": @"X", @"cat": @"handler", @"name": @"handler",
+                                         @"pid": @1, @"tid": tid, @"ts": ts, @"dur": @(e->detail / 1000.0),
+                                         @"args": args}];
+                break;
+            }
+        }
+    }
+    free(events);
+    
+    NSDictionary* trace = @{@"traceEvents": traceEvents, @"displayTimeUnit": @"ns"};
+    NSData* json = [NSJSONSerialization dataWithJSONObject:trace options:0 error:NULL];
+    TOCInternal_force(json != nil);
+    return json;
+}
@@ -0,0 +1,23 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ * A node in a lock-free disjoint-set forest, used to detect immortal flattening cycles.
+ *
+ * @discussion Each node's parent is set at most once (from nil to some root) and then never changes.
+ * Nodes retain their parent, so a node keeps all of its ancestors alive and traversing them is always safe.
+ *
+ * There is no path compression (it would require releasing ancestors that a concurrent traversal may be visiting).
+ * Instead roots are linked by random priority, which keeps the expected depth logarithmic.
+ */
+@interface TOCInternal_UnionFindNode : NSObject
+
+/*!
+ * Merges the sets containing the receiver and the given node.
+ *
+ * @result True if the sets were merged, false if the nodes were already in the same set.
+ *
+ * @discussion Safe to call concurrently with other unions. Exactly one of several racing unions that close a cycle returns false.
+ */
+-(bool) unionWith:(TOCInternal_UnionFindNode*)other;
+
+@end
@@ -0,0 +1,66 @@
+#import "TOCInternal_UnionFindNode.h"
+#import "TOCInternal.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+@implementation TOCInternal_UnionFindNode {
+/// The (retained) parent node, or NULL for a root. Set at most once.
+@private _Atomic(void*) _parent;
+/// Roots with lower priority are linked under roots with higher priority
+@private uint32_t _priority;
+}
+
+-(instancetype) init {
+    self = [super init];
+    if (self) {
+        _priority = arc4random();
+    }
+    return self;
+}
+
+-(void) dealloc {
+    void* parent = atomic_load_explicit(&_parent, memory_order_relaxed);
+    if (parent != NULL) (void)(__bridge_transfer TOCInternal_UnionFindNode*)parent;
+}
+
+static __unsafe_unretained TOCInternal_UnionFindNode* findRoot(__unsafe_unretained TOCInternal_UnionFindNode* node) {
+    // safe without retaining: the caller keeps the starting node alive, and each node keeps its parent alive
+    while (true) {
+        void* parent = atomic_load_explicit(&node->_parent, memory_order_acquire);
+        if (parent == NULL) return node;
+        node = (__bridge TOCInternal_UnionFindNode*)parent;
+    }
+}
+
+static bool linksUnder(__unsafe_unretained TOCInternal_UnionFindNode* root1,
+                       __unsafe_unretained TOCInternal_UnionFindNode* root2) {
+    if (root1->_priority != root2->_priority) return root1->_priority < root2->_priority;
+    return (uintptr_t)(__bridge void*)root1 < (uintptr_t)(__bridge void*)root2;
+}
+
+-(bool) unionWith:(TOCInternal_UnionFindNode*)other {
+    TOCInternal_need(other != nil);
+
+    while (true) {
+        __unsafe_unretained TOCInternal_UnionFindNode* root1 = findRoot(self);
+        __unsafe_unretained TOCInternal_UnionFindNode* root2 = findRoot(other);
+        if (root1 == root2) return false;
+
+        __unsafe_unretained TOCInternal_UnionFindNode* child = linksUnder(root1, root2) ? root1 : root2;
+        __unsafe_unretained TOCInternal_UnionFindNode* parent = child == root1 ? root2 : root1;
+
+        // the child must still be a root for the link to be valid, otherwise someone else merged it first and we retry
+        void* expected = NULL;
+        void* desired = (__bridge_retained void*)parent;
+        if (atomic_compare_exchange_strong_explicit(&child->_parent,
+                                                    &expected,
+                                                    desired,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+            return true;
+        }
+        (void)(__bridge_transfer TOCInternal_UnionFindNode*)desired;
+    }
+}
+
+@end
@@ -4,6 +4,8 @@
 #import <mach/mach.h>
 
 vm_size_t peekAllocatedMemoryInBytes(void);
+size_t peekAllocatedBlockCount(void);
+double measureAllocationsPerIteration(int iterations, void (^iteration)(void));
 bool testPassesConcurrently_helper(bool (^check)(void), NSTimeInterval delay);
 bool testCompletesConcurrently_helper(TOCFuture* future, NSTimeInterval timeout);
 bool futureHasResult(TOCFuture* future, id result);
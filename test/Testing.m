@@ -1,4 +1,5 @@
 #import "Testing.h"
+#include <malloc/malloc.h>
 
 int testTargetHits = 0;
 bool equals(id obj1, id obj2) {
@@ -15,6 +16,29 @@ vm_size_t peekAllocatedMemoryInBytes(void) {
     assert(kerr == KERN_SUCCESS);
     return info.resident_size;
 }
+size_t peekAllocatedBlockCount(void) {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.blocks_in_use;
+}
+double measureAllocationsPerIteration(int iterations, void (^iteration)(void)) {
+    // run off the main thread, so main-thread-preserving wrappers don't get counted
+    // (iterations should keep what they allocate alive, so it shows up as blocks in use)
+    __block size_t blocksBefore = 0;
+    __block size_t blocksAfter = 0;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        blocksBefore = peekAllocatedBlockCount();
+        for (int i = 0; i < iterations; i++) {
+            @autoreleasepool {
+                iteration();
+            }
+        }
+        blocksAfter = peekAllocatedBlockCount();
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return ((double)blocksAfter - (double)blocksBefore) / iterations;
+}
 bool futureHasResult(TOCFuture* future, id result) {
     return future.hasResult && equals(result, future.forceGetResult);
 }
@@ -0,0 +1,53 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCAdaptiveHedgeDelayTest : XCTestCase
+@end
+
+@implementation TOCAdaptiveHedgeDelayTest
+
+-(void) testInvalidArguments {
+    testThrows([TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:-1 initialDelay:1]);
+    testThrows([TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:101 initialDelay:1]);
+    testThrows([TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:50 initialDelay:-1]);
+    testThrows([TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:50 initialDelay:NAN]);
+    
+    TOCAdaptiveHedgeDelay* d = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:50 initialDelay:1];
+    testThrows([d recordLatency:-1]);
+    testThrows([d recordLatency:NAN]);
+}
+
+-(void) testUsesInitialDelayUntilLatencyRecorded {
+    TOCAdaptiveHedgeDelay* d = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:95 initialDelay:2];
+    test(d.percentile == 95);
+    test(d.currentDelay == 2);
+    [d recordLatency:0.5];
+    test(d.currentDelay == 0.5);
+}
+
+-(void) testSuggestsPercentile {
+    TOCAdaptiveHedgeDelay* p0 = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:0 initialDelay:0];
+    TOCAdaptiveHedgeDelay* p50 = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:50 initialDelay:0];
+    TOCAdaptiveHedgeDelay* p90 = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:90 initialDelay:0];
+    TOCAdaptiveHedgeDelay* p100 = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:100 initialDelay:0];
+    for (int i = 100; i >= 1; i--) {
+        for (TOCAdaptiveHedgeDelay* d in @[p0, p50, p90, p100]) {
+            [d recordLatency:i];
+        }
+    }
+    test(p0.currentDelay == 1);
+    test(p50.currentDelay == 50);
+    test(p90.currentDelay == 90);
+    test(p100.currentDelay == 100);
+}
+
+-(void) testForgetsOldLatencies {
+    TOCAdaptiveHedgeDelay* d = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:100 initialDelay:0];
+    [d recordLatency:1000];
+    for (int i = 0; i < 1000; i++) {
+        [d recordLatency:1];
+    }
+    test(d.currentDelay == 1);
+}
+
+@end
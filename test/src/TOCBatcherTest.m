@@ -0,0 +1,129 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCBatcherTest : XCTestCase
+@end
+
+@implementation TOCBatcherTest
+
+-(void) testPreconditions {
+    TOCBatchOperation op = ^(NSArray* keys) { return [TOCFuture futureWithResult:@{}]; };
+    testThrows([TOCBatcher batcherWithMaxBatchSize:0 batchWindow:1 operation:op]);
+    testThrows([TOCBatcher batcherWithMaxBatchSize:1 batchWindow:-1 operation:op]);
+    testThrows([TOCBatcher batcherWithMaxBatchSize:1 batchWindow:NAN operation:op]);
+    testThrows([TOCBatcher batcherWithMaxBatchSize:1 batchWindow:1 operation:nil]);
+    testThrows([[TOCBatcher batcherWithMaxBatchSize:1 batchWindow:1 operation:op] futureForKey:nil]);
+}
+
+-(void) testSendsOnceFull {
+    NSMutableArray* batches = [NSMutableArray array];
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCBatcher* batcher = [TOCBatcher batcherWithMaxBatchSize:3 batchWindow:INFINITY operation:^(NSArray* keys) {
+        [batches addObject:keys];
+        return s.future;
+    }];
+    
+    TOCFuture* a1 = [batcher futureForKey:@"a"];
+    TOCFuture* b = [batcher futureForKey:@"b"];
+    TOCFuture* a2 = [batcher futureForKey:@"a"];
+    test(batches.count == 0);
+    TOCFuture* c = [batcher futureForKey:@"c"];
+    test(batches.count == 1);
+    testEq(batches[0], (@[@"a", @"b", @"c"]));
+    test(c.isIncomplete);
+    
+    [s trySetResult:(@{@"a": @1, @"b": @2})];
+    testFutureHasResult(a1, @1);
+    testFutureHasResult(a2, @1);
+    testFutureHasResult(b, @2);
+    testFutureHasResult(c, nil);
+    
+    // the next key starts a new batch
+    [batcher futureForKey:@"d"];
+    [batcher flush];
+    test(batches.count == 2);
+    testEq(batches[1], (@[@"d"]));
+}
+
+-(void) testSendsOnceWindowEnds {
+    NSMutableArray* batches = [NSMutableArray array];
+    TOCBatcher* batcher = [TOCBatcher batcherWithMaxBatchSize:100 batchWindow:0.01 operation:^(NSArray* keys) {
+        @synchronized(batches) {
+            [batches addObject:keys];
+        }
+        return [TOCFuture futureWithResult:@{@"a": @1}];
+    }];
+    
+    TOCFuture* a = [batcher futureForKey:@"a"];
+    TOCFuture* b = [batcher futureForKey:@"b"];
+    testChurnUntil(!a.isIncomplete);
+    testFutureHasResult(a, @1);
+    testFutureHasResult(b, nil);
+    @synchronized(batches) {
+        test(batches.count == 1);
+        testEq(batches[0], (@[@"a", @"b"]));
+    }
+}
+
+-(void) testFailureReachesEveryCaller {
+    TOCBatcher* batcher = [TOCBatcher batcherWithMaxBatchSize:2 batchWindow:INFINITY operation:^(NSArray* keys) {
+        return [TOCFuture futureWithFailure:@"down"];
+    }];
+    TOCFuture* a = [batcher futureForKey:@"a"];
+    TOCFuture* b = [batcher futureForKey:@"b"];
+    testFutureHasFailure(a, @"down");
+    testFutureHasFailure(b, @"down");
+}
+
+-(void) testCancelledCallersAreDroppedBeforeSending {
+    NSMutableArray* batches = [NSMutableArray array];
+    TOCBatcher* batcher = [TOCBatcher batcherWithMaxBatchSize:100 batchWindow:INFINITY operation:^(NSArray* keys) {
+        [batches addObject:keys];
+        return [TOCFuture futureWithResult:@{@"a": @1, @"b": @2}];
+    }];
+    
+    TOCCancelTokenSource* c1 = [TOCCancelTokenSource new];
+    TOCCancelTokenSource* c2 = [TOCCancelTokenSource new];
+    TOCFuture* a = [batcher futureForKey:@"a" unless:c1.token];
+    TOCFuture* b1 = [batcher futureForKey:@"b" unless:c1.token];
+    TOCFuture* b2 = [batcher futureForKey:@"b" unless:c2.token];
+    
+    [c1 cancel];
+    test(a.hasFailedWithCancel);
+    test(b1.hasFailedWithCancel);
+    [batcher flush];
+    test(batches.count == 1);
+    testEq(batches[0], (@[@"b"]));
+    testFutureHasResult(b2, @2);
+    
+    // a batch everyone cancelled out of is never sent
+    TOCCancelTokenSource* c3 = [TOCCancelTokenSource new];
+    [batcher futureForKey:@"a" unless:c3.token];
+    [c3 cancel];
+    [batcher flush];
+    test(batches.count == 1);
+    
+    // already cancelled callers never join a batch
+    test([batcher futureForKey:@"a" unless:c3.token].hasFailedWithCancel);
+    [batcher flush];
+    test(batches.count == 1);
+}
+
+-(void) testCancellingAfterSendingOnlyAffectsTheCaller {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCBatcher* batcher = [TOCBatcher batcherWithMaxBatchSize:2 batchWindow:INFINITY operation:^(NSArray* keys) {
+        return s.future;
+    }];
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* a = [batcher futureForKey:@"a" unless:c.token];
+    TOCFuture* b = [batcher futureForKey:@"b"];
+    [c cancel];
+    test(a.hasFailedWithCancel);
+    
+    [s trySetResult:(@{@"a": @1, @"b": @2})];
+    test(a.hasFailedWithCancel);
+    testFutureHasResult(b, @2);
+}
+
+@end
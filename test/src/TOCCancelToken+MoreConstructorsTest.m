@@ -1,5 +1,9 @@
 #import "Testing.h"
 #import "TOCCancelToken+MoreConstructors.h"
+#import "TOCFuture+MoreContructors.h"
+
+/// How much later than requested a timer may be reported to fire, due to rounding up to a tick and coalescing with other timers
+static const NSTimeInterval TimerRounding = 0.01;
 
 @interface TOCCancelToken_MoreConstructorsTest : XCTestCase
 @end
@@ -103,4 +107,84 @@
     test(c2.state == TOCCancelTokenState_Immortal);
 }
 
+-(void)testCancelledAfter {
+    testThrows([TOCCancelToken cancelledAfter:-1]);
+    testThrows([TOCCancelToken cancelledAfter:NAN]);
+    test([TOCCancelToken cancelledAfter:0].isAlreadyCancelled);
+    test([TOCCancelToken cancelledAfter:INFINITY].state == TOCCancelTokenState_Immortal);
+    
+    TOCCancelToken* c = [TOCCancelToken cancelledAfter:0.05];
+    test(c.canStillBeCancelled);
+    test(c.remainingTime > 0 && c.remainingTime <= 0.05 + TimerRounding);
+    test(c.deadline.timeIntervalSinceNow > 0 && c.deadline.timeIntervalSinceNow <= 0.05 + TimerRounding);
+    testChurnUntil(c.isAlreadyCancelled);
+    test(c.remainingTime == 0);
+}
+-(void)testCancelledAfter_ReportsCoalescedDeadline {
+    NSTimeInterval original = TOCFuture.delayCoalescingLeeway;
+    [TOCFuture setDelayCoalescingLeeway:0.2];
+    
+    // the timer may be pushed back by up to the leeway, and the token has to report that, instead of the requested delay
+    NSTimeInterval t0 = [[NSProcessInfo processInfo] systemUptime];
+    TOCCancelToken* c = [TOCCancelToken cancelledAfter:0.01];
+    NSTimeInterval reportedDelay = c.remainingTime;
+    test(reportedDelay > 0.005 && reportedDelay <= 0.2 + TimerRounding);
+    while (c.canStillBeCancelled && [[NSProcessInfo processInfo] systemUptime] - t0 < 2) {
+        usleep(1000);
+    }
+    NSTimeInterval actualDelay = [[NSProcessInfo processInfo] systemUptime] - t0;
+    test(c.isAlreadyCancelled);
+    test(actualDelay >= reportedDelay - TimerRounding);
+    test(actualDelay <= reportedDelay + 0.05);
+    
+    [TOCFuture setDelayCoalescingLeeway:original];
+}
+-(void)testCancelledAtDeadline {
+    testThrows([TOCCancelToken cancelledAtDeadline:nil]);
+    test([TOCCancelToken cancelledAtDeadline:[NSDate dateWithTimeIntervalSinceNow:-1]].isAlreadyCancelled);
+    
+    TOCCancelToken* c = [TOCCancelToken cancelledAtDeadline:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    test(c.canStillBeCancelled);
+    testChurnUntil(c.isAlreadyCancelled);
+}
+-(void)testDeadline_NoneByDefault {
+    TOCCancelToken* none = nil;
+    test(none.deadline == nil);
+    test(![none willBeCancelledWithin:1000]);
+    test(TOCCancelToken.immortalToken.deadline == nil);
+    test(TOCCancelToken.immortalToken.remainingTime == INFINITY);
+    test(TOCCancelToken.cancelledToken.remainingTime == 0);
+    test([TOCCancelToken.cancelledToken willBeCancelledWithin:0]);
+    
+    TOCCancelTokenSource* s = [TOCCancelTokenSource new];
+    test(s.token.deadline == nil);
+    test(s.token.remainingTime == INFINITY);
+    test(![s.token willBeCancelledWithin:1000]);
+}
+-(void)testDeadline_Propagates {
+    TOCCancelToken* soon = [TOCCancelToken cancelledAfter:100];
+    TOCCancelToken* late = [TOCCancelToken cancelledAfter:1000];
+    TOCCancelTokenSource* noDeadline = [TOCCancelTokenSource new];
+    
+    test([soon willBeCancelledWithin:101]);
+    test(![soon willBeCancelledWithin:99]);
+    
+    // dependent tokens inherit the deadline
+    TOCCancelToken* dependent = [TOCCancelTokenSource cancelTokenSourceUntil:soon].token;
+    test(dependent.remainingTime > 99 && dependent.remainingTime <= 100 + TimerRounding);
+    test([TOCCancelTokenSource cancelTokenSourceUntil:nil].token.deadline == nil);
+    
+    // matching the first to cancel keeps the earliest deadline
+    TOCCancelToken* first = [TOCCancelToken matchFirstToCancelBetween:late and:soon];
+    test(first.remainingTime > 99 && first.remainingTime <= 100 + TimerRounding);
+    first = [TOCCancelToken matchFirstToCancelBetween:noDeadline.token and:late];
+    test(first.remainingTime > 999 && first.remainingTime <= 1000 + TimerRounding);
+    
+    // matching the last to cancel needs both deadlines, and keeps the latest
+    TOCCancelToken* last = [TOCCancelToken matchLastToCancelBetween:late and:soon];
+    test(last.remainingTime > 999 && last.remainingTime <= 1000 + TimerRounding);
+    last = [TOCCancelToken matchLastToCancelBetween:noDeadline.token and:soon];
+    test(last.deadline == nil);
+}
+
 @end
@@ -1,7 +1,7 @@
 #import "Testing.h"
 #import "CollapsingFutures.h"
 #import "TOCInternal_BlockObject.h"
-#import <libkern/OSAtomic.h>
+#include <stdatomic.h>
 
 @interface TOCCancelTokenTest : XCTestCase
 @end
@@ -402,12 +402,48 @@
     }
     test(hits == 1);
 }
+-(void) testWhenCancelledDo_MainThreadHandlersReleasedByOneCancelArriveInOneHop {
+    TOCCancelTokenSource* s = [TOCCancelTokenSource new];
+    const int n = 1000;
+
+    test(NSThread.isMainThread);
+    __block int ticks = 0; // only touched on the main thread
+    NSMutableArray* order = [NSMutableArray array];
+    NSMutableSet* ticksSeen = [NSMutableSet set];
+    for (int i = 0; i < n; i++) {
+        [s.token whenCancelledDo:^{
+            test(NSThread.isMainThread);
+            [order addObject:@(i)];
+            [ticksSeen addObject:@(ticks)];
+        }];
+    }
+
+    // other main queue work, arriving while the handlers are being released
+    __block atomic_bool stopTicking = false;
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_async(q, ^{
+        while (!atomic_load(&stopTicking)) {
+            dispatch_async(dispatch_get_main_queue(), ^{ ticks += 1; });
+            usleep(10);
+        }
+    });
+    dispatch_async(q, ^{ [s cancel]; });
+
+    testChurnUntil(order.count == (NSUInteger)n);
+    atomic_store(&stopTicking, true);
+
+    // nothing got in between the handlers, and they ran in the order they were registered
+    test(ticksSeen.count == 1);
+    for (int i = 0; i < (int)order.count; i++) {
+        testEq(order[(NSUInteger)i], @(i));
+    }
+}
 
 -(void)testThreadSafety_cancellationsNotLost {
     for (int runs = 0; runs < 50; runs++) {
         TOCCancelTokenSource* c = [TOCCancelTokenSource new];
-        __block int sched = 0;
-        __block int ran = 0;
+        __block atomic_int sched = 0;
+        __block atomic_int ran = 0;
         const int n = 10000;
         
         dispatch_queue_t q1 = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
@@ -415,27 +451,73 @@
         
         TOCCancelToken* d = c.token;
         dispatch_async(q1, ^{
-            while (OSAtomicIncrement32(&sched) <= n) {
+            while (atomic_fetch_add(&sched, 1) + 1 <= n) {
                 [d whenCancelledDo:^{
-                    OSAtomicIncrement32(&ran);
+                    atomic_fetch_add(&ran, 1);
                 }];
             }
         });
         dispatch_async(q2, ^{
-            while (OSAtomicAdd32(0, &sched) == 0) {
+            while (atomic_load(&sched) == 0) {
                 // waiting...
             }
             // quickly quickly!
-            test(OSAtomicAdd32(0, &sched) < n);
+            test(atomic_load(&sched) < n);
             
             [c cancel];
         });
         
         
-        for (int rep = 0; rep < 1000 && OSAtomicAdd32(0, &ran) < n; rep++) {
+        for (int rep = 0; rep < 1000 && atomic_load(&ran) < n; rep++) {
             usleep(1000*10);
         }
-        test(OSAtomicAdd32(0, &ran) == n);
+        test(atomic_load(&ran) == n);
+    }
+}
+
+-(void)testWhenCancelledDo_RunsHandlersInRegistrationOrder {
+    TOCCancelTokenSource* s = [TOCCancelTokenSource new];
+    NSMutableArray* order = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        [s.token whenCancelledDo:^{ [order addObject:@(i)]; }];
+    }
+    
+    [s cancel];
+    test(order.count == 100);
+    for (int i = 0; i < 100; i++) {
+        testEq(order[(NSUInteger)i], @(i));
+    }
+}
+-(void)testThreadSafety_removalsRacingCancellation {
+    for (int runs = 0; runs < 20; runs++) {
+        TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+        const int n = 2000;
+        NSMutableArray* unlessSources = [NSMutableArray array];
+        for (int i = 0; i < n; i++) {
+            [unlessSources addObject:[TOCCancelTokenSource new]];
+        }
+        __block atomic_int ran = 0;
+        
+        dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        dispatch_apply((size_t)n, q, ^(size_t i) {
+            [c.token whenCancelledDo:^{ atomic_fetch_add(&ran, 1); }
+                              unless:[unlessSources[i] token]];
+        });
+        
+        // remove every even handler concurrently with the token being cancelled
+        dispatch_group_t g = dispatch_group_create();
+        dispatch_group_async(g, q, ^{
+            for (NSUInteger i = 0; i < (NSUInteger)n; i += 2) {
+                [unlessSources[i] cancel];
+            }
+        });
+        [unlessSources[0] cancel];
+        [c cancel];
+        dispatch_group_wait(g, DISPATCH_TIME_FOREVER);
+        
+        // odd handlers can't be removed, even handlers may or may not have beaten the removal
+        test(atomic_load(&ran) >= n/2);
+        test(atomic_load(&ran) < n);
     }
 }
 
@@ -0,0 +1,121 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCCompletionStreamTest : XCTestCase
+@end
+
+@implementation TOCCompletionStreamTest
+
+-(void) testEmpty {
+    TOCCompletionStream* stream = @[].toc_completionStream;
+    test(stream.remainingCount == 0);
+    testThrows([stream next]);
+    testThrows([(@[@1]) toc_completionStream]);
+}
+
+-(void) testAlreadyCompletedInputsKeepTheirOrder {
+    TOCFuture* f1 = [TOCFuture futureWithResult:@1];
+    TOCFuture* f2 = [TOCFuture futureWithFailure:@2];
+    TOCCompletionStream* stream = (@[f1, f2]).toc_completionStream;
+    test(stream.remainingCount == 2);
+    test([stream next] == f1);
+    test([stream next] == f2);
+    test(stream.remainingCount == 0);
+    testThrows([stream next]);
+}
+
+-(void) testHandsOutInCompletionOrder {
+    NSArray* s = (@[[TOCFutureSource new], [TOCFutureSource new], [TOCFutureSource new]]);
+    TOCCompletionStream* stream = (@[[s[0] future], [s[1] future], [s[2] future]]).toc_completionStream;
+
+    // asking ahead of the inputs
+    TOCFuture* first = [stream next];
+    test(first.isIncomplete);
+    [s[1] trySetResult:@"A"];
+    testFutureHasResult(first, @"A");
+
+    // falling behind the inputs
+    [s[2] trySetFailure:@"B"];
+    [s[0] trySetResult:@"C"];
+    testFutureHasFailure([stream next], @"B");
+    testFutureHasResult([stream next], @"C");
+}
+
+-(void) testPipelinedNextCallsAreMatchedInOrder {
+    NSMutableArray* sources = [NSMutableArray array];
+    NSMutableArray* futures = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        TOCFutureSource* source = [TOCFutureSource new];
+        [sources addObject:source];
+        [futures addObject:source.future];
+    }
+    TOCCompletionStream* stream = futures.toc_completionStream;
+
+    NSMutableArray* handedOut = [NSMutableArray array];
+    while (stream.remainingCount > 0) {
+        [handedOut addObject:[stream next]];
+    }
+
+    for (int i = 99; i >= 0; i--) {
+        [sources[(NSUInteger)i] trySetResult:@(i)];
+    }
+    for (int i = 0; i < 100; i++) {
+        testFutureHasResult(handedOut[(NSUInteger)i], @(99 - i));
+    }
+}
+
+-(void) testCancelled {
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCFutureSource* s3 = [TOCFutureSource new];
+    TOCCompletionStream* stream = [(@[s1.future, s2.future, s3.future]) toc_completionStreamUnless:c.token];
+
+    TOCFuture* waiting = [stream next];
+    [s1 trySetResult:@1];
+    testFutureHasResult(waiting, @1);
+
+    TOCFuture* waiting2 = [stream next];
+    [c cancel];
+    test(waiting2.hasFailedWithCancel);
+
+    [s2 trySetResult:@2];
+    test([stream next].hasFailedWithCancel);
+
+    test([@[[TOCFuture futureWithResult:@1]] toc_completionStreamUnless:c.token].next.hasFailedWithCancel);
+}
+
+-(void) testImmortalInputsAreSkipped {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCCompletionStream* stream = nil;
+    TOCFuture* waiting1 = nil;
+    TOCFuture* waiting2 = nil;
+    @autoreleasepool {
+        TOCFutureSource* dropped = [TOCFutureSource new];
+        stream = (@[dropped.future, s.future]).toc_completionStream;
+        waiting1 = [stream next];
+        waiting2 = [stream next];
+    }
+
+    [s trySetResult:@1];
+    testFutureHasResult(waiting1, @1);
+    test(waiting2.state == TOCFutureState_Immortal);
+}
+
+-(void) testDoesNotKeepHandedOutInputsAlive {
+    TOCCompletionStream* stream = nil;
+    __weak TOCFuture* weakInput = nil;
+    TOCFutureSource* other = [TOCFutureSource new];
+    @autoreleasepool {
+        TOCFutureSource* s = [TOCFutureSource new];
+        weakInput = s.future;
+        stream = (@[s.future, other.future]).toc_completionStream;
+        [s trySetResult:@1];
+        testFutureHasResult([stream next], @1);
+    }
+
+    test(weakInput == nil);
+    test(stream.remainingCount == 1);
+}
+
+@end
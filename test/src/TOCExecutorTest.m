@@ -0,0 +1,189 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+/// An executor that holds onto blocks until told to run them
+@interface ManualExecutor : NSObject <TOCExecutor>
+@property (readonly, nonatomic) NSMutableArray* pending;
+-(void) runPending;
+@end
+
+@implementation ManualExecutor
+@synthesize pending;
+-(instancetype) init {
+    self = [super init];
+    if (self) {
+        pending = [NSMutableArray array];
+    }
+    return self;
+}
+-(void) execute:(void(^)(void))block {
+    @synchronized(self) {
+        [pending addObject:[block copy]];
+    }
+}
+-(void) runPending {
+    while (true) {
+        void (^block)(void);
+        @synchronized(self) {
+            if (pending.count == 0) return;
+            block = pending[0];
+            [pending removeObjectAtIndex:0];
+        }
+        block();
+    }
+}
+@end
+
+@interface TOCExecutorTest : XCTestCase
+@end
+
+@implementation TOCExecutorTest
+
+-(void) testInlineExecutor {
+    testHitsTarget([TOCExecutors.inlineExecutor execute:^{ hitTarget; }]);
+    test(TOCExecutors.inlineExecutor == TOCExecutors.inlineExecutor);
+    testThrows([TOCExecutors.inlineExecutor execute:nil]);
+}
+
+-(void) testDefaultExecutor {
+    test(NSThread.isMainThread);
+    testHitsTarget([TOCExecutors.defaultExecutor execute:^{ test(NSThread.isMainThread); hitTarget; }]);
+
+    __block id<TOCExecutor> backgroundDefault = nil;
+    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        backgroundDefault = TOCExecutors.defaultExecutor;
+    });
+    test(backgroundDefault == TOCExecutors.inlineExecutor);
+}
+
+-(void) testMainQueueExecutor_AlwaysDispatches {
+    __block bool ran = false;
+    [TOCExecutors.mainQueueExecutor execute:^{
+        test(NSThread.isMainThread);
+        ran = true;
+    }];
+    test(!ran);
+    testChurnUntil(ran);
+}
+
+-(void) testQueueExecutor {
+    static int key = 0;
+    dispatch_queue_t queue = dispatch_queue_create("TOCExecutorTest.testQueueExecutor", DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_set_specific(queue, &key, &key, NULL);
+    id<TOCExecutor> executor = [TOCExecutors executorOnQueue:queue];
+    testThrows([TOCExecutors executorOnQueue:nil]);
+
+    // even already-completed futures don't run the continuation inline
+    TOCFuture* f = [[TOCFuture futureWithResult:@1] then:^(id value) {
+        test(dispatch_get_specific(&key) == &key);
+        return @([value intValue] + 1);
+    } on:executor];
+    testCompletesConcurrently(f);
+    testFutureHasResult(f, @2);
+
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCFuture* g = [s.future finally:^(TOCFuture* completed) {
+        test(dispatch_get_specific(&key) == &key);
+        return completed;
+    } on:executor];
+    [s trySetFailure:@3];
+    testCompletesConcurrently(g);
+    testFutureHasFailure(g, @3);
+}
+
+-(void) testSerialExecutor_RunsInOrderWithoutOverlap {
+    id<TOCExecutor> concurrent = [TOCExecutors executorOnQueue:dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)];
+    id<TOCExecutor> serial = [TOCExecutors serialExecutorOn:concurrent];
+    testThrows([TOCExecutors serialExecutorOn:nil]);
+
+    int n = 10000;
+    NSMutableArray* order = [NSMutableArray array];
+    __block int running = 0;
+    __block bool overlapped = false;
+    TOCFutureSource* done = [TOCFutureSource new];
+    for (int i = 0; i < n; i++) {
+        [serial execute:^{
+            if (++running != 1) overlapped = true;
+            [order addObject:@(i)];
+            running--;
+            if (i == n - 1) [done trySetResult:nil];
+        }];
+    }
+
+    testCompletesConcurrently(done.future);
+    test(!overlapped);
+    test(order.count == (NSUInteger)n);
+    for (int i = 0; i < (int)order.count; i++) {
+        test([order[(NSUInteger)i] intValue] == i);
+    }
+}
+
+-(void) testSerialExecutor_ReentrantBlocksRunAfterCurrent {
+    id<TOCExecutor> serial = [TOCExecutors serialExecutorOn:TOCExecutors.inlineExecutor];
+    NSMutableArray* order = [NSMutableArray array];
+    [serial execute:^{
+        [serial execute:^{ [order addObject:@2]; }];
+        [order addObject:@1];
+    }];
+    test([order isEqual:(@[@1, @2])]);
+}
+
+-(void) testThenDoOn_UsesExecutor {
+    ManualExecutor* executor = [ManualExecutor new];
+    TOCFutureSource* s = [TOCFutureSource new];
+
+    testDoesNotHitTarget([s.future thenDo:^(id value) { testEq(value, @1); hitTarget; } on:executor]);
+    testDoesNotHitTarget([s trySetResult:@1]);
+    test(executor.pending.count == 1);
+    testHitsTarget([executor runPending]);
+
+    // already completed, but still given to the executor
+    testDoesNotHitTarget([s.future thenDo:^(id value) { hitTarget; } on:executor]);
+    testHitsTarget([executor runPending]);
+
+    // failures don't reach then handlers, even via an executor
+    [[TOCFuture futureWithFailure:@2] thenDo:^(id value) { hitTarget; } on:executor];
+    testDoesNotHitTarget([executor runPending]);
+}
+
+-(void) testFinallyOn_UnlessCancelledWhileQueued {
+    ManualExecutor* executor = [ManualExecutor new];
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+
+    [s.future finallyDo:^(TOCFuture* completed) { hitTarget; } on:executor unless:c.token];
+    [s trySetResult:@1];
+    test(executor.pending.count == 1);
+    [c cancel];
+    testDoesNotHitTarget([executor runPending]);
+}
+
+-(void) testWhenCancelledDoOn_UsesExecutor {
+    ManualExecutor* executor = [ManualExecutor new];
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+
+    testDoesNotHitTarget([c.token whenCancelledDo:^{ hitTarget; } on:executor]);
+    testDoesNotHitTarget([c cancel]);
+    testHitsTarget([executor runPending]);
+
+    testDoesNotHitTarget([c.token whenCancelledDo:^{ hitTarget; } on:executor]);
+    testHitsTarget([executor runPending]);
+
+    // immortal tokens discard handlers without giving them to the executor
+    [TOCCancelToken.immortalToken whenCancelledDo:^{ hitTarget; } on:executor];
+    test(executor.pending.count == 0);
+}
+
+-(void) testWhenCancelledDoOnUnless_DiscardedWhenOtherCancelledWhileQueued {
+    ManualExecutor* executor = [ManualExecutor new];
+    TOCCancelTokenSource* c1 = [TOCCancelTokenSource new];
+    TOCCancelTokenSource* c2 = [TOCCancelTokenSource new];
+
+    [c1.token whenCancelledDo:^{ hitTarget; } on:executor unless:c2.token];
+    [c1 cancel];
+    test(executor.pending.count == 1);
+    [c2 cancel];
+    testDoesNotHitTarget([executor runPending]);
+}
+
+@end
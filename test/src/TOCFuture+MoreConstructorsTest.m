@@ -1,6 +1,7 @@
 #import "Testing.h"
 #import "TOCFuture+MoreContructors.h"
 #import "TOCFuture+MoreContinuations.h"
+#import "TOCCancelToken+MoreConstructors.h"
 
 @interface TOCFutureExtraTest : XCTestCase
 @end
@@ -130,6 +131,54 @@
     test(d.lostTokenCount == 1);
     test(f.hasFailedWithCancel);
 }
+-(void)testFutureWithResultAfterDelay_CompletesInDeadlineOrder {
+    // long enough delays to be filed in upper levels of the timer wheel, and cascaded down
+    NSArray* delays = (@[@0.3, @0.01, @0.2, @0.07]);
+    NSMutableArray* order = [NSMutableArray array];
+    for (NSNumber* delay in delays) {
+        [[TOCFuture futureWithResult:delay afterDelay:delay.doubleValue] thenDo:^(id value) {
+            [order addObject:value];
+        }];
+    }
+    
+    for (int i = 0; i < 20 && order.count < delays.count; i++) {
+        [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    testEq(order, (@[@0.01, @0.07, @0.2, @0.3]));
+}
+-(void)testFutureWithResultAfterDelayUnless_CancelReleasesPendingDelays {
+    DeallocCounter* d = [DeallocCounter new];
+    TOCCancelTokenSource* s = [TOCCancelTokenSource new];
+    @autoreleasepool {
+        for (int i = 0; i < 10000; i++) {
+            [TOCFuture futureWithResult:[d makeToken]
+                             afterDelay:100.0 + i
+                                 unless:s.token];
+        }
+    }
+    test(d.lostTokenCount == 0);
+    
+    [s cancel];
+    test(d.lostTokenCount == 10000);
+}
+-(void)testDelayCoalescingLeeway {
+    testThrows([TOCFuture setDelayCoalescingLeeway:-1]);
+    testThrows([TOCFuture setDelayCoalescingLeeway:NAN]);
+    testThrows([TOCFuture setDelayCoalescingLeeway:INFINITY]);
+    
+    NSTimeInterval original = TOCFuture.delayCoalescingLeeway;
+    [TOCFuture setDelayCoalescingLeeway:0.05];
+    test(TOCFuture.delayCoalescingLeeway == 0.05);
+    
+    // delays still end, just coalesced
+    __block int fired = 0;
+    TOCFuture* f1 = [TOCFuture futureWithResult:@1 afterDelay:0.001];
+    TOCFuture* f2 = [TOCFuture futureWithResult:@2 afterDelay:0.002];
+    [f1 thenDo:^(id _) { fired++; }];
+    [f2 thenDo:^(id _) { fired++; }];
+    testChurnUntil(fired == 2);
+    [TOCFuture setDelayCoalescingLeeway:original];
+}
 -(void)testFutureWithResultAfterDelayUnless_AllowsDeallocArgument {
     TOCFuture* f;
     DeallocCounter* d = [DeallocCounter new];
@@ -301,6 +350,24 @@
     testFutureHasResult(f2, @1);
 }
 
+-(void) testFutureWithResultFromAsyncCancellableOperationWithTimeoutUnless_PassesDeadlineToOperation {
+    __block TOCCancelToken* given = nil;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) { given = unless; return [TOCFutureSource new].future; };
+    
+    [TOCFuture futureFromUnlessOperation:t withTimeout:100 unless:nil];
+    test(given.remainingTime > 99 && given.remainingTime <= 100);
+    
+    // an earlier caller deadline wins, without needing a timeout of its own
+    TOCCancelToken* soon = [TOCCancelToken cancelledAfter:10];
+    [TOCFuture futureFromUnlessOperation:t withTimeout:100 unless:soon];
+    test(given == soon);
+    
+    TOCCancelToken* late = [TOCCancelToken cancelledAfter:1000];
+    [TOCFuture futureFromUnlessOperation:t withTimeout:100 unless:late];
+    test(given != late);
+    test(given.remainingTime > 99 && given.remainingTime <= 100);
+}
+
 -(void) testFutureWithResultFromAsyncCancellableOperationWithTimeoutUnless_Immediate {
     TOCFutureSource* s = [TOCFutureSource new];
     TOCUnlessOperation t = ^(TOCCancelToken* unless) { return [s.future unless:unless]; };
@@ -409,4 +476,131 @@
     test(f.hasFailedWithCancel);
 }
 
+-(void) testFutureFromUnlessOperationWithRetryPolicy_RetriesUntilSuccess {
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        if (attemptCount < 3) return [TOCFuture futureWithFailure:@(attemptCount)];
+        return [TOCFuture futureWithResult:@"done"];
+    };
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:5 baseDelay:0 maxDelay:0];
+    
+    testFutureHasResult([TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil], @"done");
+    test(attemptCount == 3);
+    
+    testThrows([TOCFuture futureFromUnlessOperation:nil withRetryPolicy:p unless:nil]);
+    testThrows([TOCFuture futureFromUnlessOperation:t withRetryPolicy:nil unless:nil]);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_GivesUpWithLastFailure {
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        return [TOCFuture futureWithFailure:@(attemptCount)];
+    };
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:4 baseDelay:0 maxDelay:0];
+    
+    testFutureHasFailure([TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil], @4);
+    test(attemptCount == 4);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_OnlyRetriesRetryableFailures {
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        return [TOCFuture futureWithFailure:attemptCount == 1 ? @"transient" : @"fatal"];
+    };
+    TOCRetryPolicy* p = [[TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0 maxDelay:0]
+                         policyWithRetryableFailurePredicate:^(id failure) { return (bool)[failure isEqual:@"transient"]; }];
+    
+    testFutureHasFailure([TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil], @"fatal");
+    test(attemptCount == 2);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_BacksOff {
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        if (attemptCount < 2) return [TOCFuture futureWithFailure:@1];
+        return [TOCFuture futureWithResult:@2];
+    };
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:2 baseDelay:0.02 maxDelay:0.02];
+    
+    TOCFuture* f = [TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil];
+    testChurnUntil(!f.isIncomplete);
+    testFutureHasResult(f, @2);
+    test(attemptCount == 2);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_CancelDuringBackoff {
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        return [TOCFuture futureWithFailure:@1];
+    };
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:1000 maxDelay:1000];
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:c.token];
+    test(attemptCount == 1);
+    test(f.isIncomplete);
+    
+    // the result doesn't wait for the backoff to end
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    test(attemptCount == 1);
+    
+    test([TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:c.token].hasFailedWithCancel);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_CancelDuringAttempt {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) { [unless whenCancelledDo:^{ [s trySetFailedWithCancel]; }]; return s.future; };
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0 maxDelay:0];
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:c.token];
+    test(f.isIncomplete);
+    [c cancel];
+    test(s.future.hasFailedWithCancel);
+    test(f.hasFailedWithCancel);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_TotalTimeout {
+    __block int attemptCount = 0;
+    __block TOCCancelToken* lastToken = nil;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        lastToken = unless;
+        return [[TOCFutureSource new].future unless:unless];
+    };
+    TOCRetryPolicy* p = [[TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0 maxDelay:0] policyWithTotalTimeout:0.02];
+    
+    TOCFuture* f = [TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil];
+    test(lastToken.deadline != nil);
+    testChurnUntil(f.hasFailedWithTimeout);
+    test(attemptCount == 1);
+    
+    // a retry that would have to wait past the deadline isn't waited for
+    TOCUnlessOperation failing = ^(TOCCancelToken* unless) { return [TOCFuture futureWithFailure:@"bad"]; };
+    TOCRetryPolicy* slow = [[TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:1000 maxDelay:1000] policyWithTotalTimeout:0.001];
+    TOCFuture* f2 = [TOCFuture futureFromUnlessOperation:failing withRetryPolicy:slow unless:nil];
+    testChurnUntil(!f2.isIncomplete);
+    test(f2.hasFailed);
+}
+-(void) testFutureFromUnlessOperationWithRetryPolicy_TotalTimeoutDoesNotWaitForTheAttempt {
+    // an attempt that ignores its cancel token doesn't hold up the overall deadline
+    TOCFutureSource* ignoring = [TOCFutureSource new];
+    __block int attemptCount = 0;
+    TOCUnlessOperation t = ^(TOCCancelToken* unless) {
+        attemptCount += 1;
+        return ignoring.future;
+    };
+    TOCRetryPolicy* p = [[TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0 maxDelay:0] policyWithTotalTimeout:0.02];
+    
+    TOCFuture* f = [TOCFuture futureFromUnlessOperation:t withRetryPolicy:p unless:nil];
+    testChurnUntil(f.hasFailedWithTimeout);
+    test(ignoring.future.isIncomplete);
+    test(attemptCount == 1);
+    
+    // the attempt finishing late doesn't change the outcome
+    [ignoring trySetResult:@1];
+    test(f.hasFailedWithTimeout);
+    test(attemptCount == 1);
+}
+
 @end
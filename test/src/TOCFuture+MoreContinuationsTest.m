@@ -149,6 +149,12 @@
     
     testFutureHasFailure([[TOCFuture futureWithResult:@5] unless:cc], cc);
     testFutureHasFailure([[TOCFuture futureWithFailure:@6] unless:cc], cc);
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [TOCFuture futureWithResult:@7];
+    test([f unless:c.token] == f);
+    [c cancel];
+    testFutureHasResult(f, @7);
 }
 -(void) testUnless_DeferredCompletion {
     TOCCancelTokenSource* c = [TOCCancelTokenSource new];
@@ -61,6 +61,85 @@
     testFutureHasFailure(x[1], @"");
     testFutureHasResult(x[2], @3);
 }
+-(void) testFinallyAllUnless_Cancelled {
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCFuture* f = [(@[fut(@1), s.future]) toc_finallyAllUnless:c.token];
+    test(f.isIncomplete);
+    
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    [s trySetResult:@2];
+    test(f.hasFailedWithCancel);
+    
+    test([(@[fut(@1)]) toc_finallyAllUnless:c.token].hasFailedWithCancel);
+    testFutureHasResult([(@[fut(@1)]) toc_finallyAllUnless:TOCCancelToken.immortalToken], (@[fut(@1)]));
+}
+-(void) testFinallyAllUnless_CancellingReleasesInputs {
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFutureSource* pending = [TOCFutureSource new];
+    __weak TOCFuture* weakOther = nil;
+    TOCFuture* f = nil;
+    @autoreleasepool {
+        TOCFutureSource* other = [TOCFutureSource new];
+        weakOther = other.future;
+        f = [(@[pending.future, other.future]) toc_finallyAllUnless:c.token];
+        [c cancel];
+    }
+    
+    // the handler still registered on the pending input no longer keeps the other inputs alive
+    test(f.hasFailedWithCancel);
+    test(weakOther == nil);
+}
+-(void) testFinallyAll_ImmortalInputMakesResultImmortal {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCFuture* f = nil;
+    @autoreleasepool {
+        TOCFutureSource* dropped = [TOCFutureSource new];
+        f = [(@[s.future, dropped.future]) toc_finallyAll];
+        test(f.isIncomplete);
+    }
+    
+    // no need to wait for the other inputs
+    test(f.state == TOCFutureState_Immortal);
+}
+-(void) testFinallyAllUnless_LargeFanIns {
+    // (how the time taken scales with the number of inputs is measured by the finallyAll microbenchmarks)
+    for (NSNumber* size in @[@1000, @10000]) {
+        @autoreleasepool {
+            int n = size.intValue;
+            NSMutableArray* sources = [NSMutableArray arrayWithCapacity:(NSUInteger)n];
+            NSMutableArray* futures = [NSMutableArray arrayWithCapacity:(NSUInteger)n];
+            for (int i = 0; i < n; i++) {
+                TOCFutureSource* source = [TOCFutureSource new];
+                [sources addObject:source];
+                [futures addObject:source.future];
+            }
+            
+            TOCCancelTokenSource* completedCanceller = [TOCCancelTokenSource new];
+            TOCFuture* completed = [futures toc_finallyAllUnless:completedCanceller.token];
+            for (TOCFutureSource* source in sources) {
+                test(completed.isIncomplete);
+                [source trySetResult:nil];
+            }
+            test(completed.hasResult);
+            test([completed.forceGetResult count] == (NSUInteger)n);
+            
+            // (the sources must stay alive, or the inputs would become immortal instead of staying pending)
+            [sources removeAllObjects];
+            [futures removeAllObjects];
+            for (int i = 0; i < n; i++) {
+                TOCFutureSource* source = [TOCFutureSource new];
+                [sources addObject:source];
+                [futures addObject:source.future];
+            }
+            TOCCancelTokenSource* canceller = [TOCCancelTokenSource new];
+            TOCFuture* cancelled = [futures toc_finallyAllUnless:canceller.token];
+            [canceller cancel];
+            test(cancelled.hasFailedWithCancel);
+        }
+    }
+}
 -(void) testThenAll {
     testThrows(@[@1].toc_thenAll);
     testFutureHasResult(@[].toc_thenAll, @[]);
@@ -81,6 +160,85 @@
     [s trySetResult:@""];
     testFutureHasResult(f, (@[@1, @"", @3]));
 }
+-(void) testThenAllOrFirstFailure_Immediate {
+    testThrows([(@[@1]) toc_thenAllOrFirstFailureLastingUntil:nil]);
+    testFutureHasResult([@[] toc_thenAllOrFirstFailureLastingUntil:nil], @[]);
+    
+    TOCUntilOperation one = ^(TOCCancelToken* until) { test(until != nil); return fut(@1); };
+    TOCUntilOperation two = ^(TOCCancelToken* until) { return fut(@2); };
+    TOCUntilOperation fail = ^(TOCCancelToken* until) { return futfail(@"bad"); };
+    testFutureHasResult([(@[one, two]) toc_thenAllOrFirstFailureLastingUntil:nil], (@[@1, @2]));
+    testFutureHasFailure([(@[one, fail, two]) toc_thenAllOrFirstFailureLastingUntil:nil], @"bad");
+    
+    // operations after an immediate failure are never started
+    TOCUntilOperation counted = ^(TOCCancelToken* until) { hitTarget; return fut(@3); };
+    testDoesNotHitTarget([(@[fail, counted]) toc_thenAllOrFirstFailureLastingUntil:nil]);
+}
+-(void) testThenAllOrFirstFailure_FailsFastAndCancelsStragglers {
+    TOCFutureSource* slow = [TOCFutureSource new];
+    TOCFutureSource* failing = [TOCFutureSource new];
+    __block TOCCancelToken* givenToken = nil;
+    TOCUntilOperation slowOperation = ^(TOCCancelToken* until) {
+        givenToken = until;
+        [until whenCancelledDo:^{ [slow trySetFailedWithCancel]; }];
+        return slow.future;
+    };
+    TOCUntilOperation failingOperation = ^(TOCCancelToken* until) { return failing.future; };
+    
+    TOCFuture* f = [(@[slowOperation, failingOperation]) toc_thenAllOrFirstFailureLastingUntil:nil];
+    test(f.isIncomplete);
+    test(givenToken.canStillBeCancelled);
+    
+    // no waiting for the slow operation
+    [failing trySetFailure:@"bad"];
+    testFutureHasFailure(f, @"bad");
+    test(givenToken.isAlreadyCancelled);
+    test(slow.future.hasFailedWithCancel);
+}
+-(void) testThenAllOrFirstFailure_Deferred {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    __block TOCCancelToken* givenToken = nil;
+    TOCUntilOperation op1 = ^(TOCCancelToken* until) { givenToken = until; return s1.future; };
+    TOCUntilOperation op2 = ^(TOCCancelToken* until) { return s2.future; };
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [(@[op1, op2]) toc_thenAllOrFirstFailureLastingUntil:c.token];
+    [s2 trySetResult:@2];
+    test(f.isIncomplete);
+    [s1 trySetResult:@1];
+    testFutureHasResult(f, (@[@1, @2]));
+    
+    // the results last until the given token is cancelled
+    test(givenToken.canStillBeCancelled);
+    [c cancel];
+    test(givenToken.isAlreadyCancelled);
+}
+-(void) testThenAllOrFirstFailure_NilResults {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUntilOperation one = ^(TOCCancelToken* until) { return fut(@1); };
+    TOCUntilOperation none = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:nil]; };
+    TOCUntilOperation noneLater = ^(TOCCancelToken* until) { return s.future; };
+    
+    testFutureHasResult([(@[none]) toc_thenAllOrFirstFailureLastingUntil:nil], @[[NSNull null]]);
+    
+    // the last operation to succeed, with nil, is the one that completes the result
+    TOCFuture* f = [(@[one, none, noneLater]) toc_thenAllOrFirstFailureLastingUntil:nil];
+    test(f.isIncomplete);
+    [s trySetResult:nil];
+    testFutureHasResult(f, (@[@1, [NSNull null], [NSNull null]]));
+}
+-(void) testThenAllOrFirstFailure_Cancelled {
+    TOCFutureSource* s = [TOCFutureSource new];
+    __block TOCCancelToken* givenToken = nil;
+    TOCUntilOperation op = ^(TOCCancelToken* until) { givenToken = until; return s.future; };
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [@[op] toc_thenAllOrFirstFailureLastingUntil:c.token];
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    test(givenToken.isAlreadyCancelled);
+}
 -(void) testAsyncRaceAsynchronousResultUntilCancelledOperationsUntil_Failures {
     testThrows([@[] toc_raceForWinnerLastingUntil:nil]);
     testThrows([@[@1] toc_raceForWinnerLastingUntil:nil]);
@@ -213,4 +371,286 @@
     test(s2.future.hasFailedWithCancel);
 }
 
+-(void) testHedgedRace_Failures {
+    TOCUntilOperation t = ^(TOCCancelToken* until) { return [TOCFutureSource new].future; };
+    testThrows([@[] toc_raceForWinnerLastingUntil:nil withHedgeDelay:1]);
+    testThrows([@[@1] toc_raceForWinnerLastingUntil:nil withHedgeDelay:1]);
+    testThrows([@[t] toc_raceForWinnerLastingUntil:nil withHedgeDelay:-1]);
+    testThrows([@[t] toc_raceForWinnerLastingUntil:nil withHedgeDelay:NAN]);
+    testThrows([@[t] toc_raceForWinnerLastingUntil:nil withAdaptiveHedgeDelay:nil]);
+}
+-(void) testHedgedRace_StartsReplacementsForFailures {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    __block int started2 = 0;
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { return s1.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { started2++; return s2.future; };
+    
+    TOCFuture* f = [(@[t1, t2]) toc_raceForWinnerLastingUntil:nil withHedgeDelay:INFINITY];
+    test(started2 == 0);
+    
+    [s1 trySetFailure:@1];
+    test(started2 == 1);
+    test(f.isIncomplete);
+    
+    [s2 trySetFailure:@2];
+    testFutureHasFailure(f, (@[@1, @2]));
+}
+-(void) testHedgedRace_ZeroDelayStartsEverythingAndCancelsLosers {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCFutureSource* s3 = [TOCFutureSource new];
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s1 trySetFailedWithCancel]; }]; return s1.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s2 trySetFailedWithCancel]; }]; return s2.future; };
+    TOCUntilOperation t3 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s3 trySetFailedWithCancel]; }]; return s3.future; };
+    
+    TOCFuture* f = [(@[t1, t2, t3]) toc_raceForWinnerLastingUntil:nil withHedgeDelay:0];
+    test(f.isIncomplete);
+    
+    [s2 trySetResult:@7];
+    testFutureHasResult(f, @7);
+    test(s1.future.hasFailedWithCancel);
+    test(s3.future.hasFailedWithCancel);
+}
+-(void) testHedgedRace_StartsHedgeAfterDelay {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    __block bool started2 = false;
+    __block bool started3 = false;
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s1 trySetFailedWithCancel]; }]; return s1.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { started2 = true; return s2.future; };
+    TOCUntilOperation t3 = ^(TOCCancelToken* until) { started3 = true; return [TOCFutureSource new].future; };
+    
+    TOCFuture* f = [(@[t1, t2, t3]) toc_raceForWinnerLastingUntil:nil withHedgeDelay:0.01];
+    test(!started2);
+    testChurnUntil(started2);
+    
+    // the hedge wins before the third replica is needed
+    [s2 trySetResult:@8];
+    testFutureHasResult(f, @8);
+    test(s1.future.hasFailedWithCancel);
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    test(!started3);
+}
+-(void) testHedgedRace_WinBeforeDelayStartsNothingElse {
+    __block bool started2 = false;
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@9]; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { started2 = true; return [TOCFuture futureWithResult:@10]; };
+    
+    testFutureHasResult([(@[t1, t2]) toc_raceForWinnerLastingUntil:nil withHedgeDelay:0.01], @9);
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    test(!started2);
+}
+-(void) testHedgedRace_CancelDuring {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    __block bool started2 = false;
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s1 trySetFailedWithCancel]; }]; return [TOCFutureSource new].future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { started2 = true; return [TOCFutureSource new].future; };
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [(@[t1, t2]) toc_raceForWinnerLastingUntil:c.token withHedgeDelay:0.01];
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    test(s1.future.hasFailedWithCancel);
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    test(!started2);
+}
+-(void) testHedgedRace_AdaptiveDelayRecordsWinnerLatency {
+    TOCAdaptiveHedgeDelay* d = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:50 initialDelay:INFINITY];
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { return s.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { return [TOCFutureSource new].future; };
+    
+    TOCFuture* f = [(@[t1, t2]) toc_raceForWinnerLastingUntil:nil withAdaptiveHedgeDelay:d];
+    test(d.currentDelay == INFINITY);
+    [s trySetResult:@11];
+    testFutureHasResult(f, @11);
+    test(d.currentDelay < 1);
+}
+-(void) testHedgedRace_AdaptiveDelayDoesNotCollapseWhenReplicasWin {
+    // a primary that never finishes, and a replica that finishes right away
+    TOCAdaptiveHedgeDelay* d = [TOCAdaptiveHedgeDelay adaptiveHedgeDelayAtPercentile:95 initialDelay:0.02];
+    TOCUntilOperation slow = ^(TOCCancelToken* until) {
+        TOCFutureSource* s = [TOCFutureSource new];
+        [until whenCancelledDo:^{ [s trySetFailedWithCancel]; }];
+        return s.future;
+    };
+    TOCUntilOperation fast = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@12]; };
+    
+    // every race waits out the delay before the replica wins, so what gets recorded never drops below the delay
+    for (int i = 0; i < 20; i++) {
+        TOCFuture* f = [(@[slow, fast]) toc_raceForWinnerLastingUntil:nil withAdaptiveHedgeDelay:d];
+        testChurnUntil(!f.isIncomplete);
+        testFutureHasResult(f, @12);
+    }
+    test(d.currentDelay >= 0.02);
+}
+
+-(void) testQuorumRace_Failures {
+    TOCUntilOperation t = ^(TOCCancelToken* until) { return [TOCFutureSource new].future; };
+    testThrows([@[@1] toc_raceForQuorumOf:1 lastingUntil:nil]);
+    testThrows([@[t] toc_raceForQuorumOf:2 lastingUntil:nil]);
+    testFutureHasResult([@[] toc_raceForQuorumOf:0 lastingUntil:nil], @[]);
+}
+-(void) testQuorumRace_Immediate {
+    TOCUntilOperation r1 = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@1]; };
+    TOCUntilOperation r2 = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@2]; };
+    TOCUntilOperation f3 = ^(TOCCancelToken* until) { return [TOCFuture futureWithFailure:@3]; };
+    
+    testFutureHasResult([(@[r1, f3, r2]) toc_raceForQuorumOf:2 lastingUntil:nil], (@[@1, @2]));
+    testFutureHasResult([(@[r2, r1]) toc_raceForQuorumOf:1 lastingUntil:nil], @[@2]);
+    testFutureHasFailure([(@[f3, r1, f3]) toc_raceForQuorumOf:2 lastingUntil:nil], (@[@3, @3]));
+}
+-(void) testQuorumRace_SucceedsOnceQuorumReachedAndCancelsTheRest {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCFutureSource* s3 = [TOCFutureSource new];
+    TOCFutureSource* s4 = [TOCFutureSource new];
+    NSMutableArray* cancelled = [NSMutableArray array];
+    TOCUntilOperation (^op)(TOCFutureSource*, int) = ^(TOCFutureSource* s, int i) {
+        return ^(TOCCancelToken* until) {
+            [until whenCancelledDo:^{ [cancelled addObject:@(i)]; }];
+            return s.future;
+        };
+    };
+    
+    TOCFuture* f = [(@[op(s1, 1), op(s2, 2), op(s3, 3), op(s4, 4)]) toc_raceForQuorumOf:2 lastingUntil:nil];
+    [s3 trySetResult:@"c"];
+    [s4 trySetFailure:@"d"];
+    test(f.isIncomplete);
+    test(cancelled.count == 0);
+    
+    [s1 trySetResult:@"a"];
+    testFutureHasResult(f, (@[@"c", @"a"]));
+    testEq([cancelled sortedArrayUsingSelector:@selector(compare:)], (@[@2, @4]));
+    
+    // succeeding too late to be part of the quorum doesn't change anything
+    [s2 trySetResult:@"b"];
+    testFutureHasResult(f, (@[@"c", @"a"]));
+    test(cancelled.count == 2);
+}
+-(void) testQuorumRace_FailsOnceQuorumImpossible {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCFutureSource* s3 = [TOCFutureSource new];
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { return s1.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { return s2.future; };
+    TOCUntilOperation t3 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s3 trySetFailedWithCancel]; }]; return s3.future; };
+    
+    TOCFuture* f = [(@[t1, t2, t3]) toc_raceForQuorumOf:2 lastingUntil:nil];
+    [s2 trySetFailure:@2];
+    test(f.isIncomplete);
+    test(s3.future.isIncomplete);
+    
+    [s1 trySetFailure:@1];
+    testFutureHasFailure(f, (@[@2, @1]));
+    test(s3.future.hasFailedWithCancel);
+}
+-(void) testQuorumRace_DoesNotStartOperationsOnceDecided {
+    __block bool started3 = false;
+    TOCUntilOperation r1 = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@1]; };
+    TOCUntilOperation t3 = ^(TOCCancelToken* until) { started3 = true; return [TOCFutureSource new].future; };
+    
+    testFutureHasResult([(@[r1, r1, t3]) toc_raceForQuorumOf:2 lastingUntil:nil], (@[@1, @1]));
+    test(!started3);
+}
+-(void) testQuorumRace_CancelDuring {
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCUntilOperation t1 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s1 trySetFailedWithCancel]; }]; return s1.future; };
+    TOCUntilOperation t2 = ^(TOCCancelToken* until) { [until whenCancelledDo:^{ [s2 trySetFailedWithCancel]; }]; return s2.future; };
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [(@[t1, t2]) toc_raceForQuorumOf:1 lastingUntil:c.token];
+    test(f.isIncomplete);
+    
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    test(s1.future.hasFailedWithCancel);
+    test(s2.future.hasFailedWithCancel);
+}
+
+-(void) testMapAsync_Empty {
+    TOCAsyncItemOperation op = ^(id item, TOCCancelToken* unless) { return [TOCFuture futureWithResult:item]; };
+    testFutureHasResult([@[] toc_mapAsync:op maxConcurrency:1 unless:nil], @[]);
+    testThrows([@[] toc_mapAsync:op maxConcurrency:0 unless:nil]);
+    testThrows([@[] toc_mapAsync:nil maxConcurrency:1 unless:nil]);
+}
+-(void) testMapAsync_KeepsAtMostMaxConcurrencyInFlight {
+    NSMutableArray* sources = [NSMutableArray array];
+    TOCAsyncItemOperation op = ^(NSNumber* item, TOCCancelToken* unless) {
+        TOCFutureSource* s = [TOCFutureSource new];
+        [sources addObject:s];
+        return [s.future then:^(NSNumber* value) { return @(item.intValue * value.intValue); }];
+    };
+    
+    TOCFuture* f = [(@[@1, @2, @3, @4, @5]) toc_mapAsync:op maxConcurrency:2 unless:nil];
+    test(sources.count == 2);
+    
+    // completing out of order still gives results in input order
+    [sources[1] trySetResult:@10];
+    test(sources.count == 3);
+    [sources[0] trySetResult:@10];
+    test(sources.count == 4);
+    [sources[3] trySetResult:@10];
+    [sources[2] trySetResult:@10];
+    test(sources.count == 5);
+    test(f.isIncomplete);
+    [sources[4] trySetResult:@10];
+    testFutureHasResult(f, (@[@10, @20, @30, @40, @50]));
+}
+-(void) testMapAsync_ManyInlineCompletionsDoNotRecurse {
+    NSMutableArray* items = [NSMutableArray array];
+    for (int i = 0; i < 100000; i++) {
+        [items addObject:@(i)];
+    }
+    TOCAsyncItemOperation op = ^(id item, TOCCancelToken* unless) { return [TOCFuture futureWithResult:item]; };
+    
+    TOCFuture* f = [items toc_mapAsync:op maxConcurrency:4 unless:nil];
+    testFutureHasResult(f, items);
+}
+-(void) testMapAsync_FailureStopsLaunchingAndCancelsInFlight {
+    __block int startedCount = 0;
+    TOCFutureSource* s1 = [TOCFutureSource new];
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    NSArray* sources = @[s1, s2];
+    TOCAsyncItemOperation op = ^(NSNumber* item, TOCCancelToken* unless) {
+        startedCount += 1;
+        if (item.intValue >= 2) return [TOCFutureSource new].future;
+        TOCFutureSource* s = sources[(NSUInteger)item.intValue];
+        [unless whenCancelledDo:^{ [s trySetFailedWithCancel]; }];
+        return s.future;
+    };
+    
+    TOCFuture* f = [(@[@0, @1, @2, @3]) toc_mapAsync:op maxConcurrency:2 unless:nil];
+    [s2 trySetFailure:@"bad"];
+    testFutureHasFailure(f, @"bad");
+    test(s1.future.hasFailedWithCancel);
+    test(startedCount == 2);
+}
+-(void) testMapAsync_CancelStopsLaunching {
+    __block int startedCount = 0;
+    NSMutableArray* sources = [NSMutableArray array];
+    TOCAsyncItemOperation op = ^(id item, TOCCancelToken* unless) {
+        startedCount += 1;
+        TOCFutureSource* s = [TOCFutureSource futureSourceUntil:unless];
+        [sources addObject:s];
+        return s.future;
+    };
+    
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    TOCFuture* f = [(@[@0, @1, @2, @3]) toc_mapAsync:op maxConcurrency:2 unless:c.token];
+    [sources[0] trySetResult:@0];
+    test(startedCount == 3);
+    
+    [c cancel];
+    test(f.hasFailedWithCancel);
+    test([sources[1] future].hasFailedWithCancel);
+    [sources[2] trySetResult:@2];
+    test(startedCount == 3);
+    
+    test([(@[@0]) toc_mapAsync:op maxConcurrency:1 unless:c.token].hasFailedWithCancel);
+    test(startedCount == 3);
+}
+
 @end
@@ -0,0 +1,202 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCFutureCacheTest : XCTestCase
+@end
+
+@implementation TOCFutureCacheTest
+
+-(void) testPreconditions {
+    testThrows([TOCFutureCache futureCacheWithCountLimit:0 costLimit:1 timeToLive:1]);
+    testThrows([TOCFutureCache futureCacheWithCountLimit:1 costLimit:1 timeToLive:0]);
+    testThrows([TOCFutureCache futureCacheWithCountLimit:1 costLimit:1 timeToLive:NAN]);
+    
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:1 costLimit:1 timeToLive:1];
+    TOCUntilOperation op = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@1]; };
+    testThrows([cache futureForKey:nil orStart:op unless:nil]);
+    testThrows([cache futureForKey:@"a" orStart:nil unless:nil]);
+    testThrows([cache futureForKey:@"a" orStart:^(TOCCancelToken* until) { return (TOCFuture*)nil; } unless:nil]);
+}
+
+-(void) testConcurrentMissesShareTheOperation {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block int startCount = 0;
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUntilOperation op = ^(TOCCancelToken* until) { startCount += 1; return s.future; };
+    
+    TOCFuture* f1 = [cache futureForKey:@"a" orStart:op unless:nil];
+    TOCFuture* f2 = [cache futureForKey:@"a" orStart:op unless:nil];
+    test(startCount == 1);
+    test(f1.isIncomplete);
+    test(cache.count == 1);
+    
+    [s trySetResult:@1];
+    testFutureHasResult(f1, @1);
+    testFutureHasResult(f2, @1);
+    testFutureHasResult([cache futureForKey:@"a" orStart:op unless:nil], @1);
+    test(startCount == 1);
+}
+
+-(void) testFailuresAreEvictedImmediately {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block int startCount = 0;
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUntilOperation op = ^(TOCCancelToken* until) { startCount += 1; return s.future; };
+    
+    TOCFuture* f = [cache futureForKey:@"a" orStart:op unless:nil];
+    [s trySetFailure:@"bad"];
+    testFutureHasFailure(f, @"bad");
+    test(cache.count == 0);
+    
+    TOCUntilOperation op2 = ^(TOCCancelToken* until) { startCount += 1; return [TOCFuture futureWithFailure:@"worse"]; };
+    testFutureHasFailure([cache futureForKey:@"a" orStart:op2 unless:nil], @"worse");
+    test(startCount == 2);
+    test(cache.count == 0);
+}
+
+-(void) testThrowingOperationsAreEvicted {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block TOCFuture* joined = nil;
+    TOCUntilOperation throwing = ^TOCFuture*(TOCCancelToken* until) {
+        joined = [cache futureForKey:@"a" orStart:^(TOCCancelToken* until2) { return [TOCFuture futureWithResult:@0]; } unless:nil];
+        @throw [NSException exceptionWithName:@"testThrowingOperationsAreEvicted" reason:nil userInfo:nil];
+    };
+    
+    testThrows([cache futureForKey:@"a" orStart:throwing unless:nil]);
+    test(cache.count == 0);
+    test(joined.hasFailed);
+    
+    testThrows([cache futureForKey:@"a" orStart:^(TOCCancelToken* until) { return (TOCFuture*)nil; } unless:nil]);
+    test(cache.count == 0);
+    
+    testFutureHasResult([cache futureForKey:@"a" orStart:^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@1]; } unless:nil], @1);
+    test(cache.count == 1);
+}
+
+-(void) testImmortalOperationsAreEvicted {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block int startCount = 0;
+    TOCFuture* f;
+    @autoreleasepool {
+        TOCFutureSource* s = [TOCFutureSource new];
+        TOCUntilOperation op = ^(TOCCancelToken* until) { startCount += 1; return s.future; };
+        f = [cache futureForKey:@"a" orStart:op unless:nil];
+        test(cache.count == 1);
+    }
+    test(f.state == TOCFutureState_Immortal);
+    test(cache.count == 0);
+    
+    // the next request starts over, instead of getting a future that never completes
+    TOCUntilOperation op2 = ^(TOCCancelToken* until) { startCount += 1; return [TOCFuture futureWithResult:@2]; };
+    testFutureHasResult([cache futureForKey:@"a" orStart:op2 unless:nil], @2);
+    test(startCount == 2);
+}
+
+-(void) testEvictsLeastRecentlyUsed {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:2 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    NSMutableArray* started = [NSMutableArray array];
+    TOCUntilOperation (^opFor)(id) = ^(id key) {
+        return ^(TOCCancelToken* until) { [started addObject:key]; return [TOCFuture futureWithResult:key]; };
+    };
+    
+    [cache futureForKey:@"a" orStart:opFor(@"a") unless:nil];
+    [cache futureForKey:@"b" orStart:opFor(@"b") unless:nil];
+    [cache futureForKey:@"a" orStart:opFor(@"a") unless:nil];
+    [cache futureForKey:@"c" orStart:opFor(@"c") unless:nil];
+    test(cache.count == 2);
+    testEq(started, (@[@"a", @"b", @"c"]));
+    
+    [cache futureForKey:@"a" orStart:opFor(@"a") unless:nil];
+    [cache futureForKey:@"b" orStart:opFor(@"b") unless:nil];
+    testEq(started, (@[@"a", @"b", @"c", @"b"]));
+}
+
+-(void) testEvictsToFitCostLimit {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:NSUIntegerMax costLimit:10 timeToLive:INFINITY];
+    TOCUntilOperation op = ^(TOCCancelToken* until) { return [TOCFuture futureWithResult:@1]; };
+    
+    [cache futureForKey:@"a" orStart:op withCost:4 unless:nil];
+    [cache futureForKey:@"b" orStart:op withCost:4 unless:nil];
+    test(cache.totalCost == 8);
+    [cache futureForKey:@"c" orStart:op withCost:4 unless:nil];
+    test(cache.count == 2);
+    test(cache.totalCost == 8);
+    
+    // a single entry may be over the limit by itself
+    [cache futureForKey:@"d" orStart:op withCost:20 unless:nil];
+    test(cache.count == 1);
+    test(cache.totalCost == 20);
+    
+    [cache removeAllFutures];
+    test(cache.count == 0);
+    test(cache.totalCost == 0);
+}
+
+-(void) testSucceededFuturesExpire {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:0.01];
+    __block int startCount = 0;
+    TOCUntilOperation op = ^(TOCCancelToken* until) { startCount += 1; return [TOCFuture futureWithResult:@1]; };
+    
+    [cache futureForKey:@"a" orStart:op unless:nil];
+    [cache futureForKey:@"a" orStart:op unless:nil];
+    test(startCount == 1);
+    
+    testChurnUntil(cache.count == 0);
+    [cache futureForKey:@"a" orStart:op unless:nil];
+    test(startCount == 2);
+}
+
+-(void) testRemoveFutureForKey {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block int startCount = 0;
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCUntilOperation op = ^(TOCCancelToken* until) { startCount += 1; return s.future; };
+    
+    TOCFuture* f = [cache futureForKey:@"a" orStart:op unless:nil];
+    [cache removeFutureForKey:@"a"];
+    [cache removeFutureForKey:@"b"];
+    test(cache.count == 0);
+    
+    // evicting doesn't affect requests that already got the future
+    [s trySetResult:@1];
+    testFutureHasResult(f, @1);
+    test(cache.count == 0);
+    [cache futureForKey:@"a" orStart:op unless:nil];
+    test(startCount == 2);
+}
+
+-(void) testAbandonedOperationsAreCancelled {
+    TOCFutureCache* cache = [TOCFutureCache futureCacheWithCountLimit:10 costLimit:NSUIntegerMax timeToLive:INFINITY];
+    __block TOCCancelToken* operationToken = nil;
+    TOCUntilOperation op = ^(TOCCancelToken* until) {
+        operationToken = until;
+        return [TOCFutureSource futureSourceUntil:until].future;
+    };
+    
+    TOCCancelTokenSource* c1 = [TOCCancelTokenSource new];
+    TOCCancelTokenSource* c2 = [TOCCancelTokenSource new];
+    TOCFuture* f1 = [cache futureForKey:@"a" orStart:op unless:c1.token];
+    TOCFuture* f2 = [cache futureForKey:@"a" orStart:op unless:c2.token];
+    
+    [c1 cancel];
+    test(f1.hasFailedWithCancel);
+    test(f2.isIncomplete);
+    test(!operationToken.isAlreadyCancelled);
+    
+    [c2 cancel];
+    test(f2.hasFailedWithCancel);
+    test(operationToken.isAlreadyCancelled);
+    test(cache.count == 0);
+    
+    // requests that can't be cancelled keep the operation going
+    TOCCancelTokenSource* c3 = [TOCCancelTokenSource new];
+    TOCFuture* f3 = [cache futureForKey:@"b" orStart:op unless:c3.token];
+    TOCFuture* f4 = [cache futureForKey:@"b" orStart:op unless:nil];
+    [c3 cancel];
+    test(f3.hasFailedWithCancel);
+    test(f4.isIncomplete);
+    test(!operationToken.isAlreadyCancelled);
+    test(cache.count == 1);
+}
+
+@end
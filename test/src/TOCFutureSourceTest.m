@@ -442,4 +442,71 @@
     }
 }
 
+-(void)testFlatteningMergesHandlersAndFollowers {
+    TOCFutureSource* inner = [TOCFutureSource new];
+    TOCFutureSource* outer1 = [TOCFutureSource new];
+    TOCFutureSource* outer2 = [TOCFutureSource new];
+    TOCFutureSource* outerMost = [TOCFutureSource new];
+    
+    __block int hits = 0;
+    [inner.future thenDo:^(id value) { hits += 1; }];
+    [outer1.future thenDo:^(id value) { hits += 10; }];
+    
+    [outer1 trySetResult:inner.future];
+    [outer2 trySetResult:inner.future];
+    [outerMost trySetResult:outer1.future];
+    [inner.future thenDo:^(id value) { hits += 100; }];
+    test(outerMost.future.state == TOCFutureState_Flattening);
+    test(inner.future.state == TOCFutureState_AbleToBeSet);
+    test(hits == 0);
+    
+    [inner trySetResult:@7];
+    test(hits == 111);
+    testFutureHasResult(inner.future, @7);
+    testFutureHasResult(outer1.future, @7);
+    testFutureHasResult(outer2.future, @7);
+    testFutureHasResult(outerMost.future, @7);
+}
+-(void)testThreadSafety_racingFlatteningCyclesBecomeImmortal {
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (int runs = 0; runs < 1000; runs++) {
+        NSArray* sources = @[[TOCFutureSource new], [TOCFutureSource new], [TOCFutureSource new]];
+        
+        // close a three-future cycle, each link from a different thread
+        dispatch_apply(sources.count, q, ^(size_t i) {
+            [sources[i] trySetResult:[sources[(i + 1) % sources.count] future]];
+        });
+        
+        for (TOCFutureSource* s in sources) {
+            test(s.future.state == TOCFutureState_Immortal);
+        }
+    }
+}
+-(void)testThreadSafety_concurrentFlattenings {
+    // (how flattening scales across threads is measured by the flatteningIndependentFutures contention benchmark)
+    dispatch_queue_t q = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (int runs = 0; runs < 100; runs++) {
+        TOCFutureSource* shared = [TOCFutureSource new];
+        NSMutableArray* outers = [NSMutableArray array];
+        NSMutableArray* independents = [NSMutableArray array];
+        for (int i = 0; i < 8; i++) {
+            [outers addObject:[TOCFutureSource new]];
+            [independents addObject:[TOCFutureSource new]];
+        }
+        
+        // each thread flattens onto the shared future, and onto a future of its own that it then completes
+        dispatch_apply(outers.count, q, ^(size_t i) {
+            TOCFutureSource* inner = [TOCFutureSource new];
+            [independents[i] trySetResult:inner.future];
+            [outers[i] trySetResult:shared.future];
+            [inner trySetResult:@(i)];
+        });
+        [shared trySetResult:@"shared"];
+        
+        for (NSUInteger i = 0; i < outers.count; i++) {
+            testFutureHasResult([outers[i] future], @"shared");
+            testFutureHasResult([independents[i] future], @(i));
+        }
+    }
+}
 @end
@@ -421,4 +421,349 @@
     test(![[TOCFuture futureWithFailure:@1] isEqualToFuture:[TOCFuture futureWithFailure:nil]]);
 }
 
+-(void)testCancelledOnCompletionToken_Lazy {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCCancelToken* c = s.future.cancelledOnCompletionToken;
+    test(c == s.future.cancelledOnCompletionToken);
+    test(c.canStillBeCancelled);
+    
+    [s forceSetResult:@1];
+    test(c.isAlreadyCancelled);
+    test(s.future.cancelledOnCompletionToken == c);
+    
+    test([TOCFuture futureWithResult:@1].cancelledOnCompletionToken.isAlreadyCancelled);
+    test([TOCFuture futureWithFailure:@2].cancelledOnCompletionToken.isAlreadyCancelled);
+    
+    TOCFuture* f;
+    @autoreleasepool {
+        TOCFutureSource* s2 = [TOCFutureSource new];
+        f = s2.future;
+        c = f.cancelledOnCompletionToken;
+    }
+    test(f.state == TOCFutureState_Immortal);
+    test(c.state == TOCCancelTokenState_Immortal);
+    test(f.cancelledOnCompletionToken.state == TOCCancelTokenState_Immortal);
+}
+-(void)testImmortalityPropagatesThroughContinuations {
+    TOCFuture* f1;
+    TOCFuture* f2;
+    TOCFuture* f3;
+    @autoreleasepool {
+        TOCFutureSource* s = [TOCFutureSource new];
+        f1 = [s.future then:^(id value) { return value; }];
+        f2 = [s.future catch:^(id value) { return value; } unless:[TOCCancelTokenSource new].token];
+        TOCFutureSource* s2 = [TOCFutureSource new];
+        [s2 trySetResult:s.future];
+        f3 = s2.future;
+    }
+    test(f1.state == TOCFutureState_Immortal);
+    test(f2.state == TOCFutureState_Immortal);
+    test(f3.state == TOCFutureState_Immortal);
+}
+
+-(void)testAllocationsPerContinuation {
+    // Before futures stored their own state, each pending continuation allocated:
+    // a future source, a future, a cancel token source, a cancel token, the token's handler collections, and the handler blocks.
+    // Now it should just be the result future and the handler node.
+    // (allocation counts are whole numbers, so staying under the next one up leaves room for noise from other threads)
+    int n = 10000;
+    TOCFutureSource* s = [TOCFutureSource new];
+    NSMutableArray* keepAlive = [NSMutableArray arrayWithCapacity:(NSUInteger)n * 4];
+    TOCFutureThenContinuation same = ^(id value) { return value; };
+    TOCFutureCatchContinuation catchSame = ^(id failure) { return failure; };
+    TOCFutureFinallyContinuation finallySame = ^(TOCFuture* completed) { return completed; };
+    
+    double sourceCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[TOCFutureSource new]]; });
+    double thenCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[s.future then:same]]; });
+    double catchCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[s.future catch:catchSame]]; });
+    double finallyCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[s.future finally:finallySame]]; });
+    
+    test(sourceCost < 2.5);
+    test(thenCost < 2.5);
+    test(catchCost < 2.5);
+    test(finallyCost < 2.5);
+    
+    // everything still completes properly
+    [s forceSetResult:@7];
+    for (TOCFuture* f in keepAlive) {
+        if ([f isKindOfClass:[TOCFutureSource class]]) continue;
+        test(!f.isIncomplete);
+    }
+}
+
+-(void)testAllocationsPerContinuation_AlreadyCompleted {
+    // continuing an already completed future, with nothing that could cancel the continuation, shouldn't involve any bookkeeping
+    int n = 10000;
+    TOCFuture* succeeded = [TOCFuture futureWithResult:@1];
+    TOCFuture* failed = [TOCFuture futureWithFailure:@2];
+    NSMutableArray* keepAlive = [NSMutableArray arrayWithCapacity:(NSUInteger)n * 4];
+    TOCFutureThenContinuation same = ^(id value) { return value; };
+    TOCFutureFinallyContinuation finallySame = ^(TOCFuture* completed) { return completed; };
+    
+    double thenCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[succeeded then:same]]; });
+    double thenImmortalCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[succeeded then:same unless:TOCCancelToken.immortalToken]]; });
+    double thenPassThroughCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[failed then:same]]; });
+    double catchPassThroughCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[succeeded catch:same]]; });
+    double finallyFlattenedCost = measureAllocationsPerIteration(n, ^{ [keepAlive addObject:[succeeded finally:finallySame]]; });
+    double thenDoCost = measureAllocationsPerIteration(n, ^{ [succeeded thenDo:^(id value) { [keepAlive addObject:value]; }]; });
+    // a continuation returning a plain value costs just the completed result future
+    test(thenCost < 1.5);
+    test(thenImmortalCost < 1.5);
+    // pass-throughs and flattening an already completed future cost nothing
+    test(thenPassThroughCost < 0.5);
+    test(catchPassThroughCost < 0.5);
+    test(finallyFlattenedCost < 0.5);
+    test(thenDoCost < 0.5);
+    
+    testFutureHasResult([succeeded then:same], @1);
+    test([failed then:same] == failed);
+    test([succeeded catch:same] == succeeded);
+    test([succeeded finally:finallySame] == succeeded);
+    testFutureHasResult([failed catch:same], @2);
+    test([succeeded then:same unless:TOCCancelToken.cancelledToken].hasFailedWithCancel);
+}
+
+-(TOCFuture*) countdownFrom:(int)remaining
+                  stepQueue:(NSMutableArray*)stepQueue {
+    if (remaining == 0) return [TOCFuture futureWithResult:@"done"];
+    
+    // each step waits on a source driven by the test, then recursively continues with the next step
+    TOCFutureSource* step = [TOCFutureSource new];
+    [stepQueue addObject:step];
+    return [step.future then:^(id value) {
+        return [self countdownFrom:remaining - 1 stepQueue:stepQueue];
+    }];
+}
+-(void)testLongRecursiveFlatteningChain_MemoryStaysFlat {
+    const int depth = 1000000;
+    NSMutableArray* stepQueue = [NSMutableArray array];
+    TOCFuture* result = [self countdownFrom:depth stepQueue:stepQueue];
+    
+    size_t blocksEarly = 0;
+    size_t blocksLate = 0;
+    for (int i = 0; i < depth; i++) {
+        if (i == depth / 10) blocksEarly = peekAllocatedBlockCount();
+        if (i == depth - depth / 10) blocksLate = peekAllocatedBlockCount();
+        @autoreleasepool {
+            TOCFutureSource* step = stepQueue.lastObject;
+            [stepQueue removeLastObject];
+            [step trySetResult:nil];
+        }
+    }
+    
+    testFutureHasResult(result, @"done");
+    test(stepQueue.count == 0);
+    
+    // every intermediate future links straight to the outermost one, so nothing proportional to the depth is kept alive
+    // (some slack for the few cycle detection nodes that stay on the path to the root)
+    test(blocksLate < blocksEarly + 10000);
+}
+
+-(void)testLongThenChain_CompletesWithoutOverflowingTheStack {
+    // every link's continuation completes the next link, so running handlers recursively would nest once per link
+    // (far past the inline nesting limit, and past what the stack could take; throughput is measured by the thenChain benchmark)
+    const int n = 100 * 1000;
+    TOCFutureSource* head = [TOCFutureSource new];
+    TOCFutureThenContinuation increment = ^(NSNumber* value) { return @(value.intValue + 1); };
+    __block TOCFuture* last = nil;
+    
+    // off of the main thread, so the continuations run inline instead of hopping to the main thread
+    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        TOCFuture* f = head.future;
+        for (int i = 0; i < n; i++) {
+            @autoreleasepool {
+                f = [f then:increment];
+            }
+        }
+        
+        [head trySetResult:@0];
+        last = f;
+    });
+    
+    testFutureHasResult(last, @(n));
+}
+
+-(void)testInlineNestingLimit_QueuedRunsStillFinishBeforeReturning {
+    NSUInteger originalLimit = TOCExecutors.inlineNestingLimit;
+    TOCFutureThenContinuation increment = ^(NSNumber* value) { return @(value.intValue + 1); };
+    
+    for (NSUInteger limit = 0; limit < 4; limit++) {
+        [TOCExecutors setInlineNestingLimit:limit];
+        test(TOCExecutors.inlineNestingLimit == limit);
+        
+        dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            TOCFutureSource* s = [TOCFutureSource new];
+            TOCFuture* f = s.future;
+            NSMutableArray* order = [NSMutableArray array];
+            for (int i = 0; i < 100; i++) {
+                [f thenDo:^(id value) { [order addObject:@(i)]; }];
+                f = [f then:increment];
+            }
+            
+            [s trySetResult:@0];
+            testFutureHasResult(f, @100);
+            test(order.count == 100);
+            for (int i = 0; i < (int)order.count; i++) {
+                testEq(order[(NSUInteger)i], @(i));
+            }
+        });
+    }
+    
+    [TOCExecutors setInlineNestingLimit:originalLimit];
+}
+-(void)testInlineNestingLimit_ThrowingHandlerDoesNotStrandQueuedRuns {
+    NSUInteger originalLimit = TOCExecutors.inlineNestingLimit;
+    [TOCExecutors setInlineNestingLimit:1];
+    TOCFutureThenContinuation increment = ^(NSNumber* value) { return @(value.intValue + 1); };
+    DeallocCounter* d = [DeallocCounter new];
+    
+    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        TOCFutureSource* s = [TOCFutureSource new];
+        TOCFuture* f = s.future;
+        TOCFuture* middle = nil;
+        for (int i = 0; i < 20; i++) {
+            f = [f then:increment];
+            if (i == 10) middle = f;
+        }
+        
+        // past the nesting limit, after the rest of the chain was continued, and before another handler
+        __block bool ranAfterThrow = false;
+        [middle thenDo:^(id value) { [NSException raise:@"Test" format:@"handler threw"]; }];
+        @autoreleasepool {
+            DeallocToken* dToken = [d makeToken];
+            [middle thenDo:^(id value) {
+                ranAfterThrow = true;
+                [dToken poke];
+            }];
+        }
+        
+        testThrows([s trySetResult:@0]);
+        
+        // the queued runs still happened, before the exception got out
+        testFutureHasResult(f, @20);
+        // the handler after the one that threw was discarded, not leaked
+        test(!ranAfterThrow);
+        test(d.lostTokenCount == 1);
+        
+        // and nothing was left queued, to run inside an unrelated completion later
+        TOCFutureSource* unrelated = [TOCFutureSource new];
+        __block int unrelatedHits = 0;
+        [unrelated.future thenDo:^(id value) { unrelatedHits += 1; }];
+        [unrelated trySetResult:@1];
+        test(unrelatedHits == 1);
+    });
+    
+    [TOCExecutors setInlineNestingLimit:originalLimit];
+}
+
+-(void)testWaitUntilCompleted_AlreadySettled {
+    test([[TOCFuture futureWithResult:@1] waitUntilCompletedWithTimeout:0]);
+    test([[TOCFuture futureWithFailure:@2] waitUntilCompletedWithTimeout:INFINITY]);
+    test(![[TOCFutureSource new].future waitUntilCompletedWithTimeout:INFINITY]);
+    
+    testEq([[TOCFuture futureWithResult:@1] forceGetResultWaitingUpTo:0], @1);
+    testThrows([[TOCFuture futureWithFailure:@2] forceGetResultWaitingUpTo:0]);
+    
+    testThrows([[TOCFuture futureWithResult:@1] waitUntilCompletedWithTimeout:-1]);
+    testThrows([[TOCFuture futureWithResult:@1] waitUntilCompletedWithTimeout:NAN]);
+}
+-(void)testWaitUntilCompleted_TimesOut {
+    TOCFutureSource* s = [TOCFutureSource new];
+    test(![s.future waitUntilCompletedWithTimeout:0]);
+    test(![s.future waitUntilCompletedWithTimeout:0.01]);
+    testThrows([s.future forceGetResultWaitingUpTo:0.01]);
+    
+    // timing out doesn't get in the way of completing later
+    [s trySetResult:@3];
+    test([s.future waitUntilCompletedWithTimeout:0]);
+    testEq([s.future forceGetResultWaitingUpTo:0], @3);
+}
+-(void)testWaitUntilCompleted_CompletedByOtherThread {
+    TOCFutureSource* s = [TOCFutureSource new];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.01 * NSEC_PER_SEC)),
+                   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+                   ^{ [s trySetResult:@4]; });
+    testEq([s.future forceGetResultWaitingUpTo:5], @4);
+    
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.01 * NSEC_PER_SEC)),
+                   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+                   ^{ [s2 trySetFailure:@5]; });
+    test([s2.future waitUntilCompletedWithTimeout:INFINITY]);
+    testFutureHasFailure(s2.future, @5);
+}
+-(void)testWaitUntilCompleted_RefusesToDeadlockTheMainThread {
+    test(NSThread.isMainThread);
+    TOCFutureThenContinuation increment = ^(NSNumber* value) { return @(value.intValue + 1); };
+    
+    // the default executor, on the main thread, is the main thread
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCFuture* f = [s.future then:increment];
+    testThrows([f waitUntilCompletedWithTimeout:1]);
+    test(![f waitUntilCompletedWithTimeout:0]);
+    [s trySetResult:@1];
+    testEq([f forceGetResultWaitingUpTo:1], @2);
+    
+    // the main queue needs the main thread to be free
+    TOCFuture* g = [[TOCFuture futureWithResult:@1] then:increment on:TOCExecutors.mainQueueExecutor];
+    testThrows([g forceGetResultWaitingUpTo:1]);
+    testChurnUntil(!g.isIncomplete);
+    testEq([g forceGetResultWaitingUpTo:0], @2);
+    
+    // continuations that don't need the main thread can be waited on
+    TOCFutureSource* s2 = [TOCFutureSource new];
+    TOCFuture* h = [s2.future then:increment on:TOCExecutors.inlineExecutor];
+    test(![h waitUntilCompletedWithTimeout:0.01]);
+}
+-(void)testWaitUntilCompleted_RefusesToDeadlockTheMainThreadIndirectly {
+    test(NSThread.isMainThread);
+    TOCFutureThenContinuation increment = ^(NSNumber* value) { return @(value.intValue + 1); };
+    
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCFuture* onMain = [s.future then:increment];
+    
+    // continuing from it
+    TOCFuture* continued = [onMain then:increment on:TOCExecutors.inlineExecutor];
+    TOCFuture* continuedAgain = [continued finally:^(TOCFuture* completed) { return completed; } on:TOCExecutors.inlineExecutor];
+    testThrows([continued waitUntilCompletedWithTimeout:1]);
+    testThrows([continuedAgain waitUntilCompletedWithTimeout:1]);
+    
+    // flattening it
+    TOCFutureSource* flattening = [TOCFutureSource new];
+    [flattening trySetResult:onMain];
+    TOCFutureSource* flatteningFlattening = [TOCFutureSource new];
+    [flatteningFlattening trySetResult:flattening.future];
+    testThrows([flattening.future waitUntilCompletedWithTimeout:1]);
+    testThrows([flatteningFlattening.future waitUntilCompletedWithTimeout:1]);
+    
+    // once the main thread continuation has run, they can all be waited on
+    [s trySetResult:@1];
+    testEq([continued forceGetResultWaitingUpTo:1], @3);
+    testEq([continuedAgain forceGetResultWaitingUpTo:1], @3);
+    testEq([flatteningFlattening.future forceGetResultWaitingUpTo:1], @2);
+
+}
+-(void)testWaitUntilCompleted_InsideHandlerSendsOffHeldBackMainThreadWork {
+    test(NSThread.isMainThread);
+    TOCFutureSource* s = [TOCFutureSource new];
+    
+    // registered from the main thread, so it runs on the main thread
+    TOCFuture* onMain = [s.future then:^(id value) { return @"main"; }];
+    
+    // released by the same completion, on a worker thread, while the main thread hops are being collected into one
+    __block bool waited = false;
+    __block bool waitEnded = false;
+    [s.future thenDo:^(id value) {
+        waited = [onMain waitUntilCompletedWithTimeout:5];
+        waitEnded = true;
+    } on:TOCExecutors.inlineExecutor unless:nil];
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [s trySetResult:@1];
+    });
+    testChurnUntil(waitEnded);
+    test(waited);
+    testFutureHasResult(onMain, @"main");
+}
+
 @end
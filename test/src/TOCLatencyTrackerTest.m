@@ -0,0 +1,149 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCLatencyTrackerTest : XCTestCase
+@end
+
+@implementation TOCLatencyTrackerTest
+
+-(void) testTrackersAreSharedByLabel {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testTrackersAreSharedByLabel"];
+    test(tracker == [TOCLatencyTracker latencyTrackerForLabel:@"testTrackersAreSharedByLabel"]);
+    test(tracker != [TOCLatencyTracker latencyTrackerForLabel:@"testTrackersAreSharedByLabel-other"]);
+    testEq(tracker.label, @"testTrackersAreSharedByLabel");
+    test([TOCLatencyTracker latencyTrackersByLabel][@"testTrackersAreSharedByLabel"] == tracker);
+    testThrows([TOCLatencyTracker latencyTrackerForLabel:nil]);
+}
+
+-(void) testEmptySnapshot {
+    TOCLatencySnapshot* snapshot = [[TOCLatencyTracker latencyTrackerForLabel:@"testEmptySnapshot"] snapshot];
+    test(snapshot.count == 0);
+    test(snapshot.minimum == 0);
+    test(snapshot.maximum == 0);
+    test(snapshot.mean == 0);
+    test([snapshot latencyAtPercentile:50] == 0);
+    testThrows([snapshot latencyAtPercentile:-1]);
+    testThrows([snapshot latencyAtPercentile:101]);
+}
+
+-(void) testPercentiles {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testPercentiles"];
+    for (int i = 1; i <= 100; i++) {
+        [tracker recordLatency:i / 1000.0 withOutcome:TOCOperationOutcome_Result];
+    }
+    testThrows([tracker recordLatency:-1 withOutcome:TOCOperationOutcome_Result]);
+    testThrows([tracker recordLatency:NAN withOutcome:TOCOperationOutcome_Result]);
+    
+    TOCLatencySnapshot* snapshot = [tracker snapshotOfOutcome:TOCOperationOutcome_Result];
+    test(snapshot.count == 100);
+    test(fabs(snapshot.minimum - 0.001) < 0.000001);
+    test(fabs(snapshot.maximum - 0.1) < 0.000001);
+    test(fabs(snapshot.mean - 0.0505) < 0.000001);
+    test([snapshot latencyAtPercentile:0] == snapshot.minimum);
+    test([snapshot latencyAtPercentile:100] == snapshot.maximum);
+    
+    // percentiles may overestimate by a few percent, but never underestimate
+    for (int p = 1; p <= 100; p++) {
+        NSTimeInterval latency = [snapshot latencyAtPercentile:p];
+        test(latency >= p / 1000.0 - 0.000001);
+        test(latency <= p / 1000.0 * 1.04);
+    }
+}
+
+-(void) testLargeAndTinyLatencies {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testLargeAndTinyLatencies"];
+    [tracker recordLatency:0 withOutcome:TOCOperationOutcome_Failure];
+    [tracker recordLatency:1000000 withOutcome:TOCOperationOutcome_Failure];
+    testThrows([tracker recordLatency:INFINITY withOutcome:TOCOperationOutcome_Failure]);
+    
+    TOCLatencySnapshot* snapshot = [tracker snapshotOfOutcome:TOCOperationOutcome_Failure];
+    test(snapshot.count == 2);
+    test([snapshot latencyAtPercentile:0] == 0);
+    test([snapshot latencyAtPercentile:50] == 0);
+    test([snapshot latencyAtPercentile:51] == 1000000);
+    test([snapshot latencyAtPercentile:100] == 1000000);
+}
+
+-(void) testLatenciesAroundTheLargestBucket {
+    // just under 2^48 nanoseconds (~78 hours) has a bucket of its own, apart from everything larger
+    NSTimeInterval largestBucketed = 281000;
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testLatenciesAroundTheLargestBucket"];
+    [tracker recordLatency:largestBucketed withOutcome:TOCOperationOutcome_Timeout];
+    [tracker recordLatency:1000000 withOutcome:TOCOperationOutcome_Timeout];
+    
+    TOCLatencySnapshot* snapshot = [tracker snapshotOfOutcome:TOCOperationOutcome_Timeout];
+    test(snapshot.count == 2);
+    test([snapshot latencyAtPercentile:50] >= largestBucketed);
+    test([snapshot latencyAtPercentile:50] <= largestBucketed * 1.04);
+    test([snapshot latencyAtPercentile:100] == 1000000);
+}
+
+-(void) testTrackingSplitsByOutcome {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testTrackingSplitsByOutcome"];
+    TOCFutureSource* s = [TOCFutureSource new];
+    test([tracker trackLatencyOf:s.future] == s.future);
+    [tracker trackLatencyOf:[TOCFuture futureWithResult:@1]];
+    [tracker trackLatencyOf:[TOCFuture futureWithFailure:@2]];
+    [tracker trackLatencyOf:[TOCFuture futureWithCancelFailure]];
+    [tracker trackLatencyOf:[TOCFuture futureWithTimeoutFailure]];
+    testThrows([tracker trackLatencyOf:nil]);
+    
+    test([tracker snapshotOfOutcome:TOCOperationOutcome_Result].count == 1);
+    test([tracker snapshotOfOutcome:TOCOperationOutcome_Failure].count == 1);
+    test([tracker snapshotOfOutcome:TOCOperationOutcome_Cancel].count == 1);
+    test([tracker snapshotOfOutcome:TOCOperationOutcome_Timeout].count == 1);
+    test(tracker.snapshot.count == 4);
+    
+    [s trySetResult:@3];
+    test([tracker snapshotOfOutcome:TOCOperationOutcome_Result].count == 2);
+    test(tracker.snapshot.count == 5);
+}
+
+-(void) testTrackingMeasuresUntilCompletion {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testTrackingMeasuresUntilCompletion"];
+    TOCFuture* f = [tracker trackLatencyOf:[TOCFuture futureWithResult:@1 afterDelay:0.05]];
+    testChurnUntil(!f.isIncomplete);
+    
+    TOCLatencySnapshot* snapshot = [tracker snapshotOfOutcome:TOCOperationOutcome_Result];
+    test(snapshot.count == 1);
+    test(snapshot.minimum >= 0.04);
+}
+
+-(void) testImmortalFuturesAreNotRecorded {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testImmortalFuturesAreNotRecorded"];
+    @autoreleasepool {
+        [tracker trackLatencyOf:[TOCFutureSource new].future];
+    }
+    test(tracker.snapshot.count == 0);
+}
+
+-(void) testCombinedSnapshots {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testCombinedSnapshots"];
+    [tracker recordLatency:1 withOutcome:TOCOperationOutcome_Result];
+    [tracker recordLatency:3 withOutcome:TOCOperationOutcome_Timeout];
+    
+    TOCLatencySnapshot* combined = [[tracker snapshotOfOutcome:TOCOperationOutcome_Result]
+                                    snapshotCombinedWith:[tracker snapshotOfOutcome:TOCOperationOutcome_Timeout]];
+    test(combined.count == 2);
+    test(combined.minimum == 1);
+    test(combined.maximum == 3);
+    test(combined.mean == 2);
+    testThrows([combined snapshotCombinedWith:nil]);
+}
+
+-(void) testConcurrentRecording {
+    TOCLatencyTracker* tracker = [TOCLatencyTracker latencyTrackerForLabel:@"testConcurrentRecording"];
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (int i = 0; i < 1000; i++) {
+            [tracker recordLatency:(thread + 1) / 1000.0 withOutcome:TOCOperationOutcome_Result];
+        }
+    });
+    
+    TOCLatencySnapshot* snapshot = tracker.snapshot;
+    test(snapshot.count == 8000);
+    test(fabs(snapshot.minimum - 0.001) < 0.000001);
+    test(fabs(snapshot.maximum - 0.008) < 0.000001);
+    test(fabs(snapshot.mean - 0.0045) < 0.000001);
+}
+
+@end
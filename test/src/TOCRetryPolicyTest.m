@@ -0,0 +1,64 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCRetryPolicyTest : XCTestCase
+@end
+
+@implementation TOCRetryPolicyTest
+
+-(void) testPreconditions {
+    testThrows([TOCRetryPolicy retryPolicyWithMaxAttempts:0 baseDelay:1 maxDelay:1]);
+    testThrows([TOCRetryPolicy retryPolicyWithMaxAttempts:1 baseDelay:-1 maxDelay:1]);
+    testThrows([TOCRetryPolicy retryPolicyWithMaxAttempts:1 baseDelay:INFINITY maxDelay:INFINITY]);
+    testThrows([TOCRetryPolicy retryPolicyWithMaxAttempts:1 baseDelay:2 maxDelay:1]);
+    testThrows([TOCRetryPolicy retryPolicyWithMaxAttempts:1 baseDelay:1 maxDelay:NAN]);
+    
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:1 baseDelay:1 maxDelay:1];
+    testThrows([p policyWithRetryableFailurePredicate:nil]);
+    testThrows([p policyWithTotalTimeout:0]);
+    testThrows([p policyWithTotalTimeout:NAN]);
+}
+
+-(void) testModifiedCopies {
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:3 baseDelay:0.5 maxDelay:4];
+    test(p.maxAttempts == 3);
+    test(p.baseDelay == 0.5);
+    test(p.maxDelay == 4);
+    test(p.isRetryableFailure == nil);
+    test(p.totalTimeout == INFINITY);
+    
+    TOCRetryPolicy* p2 = [[p policyWithTotalTimeout:10] policyWithRetryableFailurePredicate:^(id failure) { return (bool)[failure isEqual:@"retry"]; }];
+    test(p2.maxAttempts == 3);
+    test(p2.totalTimeout == 10);
+    test(p.totalTimeout == INFINITY);
+    test(p.isRetryableFailure == nil);
+    
+    test([p shouldRetryFailure:@"anything"]);
+    test(![p shouldRetryFailure:TOCCancelToken.cancelledToken]);
+    test([p2 shouldRetryFailure:@"retry"]);
+    test(![p2 shouldRetryFailure:@"other"]);
+    test(![p2 shouldRetryFailure:TOCCancelToken.cancelledToken]);
+}
+
+-(void) testJitteredDelaysStayUnderTheExponentialCap {
+    TOCRetryPolicy* p = [TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0.5 maxDelay:4];
+    bool sawDifferentDelays = false;
+    for (int i = 0; i < 1000; i++) {
+        NSTimeInterval d0 = [p jitteredDelayBeforeRetry:0];
+        NSTimeInterval d2 = [p jitteredDelayBeforeRetry:2];
+        NSTimeInterval d9 = [p jitteredDelayBeforeRetry:9];
+        NSTimeInterval dHuge = [p jitteredDelayBeforeRetry:NSUIntegerMax];
+        test(d0 >= 0 && d0 <= 0.5);
+        test(d2 >= 0 && d2 <= 2);
+        test(d9 >= 0 && d9 <= 4);
+        test(dHuge >= 0 && dHuge <= 4);
+        if (d0 != [p jitteredDelayBeforeRetry:0]) sawDifferentDelays = true;
+    }
+    test(sawDifferentDelays);
+    
+    TOCRetryPolicy* unbounded = [TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:1 maxDelay:INFINITY];
+    test([unbounded jitteredDelayBeforeRetry:NSUIntegerMax] == INFINITY);
+    test([[TOCRetryPolicy retryPolicyWithMaxAttempts:10 baseDelay:0 maxDelay:INFINITY] jitteredDelayBeforeRetry:NSUIntegerMax] == 0);
+}
+
+@end
@@ -0,0 +1,121 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCStatisticsTest : XCTestCase
+@end
+
+@implementation TOCStatisticsTest
+
+-(void) testSnapshotDifference {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    TOCStatistics* after = [TOCStatistics snapshot];
+    TOCStatistics* delta = [after statisticsSince:before];
+    test(delta.futuresCreated == after.futuresCreated - before.futuresCreated);
+    test(delta.handlersRun == after.handlersRun - before.handlersRun);
+    test(delta.liveFutures == after.liveFutures);
+    test(delta.pendingHandlers == after.pendingHandlers);
+    testThrows([after statisticsSince:nil]);
+    
+    test([[after dictionaryRepresentation][@"futuresCreated"] isEqual:@(after.futuresCreated)]);
+    test([after description] != nil);
+}
+
+-(void) testCountsFuturesAndSources {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    TOCFutureSource* s = [TOCFutureSource new];
+    [s trySetResult:@1];
+    TOCFuture* f = [TOCFuture futureWithResult:@2];
+    TOCStatistics* delta = [[TOCStatistics snapshot] statisticsSince:before];
+    
+    test(f != nil);
+    test(delta.futureSourcesCreated >= 1);
+    test(delta.futuresCreated >= 2);
+    test(delta.futuresCompleted >= 2);
+}
+
+-(void) testCountsTokensAndCancellation {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    [c cancel];
+    TOCStatistics* delta = [[TOCStatistics snapshot] statisticsSince:before];
+    
+    test(delta.cancelTokenSourcesCreated >= 1);
+    test(delta.cancelTokensCreated >= 1);
+    test(delta.cancelTokensCancelled >= 1);
+}
+
+-(void) testCountsHandlers {
+    TOCFutureSource* s = [TOCFutureSource new];
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    
+    TOCStatistics* before = [TOCStatistics snapshot];
+    [s.future finallyDo:^(TOCFuture* completed) {} unless:c.token];
+    TOCStatistics* registered = [[TOCStatistics snapshot] statisticsSince:before];
+    test(registered.handlersRegistered >= 1);
+    
+    [c cancel];
+    TOCStatistics* removed = [[TOCStatistics snapshot] statisticsSince:before];
+    test(removed.handlersRemoved >= 1);
+    
+    __block bool ran = false;
+    [s.future finallyDo:^(TOCFuture* completed) { ran = true; }];
+    [s trySetResult:@1];
+    TOCStatistics* run = [[TOCStatistics snapshot] statisticsSince:before];
+    test(ran);
+    test(run.handlersRun >= 1);
+}
+
+-(void) testCountsDiscardedHandlers {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    @autoreleasepool {
+        TOCFutureSource* s = [TOCFutureSource new];
+        [s.future finallyDo:^(TOCFuture* completed) {}];
+    }
+    TOCStatistics* delta = [[TOCStatistics snapshot] statisticsSince:before];
+    test(delta.futuresImmortalized >= 1);
+    test(delta.handlersDiscarded >= 1);
+}
+
+-(void) testCountsFlatteningCycles {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    TOCFutureSource* s = [TOCFutureSource new];
+    [s trySetResult:s.future];
+    TOCStatistics* delta = [[TOCStatistics snapshot] statisticsSince:before];
+    
+    test(s.future.state == TOCFutureState_Immortal);
+    test(delta.flatteningCyclesDetected >= 1);
+}
+
+-(void) testMergesCountsFromExitedThreads {
+    TOCStatistics* before = [TOCStatistics snapshot];
+    
+    NSThread* thread = [[NSThread alloc] initWithTarget:[NSBlockOperation blockOperationWithBlock:^{
+        for (int i = 0; i < 100; i++) {
+            [TOCFuture futureWithResult:@(i)];
+        }
+    }] selector:@selector(main) object:nil];
+    [thread start];
+    testChurnUntil(thread.isFinished);
+    
+    TOCStatistics* delta = [[TOCStatistics snapshot] statisticsSince:before];
+    test(delta.futuresCreated >= 100);
+    test(delta.futuresCompleted >= 100);
+}
+
+-(void) testLiveCountsFallWhenReleased {
+    TOCStatistics* before;
+    TOCStatistics* during;
+    @autoreleasepool {
+        before = [TOCStatistics snapshot];
+        NSMutableArray* sources = [NSMutableArray array];
+        for (int i = 0; i < 100; i++) {
+            [sources addObject:[TOCFutureSource new]];
+        }
+        during = [TOCStatistics snapshot];
+        test(during.liveFutureSources >= before.liveFutureSources + 100 - 10);
+    }
+    TOCStatistics* after = [TOCStatistics snapshot];
+    test(after.liveFutureSources <= during.liveFutureSources - 100 + 10);
+}
+
+@end
@@ -0,0 +1,149 @@
+#import "Testing.h"
+#import "CollapsingFutures.h"
+
+@interface TOCTracingTest : XCTestCase
+@end
+
+static NSArray* exportedTraceEvents(void) {
+    NSDictionary* trace = [NSJSONSerialization JSONObjectWithData:[TOCTracing chromeTraceJSON] options:0 error:NULL];
+    return trace[@"traceEvents"];
+}
+
+static NSArray* traceEventsNamed(NSArray* events, NSString* phase, NSString* name) {
+    return [events filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSDictionary* event, NSDictionary* bindings) {
+        return [event[@"ph"] isEqual:phase] && [event[@"name"] isEqual:name];
+    }]];
+}
+
+@implementation TOCTracingTest
+
+-(void) tearDown {
+    [TOCTracing stopTracing];
+    [super tearDown];
+}
+
+-(void) testStartAndStop {
+    [TOCTracing startTracing];
+    test(TOCTracing.isTracing);
+    [TOCTracing stopTracing];
+    test(!TOCTracing.isTracing);
+    
+    [TOCFuture futureWithResult:@1];
+    test(traceEventsNamed(exportedTraceEvents(), @"b", @"future").count == 0);
+}
+
+-(void) testStartingDiscardsPreviousEvents {
+    [TOCTracing startTracing];
+    [TOCFuture futureWithResult:@1];
+    test(traceEventsNamed(exportedTraceEvents(), @"b", @"future").count == 1);
+    
+    [TOCTracing startTracing];
+    test(traceEventsNamed(exportedTraceEvents(), @"b", @"future").count == 0);
+}
+
+-(void) testRecordsFutureLifetimes {
+    [TOCTracing startTracing];
+    TOCFutureSource* s = [TOCFutureSource new];
+    [s trySetFailure:@1];
+    [TOCTracing stopTracing];
+    
+    NSArray* events = exportedTraceEvents();
+    NSArray* begins = traceEventsNamed(events, @"b", @"future");
+    NSArray* ends = traceEventsNamed(events, @"e", @"future");
+    test(begins.count == 1);
+    test(ends.count == 1);
+    testEq(begins[0][@"id"], ends[0][@"id"]);
+    testEq(ends[0][@"args"][@"state"], @"failed");
+    test([ends[0][@"ts"] doubleValue] >= [begins[0][@"ts"] doubleValue]);
+}
+
+-(void) testRecordsContinuationsAndHandlers {
+    TOCFutureSource* s = [TOCFutureSource new];
+    [TOCTracing startTracing];
+    TOCFuture* continued = [s.future then:^(id value) { return value; } on:TOCExecutors.inlineExecutor];
+    [s trySetResult:@1];
+    [TOCTracing stopTracing];
+    testFutureHasResult(continued, @1);
+    
+    NSArray* events = exportedTraceEvents();
+    NSArray* links = traceEventsNamed(events, @"i", @"continue");
+    test(links.count == 1);
+    NSString* parent = links[0][@"args"][@"parent"];
+    NSString* child = links[0][@"args"][@"future"];
+    test(parent != nil && ![parent isEqual:child]);
+    
+    bool foundChild = false;
+    for (NSDictionary* begin in traceEventsNamed(events, @"b", @"future")) {
+        if ([begin[@"id"] isEqual:child]) {
+            foundChild = true;
+            testEq(begin[@"args"][@"parent"], parent);
+        }
+    }
+    test(foundChild);
+    
+    NSArray* handlers = traceEventsNamed(events, @"X", @"handler");
+    test(handlers.count == 1);
+    testEq(handlers[0][@"args"][@"future"], parent);
+    test([handlers[0][@"args"][@"queueDelayUs"] doubleValue] >= 0);
+    test([handlers[0][@"dur"] doubleValue] >= 0);
+}
+
+-(void) testRecordsFlattening {
+    [TOCTracing startTracing];
+    TOCFutureSource* outer = [TOCFutureSource new];
+    TOCFutureSource* inner = [TOCFutureSource new];
+    [outer trySetResult:inner.future];
+    [inner trySetResult:@1];
+    
+    TOCFutureSource* cyclic = [TOCFutureSource new];
+    [cyclic trySetResult:cyclic.future];
+    [TOCTracing stopTracing];
+    
+    NSArray* events = exportedTraceEvents();
+    test(traceEventsNamed(events, @"i", @"flatten").count == 2);
+    test(traceEventsNamed(events, @"i", @"flattening cycle").count == 1);
+    
+    // the outer future ends when the inner future completes, even though only the inner future was completed directly
+    NSArray* ends = traceEventsNamed(events, @"e", @"future");
+    test(ends.count == 3);
+    NSUInteger resultCount = 0;
+    for (NSDictionary* end in ends) {
+        if ([end[@"args"][@"state"] isEqual:@"result"]) resultCount++;
+    }
+    test(resultCount == 2);
+}
+
+-(void) testRecordsCancellation {
+    [TOCTracing startTracing];
+    TOCCancelTokenSource* c = [TOCCancelTokenSource new];
+    [c cancel];
+    [c cancel];
+    [TOCTracing stopTracing];
+    
+    test(traceEventsNamed(exportedTraceEvents(), @"i", @"cancel").count == 1);
+}
+
+-(void) testTagsEventsWithThreads {
+    [TOCTracing startTracing];
+    [TOCFuture futureWithResult:@1];
+    NSThread* thread = [[NSThread alloc] initWithTarget:[NSBlockOperation blockOperationWithBlock:^{
+        [TOCFuture futureWithResult:@2];
+    }] selector:@selector(main) object:nil];
+    [thread start];
+    testChurnUntil(thread.isFinished);
+    [TOCTracing stopTracing];
+    
+    NSArray* events = exportedTraceEvents();
+    NSArray* begins = traceEventsNamed(events, @"b", @"future");
+    test(begins.count == 2);
+    test(![begins[0][@"tid"] isEqual:begins[1][@"tid"]]);
+    
+    NSMutableSet* namedThreads = [NSMutableSet set];
+    for (NSDictionary* metadata in traceEventsNamed(events, @"M", @"thread_name")) {
+        [namedThreads addObject:metadata[@"tid"]];
+    }
+    test([namedThreads containsObject:begins[0][@"tid"]]);
+    test([namedThreads containsObject:begins[1][@"tid"]]);
+}
+
+@end